@@ -31,6 +31,9 @@
 #ifdef WIN32
 #include "evwin32.h"
 #endif
+#ifdef HAVE_EVIOURING
+#include "eviouring.h"
+#endif
 #include "mutex.h"
 #include "logger.h"
 typedef struct _EVOPS
@@ -46,6 +49,7 @@ typedef struct _EVOPS
 }EVOPS;
 static EVOPS evops[EOP_LIMIT];
 static int evops_default =      -1;
+static int evops_prefer =       -1;
 /* set event operating */
 int evbase_set_evops(EVBASE *evbase, int evopid)
 {
@@ -62,7 +66,10 @@ int evbase_set_evops(EVBASE *evbase, int evopid)
             if(evops[evopid].reset) evbase->reset = evops[evopid].reset;
             if(evops[evopid].clean) evbase->clean = evops[evopid].clean;
             if(evbase->init(evbase) == -1)
-                evbase->set_evops(evbase, evops_default);
+            {
+                if(evopid == evops_default) return -1;
+                return evbase->set_evops(evbase, evops_default);
+            }
             evbase->evopid = evopid;
             return 0;
         }
@@ -70,6 +77,17 @@ int evbase_set_evops(EVBASE *evbase, int evopid)
     return -1;
 }
 
+/* prefer event operating for evbases initialized later */
+int evbase_prefer_evops(int evopid)
+{
+    if(evopid >= 0 && evopid < EOP_LIMIT)
+    {
+        evops_prefer = evopid;
+        return 0;
+    }
+    return -1;
+}
+
 int evbase_set_logfile(EVBASE *evbase, char *logfile)
 {
     if(evbase && logfile)
@@ -176,10 +194,21 @@ EVBASE *evbase_init(int use_lock)
         evops[EOP_WIN32].loop     = &evwin32_loop;
         evops[EOP_WIN32].reset    = &evwin32_reset;
         evops[EOP_WIN32].clean    = &evwin32_clean;
+#endif
+#ifdef HAVE_EVIOURING
+        evops[EOP_IOURING].name   = "IOURING";
+        evops[EOP_IOURING].init   = &eviouring_init;
+        evops[EOP_IOURING].add    = &eviouring_add;
+        evops[EOP_IOURING].update = &eviouring_update;
+        evops[EOP_IOURING].del    = &eviouring_del;
+        evops[EOP_IOURING].loop   = &eviouring_loop;
+        evops[EOP_IOURING].reset  = &eviouring_reset;
+        evops[EOP_IOURING].clean  = &eviouring_clean;
 #endif
         evbase->set_evops   = evbase_set_evops;
         //evbase->clean 	=  evbase_clean;
         evops_default = evops_default_v;
+        if(evops_prefer >= 0 && evops[evops_prefer].name) evops_default_v = evops_prefer;
         if(evops_default_v == -1 || evbase->set_evops(evbase, evops_default_v) == -1)
         {
             free(evbase); 
@@ -22,7 +22,8 @@ extern "C" {
 #define EOP_KQUEUE      0x05
 #define EOP_DEVPOLL     0x06
 #define EOP_WIN32       0x07
-#define EOP_LIMIT       8
+#define EOP_IOURING     0x08
+#define EOP_LIMIT       9
 struct _EVENT;
 /*
 #ifndef __TYPEDEF__MUTEX
@@ -73,6 +74,8 @@ typedef struct _EVBASE
     int     (*set_evops)(struct _EVBASE *, int evopid);
 }EVBASE;
 EVBASE *evbase_init(int use_lock);
+/* prefer evopid for evbases initialized later, platform default if not supported */
+int evbase_prefer_evops(int evopid);
 int evbase_set_logfile(EVBASE *evbase, char *logfile);
 #define NEW_EVENT_FD(evbase, event)                                     \
 do{                                                                     \
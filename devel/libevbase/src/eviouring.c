@@ -0,0 +1,426 @@
+#include "eviouring.h"
+#include <errno.h>
+#ifdef HAVE_EVIOURING
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "logger.h"
+#include "mutex.h"
+#define EVIOURING_ENTRIES       4096
+#define EVIOURING_CQ_SCALE      4
+/* user_data of poll is fd and generation of event on fd, 0 for none */
+#define EVIOURING_NONE          0llu
+#define EVIOURING_UDATA(fd, gen) ((((unsigned long long)(gen)) << 32) | (unsigned int)(fd))
+#define EVIOURING_FD(udata)     ((int)((udata) & 0xffffffffllu))
+#define EVIOURING_GEN(udata)    ((unsigned int)((udata) >> 32))
+typedef struct _EVIOFD
+{
+    unsigned int gen;
+    unsigned int mask;
+    unsigned int multi;
+    int armed;
+}EVIOFD;
+typedef struct _EVIOCQE
+{
+    unsigned long long udata;
+    int res;
+    unsigned int flags;
+}EVIOCQE;
+typedef struct _EVIOURING
+{
+    int fd;
+    int nqueued;
+    int has_loop;
+    unsigned int sq_entries;
+    unsigned int cq_entries;
+    unsigned int sq_mask;
+    unsigned int cq_mask;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    pthread_t loop_thread;
+    void *mutex;
+    EVIOFD *fds;
+    EVIOCQE *cqs;
+}EVIOURING;
+/* arming on loop thread waits for next io_uring_enter() of loop, others submit at once */
+#define EVIOURING_DEFER(ring) (ring->has_loop && pthread_equal(ring->loop_thread, pthread_self()))
+
+/* release ring */
+static void eviouring_free(EVIOURING *ring)
+{
+    if(ring)
+    {
+        if(ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        if(ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        if(ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+        if(ring->fd > 0) close(ring->fd);
+        if(ring->fds) free(ring->fds);
+        if(ring->cqs) free(ring->cqs);
+        MUTEX_DESTROY(ring->mutex);
+        free(ring);
+    }
+    return ;
+}
+
+/* setup ring with SQ/CQ mapped */
+static EVIOURING *eviouring_new()
+{
+    struct io_uring_params params;
+    EVIOURING *ring = NULL;
+    unsigned int i = 0;
+    char *sq = NULL, *cq = NULL;
+
+    if((ring = (EVIOURING *)calloc(1, sizeof(EVIOURING))) == NULL) return NULL;
+    memset(&params, 0, sizeof(struct io_uring_params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = EVIOURING_ENTRIES * EVIOURING_CQ_SCALE;
+    if((ring->fd = syscall(__NR_io_uring_setup, EVIOURING_ENTRIES, &params)) < 0
+            || !(params.features & IORING_FEAT_EXT_ARG)) goto err;
+    fcntl(ring->fd, F_SETFD, FD_CLOEXEC);
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if((params.features & IORING_FEAT_SINGLE_MMAP) && ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+    if((ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING)) == MAP_FAILED) goto err;
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ring = ring->sq_ring;
+    else if((ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) goto err;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if((ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES)) == MAP_FAILED) goto err;
+    sq = (char *)ring->sq_ring;
+    cq = (char *)ring->cq_ring;
+    ring->sq_entries = params.sq_entries;
+    ring->cq_entries = params.cq_entries;
+    ring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    ring->sq_mask = *((unsigned int *)(sq + params.sq_off.ring_mask));
+    ring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    ring->cq_mask = *((unsigned int *)(cq + params.cq_off.ring_mask));
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    for(i = 0; i < ring->sq_entries; i++) ring->sq_array[i] = i;
+    if((ring->fds = (EVIOFD *)calloc(EV_MAX_FD, sizeof(EVIOFD))) == NULL
+            || (ring->cqs = (EVIOCQE *)calloc(ring->cq_entries, sizeof(EVIOCQE))) == NULL) goto err;
+    MUTEX_INIT(ring->mutex);
+    return ring;
+err:
+    eviouring_free(ring);
+    return NULL;
+}
+
+/* submit queued SQEs, ring locked */
+static int eviouring_submit(EVIOURING *ring)
+{
+    int n = ring->nqueued;
+
+    ring->nqueued = 0;
+    if(n > 0) return syscall(__NR_io_uring_enter, ring->fd, n, 0, 0, NULL, 0);
+    return 0;
+}
+
+/* queue SQE, ring locked */
+static int eviouring_push(EVIOURING *ring, int op, int fd, unsigned int mask,
+        unsigned long long addr, unsigned int len, unsigned long long udata)
+{
+    struct io_uring_sqe *sqe = NULL;
+    unsigned int tail = *(ring->sq_tail);
+
+    if(tail - *((volatile unsigned int *)ring->sq_head) >= ring->sq_entries)
+    {
+        eviouring_submit(ring);
+        if(tail - *((volatile unsigned int *)ring->sq_head) >= ring->sq_entries) return -1;
+    }
+    sqe = &(ring->sqes[tail & ring->sq_mask]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->addr = addr;
+    sqe->len = len;
+    sqe->user_data = udata;
+    __sync_synchronize();
+    *(ring->sq_tail) = tail + 1;
+    ring->nqueued++;
+    return 0;
+}
+
+/* (re)arm poll of event with current flags, E_EPOLL_ET as multishot, ring locked */
+static void eviouring_arm(EVIOURING *ring, EVENT *event)
+{
+    EVIOFD *p = &(ring->fds[event->ev_fd]);
+    unsigned int mask = 0, multi = 0;
+
+    if(event->ev_flags & E_READ) mask |= POLLIN;
+    if(event->ev_flags & E_WRITE) mask |= POLLOUT;
+    if(event->ev_flags & E_EPOLL_ET) multi = IORING_POLL_ADD_MULTI;
+    if(p->armed)
+    {
+        if(p->mask == mask && p->multi == multi) return ;
+        eviouring_push(ring, IORING_OP_POLL_REMOVE, -1, 0,
+                EVIOURING_UDATA(event->ev_fd, p->gen), 0, EVIOURING_NONE);
+        p->armed = 0;
+    }
+    if(++(p->gen) == 0) p->gen = 1;
+    p->mask = mask;
+    p->multi = multi;
+    if(mask && eviouring_push(ring, IORING_OP_POLL_ADD, event->ev_fd, mask, 0,
+                multi, EVIOURING_UDATA(event->ev_fd, p->gen)) == 0)
+    {
+        p->armed = 1;
+    }
+    return ;
+}
+
+/* Initialize eviouring  */
+int eviouring_init(EVBASE *evbase)
+{
+    EVIOURING *ring = NULL;
+
+    if(evbase && (ring = eviouring_new()))
+    {
+        if(evbase->efd > 0) close(evbase->efd);
+        evbase->efd     = ring->fd;
+        evbase->evs     = ring;
+        evbase->allowed = EV_MAX_FD;
+        return 0;
+    }
+    return -1;
+}
+
+/* Add new event to evbase */
+int eviouring_add(EVBASE *evbase, EVENT *event)
+{
+    EVIOURING *ring = NULL;
+    int ret = -1;
+
+    if(evbase && (ring = (EVIOURING *)evbase->evs) && event
+            && event->ev_fd >= 0 && event->ev_fd < evbase->allowed)
+    {
+        MUTEX_LOCK(ring->mutex);
+        event->ev_base = evbase;
+        if(event->ev_flags & (E_READ|E_WRITE))
+        {
+            UPDATE_EVENT_FD(evbase, event);
+            eviouring_arm(ring, event);
+            if(!EVIOURING_DEFER(ring)) eviouring_submit(ring);
+        }
+        MUTEX_UNLOCK(ring->mutex);
+        ret = 0;
+    }
+    return ret;
+}
+
+/* Update event in evbase */
+int eviouring_update(EVBASE *evbase, EVENT *event)
+{
+    EVIOURING *ring = NULL;
+    int ret = -1;
+
+    if(evbase && (ring = (EVIOURING *)evbase->evs) && event
+            && event->ev_fd >= 0 && event->ev_fd < evbase->allowed)
+    {
+        MUTEX_LOCK(ring->mutex);
+        UPDATE_EVENT_FD(evbase, event);
+        eviouring_arm(ring, event);
+        if(!EVIOURING_DEFER(ring)) eviouring_submit(ring);
+        MUTEX_UNLOCK(ring->mutex);
+        ret = 0;
+    }
+    return ret;
+}
+
+/* Delete event from evbase */
+int eviouring_del(EVBASE *evbase, EVENT *event)
+{
+    EVIOURING *ring = NULL;
+    EVIOFD *p = NULL;
+
+    if(evbase && (ring = (EVIOURING *)evbase->evs) && event
+            && event->ev_fd >= 0 && event->ev_fd < evbase->allowed)
+    {
+        MUTEX_LOCK(ring->mutex);
+        if(evbase->evlist[event->ev_fd])
+        {
+            p = &(ring->fds[event->ev_fd]);
+            if(p->armed)
+            {
+                eviouring_push(ring, IORING_OP_POLL_REMOVE, -1, 0,
+                        EVIOURING_UDATA(event->ev_fd, p->gen), 0, EVIOURING_NONE);
+                p->armed = 0;
+            }
+            if(++(p->gen) == 0) p->gen = 1;
+            REMOVE_EVENT_FD(evbase, event);
+            if(!EVIOURING_DEFER(ring)) eviouring_submit(ring);
+        }
+        MUTEX_UNLOCK(ring->mutex);
+    }
+    return -1;
+}
+
+/* Loop evbase, queued polls submitted and completions waited in one io_uring_enter() */
+int eviouring_loop(EVBASE *evbase, int loop_flags, struct timeval *tv)
+{
+    int i = 0, n = 0, k = 0, fd = 0, ev_flags = 0, to_submit = 0, min_complete = 1, flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int head = 0, tail = 0, gen = 0;
+    struct io_uring_cqe *cqe = NULL;
+    EVIOURING *ring = NULL;
+    EVIOFD *p = NULL;
+    EVENT *ev = NULL;
+
+    if(evbase && (ring = (EVIOURING *)evbase->evs))
+    {
+        MUTEX_LOCK(ring->mutex);
+        if(ring->has_loop == 0)
+        {
+            ring->loop_thread = pthread_self();
+            ring->has_loop = 1;
+        }
+        to_submit = ring->nqueued;
+        ring->nqueued = 0;
+        MUTEX_UNLOCK(ring->mutex);
+        flags = IORING_ENTER_GETEVENTS;
+        memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+        if(tv)
+        {
+            ts.tv_sec = tv->tv_sec;
+            ts.tv_nsec = (long long)tv->tv_usec * 1000ll;
+            arg.ts = (unsigned long long)((unsigned long)&ts);
+        }
+        flags |= IORING_ENTER_EXT_ARG;
+        if(*((volatile unsigned int *)ring->cq_tail) != *(ring->cq_head)) min_complete = 0;
+        if(syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags,
+                    &arg, sizeof(struct io_uring_getevents_arg)) < 0
+                && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            fprintf(stderr, "io_uring_enter(%d, %d, %d) failed, %s\n", ring->fd, to_submit, min_complete, strerror(errno));
+            return -1;
+        }
+        /* reap completions before handlers which may arm/delete events */
+        MUTEX_LOCK(ring->mutex);
+        head = *(ring->cq_head);
+        tail = *((volatile unsigned int *)ring->cq_tail);
+        __sync_synchronize();
+        for(k = 0; head != tail && k < (int)ring->cq_entries; head++)
+        {
+            cqe = &(ring->cqes[head & ring->cq_mask]);
+            if(cqe->user_data == EVIOURING_NONE) continue;
+            ring->cqs[k].udata = cqe->user_data;
+            ring->cqs[k].res = cqe->res;
+            ring->cqs[k].flags = cqe->flags;
+            k++;
+        }
+        __sync_synchronize();
+        *(ring->cq_head) = head;
+        MUTEX_UNLOCK(ring->mutex);
+        for(i = 0; i < k; i++)
+        {
+            fd = EVIOURING_FD(ring->cqs[i].udata);
+            gen = EVIOURING_GEN(ring->cqs[i].udata);
+            if(fd < 0 || fd >= evbase->allowed) continue;
+            MUTEX_LOCK(ring->mutex);
+            p = &(ring->fds[fd]);
+            ev = evbase->evlist[fd];
+            if(ev == NULL || p->gen != gen || p->armed == 0)
+            {
+                MUTEX_UNLOCK(ring->mutex);
+                continue;
+            }
+            if(p->multi == 0 || !(ring->cqs[i].flags & IORING_CQE_F_MORE)) p->armed = 0;
+            MUTEX_UNLOCK(ring->mutex);
+            if(ring->cqs[i].res < 0)
+            {
+                if(ring->cqs[i].res != -ECANCELED)
+                {
+                    WARN_LOGGER(evbase->logger, "poll on ev:%p fd:%d evflags:%d failed, %s", ev, fd, ev->ev_flags, strerror(-(ring->cqs[i].res)));
+                    continue;
+                }
+            }
+            else
+            {
+                ev_flags = 0;
+                if(ring->cqs[i].res & (POLLHUP|POLLERR))
+                {
+                    ev_flags = E_READ|E_WRITE;
+                }
+                else
+                {
+                    if(ring->cqs[i].res & POLLIN) ev_flags |= E_READ;
+                    if(ring->cqs[i].res & POLLOUT) ev_flags |= E_WRITE;
+                }
+                if(ev_flags)
+                {
+                    event_active(ev, ev_flags);
+                    n++;
+                }
+            }
+            /* oneshot fired or multishot ended, re-armed unless handler changed event */
+            MUTEX_LOCK(ring->mutex);
+            if(evbase->evlist[fd] == ev && p->gen == gen && p->armed == 0)
+                eviouring_arm(ring, ev);
+            MUTEX_UNLOCK(ring->mutex);
+        }
+    }
+    return n;
+}
+
+/* Reset evbase */
+void eviouring_reset(EVBASE *evbase)
+{
+    EVIOURING *ring = NULL;
+
+    if(evbase)
+    {
+        if((ring = (EVIOURING *)evbase->evs))
+        {
+            eviouring_free(ring);
+            evbase->evs = NULL;
+            evbase->efd = 0;
+            if((ring = eviouring_new()))
+            {
+                evbase->efd = ring->fd;
+                evbase->evs = ring;
+            }
+        }
+        evbase->maxfd = 0;
+        memset(evbase->evlist, 0, sizeof(evbase->evlist));
+    }
+    return ;
+}
+
+/* Clean evbase */
+void eviouring_clean(EVBASE *evbase)
+{
+    if(evbase)
+    {
+        if(evbase->evs) eviouring_free((EVIOURING *)evbase->evs);
+        if(evbase->ev_fds)free(evbase->ev_fds);
+        if(evbase->ev_read_fds)free(evbase->ev_read_fds);
+        if(evbase->ev_write_fds)free(evbase->ev_write_fds);
+        MUTEX_DESTROY(evbase->mutex);
+        free(evbase);
+    }
+    return ;
+}
+#endif
@@ -0,0 +1,20 @@
+#include "evbase.h"
+#ifdef HAVE_EVIOURING
+#ifndef _EVIOURING_H
+#define _EVIOURING_H
+/* Initialize eviouring  */
+int eviouring_init(EVBASE *evbase);
+/* Add new event to evbase */
+int eviouring_add(EVBASE *evbase, EVENT *event);
+/* Update event in evbase */
+int eviouring_update(EVBASE *evbase, EVENT *event);
+/* Delete event from evbase */
+int eviouring_del(EVBASE *evbase, EVENT *event);
+/* Loop evbase */
+int eviouring_loop(EVBASE *evbase, int, struct timeval *tv);
+/* Reset evbase */
+void eviouring_reset(EVBASE *evbase);
+/* Clean evbase */
+void eviouring_clean(EVBASE *evbase);
+#endif
+#endif
@@ -1,3 +1,7 @@
+#define _GNU_SOURCE
+#include <sys/uio.h>
+#include <netinet/udp.h>
+#include <stdint.h>
 #include "sbase.h"
 #include "xssl.h"
 #include "conn.h"
@@ -8,6 +12,8 @@
 #include "service.h"
 #include "evtimer.h"
 #include "xmm.h"
+/* session of connection not set */
+static SESSION conn_session_none = {0};
 #ifndef PPL
 #define PPL(_x_) ((void *)(_x_))
 #endif
@@ -16,6 +22,10 @@
 #endif
 int conn__push__message(CONN *conn, int message_id);
 int conn_shut(CONN *conn, int d_state, int e_state);
+static void conn_proxy_unblock(CONN *conn);
+static CONN *conn_proxy_peer(CONN *conn);
+static int conn_proxy_splice(CONN *conn, CONN *oconn);
+static int conn_dgram_flush(CONN *conn);
 int conn_reading_chunk(CONN *conn)
 {
 	if(conn->ssl) return CHUNK_READ_SSL(&conn->chunk, conn->ssl);
@@ -28,12 +38,12 @@ int conn_chunk_reading(CONN *conn)
 
     if(conn)
     {
-        if(conn->session.chunk_reader == NULL)
+        if(conn->session->chunk_reader == NULL)
         {
             WARN_LOGGER(conn->logger, "NO session.chunk_reader() on connection remote[%s:%d] local[%s:%d] via %d", conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             return ret;
         }
-        if((n = conn->session.chunk_reader(conn, PCB(conn->buffer))) > 0)
+        if((n = conn->session->chunk_reader(conn, PCB(conn->buffer))) > 0)
         {
             chunk_mem(&(conn->chunk), n);
             conn->s_state = S_STATE_READ_CHUNK;
@@ -47,10 +57,54 @@ int conn_chunk_reading(CONN *conn)
     return ret;
 }
 
+/* sendto head chunk and same size chunks queued behind it in one UDP_SEGMENT call,
+ * those sent behind head are unlinked here, head is popped by conn_write_handler() */
+static int conn_sendto_gso(CONN *conn, CHUNK *cp)
+{
+    QBLOCK *qblock = NULL, *last = NULL;
+    void *chunks[SB_DGRAM_GSO_SEGS];
+    long long total = 0, nbytes = 0;
+    int n = 0, i = 0, ret = -1;
+
+    MUTEX_LOCK(conn->mutex);
+    for(qblock = (QBLOCK *)cp; qblock && n < SB_DGRAM_GSO_SEGS; qblock = qblock->next)
+    {
+        if(CHK(qblock)->type != CHUNK_MEM || CHK(qblock)->left <= 0
+                || CHK(qblock)->left > CHK(cp)->left || CHK(cp)->left > SB_DGRAM_GSO_SIZE
+                || total + CHK(qblock)->left > SB_DGRAM_GSO_MAX) break;
+        chunks[n++] = qblock;
+        total += CHK(qblock)->left;
+        if(CHK(qblock)->left < CHK(cp)->left) break;
+    }
+    MUTEX_UNLOCK(conn->mutex);
+    if(n < 2) return CHUNK_SENDTO(cp, conn->fd, conn->remote_ip, conn->remote_port);
+    if((ret = chunk_sendto_gso(chunks, n, conn->fd, conn->remote_ip, conn->remote_port)) > 0)
+    {
+        MUTEX_LOCK(conn->mutex);
+        last = (QBLOCK *)cp;
+        for(i = 1; i < n && CHK(chunks[i])->left == 0; i++)
+        {
+            last = (QBLOCK *)chunks[i];
+            nbytes += last->nbytes;
+        }
+        if(last != (QBLOCK *)cp)
+        {
+            ((QBLOCK *)cp)->next = last->next;
+            if(conn->qtail == last) conn->qtail = (QBLOCK *)cp;
+            conn->nsendq -= i - 1;
+            conn->sendq_bytes -= nbytes;
+        }
+        MUTEX_UNLOCK(conn->mutex);
+        while(--i > 0) conn_freechunk(conn, (CB_DATA *)chunks[i]);
+    }
+    return ret;
+}
+
 int conn_write_chunk(CONN *conn, CHUNK *cp)
 {
-    if(conn->session.flags & SB_MULTICAST)
+    if(conn->session->flags & SB_MULTICAST)
     {
+        if(conn->session->flags & SB_DGRAM_GSO) return conn_sendto_gso(conn, cp);
         return CHUNK_SENDTO(cp, conn->fd, conn->remote_ip, conn->remote_port);
     }
 	else if(conn->ssl) 
@@ -68,6 +122,30 @@ int conn_read_buffer(CONN *conn)
 	if(conn->ssl) return MMB_READ_SSL(conn->buffer, conn->ssl);
 	else return MMB_READ(conn->buffer, conn->fd);
 }
+/* link qblock to send queue of conn, conn->mutex held */
+static void conn__pushto__sendq(CONN *conn, QBLOCK *qblock)
+{
+    qblock->next = NULL;
+    qblock->nbytes = (long long)CHK(qblock)->left;
+    if(conn->session->flags & SB_DGRAM) 
+        memcpy(&(qblock->addr), &(conn->dgram_addr), sizeof(struct sockaddr_in));
+    if(conn->qtail)
+    {
+        conn->qtail->next = qblock;
+        conn->qtail = qblock;
+    }
+    else
+    {
+        conn->qhead = conn->qtail = qblock;
+    }
+    conn->nsendq++;
+    conn->sendq_bytes += qblock->nbytes;
+    if((conn->sendq_high > 0 && conn->sendq_bytes >= conn->sendq_high)
+            || (conn->sendq_nhigh > 0 && conn->nsendq >= conn->sendq_nhigh))
+        conn->sendq_full = 1;
+    return ;
+}
+
 void conn_pushto_sendq(CONN *conn, CHUNK *cp)
 {
     QBLOCK *qblock = NULL;
@@ -75,17 +153,7 @@ void conn_pushto_sendq(CONN *conn, CHUNK *cp)
     if(conn && (qblock = (QBLOCK *)cp))
     {
         MUTEX_LOCK(conn->mutex);
-        qblock->next = NULL;
-        if(conn->qtail)
-        {
-            conn->qtail->next = qblock;
-            conn->qtail = qblock;
-        }
-        else
-        {
-            conn->qhead = conn->qtail = qblock;
-        }
-        conn->nsendq++;
+        conn__pushto__sendq(conn, qblock);
         MUTEX_UNLOCK(conn->mutex);
     }
     return ;
@@ -104,24 +172,75 @@ CHUNK *conn_sendq_head(CONN *conn)
     return chunk;
 }
 
+/* proxy watermarks of send queue, conn->mutex locked */
+#define PROXY_SENDQ_HIGH(conn) ((conn->sendq_high > 0) ? conn->sendq_high : SB_PROXY_SENDQ_HIGH)
+#define PROXY_SENDQ_LOW(conn) ((conn->sendq_high > 0) ? conn->sendq_low : SB_PROXY_SENDQ_LOW)
+/* send queue under low watermarks, conn->mutex locked */
+#define SENDQ_UNDER_LOW(conn) ((conn->sendq_high == 0 || conn->sendq_bytes <= conn->sendq_low)   \
+        && (conn->sendq_nhigh == 0 || conn->nsendq <= conn->sendq_nlow))
 CHUNK *conn_popfrom_sendq(CONN *conn)
 {
     CHUNK *chunk = NULL;
+    int writable = 0, unblock = 0;
 
     if(conn)
     {
         MUTEX_LOCK(conn->mutex);
         if((chunk = (CHUNK *)conn->qhead)) 
         {
+            conn->sendq_bytes -= conn->qhead->nbytes;
             if((conn->qhead = conn->qhead->next) == NULL)
                 conn->qtail = NULL;
             conn->nsendq--;
+            /* told once when falling from high to low watermark */
+            if(conn->sendq_full && SENDQ_UNDER_LOW(conn))
+            {
+                conn->sendq_full = 0;
+                writable = 1;
+            }
+            if(conn->proxy_blocked && conn->sendq_bytes <= PROXY_SENDQ_LOW(conn))
+            {
+                conn->proxy_blocked = 0;
+                unblock = 1;
+            }
         }
         MUTEX_UNLOCK(conn->mutex);
+        if(writable) conn_push_message(conn, MESSAGE_WRITABLE);
+        if(unblock) conn_proxy_unblock(conn);
     }
     return chunk;
 }
 
+/* set send queue watermarks */
+int conn_set_watermark(CONN *conn, int high, int low, int nhigh, int nlow)
+{
+    int ret = -1, full = 0;
+
+    if(conn && high >= 0 && low >= 0 && low <= high && nhigh >= 0 && nlow >= 0 && nlow <= nhigh)
+    {
+        MUTEX_LOCK(conn->mutex);
+        conn->sendq_high = high;
+        conn->sendq_low = low;
+        conn->sendq_nhigh = nhigh;
+        conn->sendq_nlow = nlow;
+        full = conn->sendq_full;
+        conn->sendq_full = ((high > 0 && conn->sendq_bytes >= high)
+                || (nhigh > 0 && conn->nsendq >= nhigh));
+        full = (full && conn->sendq_full == 0);
+        MUTEX_UNLOCK(conn->mutex);
+        if(full) conn_push_message(conn, MESSAGE_WRITABLE);
+        ret = 0;
+    }
+    return ret;
+}
+
+/* producers may push while send queue not over high watermark */
+int conn_writable(CONN *conn)
+{
+    if(conn && conn->sendq_full == 0) return 1;
+    return 0;
+}
+
 #define PPARENT(conn) ((PROCTHREAD *)(conn->parent))
 #define INDAEMON(conn) ((PROCTHREAD *)(conn->indaemon))
 #define INWAKEUP(conn) {if(INDAEMON(conn))INDAEMON(conn)->wakeup(INDAEMON(conn));}            
@@ -147,7 +266,7 @@ CHUNK *conn_popfrom_sendq(CONN *conn)
 #define SENDQCLOSE(conn) do{}while(0)
 #define SENDQCLEAN(conn) (queue_clean(conn->queue))
 */
-#define SENDQ(conn) (conn->qblocks)
+#define SENDQ(conn) (&(conn->qhead))
 #define SENDQTOTAL(conn) conn->nsendq
 #define SENDQHEAD(conn) conn_sendq_head(conn)
 #define SENDQPOP(conn) conn_popfrom_sendq(conn)
@@ -216,7 +335,15 @@ do
 do{                                                                                         \
     if(conn)                                                                                \
     {                                                                                       \
-        if(conn->outdaemon)                                                                 \
+        if(conn->session->flags & SB_DGRAM)                                                 \
+        {                                                                                   \
+            if(PPARENT(conn) && !pthread_equal(pthread_self(), PPARENT(conn)->threadid))    \
+            {                                                                               \
+                conn_push_message(conn, MESSAGE_OUT);                                       \
+            }                                                                               \
+            else if(conn->dgram == NULL) conn_dgram_flush(conn);                            \
+        }                                                                                   \
+        else if(conn->outdaemon)                                                            \
         {                                                                                   \
             qmessage_push(conn->outqmessage, MESSAGE_OUT,                                   \
                         conn->index, conn->fd, -1, conn->outdaemon, conn, NULL);            \
@@ -309,14 +436,20 @@ do
         INWAKEUP(conn);                                                                     \
     }                                                                                       \
 }while(0)
+/* pipelined data or grown buffer to reader thread, empty base buffer freed by next read */
 #define SESSION_RESET(conn)                                                                 \
 do                                                                                          \
 {                                                                                           \
     MMB_RESET(conn->packet);                                                                \
+    MMB_RELEASE(conn->packet);                                                              \
     MMB_RESET(conn->cache);                                                                 \
+    MMB_RELEASE(conn->cache);                                                               \
     chunk_reset(&(conn->chunk));                                                            \
     CONN_STATE_RESET(conn);                                                                 \
-    if(MMB_NDATA(conn->buffer) > 0){PUSH_INQMESSAGE(conn, MESSAGE_BUFFER);}                 \
+    if(MMB_NDATA(conn->buffer) > 0 || MMB_SIZE(conn->buffer) > MMBLOCK_BASE)              \
+    {                                                                                       \
+        PUSH_INQMESSAGE(conn, MESSAGE_BUFFER);                                              \
+    }                                                                                       \
 }while(0)
 
 /* out event handler */
@@ -326,13 +459,18 @@ void conn_outevent_handler(CONN *conn)
 
     if(conn)
     {
-        if(SENDQTOTAL(conn) > 0)
+        /* datagrams pushed by other threads, flushed on procthread of conn */
+        if(conn->session->flags & SB_DGRAM)
+        {
+            if(conn->dgram == NULL) conn_dgram_flush(conn);
+        }
+        else if(SENDQTOTAL(conn) > 0)
         {
             if(PPARENT(conn) && PPARENT(conn)->service 
                     && (PPARENT(conn)->service->flag & SB_WHILE_SEND))
-                ret = conn->send_handler(conn);
+                ret = conn->ops->send_handler(conn);
             else
-                ret = conn->write_handler(conn);
+                ret = conn->ops->write_handler(conn);
             if(ret < 0)
             {
                 CONN_OUTEVENT_DESTROY(conn);
@@ -350,6 +488,17 @@ void conn_outevent_handler(CONN *conn)
     }
     return ;
 }
+/* buffer left to reader thread, free only where no packet can refer to it */
+#define CONN_BUFFER_RELEASE(conn)                                                           \
+do                                                                                          \
+{                                                                                           \
+    if((conn->s_state == 0 || conn->s_state == S_STATE_PACKET_HANDLING)                     \
+            && MMB_NDATA(conn->buffer) == 0)                                                \
+    {                                                                                       \
+        MMB_RELEASE(conn->buffer);                                                          \
+    }                                                                                       \
+}while(0)
+
 /* read  packet from buffer  */
 void conn_buffer_handler(CONN *conn)
 {
@@ -358,7 +507,8 @@ void conn_buffer_handler(CONN *conn)
 
     if(conn)
     {
-        if(conn->s_state == 0) ret = conn->packet_reader(conn);
+        if(conn->s_state == 0 && MMB_NDATA(conn->buffer) > 0) ret = conn->ops->packet_reader(conn);
+        CONN_BUFFER_RELEASE(conn);
     }
     return ;
 }
@@ -459,6 +609,191 @@ void conn_end_handler(CONN *conn)
     return ;
 }
 
+/* writable handler, send queue fell to low watermark */
+void conn_writable_handler(CONN *conn)
+{
+    CONN_CHECK(conn, D_STATE_CLOSE);
+
+    if(conn && conn->sendq_full == 0 && conn->session->writable_handler)
+    {
+        conn->session->writable_handler(conn);
+    }
+    return ;
+}
+
+/* put unsent datagrams back to head of send queue in order */
+static void conn_dgram_requeue(CONN *conn, QBLOCK **qblocks, int n)
+{
+    int i = 0;
+
+    if(n > 0)
+    {
+        MUTEX_LOCK(conn->mutex);
+        for(i = 0; i < n - 1; i++) qblocks[i]->next = qblocks[i+1];
+        if((qblocks[n-1]->next = conn->qhead) == NULL) conn->qtail = qblocks[n-1];
+        conn->qhead = qblocks[0];
+        for(i = 0; i < n; i++) conn->sendq_bytes += qblocks[i]->nbytes;
+        conn->nsendq += n;
+        if((conn->sendq_high > 0 && conn->sendq_bytes >= conn->sendq_high)
+                || (conn->sendq_nhigh > 0 && conn->nsendq >= conn->sendq_nhigh))
+            conn->sendq_full = 1;
+        MUTEX_UNLOCK(conn->mutex);
+    }
+    return ;
+}
+
+/* send queued datagrams to their peers with sendmmsg(), with SB_DGRAM_GSO
+ * runs of same size datagrams to one peer go in one message with UDP_SEGMENT,
+ * unsent are requeued and sent again on E_WRITE when socket buffer is full */
+static int conn_dgram_flush(CONN *conn)
+{
+    QBLOCK *qblock = NULL, *qblocks[SB_DGRAM_GSO_SEGS];
+    struct mmsghdr msgs[SB_DGRAM_BATCH];
+    struct iovec iovs[SB_DGRAM_GSO_SEGS];
+    struct sockaddr_in *addr = NULL;
+    struct msghdr *msg = NULL;
+    int n = 0, i = 0, k = 0, x = 0, sent = 0, total = 0, gso = 0, seg = 0, bytes = 0, len = 0;
+    int blocked = 0, dropped = 0;
+#ifdef UDP_SEGMENT
+    char controls[SB_DGRAM_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr *cmsg = NULL;
+
+    gso = (conn->session->flags & SB_DGRAM_GSO);
+#endif
+    do
+    {
+        n = k = 0;
+        while(n < SB_DGRAM_BATCH && k < SB_DGRAM_GSO_SEGS && (qblock = (QBLOCK *)SENDQPOP(conn)))
+        {
+            if(CHK(qblock)->type != CHUNK_MEM || CHK(qblock)->left <= 0)
+            {
+                WARN_LOGGER(conn->logger, "Dropped chunk type:%d left:%lld not datagram via %d", CHK(qblock)->type, LL(CHK(qblock)->left), conn->fd);
+                conn_freechunk(conn, (CB_DATA *)qblock);
+                continue;
+            }
+            len = (int)CHK(qblock)->left;
+            iovs[k].iov_base = CHK(qblock)->end;
+            iovs[k].iov_len = len;
+            qblocks[k] = qblock;
+            /* joins last message while its datagrams are all of segment size */
+            if(gso && n > 0 && seg <= SB_DGRAM_GSO_SIZE && len <= seg 
+                    && msg->msg_iov[msg->msg_iovlen - 1].iov_len == seg
+                    && bytes + len <= SB_DGRAM_GSO_MAX 
+                    && addr->sin_addr.s_addr == qblock->addr.sin_addr.s_addr 
+                    && addr->sin_port == qblock->addr.sin_port)
+            {
+                msg->msg_iovlen++;
+                bytes += len;
+            }
+            else
+            {
+                memset(&(msgs[n]), 0, sizeof(struct mmsghdr));
+                msg = &(msgs[n++].msg_hdr);
+                addr = &(qblock->addr);
+                msg->msg_name = addr;
+                msg->msg_namelen = sizeof(struct sockaddr_in);
+                msg->msg_iov = &(iovs[k]);
+                msg->msg_iovlen = 1;
+                seg = bytes = len;
+            }
+            k++;
+        }
+        if(n == 0) break;
+#ifdef UDP_SEGMENT
+        for(i = 0; i < n; i++)
+        {
+            msg = &(msgs[i].msg_hdr);
+            if(msg->msg_iovlen < 2) continue;
+            msg->msg_control = controls[i];
+            msg->msg_controllen = sizeof(controls[i]);
+            cmsg = CMSG_FIRSTHDR(msg);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *((uint16_t *)CMSG_DATA(cmsg)) = (uint16_t)msg->msg_iov[0].iov_len;
+        }
+#endif
+#ifdef MSG_WAITFORONE
+        sent = sendmmsg(conn->fd, msgs, n, MSG_DONTWAIT);
+#else
+        for(sent = 0; sent < n; sent++)
+        {
+            if((i = sendmsg(conn->fd, &(msgs[sent].msg_hdr), MSG_DONTWAIT)) < 0) break;
+            msgs[sent].msg_len = i;
+        }
+#endif
+        dropped = 0;
+        if(sent < 0)
+        {
+            sent = 0;
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == EINTR)
+                blocked = 1;
+            else
+            {
+                /* error on first message is of it only, the rest go again */
+                WARN_LOGGER(conn->logger, "Dropped message of %d datagrams to port:%d via %d, %s", (int)msgs[0].msg_hdr.msg_iovlen, ntohs(((struct sockaddr_in *)msgs[0].msg_hdr.msg_name)->sin_port), conn->fd, strerror(errno));
+                dropped = 1;
+            }
+        }
+        for(i = 0; i < sent; i++) conn->sent_data_total += msgs[i].msg_len;
+        /* datagrams of messages sent or dropped */
+        x = (sent + dropped < n) ? (int)(msgs[sent + dropped].msg_hdr.msg_iov - iovs) : k;
+        for(i = 0; i < x; i++) conn_freechunk(conn, (CB_DATA *)qblocks[i]);
+        conn_dgram_requeue(conn, &(qblocks[x]), k - x);
+        total += sent;
+        if(blocked) break;
+    }while(n == SB_DGRAM_BATCH || k == SB_DGRAM_GSO_SEGS || x < k);
+    /* socket buffer full, wait for writable */
+    if(blocked)
+    {
+        if(!(conn->event.ev_flags & E_WRITE)) event_add(&(conn->event), E_WRITE);
+    }
+    else if(conn->event.ev_flags & E_WRITE)
+    {
+        event_del(&(conn->event), E_WRITE);
+    }
+    return total;
+}
+
+/* datagram handler, packet_handler() on each datagram of batch */
+int conn_dgram_handler(CONN *conn, void *arg)
+{
+    DGRAM *dgram = (DGRAM *)arg;
+    CB_DATA packet = {0};
+    int i = 0, off = 0, seg = 0;
+
+    if(conn && dgram)
+    {
+        conn->dgram = dgram;
+        for(i = 0; i < dgram->count; i++)
+        {
+            if(conn->d_state & D_STATE_CLOSE) break;
+            memcpy(&(conn->dgram_addr), &(dgram->addrs[i]), sizeof(struct sockaddr_in));
+            inet_ntop(AF_INET, &(dgram->addrs[i].sin_addr), conn->remote_ip, SB_IP_MAX);
+            conn->remote_port = ntohs(dgram->addrs[i].sin_port);
+            conn->recv_data_total += dgram->lens[i];
+            /* datagrams coalesced by UDP_GRO are split on segment size */
+            seg = (dgram->segs[i] > 0) ? dgram->segs[i] : dgram->lens[i];
+            off = 0;
+            do
+            {
+                packet.data = DGRAM_DATA(dgram, i) + off;
+                packet.ndata = packet.size = (dgram->lens[i] - off < seg) ? (dgram->lens[i] - off) : seg;
+                if(conn->session->packet_handler)
+                {
+                    conn->session->packet_handler(conn, &packet);
+                }
+                off += seg;
+            }while(seg > 0 && off < dgram->lens[i]);
+        }
+        conn->dgram = NULL;
+        conn_dgram_flush(conn);
+        service_dgram_free((SERVICE *)conn->service, dgram);
+        return 0;
+    }
+    return -1;
+}
+
 /* free handler  */
 void conn_free_handler(CONN *conn)
 {
@@ -467,7 +802,7 @@ void conn_free_handler(CONN *conn)
     if(conn)
     {
         SESSION_RESET(conn);
-        if(conn->session.flags & SB_MULTICAST) 
+        if(conn->session->flags & SB_MULTICAST) 
             PPARENT(conn)->service->freeconn(PPARENT(conn)->service, conn);
     }
     return ;
@@ -491,9 +826,9 @@ void conn_output_handler(int event_fd, int event, void *arg)
         {
             if(PPARENT(conn) && PPARENT(conn)->service 
                     && (PPARENT(conn)->service->flag & SB_WHILE_SEND))
-                ret = conn->send_handler(conn);
+                ret = conn->ops->send_handler(conn);
             else
-                ret = conn->write_handler(conn);
+                ret = conn->ops->write_handler(conn);
             if(ret < 0)
             {
                 CONN_OUTEVENT_DESTROY(conn);
@@ -541,9 +876,9 @@ void conn_event_handler(int event_fd, int event, void *arg)
                 if(PPARENT(conn) && PPARENT(conn)->service)
                     PPARENT(conn)->service->okconn(PPARENT(conn)->service, conn);
                 event_del(&(conn->event), E_WRITE);
-                if(conn->session.ok_handler) 
+                if(conn->session->ok_handler) 
                 {
-                    conn->session.ok_handler(conn);
+                    conn->session->ok_handler(conn);
                 }
                 return ;
             }
@@ -558,7 +893,7 @@ void conn_event_handler(int event_fd, int event, void *arg)
             }
             if(event & E_READ)
             {
-                ret = conn->read_handler(conn);
+                ret = conn->ops->read_handler(conn);
                 if(ret < 0)
                 {
                     event_destroy(&(conn->event)); 
@@ -566,14 +901,18 @@ void conn_event_handler(int event_fd, int event, void *arg)
                     return ;
                 }
             }
-            if((event & E_WRITE))
+            if((event & E_WRITE) && (conn->session->flags & SB_DGRAM))
+            {
+                conn_dgram_flush(conn);
+            }
+            else if((event & E_WRITE))
             {
                 if(conn->outdaemon == NULL)
                 {
                     if(PPARENT(conn) && PPARENT(conn)->service && (PPARENT(conn)->service->flag & SB_WHILE_SEND))
-                        ret = conn->send_handler(conn);
+                        ret = conn->ops->send_handler(conn);
                     else
-                        ret = conn->write_handler(conn);
+                        ret = conn->ops->write_handler(conn);
                     if(ret < 0)
                     {
                         event_destroy(&(conn->event)); 
@@ -604,11 +943,21 @@ int conn_set(CONN *conn)
     int flag = 0;
     if(conn && conn->fd > 0 )
     {
+        conn->evid = -1;
+        /* datagrams read by service and written by conn_dgram_flush(),
+         * fd shares file status flags with service->fd, leave them alone,
+         * event without E_READ for E_WRITE when socket buffer is full */
+        if(conn->session->flags & SB_DGRAM)
+        {
+            if(conn->evbase == NULL) return -1;
+            event_set(&(conn->event), conn->fd, E_PERSIST, (void *)conn, &conn_event_handler);
+            conn->evbase->add(conn->evbase, &(conn->event));
+            return 0;
+        }
         //non-block
         fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL, 0)|O_NONBLOCK);
         //timeout
-        conn->evid = -1;
-        if(conn->parent && conn->session.timeout > 0) conn->set_timeout(conn, conn->session.timeout);
+        if(conn->parent && conn->xsession.timeout > 0) conn->ops->set_timeout(conn, conn->xsession.timeout);
         //SENDQNEW(conn);
         if(conn->outdaemon)
         {
@@ -672,9 +1021,11 @@ int conn_over(CONN *conn)
 
     if(conn)
     {
+        /* datagram connection serves all peers */
+        if(conn->session->flags & SB_DGRAM) return 0;
         DEBUG_LOGGER(conn->logger, "Ready for over-connection[%p] remote[%s:%d] local[%s:%d] via %d", conn, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
         MUTEX_LOCK(conn->mutex);
-        conn->over_timeout(conn);
+        conn->ops->over_timeout(conn);
         if(conn->d_state == D_STATE_FREE) over = 1;
         MUTEX_UNLOCK(conn->mutex);
         if(over)conn_over_chunk(conn);
@@ -690,8 +1041,11 @@ int conn_shut(CONN *conn, int d_state, int e_state)
 
     if(conn)
     {
+        /* datagram connection closed only with service */
+        if((conn->session->flags & SB_DGRAM) && ((SERVICE *)(conn->service))->lock == 0) 
+            return 0;
         MUTEX_LOCK(conn->mutex);
-        conn->over_timeout(conn);
+        conn->ops->over_timeout(conn);
         if(conn->d_state == D_STATE_FREE && conn->fd > 0)
         {
             conn->d_state |= d_state;
@@ -718,33 +1072,33 @@ int conn_terminate(CONN *conn)
         //continue incompleted data handling 
         if(conn->s_state == S_STATE_DATA_HANDLING && CHK_NDATA(conn->chunk) > 0)
         {
-            if(conn->session.packet_type == PACKET_PROXY)
+            if(conn->xsession.packet_type == PACKET_PROXY)
             {
-                conn->proxy_handler(conn);
+                conn->ops->proxy_handler(conn);
             }
         }
         if((conn->s_state == S_STATE_CHUNK_READING) && MMB_NDATA(conn->buffer) > 0
-                && conn->session.chunk_reader)
+                && conn->session->chunk_reader)
         {
             DEBUG_LOGGER(conn->logger, "chunk_reader() session[%s:%d] local[%s:%d] via %d cid:%d %d", conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->c_id, conn->packet.ndata);
-            if(conn->session.chunk_reader(conn, PCB(conn->buffer)) > 0)
+            if(conn->session->chunk_reader(conn, PCB(conn->buffer)) > 0)
             {
                 DEBUG_LOGGER(conn->logger, "chunk_handler() session[%s:%d] local[%s:%d] via %d cid:%d %d", conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->c_id, conn->packet.ndata);
-                conn->session.chunk_handler(conn, PCB(conn->packet), PCB(conn->cache), PCB(conn->buffer));
+                conn->session->chunk_handler(conn, PCB(conn->packet), PCB(conn->cache), PCB(conn->buffer));
                 conn->e_state = E_STATE_OFF;
             }
         }
-        if(conn->e_state == E_STATE_ON && conn->session.error_handler)
+        if(conn->e_state == E_STATE_ON && conn->session->error_handler)
         {
             DEBUG_LOGGER(conn->logger, "error handler session[%s:%d] local[%s:%d] via %d cid:%d %d", conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->c_id, conn->packet.ndata);
-            conn->session.error_handler(conn, PCB(conn->packet), PCB(conn->cache), PCB(conn->chunk));
+            conn->session->error_handler(conn, PCB(conn->packet), PCB(conn->cache), PCB(conn->chunk));
             MMB_RESET(conn->buffer); 
             MMB_RESET(conn->packet); 
             MMB_RESET(conn->cache); 
             MMB_RESET(conn->oob); 
             chunk_reset(&conn->chunk); 
         }
-        conn->close_proxy(conn);
+        conn->ops->close_proxy(conn);
         EVTIMER_DEL(conn->evtimer, conn->evid);
         DEBUG_LOGGER(conn->logger, "terminateing conn[%p]->d_state:%d queue:%d session[%s:%d] local[%s:%d] via %d", conn, conn->d_state, SENDQTOTAL(conn), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
         /* clean send queue */
@@ -873,18 +1227,18 @@ int conn_timeout_handler(CONN *conn)
 
     if(conn && conn->evid >= 0)
     {
-        if(conn->evstate == EVSTATE_WAIT && conn->session.evtimeout_handler)
+        if(conn->evstate == EVSTATE_WAIT && conn->session->evtimeout_handler)
         {
             conn->evstate = EVSTATE_INIT;
             conn_over_timeout(conn);
-            ret = conn->session.evtimeout_handler(conn);
+            ret = conn->session->evtimeout_handler(conn);
             return ret;
         }
-        if(conn->session.timeout_handler)
+        if(conn->session->timeout_handler)
         {
             DEBUG_LOGGER(conn->logger, "timeout_handler(%d) on remote[%s:%d] local[%s:%d] via %d", conn->timeout, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             CONN_STATE_RESET(conn);
-            ret = conn->session.timeout_handler(conn, PCB(conn->packet), 
+            ret = conn->session->timeout_handler(conn, PCB(conn->packet), 
                     PCB(conn->cache), PCB(conn->chunk));
             DEBUG_LOGGER(conn->logger, "over timeout_handler(%d) on remote[%s:%d] local[%s:%d] via %d", conn->timeout, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             return 0;
@@ -1020,25 +1374,27 @@ int conn_push_message(CONN *conn, int message_id)
 int conn_read_handler(CONN *conn)
 {
     int ret = -1, n = -1;
+    CONN *oconn = NULL;
 
     CONN_CHECK_RET(conn, (D_STATE_RCLOSE|D_STATE_CLOSE), ret);
 
     if(conn)
     {
-        if((conn->session.flags & SB_USE_OOB) && (n = MMB_RECV(conn->oob, conn->fd, MSG_OOB)) > 0)
+        if((conn->session->flags & SB_USE_OOB) && (n = MMB_RECV(conn->oob, conn->fd, MSG_OOB)) > 0)
         {
             conn->recv_oob_total += n;
             DEBUG_LOGGER(conn->logger, "Received %d bytes OOB total %lld from %s:%d on %s:%d via %d", n, LL(conn->recv_oob_total), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
-            if((n = conn->oob_handler(conn)) > 0)
+            if((n = conn->ops->oob_handler(conn)) > 0)
             {
                 MMB_DELETE(conn->oob, n);
             }
+            MMB_RELEASE(conn->oob);
             // CONN TIMER sample 
             return (ret = 0);
         }
         /* Receive to chunk with chunk_read_state before reading to buffer */
         if(conn->s_state == S_STATE_READ_CHUNK
-                && conn->session.packet_type != PACKET_PROXY
+                && conn->xsession.packet_type != PACKET_PROXY
                 && CHK_LEFT(conn->chunk) > 0)
         {
             if(conn->buffer.ndata > 0) ret = conn__read__chunk(conn);
@@ -1046,6 +1402,27 @@ int conn_read_handler(CONN *conn)
             return ret;
             //goto end;
         }
+        /* Splice proxy data between plain sockets */
+        if(conn->xsession.packet_type == PACKET_PROXY && conn->ssl == NULL
+                && MMB_NDATA(conn->buffer) == 0 && MMB_NDATA(conn->exchange) == 0 
+                && CHK_NDATA(conn->chunk) == 0 && (oconn = conn_proxy_peer(conn)) 
+                && oconn->ssl == NULL && (n = conn_proxy_splice(conn, oconn)) != -2)
+        {
+            if(n > 0)
+            {
+                conn->recv_data_total += n;
+                return (ret = 0);
+            }
+            if(n < 0 && (errno == EAGAIN || errno == EINTR)) return (ret = 0);
+            /* peer closed */
+            if(n == 0)
+            {
+                DEBUG_LOGGER(conn->logger, "Splicing closed (recv:%lld sent:%lld) by %s:%d on %s:%d via %d", LL(conn->recv_data_total), LL(conn->sent_data_total), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+                return ret;
+            }
+            WARN_LOGGER(conn->logger, "Splicing data %d bytes (recv:%lld sent:%lld) from %s:%d on %s:%d via %d failed, %s", n, LL(conn->recv_data_total), LL(conn->sent_data_total), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, strerror(errno));
+            return ret;
+        }
         /* Receive normal data */
         if(conn->ssl) 
         {
@@ -1065,16 +1442,17 @@ int conn_read_handler(CONN *conn)
             conn->recv_data_total += n;
         }
         ACCESS_LOGGER(conn->logger, "Received %d bytes s_state:%d npacket:%d nbuffer:%d/%d  left:%d data total %lld from %s:%d on %s:%d via %d", n, conn->s_state, conn->packet.ndata, conn->buffer.ndata, MMB_SIZE(conn->buffer), MMB_LEFT(conn->buffer), LL(conn->recv_data_total), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
-        if(conn->session.packet_type & PACKET_PROXY)
+        if(conn->xsession.packet_type & PACKET_PROXY)
         {
-            ret = conn->proxy_handler(conn);
-            if(conn->session.packet_type == PACKET_PROXY) return ret;
+            ret = conn->ops->proxy_handler(conn);
+            if(conn->xsession.packet_type == PACKET_PROXY) return ret;
         }
         if(conn->s_state == 0 && conn->packet.ndata == 0)
-            ret = conn->packet_reader(conn);
+            ret = conn->ops->packet_reader(conn);
         /* reading chunk */
         if(conn->s_state == S_STATE_CHUNK_READING) 
             ret = conn_chunk_reading(conn);
+        CONN_BUFFER_RELEASE(conn);
         ret = 0;
     }
     return ret;
@@ -1139,7 +1517,7 @@ int conn_write_handler(CONN *conn)
                 if(chunk_over)
                 {
                     CONN_OUTEVENT_DEL(conn);
-                    if(conn->session.flags & SB_MULTICAST)
+                    if(conn->session->flags & SB_MULTICAST)
                     {
                         conn_push_message(conn, MESSAGE_FREE);
                     }
@@ -1227,7 +1605,7 @@ int conn_send_handler(CONN *conn)
                 if(chunk_over)
                 {
                     CONN_OUTEVENT_DEL(conn);
-                    if(conn->session.flags & SB_MULTICAST)
+                    if(conn->session->flags & SB_MULTICAST)
                     {
                         conn_push_message(conn, MESSAGE_FREE);
                     }
@@ -1272,7 +1650,7 @@ int conn_packet_reader(CONN *conn)
     {
         data = PCB(conn->buffer);
         e = MMB_END(conn->buffer);
-        packet_type = conn->session.packet_type;
+        packet_type = conn->xsession.packet_type;
 
         /* Remove invalid packet type */
         if(!(packet_type & PACKET_ALL))
@@ -1282,28 +1660,28 @@ int conn_packet_reader(CONN *conn)
             conn_shut(conn, D_STATE_CLOSE, E_STATE_ON);
         }
         /* Read packet with customized function from user */
-        else if(packet_type & PACKET_CUSTOMIZED && conn->session.packet_reader)
+        else if(packet_type & PACKET_CUSTOMIZED && conn->session->packet_reader)
         {
-            len = conn->session.packet_reader(conn, data);
-            ACCESS_LOGGER(conn->logger, "Reading packet with customized function[%p] length[%d]-[%d] from %s:%d on %s:%d via %d", PPL(conn->session.packet_reader), len, data->ndata, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+            len = conn->session->packet_reader(conn, data);
+            ACCESS_LOGGER(conn->logger, "Reading packet with customized function[%p] length[%d]-[%d] from %s:%d on %s:%d via %d", PPL(conn->session->packet_reader), len, data->ndata, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             goto end;
         }
         /* Read packet with certain length */
         else if(packet_type & PACKET_CERTAIN_LENGTH
-                && MMB_NDATA(conn->buffer) >= conn->session.packet_length)
+                && MMB_NDATA(conn->buffer) >= conn->session->packet_length)
         {
-            len = conn->session.packet_length;
+            len = conn->session->packet_length;
             ACCESS_LOGGER(conn->logger, "Reading packet with certain length[%d] from %s:%d on %s:%d via %d", len, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             goto end;
         }
         /* Read packet with delimiter */
-        else if((packet_type & PACKET_DELIMITER) && conn->session.packet_delimiter
-                && conn->session.packet_delimiter_length > 0)
+        else if((packet_type & PACKET_DELIMITER) && conn->session->packet_delimiter
+                && conn->session->packet_delimiter_length > 0)
         {
             p = MMB_DATA(conn->buffer);
-            if((p = strstr(p, conn->session.packet_delimiter)))
+            if((p = strstr(p, conn->session->packet_delimiter)))
             {
-                len = p + conn->session.packet_delimiter_length - MMB_DATA(conn->buffer);
+                len = p + conn->session->packet_delimiter_length - MMB_DATA(conn->buffer);
             }
             goto end;
         }
@@ -1317,8 +1695,8 @@ end:
             MMB_PUSH(conn->packet, MMB_DATA(conn->buffer), len);
             MMB_DELETE(conn->buffer, len);
             /* For packet quick handling */
-            if(MMB_NDATA(conn->buffer) > 0 && conn->session.quick_handler 
-                    && (n = conn->session.quick_handler(conn, PCB(conn->packet))) > 0)
+            if(MMB_NDATA(conn->buffer) > 0 && conn->session->quick_handler 
+                    && (n = conn->session->quick_handler(conn, PCB(conn->packet))) > 0)
             {
                 ACCESS_LOGGER(conn->logger, "fill-chunk left[%d/%d] from %s:%d on %s:%d via %d", CHK_LEFT(conn->chunk), n, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
                 chunk_mem(&(conn->chunk), n);
@@ -1345,15 +1723,15 @@ int conn_packet_handler(CONN *conn)
     CONN_CHECK_RET(conn, D_STATE_CLOSE, -1);
     PROCTHREAD *parent = NULL;
 
-    if(conn && conn->session.packet_handler && (parent = PPARENT(conn)))
+    if(conn && conn->session->packet_handler && (parent = PPARENT(conn)))
     {
-        ACCESS_LOGGER(conn->logger, "packet_handler(%p) on %s:%d local[%s:%d] via %d", conn->session.packet_handler, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
-        ret = conn->session.packet_handler(conn, PCB(conn->packet));
-        ACCESS_LOGGER(conn->logger, "over packet_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d s_state:%d", conn->session.packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->s_state);
+        ACCESS_LOGGER(conn->logger, "packet_handler(%p) on %s:%d local[%s:%d] via %d", conn->session->packet_handler, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+        ret = conn->session->packet_handler(conn, PCB(conn->packet));
+        ACCESS_LOGGER(conn->logger, "over packet_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d s_state:%d", conn->session->packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->s_state);
 
         if(conn->s_state == S_STATE_PACKET_HANDLING)
         {
-            DEBUG_LOGGER(conn->logger, "Reset packet_handler(%p) buffer:[%d/%d] on %s:%d via %d", conn->session.packet_handler, MMB_LEFT(conn->buffer), MMB_SIZE(conn->buffer), conn->remote_ip, conn->remote_port, conn->fd);
+            DEBUG_LOGGER(conn->logger, "Reset packet_handler(%p) buffer:[%d/%d] on %s:%d via %d", conn->session->packet_handler, MMB_LEFT(conn->buffer), MMB_SIZE(conn->buffer), conn->remote_ip, conn->remote_port, conn->fd);
             SESSION_RESET(conn);
         }
     }
@@ -1365,11 +1743,11 @@ int conn_oob_handler(CONN *conn)
 {
     int ret = -1;
 
-    if(conn && conn->session.oob_handler)
+    if(conn && conn->session->oob_handler)
     {
-        DEBUG_LOGGER(conn->logger, "oob_handler(%p) on %s:%d via %d", conn->session.oob_handler, conn->remote_ip, conn->remote_port, conn->fd);
-        ret = conn->session.oob_handler(conn, PCB(conn->oob));
-        DEBUG_LOGGER(conn->logger, "over oob_handler(%p) on %s:%d via %d", conn->session.oob_handler, conn->remote_ip, conn->remote_port, conn->fd);
+        DEBUG_LOGGER(conn->logger, "oob_handler(%p) on %s:%d via %d", conn->session->oob_handler, conn->remote_ip, conn->remote_port, conn->fd);
+        ret = conn->session->oob_handler(conn, PCB(conn->oob));
+        DEBUG_LOGGER(conn->logger, "over oob_handler(%p) on %s:%d via %d", conn->session->oob_handler, conn->remote_ip, conn->remote_port, conn->fd);
     }
     return ret;
 }
@@ -1383,19 +1761,19 @@ int conn_chunk_handler(CONN *conn)
 
     if(conn && (parent = PPARENT(conn)))
     {
-        if(conn->session.chunk_handler == NULL)
+        if(conn->session->chunk_handler == NULL)
         {
-            WARN_LOGGER(conn->logger, "NO session.chunk_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session.packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+            WARN_LOGGER(conn->logger, "NO session.chunk_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session->packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
             return ret;
         }
-        ret = conn->session.chunk_handler(conn, PCB(conn->packet), 
+        ret = conn->session->chunk_handler(conn, PCB(conn->packet), 
                 PCB(conn->cache), PCB(conn->buffer));
-        ACCESS_LOGGER(conn->logger, "over chunk_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session.packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+        ACCESS_LOGGER(conn->logger, "over chunk_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session->packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
         //reset session
         if(conn->s_state == S_STATE_DATA_HANDLING)
         {
             SESSION_RESET(conn);
-            DEBUG_LOGGER(conn->logger, "Reset chunk_handler(%p) buffer:%d on %s:%d via %d", conn->session.chunk_handler, conn->buffer.ndata, conn->remote_ip, conn->remote_port, conn->fd);
+            DEBUG_LOGGER(conn->logger, "Reset chunk_handler(%p) buffer:%d on %s:%d via %d", conn->session->chunk_handler, conn->buffer.ndata, conn->remote_ip, conn->remote_port, conn->fd);
         }
     }
     return ret;
@@ -1410,31 +1788,31 @@ int conn_data_handler(CONN *conn)
 
     if(conn && (parent = PPARENT(conn)))
     {
-        if(conn->session.packet_type == PACKET_PROXY)
+        if(conn->xsession.packet_type == PACKET_PROXY)
         {
-            return conn->proxy_handler(conn);
+            return conn->ops->proxy_handler(conn);
         }
-        else if(CHK_TYPE(conn->chunk) == CHUNK_MEM && conn->session.data_handler)
+        else if(CHK_TYPE(conn->chunk) == CHUNK_MEM && conn->session->data_handler)
         {
-            ACCESS_LOGGER(conn->logger, "data_handler(%p) on %s:%d via %d", conn->session.data_handler, conn->remote_ip, conn->remote_port, conn->fd);
+            ACCESS_LOGGER(conn->logger, "data_handler(%p) on %s:%d via %d", conn->session->data_handler, conn->remote_ip, conn->remote_port, conn->fd);
             //fprintf(stdout, "service[%s]->session.data_handler:%p\n", PPARENT(conn)->service->service_name, conn->session.data_handler);
-            ret = conn->session.data_handler(conn, PCB(conn->packet), 
+            ret = conn->session->data_handler(conn, PCB(conn->packet), 
                     PCB(conn->cache), PCB(conn->chunk));
-            ACCESS_LOGGER(conn->logger, "over data_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session.packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+            ACCESS_LOGGER(conn->logger, "over data_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session->packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
         }
-        else if(CHK_TYPE(conn->chunk) == CHUNK_FILE && conn->session.file_handler)
+        else if(CHK_TYPE(conn->chunk) == CHUNK_FILE && conn->session->file_handler)
         {
-            ACCESS_LOGGER(conn->logger, "file_handler(%p) on %s:%d via %d", conn->session.file_handler, conn->remote_ip, conn->remote_port, conn->fd);
+            ACCESS_LOGGER(conn->logger, "file_handler(%p) on %s:%d via %d", conn->session->file_handler, conn->remote_ip, conn->remote_port, conn->fd);
             //fprintf(stdout, "service[%s]->session.data_handler:%p\n", PPARENT(conn)->service->service_name, conn->session.data_handler);
-            ret = conn->session.file_handler(conn, PCB(conn->packet), 
+            ret = conn->session->file_handler(conn, PCB(conn->packet), 
                     PCB(conn->cache), CHK_FILENAME(conn->chunk));
-            ACCESS_LOGGER(conn->logger, "over file_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session.packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
+            ACCESS_LOGGER(conn->logger, "over file_handler(%p) parent->qtotal:%d on %s:%d local[%s:%d] via %d", conn->session->packet_handler, QMTOTAL(parent->message_queue), conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd);
         }
         //reset session
         if(conn->s_state == S_STATE_DATA_HANDLING)
         {
             SESSION_RESET(conn);
-            DEBUG_LOGGER(conn->logger, "Reset data_handler(%p) buffer:%d on %s:%d via %d", conn->session.data_handler, conn->buffer.ndata, conn->remote_ip, conn->remote_port, conn->fd);
+            DEBUG_LOGGER(conn->logger, "Reset data_handler(%p) buffer:%d on %s:%d via %d", conn->session->data_handler, conn->buffer.ndata, conn->remote_ip, conn->remote_port, conn->fd);
         }
     }
     return ret;
@@ -1448,9 +1826,9 @@ int conn_bind_proxy(CONN *conn, CONN *child)
 
     if(conn && child)
     {
-        conn->session.packet_type |= PACKET_PROXY;
-        conn->session.childid = child->index;
-        conn->session.child = child;
+        conn->xsession.packet_type |= PACKET_PROXY;
+        conn->xsession.childid = child->index;
+        conn->xsession.child = child;
         DEBUG_LOGGER(conn->logger, "Bind proxy connection[%s:%d] to connection[%s:%d]", conn->remote_ip, conn->remote_port, child->remote_ip, child->remote_port);
         conn_push_message(conn, MESSAGE_PROXY);
         ret = 0;
@@ -1458,27 +1836,164 @@ int conn_bind_proxy(CONN *conn, CONN *child)
     return ret;
 }
 
-/* proxy data handler */
-int conn_proxy_handler(CONN *conn)
+/* live peer of proxy connection */
+static CONN *conn_proxy_peer(CONN *conn)
 {
-    CONN *parent = NULL, *child = NULL, *oconn = NULL;
-    CB_DATA *exchange = NULL, *chunk = NULL, *buffer = NULL;
+    CONN *parent = NULL, *child = NULL;
+
+    if(conn->xsession.parent && (parent = PPARENT(conn)->service->findconn(
+                    PPARENT(conn)->service, conn->xsession.parentid))
+            && parent == conn->xsession.parent)
+    {
+        return parent;
+    }
+    else if(conn->xsession.child && (child = PPARENT(conn)->service->findconn(
+                    PPARENT(conn)->service, conn->xsession.childid))
+            && child == conn->xsession.child)
+    {
+        return child;
+    }
+    return NULL;
+}
+
+/* stop reading conn while send queue of peer oconn over high watermark,
+ * E_READ of conn is changed by its procthread with MESSAGE_PROXY_READ */
+static void conn_proxy_block(CONN *conn, CONN *oconn, long long high)
+{
+    int block = 0;
+
+    MUTEX_LOCK(oconn->mutex);
+    if(oconn->sendq_bytes >= high && oconn->proxy_blocked == 0)
+    {
+        oconn->proxy_blocked = 1;
+        block = 1;
+        DEBUG_LOGGER(conn->logger, "Blocked reading connection[%s:%d] on queued %lld bytes to connection[%s:%d]", conn->remote_ip, conn->remote_port, LL(oconn->sendq_bytes), oconn->remote_ip, oconn->remote_port);
+    }
+    MUTEX_UNLOCK(oconn->mutex);
+    if(block) conn_push_message(conn, MESSAGE_PROXY_READ);
+    return ;
+}
+
+/* resume reading the proxy peer blocked on send queue of conn */
+static void conn_proxy_unblock(CONN *conn)
+{
+    CONN *oconn = NULL;
+
+    if(conn && (conn->xsession.packet_type & PACKET_PROXY) 
+            && (oconn = conn_proxy_peer(conn))
+            && !(oconn->d_state & D_STATE_CLOSE))
+    {
+        conn_push_message(oconn, MESSAGE_PROXY_READ);
+        DEBUG_LOGGER(conn->logger, "Unblocked reading connection[%s:%d] on queued %lld bytes to connection[%s:%d]", oconn->remote_ip, oconn->remote_port, LL(conn->sendq_bytes), conn->remote_ip, conn->remote_port);
+    }
+    return ;
+}
+
+/* proxy read handler, E_READ of conn follows blocking by send queue of peer,
+ * block and unblock in any order end with state of peer at handling */
+void conn_proxy_read_handler(CONN *conn)
+{
+    CONN *oconn = NULL;
+    int blocked = 0;
+    CONN_CHECK(conn, D_STATE_CLOSE);
 
     if(conn)
     {
-        if(conn->session.parent && (parent = PPARENT(conn)->service->findconn(
-                        PPARENT(conn)->service, conn->session.parentid))
-                && parent == conn->session.parent)
+        if((conn->xsession.packet_type & PACKET_PROXY) && (oconn = conn_proxy_peer(conn)))
         {
-            oconn = parent;
+            MUTEX_LOCK(oconn->mutex);
+            blocked = oconn->proxy_blocked;
+            MUTEX_UNLOCK(oconn->mutex);
         }
-        else if(conn->session.child && (child = PPARENT(conn)->service->findconn(
-                        PPARENT(conn)->service, conn->session.childid))
-                && child == conn->session.child)
+        if(blocked) 
         {
-            oconn = child;
+            if(conn->event.ev_flags & E_READ) event_del(&(conn->event), E_READ);
         }
-        else 
+        else if(!(conn->event.ev_flags & E_READ)) 
+        {
+            event_add(&(conn->event), E_READ);
+        }
+    }
+    return ;
+}
+
+#define CONN_PIPE_CLOSE(conn)                                                               \
+do                                                                                          \
+{                                                                                           \
+    if(conn->pipe_size > 0)                                                                 \
+    {                                                                                       \
+        close(conn->pipes[0]);                                                              \
+        close(conn->pipes[1]);                                                              \
+    }                                                                                       \
+    conn->pipe_size = 0;                                                                    \
+}while(0)
+
+/* splice data of proxy conn to peer oconn through pipe of oconn, pipe opened, filled
+ * and queued under oconn->mutex so a closing oconn never loses spliced bytes,
+ * return bytes moved, 0 on closed, -1 on error and -2 when splice() unusable */
+static int conn_proxy_splice(CONN *conn, CONN *oconn)
+{
+    QBLOCK *qblock = NULL;
+    int n = -1, len = 0, err = 0;
+
+    if((qblock = (QBLOCK *)conn_popchunk(oconn)) == NULL) return -1;
+    MUTEX_LOCK(oconn->mutex);
+    if((oconn->d_state & (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE))
+            || oconn->status != CONN_STATUS_FREE
+            || (oconn->xsession.parent != conn && oconn->xsession.child != conn))
+    {
+        err = EPIPE;
+        goto end;
+    }
+    if(oconn->pipe_size == 0 && (oconn->pipe_size = chunk_pipe_open(oconn->pipes, 
+                    SB_PROXY_SENDQ_HIGH)) < 0)
+    {
+        WARN_LOGGER(conn->logger, "Opening pipe to connection[%s:%d] failed, %s", oconn->remote_ip, oconn->remote_port, strerror(errno));
+    }
+    if(oconn->pipe_size < 0)
+    {
+        n = -2;
+        goto end;
+    }
+    /* queued bytes of oconn never less than data left in pipe */
+    if((len = oconn->pipe_size - (int)oconn->sendq_bytes) > SB_BUF_SIZE) len = SB_BUF_SIZE;
+    if(len <= 0)
+    {
+        err = EAGAIN;
+        goto end;
+    }
+    if((n = chunk_pipe_read(conn->fd, oconn->pipes[1], len)) > 0)
+    {
+        chunk_pipe((CHUNK *)qblock, oconn->pipes[0], n);
+        conn__pushto__sendq(oconn, qblock);
+        qblock = NULL;
+    }
+    else err = errno;
+end:
+    MUTEX_UNLOCK(oconn->mutex);
+    if(qblock) conn_freechunk(oconn, (CB_DATA *)qblock);
+    if(n > 0)
+    {
+        CONN_OUTEVENT_MESSAGE(oconn);
+        conn_proxy_block(conn, oconn, PROXY_SENDQ_HIGH(oconn));
+    }
+    else if(err == EAGAIN && len <= 0)
+    {
+        conn_proxy_block(conn, oconn, oconn->pipe_size);
+    }
+    errno = err;
+    return n;
+}
+
+/* proxy data handler */
+int conn_proxy_handler(CONN *conn)
+{
+    CONN *oconn = NULL;
+    CB_DATA *exchange = NULL, *chunk = NULL, *buffer = NULL;
+
+    if(conn)
+    {
+        if((oconn = conn_proxy_peer(conn)) == NULL)
         {
             return -1;
         }
@@ -1486,22 +2001,24 @@ int conn_proxy_handler(CONN *conn)
         if((exchange = PCB(conn->exchange)) && exchange->ndata > 0)
         {
             DEBUG_LOGGER(conn->logger, "Ready exchange packet[%d] to conn[%s:%d]", exchange->ndata, oconn->remote_ip, oconn->remote_port);
-            oconn->push_chunk(oconn, exchange->data, exchange->ndata);
+            oconn->ops->push_chunk(oconn, exchange->data, exchange->ndata);
             MMB_RESET(conn->exchange);
+            MMB_RELEASE(conn->exchange);
         }
         if((chunk = PCB(conn->chunk)) && chunk->ndata > 0)
         {
             DEBUG_LOGGER(conn->logger, "Ready exchange chunk[%d] to conn[%s:%d]", chunk->ndata, oconn->remote_ip, oconn->remote_port);
-            oconn->push_chunk(oconn, chunk->data, chunk->ndata);
+            oconn->ops->push_chunk(oconn, chunk->data, chunk->ndata);
             chunk_reset(&conn->chunk);
         }
-        if(conn->session.packet_type == PACKET_PROXY 
+        if(conn->xsession.packet_type == PACKET_PROXY 
                 && (buffer = PCB(conn->buffer)) && buffer->ndata > 0)
         {
             DEBUG_LOGGER(conn->logger, "Ready exchange buffer[%d] to conn[%s:%d]", buffer->ndata, oconn->remote_ip, oconn->remote_port);
-            oconn->push_chunk(oconn, buffer->data, buffer->ndata);
+            oconn->ops->push_chunk(oconn, buffer->data, buffer->ndata);
             MMB_DELETE(conn->buffer, buffer->ndata);
         }
+        if(!(conn->d_state & D_STATE_CLOSE)) conn_proxy_block(conn, oconn, PROXY_SENDQ_HIGH(oconn));
         return 0;
     }
     return -1;
@@ -1510,27 +2027,33 @@ int conn_proxy_handler(CONN *conn)
 /* close proxy */
 int conn_close_proxy(CONN *conn)
 {
-    int ret = -1;
+    int ret = -1, blocked = 0;
     CONN *parent = NULL, *child = NULL;
 
-    if(conn && (conn->session.packet_type & PACKET_PROXY))
+    if(conn && (conn->xsession.packet_type & PACKET_PROXY))
     {
-        conn->proxy_handler(conn);
-        if(conn->session.parent && (parent = PPARENT(conn)->service->findconn(
-                        PPARENT(conn)->service, conn->session.parentid))
-                && parent == conn->session.parent)
+        conn->ops->proxy_handler(conn);
+        /* let the blocked peer read on to see its close */
+        MUTEX_LOCK(conn->mutex);
+        blocked = conn->proxy_blocked;
+        conn->proxy_blocked = 0;
+        MUTEX_UNLOCK(conn->mutex);
+        if(blocked) conn_proxy_unblock(conn);
+        if(conn->xsession.parent && (parent = PPARENT(conn)->service->findconn(
+                        PPARENT(conn)->service, conn->xsession.parentid))
+                && parent == conn->xsession.parent)
         {
-            parent->set_timeout(parent, SB_PROXY_TIMEOUT);
-            parent->session.childid = 0;
-            parent->session.child = NULL;
+            parent->ops->set_timeout(parent, SB_PROXY_TIMEOUT);
+            parent->xsession.childid = 0;
+            parent->xsession.child = NULL;
         }
-        else if(conn->session.child && (child = PPARENT(conn)->service->findconn(
-                        PPARENT(conn)->service, conn->session.childid))
-                && child == conn->session.child)
+        else if(conn->xsession.child && (child = PPARENT(conn)->service->findconn(
+                        PPARENT(conn)->service, conn->xsession.childid))
+                && child == conn->xsession.child)
         {
-            child->set_timeout(child, SB_PROXY_TIMEOUT);
-            child->session.parent = NULL;
-            child->session.parentid = 0;
+            child->ops->set_timeout(child, SB_PROXY_TIMEOUT);
+            child->xsession.parent = NULL;
+            child->xsession.parentid = 0;
         }
         ret = 0;
     }
@@ -1593,7 +2116,7 @@ int conn__read__chunk(CONN *conn)
     if(conn)
     {
         if(conn->s_state == S_STATE_READ_CHUNK
-                && conn->session.packet_type != PACKET_PROXY
+                && conn->xsession.packet_type != PACKET_PROXY
                 && CHK_LEFT(conn->chunk) > 0
                 && MMB_NDATA(conn->buffer) > 0)
         {
@@ -1621,44 +2144,63 @@ int conn__read__chunk(CONN *conn)
 /* pop newchunk */
 CHUNK *conn_popchunk(CONN *conn)
 {
-    CHUNK *cp = NULL;
-    int x = 0;
+    QBLOCK *qblock = NULL;
 
     if(conn)
     {
         MUTEX_LOCK(conn->mutex);
-        if(conn->nqleft > 0)
-        {
-            x = --(conn->nqleft);
-            cp = (CHUNK *)(conn->qleft[x]);
-            conn->qleft[x] = NULL;
-        }
-        else 
+        if((qblock = conn->qleft))
         {
-            x = conn->qblock_max++;
-            cp = &(conn->qblocks[x].chunk);
+            conn->qleft = qblock->next;
+            conn->nqleft--;
         }
         MUTEX_UNLOCK(conn->mutex);
+        if(qblock == NULL) 
+            qblock = (QBLOCK *)xmm_tag_mnew(XMM_TAG_CHUNK, sizeof(QBLOCK));
     }
-    return cp;
+    return (CHUNK *)qblock;
 }
 
 void conn_freechunk(CONN *conn, CB_DATA *chunk)
 {
-    CHUNK *cp = NULL;
-    int x = 0;
+    QBLOCK *qblock = NULL;
 
-    if(conn && (cp = (CHUNK *)chunk))
+    if(conn && (qblock = (QBLOCK *)chunk))
     {
-        chunk_reset(cp);
+        chunk_reset(&(qblock->chunk));
         MUTEX_LOCK(conn->mutex);
-        x = conn->nqleft++;
-        conn->qleft[x] = (QBLOCK *)cp;
+        if(conn->nqleft < SB_QBLOCK_MAX)
+        {
+            qblock->next = conn->qleft;
+            conn->qleft = qblock;
+            conn->nqleft++;
+            qblock = NULL;
+        }
         MUTEX_UNLOCK(conn->mutex);
+        if(qblock)
+        {
+            chunk_destroy(&(qblock->chunk));
+            xmm_tag_free(XMM_TAG_CHUNK, qblock, sizeof(QBLOCK));
+        }
     }
     return ;
 }
 
+/* free blocks of send queue */
+void conn_free_qblocks(CONN *conn)
+{
+    QBLOCK *qblock = NULL;
+
+    while((qblock = conn->qleft))
+    {
+        conn->qleft = qblock->next;
+        chunk_destroy(&(qblock->chunk));
+        xmm_tag_free(XMM_TAG_CHUNK, qblock, sizeof(QBLOCK));
+    }
+    conn->nqleft = 0;
+    return ;
+}
+
 /* newchunk */
 CB_DATA *conn_newchunk(CONN *conn, int len)
 {
@@ -1712,7 +2254,7 @@ int conn_read_chunk(CONN *conn)
         conn->s_state = S_STATE_CHUNK_READING;
         if(conn->d_state & D_STATE_CLOSE)
         {
-            conn->chunk_reading(conn);
+            conn->ops->chunk_reading(conn);
         }
         else
         {
@@ -1735,7 +2277,7 @@ int conn_recv_chunk(CONN *conn, int size)
         conn->s_state = S_STATE_READ_CHUNK;
         if(conn->d_state & D_STATE_CLOSE)
         {
-            conn->chunk_reader(conn);
+            conn->ops->chunk_reader(conn);
         }
         else
         {
@@ -1762,7 +2304,7 @@ int conn_recv2_chunk(CONN *conn, int size, char *data, int ndata)
         conn->s_state = S_STATE_READ_CHUNK;
         if(conn->d_state & D_STATE_CLOSE)
         {
-            conn->chunk_reader(conn);
+            conn->ops->chunk_reader(conn);
         }
         else
         {
@@ -1780,7 +2322,7 @@ int conn_push_chunk(CONN *conn, void *data, int size)
     CHUNK *cp = NULL;
     CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
 
-    if(conn && conn->status == CONN_STATUS_FREE && SENDQ(conn) && data && size > 0)
+    if(conn && conn->status == CONN_STATUS_FREE && data && size > 0)
     {
         //CHUNK_POP(conn, cp);
         //if(PPARENT(conn) && PPARENT(conn)->service 
@@ -1798,6 +2340,52 @@ int conn_push_chunk(CONN *conn, void *data, int size)
     return ret;
 }
 
+/* push reference of shared data */
+int conn_push_shared(CONN *conn, void *shared)
+{
+    int ret = -1;
+    CHUNK *cp = NULL;
+    CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
+
+    if(conn && conn->status == CONN_STATUS_FREE && shared)
+    {
+        if((cp = (CHUNK *)conn_popchunk(conn)))
+        {
+            chunk_shared(cp, (CHUNK_SHARED *)shared);
+            SENDQPUSH(conn, cp);
+            CONN_OUTEVENT_MESSAGE(conn);
+            ACCESS_LOGGER(conn->logger, "Pushed shared size[%d] to %s:%d queue[%p] total:%d on %s:%d via %d", ((CHUNK_SHARED *)shared)->ndata, conn->remote_ip, conn->remote_port, SENDQ(conn), SENDQTOTAL(conn), conn->local_ip, conn->local_port, conn->fd);
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+/* push copy of head then reference of shared data from off in one chunk */
+int conn_push_shared_head(CONN *conn, void *head, int nhead, void *shared, int off)
+{
+    int ret = -1;
+    CHUNK *cp = NULL;
+    CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
+
+    if(conn && conn->status == CONN_STATUS_FREE && head && nhead > 0 && shared)
+    {
+        if((cp = (CHUNK *)conn_popchunk(conn)))
+        {
+            if(chunk_shared_head(cp, head, nhead, (CHUNK_SHARED *)shared, off) != 0)
+            {
+                conn_freechunk(conn, (CB_DATA *)cp);
+                return ret;
+            }
+            SENDQPUSH(conn, cp);
+            CONN_OUTEVENT_MESSAGE(conn);
+            ACCESS_LOGGER(conn->logger, "Pushed head[%d] shared size[%d] from %d to %s:%d queue[%p] total:%d on %s:%d via %d", nhead, ((CHUNK_SHARED *)shared)->ndata, off, conn->remote_ip, conn->remote_port, SENDQ(conn), SENDQTOTAL(conn), conn->local_ip, conn->local_port, conn->fd);
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
 /* receive chunk file */
 int conn_recv_file(CONN *conn, char *filename, long long offset, long long size)
 {
@@ -1810,7 +2398,7 @@ int conn_recv_file(CONN *conn, char *filename, long long offset, long long size)
         conn->s_state = S_STATE_READ_CHUNK;
         if(conn->d_state & D_STATE_CLOSE)
         {
-            conn->chunk_reader(conn);
+            conn->ops->chunk_reader(conn);
         }
         else
         {
@@ -1829,7 +2417,7 @@ int conn_push_file(CONN *conn, char *filename, long long offset, long long size)
     CHUNK *cp = NULL;
     CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
 
-    if(conn && conn->status == CONN_STATUS_FREE && SENDQ(conn) 
+    if(conn && conn->status == CONN_STATUS_FREE 
             && filename && offset >= 0 && size > 0)
     {
         //CHUNK_POP(conn, cp);
@@ -1849,6 +2437,28 @@ int conn_push_file(CONN *conn, char *filename, long long offset, long long size)
     return ret;
 }
 
+/* push chunk of opened file, fd closed by connection when pushed */
+int conn_push_fd(CONN *conn, int fd, long long offset, long long size)
+{
+    int ret = -1;
+    CHUNK *cp = NULL;
+    CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
+
+    if(conn && conn->status == CONN_STATUS_FREE 
+            && fd > 0 && offset >= 0 && size > 0)
+    {
+        if((cp = (CHUNK *)conn_popchunk(conn)))
+        {
+            chunk_fd(cp, fd, offset, size);
+            SENDQPUSH(conn, cp);
+            CONN_OUTEVENT_MESSAGE(conn);
+            ACCESS_LOGGER(conn->logger, "Pushed fd[%d] [%lld][%lld] to %s:%d queue total %d on %s:%d via %d ", fd, LL(offset), LL(size), conn->remote_ip, conn->remote_port, SENDQTOTAL(conn), conn->local_ip, conn->local_port, conn->fd);
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
 /* send chunk */
 int conn_send_chunk(CONN *conn, CB_DATA *chunk, int len)
 {
@@ -1874,7 +2484,7 @@ int conn_over_chunk(CONN *conn)
     CHUNK *cp = NULL;
     CONN_CHECK_RET(conn, (D_STATE_CLOSE|D_STATE_WCLOSE|D_STATE_RCLOSE), ret);
 
-    if(conn && conn->status == CONN_STATUS_FREE && SENDQ(conn))
+    if(conn && conn->status == CONN_STATUS_FREE)
     {
         //if(PPARENT(conn) && PPARENT(conn)->service 
         //        && (cp = PPARENT(conn)->service->popchunk(PPARENT(conn)->service)))
@@ -1893,14 +2503,26 @@ int conn_over_chunk(CONN *conn)
 /* set session options */
 int conn_set_session(CONN *conn, SESSION *session)
 {
+    SESSION *sess = NULL, *old = NULL;
     int ret = -1;
 
     CONN_CHECK_RET(conn, D_STATE_CLOSE, -1);
-    if(conn && session)
-    {
-        memcpy(&(conn->session), session, sizeof(SESSION));
-        if(conn->parent && conn->session.timeout > 0) 
-            conn->set_timeout(conn, conn->session.timeout);
+    if(conn && session && (sess = service_session_ref((SERVICE *)conn->service, session)))
+    {
+        /* switch template by reference, keep only per connection part */
+        old = conn->session;
+        conn->session = sess;
+        conn->xsession.packet_type = session->packet_type;
+        conn->xsession.timeout = session->timeout;
+        conn->xsession.childid = session->childid;
+        conn->xsession.child = session->child;
+        conn->xsession.parentid = session->parentid;
+        conn->xsession.parent = session->parent;
+        if(old != &conn_session_none) service_session_unref(old);
+        conn_set_watermark(conn, sess->sendq_high, sess->sendq_low, 
+                sess->sendq_nhigh, sess->sendq_nlow);
+        if(conn->parent && conn->xsession.timeout > 0) 
+            conn->ops->set_timeout(conn, conn->xsession.timeout);
         ret = 0;
     }
     return ret;
@@ -1915,7 +2537,7 @@ int conn_over_session(CONN *conn)
     if(conn)
     {
         SESSION_RESET(conn);
-        if(conn->session.flags & SB_MULTICAST) 
+        if(conn->session->flags & SB_MULTICAST) 
             PPARENT(conn)->service->freeconn(PPARENT(conn)->service, conn);
         else
         {
@@ -1971,9 +2593,9 @@ int conn_transaction_handler(CONN *conn, int tid)
 
     if(conn)
     {
-        if(conn && conn->session.transaction_handler)
+        if(conn && conn->session->transaction_handler)
         {
-            ret = conn->session.transaction_handler(conn, tid);
+            ret = conn->session->transaction_handler(conn, tid);
         }
     }
     return ret;
@@ -2041,25 +2663,34 @@ void conn_reset(CONN *conn)
         /* event timer */
         conn->evid = -1;
         conn->evtimer = NULL;
-        /* buffer and chunk */
-        MMB_RESET(conn->buffer);
-        MMB_RESET(conn->packet);
-        MMB_RESET(conn->oob);
-        MMB_RESET(conn->cache);
-        MMB_RESET(conn->exchange);
+        /* buffer and chunk, pooled connection holds no memory */
+        MMB_DESTROY(conn->buffer);
+        MMB_DESTROY(conn->packet);
+        MMB_DESTROY(conn->oob);
+        MMB_DESTROY(conn->cache);
+        MMB_DESTROY(conn->header);
+        MMB_DESTROY(conn->exchange);
         chunk_reset(&conn->chunk);
         /* timer, logger, message_queue and queue */
         conn->message_queue = NULL;
         conn->inqmessage = NULL;
         conn->outqmessage = NULL;
-        if(SENDQ(conn))
+        while((cp = (CHUNK *)SENDQPOP(conn)))
         {
-            while((cp = (CHUNK *)SENDQPOP(conn)))
-            {
-                conn_freechunk(conn, (CB_DATA *)cp);
-                cp  = NULL;
-            }
+            conn_freechunk(conn, (CB_DATA *)cp);
+            cp  = NULL;
         }
+        conn_free_qblocks(conn);
+        /* peer splicing into pipe checks pairing under mutex */
+        MUTEX_LOCK(conn->mutex);
+        CONN_PIPE_CLOSE(conn);
+        memset(&(conn->xsession), 0, sizeof(XSESSION));
+        conn->proxy_blocked = 0;
+        MUTEX_UNLOCK(conn->mutex);
+        conn->sendq_bytes = 0ll;
+        conn->sendq_high = conn->sendq_low = 0;
+        conn->sendq_nhigh = conn->sendq_nlow = 0;
+        conn->sendq_full = 0;
         /* SSL */
 #ifdef HAVE_SSL
         if(conn->ssl)
@@ -2082,18 +2713,27 @@ void conn_reset(CONN *conn)
         conn->evstate = 0;
         conn->timeout = 0;
         /* session */
-        memset(&(conn->session), 0, sizeof(SESSION));
+        if(conn->session != &conn_session_none) service_session_unref(conn->session);
+        conn->session = &conn_session_none;
     }
     return ;
 }
 /* clean connection */
 void conn_clean(CONN *conn)
 {
-    int i = 0;
+    CHUNK *cp = NULL;
 
     if(conn)
     {
+        /* Clean queue */
+        while((cp = (CHUNK *)SENDQPOP(conn)))
+        {
+            conn_freechunk(conn, (CB_DATA *)cp);
+        }
+        conn_free_qblocks(conn);
+        CONN_PIPE_CLOSE(conn);
         MUTEX_DESTROY(conn->mutex);
+        if(conn->session != &conn_session_none) service_session_unref(conn->session);
         conn->mutex = NULL;
         event_clean(&(conn->event));
         /* Clean BUFFER */
@@ -2106,14 +2746,11 @@ void conn_clean(CONN *conn)
         MMB_DESTROY(conn->packet);
         /* Clean exchange */
         MMB_DESTROY(conn->exchange);
+        /* Clean header */
+        MMB_DESTROY(conn->header);
         /* Clean chunk */
         chunk_destroy(&(conn->chunk));
-        /* Clean queue */
         SENDQCLEAN(conn);
-        for(i = 0; i < conn->qblock_max; i++)
-        {
-            chunk_destroy((void *)&(conn->qblocks[i]));
-        }
 #ifdef HAVE_SSL
         if(conn->ssl)
         {
@@ -2122,82 +2759,97 @@ void conn_clean(CONN *conn)
         }
 #endif
         DEBUG_LOGGER(conn->logger, "over-clean conn[%p]", conn);
-        xmm_free(conn, sizeof(CONN));
+        xmm_tag_free(XMM_TAG_CONN, conn, sizeof(CONN));
     }
     return ;
 }
 
+/* methods shared by all connections */
+static CONNOPS conn_ops =
+{
+    .set                   = conn_set,
+    .get_service_id        = conn_get_service_id,
+    .set_watermark         = conn_set_watermark,
+    .writable              = conn_writable,
+    .close                 = conn_close,
+    .over                  = conn_over,
+    .terminate             = conn_terminate,
+    .start_cstate          = conn_start_cstate,
+    .over_cstate           = conn_over_cstate,
+    .wait_estate           = conn_wait_estate,
+    .over_estate           = conn_over_estate,
+    .set_timeout           = conn_set_timeout,
+    .over_timeout          = conn_over_timeout,
+    .timeout_handler       = conn_timeout_handler,
+    .wait_evtimeout        = conn_wait_evtimeout,
+    .wait_evstate          = conn_wait_evstate,
+    .over_evstate          = conn_over_evstate,
+    .push_message          = conn_push_message,
+    .outevent_handler      = conn_outevent_handler,
+    .read_handler          = conn_read_handler,
+    .write_handler         = conn_write_handler,
+    .send_handler          = conn_send_handler,
+    .packet_reader         = conn_packet_reader,
+    .packet_handler        = conn_packet_handler,
+    .oob_handler           = conn_oob_handler,
+    .chunk_handler         = conn_chunk_handler,
+    .data_handler          = conn_data_handler,
+    .bind_proxy            = conn_bind_proxy,
+    .proxy_handler         = conn_proxy_handler,
+    .proxy_read_handler    = conn_proxy_read_handler,
+    .close_proxy           = conn_close_proxy,
+    .push_exchange         = conn_push_exchange,
+    .transaction_handler   = conn_transaction_handler,
+    .save_cache            = conn_save_cache,
+    .save_header           = conn_save_header,
+    .chunk_reader          = conn_chunk_reader,
+    .chunk_reading         = conn_chunk_reading,
+    .read_chunk            = conn_read_chunk,
+    .recv_chunk            = conn_recv_chunk,
+    .recv2_chunk           = conn_recv2_chunk,
+    .push_chunk            = conn_push_chunk,
+    .push_shared           = conn_push_shared,
+    .push_shared_head      = conn_push_shared_head,
+    .recv_file             = conn_recv_file,
+    .push_file             = conn_push_file,
+    .push_fd               = conn_push_fd,
+    .send_chunk            = conn_send_chunk,
+    .over_chunk            = conn_over_chunk,
+    .newchunk              = conn_newchunk,
+    .mnewchunk             = conn_mnewchunk,
+    .freechunk             = conn_freechunk,
+    .buffer_handler        = conn_buffer_handler,
+    .chunkio_handler       = conn_chunkio_handler,
+    .free_handler          = conn_free_handler,
+    .end_handler           = conn_end_handler,
+    .writable_handler      = conn_writable_handler,
+    .dgram_handler         = conn_dgram_handler,
+    .shut_handler          = conn_shut_handler,
+    .shutout_handler       = conn_shutout_handler,
+    .set_session           = conn_set_session,
+    .over_session          = conn_over_session,
+    .newtask               = conn_newtask,
+    .add_multicast         = conn_add_multicast,
+    .reset_xids            = conn_reset_xids,
+    .reset_state           = conn_reset_state,
+    .reset                 = conn_reset,
+    .clean                 = conn_clean,
+};
+
 /* Initialize connection */
 CONN *conn_init()
 {
     CONN *conn = NULL;
 
-    if((conn = (CONN *)xmm_mnew(sizeof(CONN))))
+    if((conn = (CONN *)xmm_tag_mnew(XMM_TAG_CONN, sizeof(CONN))))
     {
         conn->groupid = -1;
         conn->index = -1;
         conn->gindex = -1;
         MUTEX_INIT(conn->mutex);
         //SENDQINIT(conn);
-        conn->set                   = conn_set;
-        conn->get_service_id        = conn_get_service_id;
-        conn->close                 = conn_close;
-        conn->over                  = conn_over;
-        conn->terminate             = conn_terminate;
-        conn->start_cstate          = conn_start_cstate;
-        conn->over_cstate           = conn_over_cstate;
-        conn->wait_estate           = conn_wait_estate;
-        conn->over_estate           = conn_over_estate;
-        conn->set_timeout           = conn_set_timeout;
-        conn->over_timeout          = conn_over_timeout;
-        conn->timeout_handler       = conn_timeout_handler;
-        conn->wait_evtimeout        = conn_wait_evtimeout;
-        conn->wait_evstate          = conn_wait_evstate;
-        conn->over_evstate          = conn_over_evstate;
-        conn->push_message          = conn_push_message;
-        conn->outevent_handler      = conn_outevent_handler;
-        conn->read_handler          = conn_read_handler;
-        conn->write_handler         = conn_write_handler;
-        conn->send_handler          = conn_send_handler;
-        conn->packet_reader         = conn_packet_reader;
-        conn->packet_handler        = conn_packet_handler;
-        conn->oob_handler           = conn_oob_handler;
-        conn->chunk_handler         = conn_chunk_handler;
-        conn->data_handler          = conn_data_handler;
-        conn->bind_proxy            = conn_bind_proxy;
-        conn->proxy_handler         = conn_proxy_handler;
-        conn->close_proxy           = conn_close_proxy;
-        conn->push_exchange         = conn_push_exchange;
-        conn->transaction_handler   = conn_transaction_handler;
-        conn->save_cache            = conn_save_cache;
-        conn->save_header           = conn_save_header;
-        conn->chunk_reader          = conn_chunk_reader;
-        conn->chunk_reading         = conn_chunk_reading;
-        conn->read_chunk            = conn_read_chunk;
-        conn->recv_chunk            = conn_recv_chunk;
-        conn->recv2_chunk           = conn_recv2_chunk;
-        conn->push_chunk            = conn_push_chunk;
-        conn->recv_file             = conn_recv_file;
-        conn->push_file             = conn_push_file;
-        conn->send_chunk            = conn_send_chunk;
-        conn->over_chunk            = conn_over_chunk;
-        conn->newchunk              = conn_newchunk;
-        conn->mnewchunk             = conn_mnewchunk;
-        conn->freechunk             = conn_freechunk;
-        conn->buffer_handler        = conn_buffer_handler;
-        conn->chunkio_handler       = conn_chunkio_handler;
-        conn->free_handler          = conn_free_handler;
-        conn->end_handler           = conn_end_handler;
-        conn->shut_handler          = conn_shut_handler;
-        conn->shutout_handler       = conn_shutout_handler;
-        conn->set_session           = conn_set_session;
-        conn->over_session          = conn_over_session;
-        conn->newtask               = conn_newtask;
-        conn->add_multicast         = conn_add_multicast;
-        conn->reset_xids            = conn_reset_xids;
-        conn->reset_state           = conn_reset_state;
-        conn->reset                 = conn_reset;
-        conn->clean                 = conn_clean;
+        conn->ops                   = &conn_ops;
+        conn->session               = &conn_session_none;
     }
     return conn;
 }
@@ -65,6 +65,9 @@ int conn_bind_proxy(CONN *conn, CONN *child);
 /* proxy data handler */
 int conn_proxy_handler(CONN *conn);
 
+/* proxy read handler, E_READ on blocking of proxy peer */
+void conn_proxy_read_handler(CONN *conn);
+
 /* close proxy */
 int conn_close_proxy(CONN *conn);
 
@@ -89,6 +92,12 @@ int conn_recv2_chunk(CONN *conn, int size, char *data, int ndata);
 /* push chunk */
 int conn_push_chunk(CONN *conn, void *chunk_data, int size);
 
+/* push reference of shared data */
+int conn_push_shared(CONN *conn, void *shared);
+
+/* push copy of head then reference of shared data from off in one chunk */
+int conn_push_shared_head(CONN *conn, void *head, int nhead, void *shared, int off);
+
 /* over chunk */
 int conn_over_chunk(CONN *conn);
 
@@ -104,12 +113,18 @@ CB_DATA* conn_mnewchunk(CONN *conn, int size);
 /* freechunk */
 void conn_freechunk(CONN *conn, CB_DATA *chunk);
 
+/* free blocks of send queue */
+void conn_free_qblocks(CONN *conn);
+
 /* receive chunk file */
 int conn_recv_file(CONN *conn, char *file, long long offset, long long size);
 
 /* push chunk file */
 int conn_push_file(CONN *conn, char *file, long long offset, long long size);
 
+/* push chunk of opened file, fd closed by connection when pushed */
+int conn_push_fd(CONN *conn, int fd, long long offset, long long size);
+
 /* send chunk */
 int conn_send_chunk(CONN *conn, CB_DATA *chunk, int len);
 
@@ -131,6 +146,15 @@ int conn_transaction_handler(CONN *conn, int tid);
 /* timeout handler */
 int conn_timeout_handler(CONN *conn);
 
+/* datagram handler */
+int conn_dgram_handler(CONN *conn, void *dgram);
+
+/* set send queue watermarks in bytes and chunks, 0 for none */
+int conn_set_watermark(CONN *conn, int high, int low, int nhigh, int nlow);
+
+/* send queue under high watermark */
+int conn_writable(CONN *conn);
+
 /* evtimer handler */
 void conn_evtimer_handler(void *arg);
 
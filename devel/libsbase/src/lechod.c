@@ -40,7 +40,7 @@ int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
 
     if(conn && dir && path && (dirp = opendir(dir)))
     {
-        if((block = conn->newchunk(conn, HTTP_VIEW_SIZE)))
+        if((block = conn->ops->newchunk(conn, HTTP_VIEW_SIZE)))
         {
             p = pp = block->data;
             p += sprintf(p, "<html><head><title>Indexes Of %s </title>"
@@ -129,11 +129,11 @@ int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
             }
             p += sprintf(p, "Date: ");p += GMTstrdate(time(NULL), p);p += sprintf(p, "\r\n");
             p += sprintf(p, "Server: xhttpd/%s\r\n\r\n", XHTTPD_VERSION);
-            conn->push_chunk(conn, buf, p - buf);
-            if(conn->send_chunk(conn, block, len) != 0)
-                conn->freechunk(conn, block);
+            conn->ops->push_chunk(conn, buf, p - buf);
+            if(conn->ops->send_chunk(conn, block, len) != 0)
+                conn->ops->freechunk(conn, block);
             //fprintf(stdout, "buf:%s pp:%s\n", buf, pp);
-            if(!keepalive) conn->over(conn);
+            if(!keepalive) conn->ops->over(conn);
         }
         closedir(dirp);
         return 0;
@@ -160,14 +160,14 @@ int lechod_packet_handler(CONN *conn, CB_DATA *packet)
         char buf[4096], *s = "sdklhafkllllllllllllllllllllllllllllllllllllllllllllllllllllllllllllhflkdfklasdjfkldsakfldsalkfkasdfjksdjfkdasjfklasdjfklsdjfklsjdkfljdssssssssssssssssssssssssssssssssssssssssldkfjsakldjflkajsdfkljadkfjkldajfkljd";x = strlen(s);
         if(keepalive)
         {
-            n = sprintf(buf, "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->push_chunk(conn, buf, n); 
+            n = sprintf(buf, "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->ops->push_chunk(conn, buf, n); 
         }
         else
         {
-            n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->push_chunk(conn, buf, n); 
+            n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->ops->push_chunk(conn, buf, n); 
 
         }
-        if(keepalive == 0) conn->over(conn); 
+        if(keepalive == 0) conn->ops->over(conn); 
         return 0;
         /*
         */
@@ -183,9 +183,9 @@ int lechod_data_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DATA *ch
 
 int lechod_oob_handler(CONN *conn, CB_DATA *oob)
 {
-    if(conn && conn->push_chunk)
+    if(conn && conn->ops->push_chunk)
     {
-        conn->push_chunk((CONN *)conn, ((CB_DATA *)oob)->data, oob->ndata);
+        conn->ops->push_chunk((CONN *)conn, ((CB_DATA *)oob)->data, oob->ndata);
         return oob->ndata;
     }
     return -1;
@@ -207,6 +207,7 @@ static void lechod_stop(int sig){
 int sbase_initialize(SBASE *sbase, char *conf)
 {
 	char *s = NULL, *p = NULL, *cacert_file = NULL, *privkey_file = NULL;
+	int n = 0;
 	if((dict = iniparser_new(conf)) == NULL)
 	{
 		fprintf(stderr, "Initializing conf:%s failed, %s\n", conf, strerror(errno));
@@ -216,6 +217,7 @@ int sbase_initialize(SBASE *sbase, char *conf)
 	sbase->nchilds = iniparser_getint(dict, "SBASE:nchilds", 0);
 	sbase->connections_limit = iniparser_getint(dict, "SBASE:connections_limit", SB_CONN_MAX);
 	sbase->usec_sleep = iniparser_getint(dict, "SBASE:usec_sleep", SB_USEC_SLEEP);
+	if((n = iniparser_getint(dict, "SBASE:evopid", -1)) >= 0) evbase_prefer_evops(n);
 	sbase->set_log(sbase, iniparser_getstr(dict, "SBASE:logfile"));
     sbase->set_log_level(sbase, iniparser_getint(dict, "SBASE:log_level", 0));
 	sbase->set_evlog(sbase, iniparser_getstr(dict, "SBASE:evlogfile"));
@@ -259,6 +261,15 @@ int sbase_initialize(SBASE *sbase, char *conf)
         service->session.packet_delimiter_length = strlen(service->session.packet_delimiter);
     }
 	service->session.buffer_size = iniparser_getint(dict, "LECHOD:buffer_size", SB_BUF_SIZE);
+    if(service->sock_type == SOCK_DGRAM)
+    {
+        if(iniparser_getint(dict, "LECHOD:is_dgram", 0))
+            service->session.flags |= SB_DGRAM;
+        if(iniparser_getint(dict, "LECHOD:is_dgram_gso", 0))
+            service->session.flags |= SB_DGRAM_GSO;
+        if(iniparser_getint(dict, "LECHOD:is_dgram_gro", 0))
+            service->session.flags |= SB_DGRAM_GRO;
+    }
 	service->session.packet_reader = &lechod_packet_reader;
 	service->session.packet_handler = &lechod_packet_handler;
 	service->session.data_handler = &lechod_data_handler;
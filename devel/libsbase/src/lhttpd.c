@@ -4,6 +4,7 @@
 #include <sbase.h>
 #include <time.h>
 #include <sys/stat.h>
+#include "stime.h"
 static SBASE *sbase = NULL;
 static SERVICE *lhttpd = NULL;
 static char *httpd_home = "/tmp";
@@ -29,36 +30,6 @@ do
     }                                                                               \
     else *pp++ = *s++;                                                              \
 }while(0)
-int GMTstrdate(time_t times, char *date)
-{
-    static char *_wdays_[]={"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
-    static char *_ymonths_[]= {"Jan", "Feb", "Mar","Apr", "May", "Jun",
-        "Jul", "Aug", "Sep","Oct", "Nov", "Dec"};
-    struct tm *tp = NULL;
-    time_t timep = 0;
-    int n = 0;
-
-    if(date)
-    {
-        if(times > 0)
-        {
-            tp = gmtime(&times);
-        }
-        else
-        {
-            time(&timep);
-            tp = gmtime(&timep);
-        }
-        if(tp)
-        {
-            n = sprintf(date, "%s, %02d %s %d %02d:%02d:%02d GMT",
-                    _wdays_[tp->tm_wday], tp->tm_mday, 
-                    _ymonths_[tp->tm_mon], 1900+tp->tm_year, 
-                    tp->tm_hour, tp->tm_min, tp->tm_sec);
-        }
-    }
-    return n;
-}
 int lhttpd_packet_handler(CONN *conn, CB_DATA *packet)
 {
     char *s = NULL, *end = NULL, *p = NULL, 
@@ -102,32 +73,32 @@ int lhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                     p += sprintf(p, "HTTP/1.0 200 OK\r\nContent-Length: %lld\r\n"
                             "Last-Modified:", LL(st.st_size));
                     p += GMTstrdate(st.st_mtime, p);p += sprintf(p, "%s", "\r\n");
-                    p += sprintf(p, "Date: ");p += GMTstrdate(time(NULL), p);
+                    p += sprintf(p, "Date: ");p += stime_date(p);
                     p += sprintf(p, "\r\n");
                     if(keepalive) p += sprintf(p, "Connection: Keep-Alive\r\n");
                     else p += sprintf(p, "Connection: close\r\n");
                     p += sprintf(p, "Server: lhttpd/%s\r\n\r\n", LHTTPD_VERSION);
-                    conn->push_chunk(conn, line, (p - line));
-                    conn->push_file(conn, path, 0, st.st_size);
+                    conn->ops->push_chunk(conn, line, (p - line));
+                    conn->ops->push_file(conn, path, 0, st.st_size);
                     if(keepalive) 
-                        conn->set_timeout(conn, HTTP_TIMEOUT);
+                        conn->ops->set_timeout(conn, HTTP_TIMEOUT);
                     else
-                        conn->over(conn);
+                        conn->ops->over(conn);
                     return 0;
                 }
                 else
                 {
-                    conn->push_chunk(conn, HTTP_FORBIDDEN, strlen(HTTP_FORBIDDEN));
-                    return conn->over(conn);
+                    conn->ops->push_chunk(conn, HTTP_FORBIDDEN, strlen(HTTP_FORBIDDEN));
+                    return conn->ops->over(conn);
                 }
             }
         }
 err:
-        conn->push_chunk(conn, HTTP_BAD_REQUEST, strlen(HTTP_BAD_REQUEST));
-        return conn->over(conn);
+        conn->ops->push_chunk(conn, HTTP_BAD_REQUEST, strlen(HTTP_BAD_REQUEST));
+        return conn->ops->over(conn);
 not_found:
-        conn->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
-        return conn->over(conn);
+        conn->ops->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
+        return conn->ops->over(conn);
     }
     return -1;
 }
@@ -135,7 +106,7 @@ int lhttpd_timeout_handler(CONN *conn)
 {
     if(conn)
     {
-        conn->close(conn);
+        conn->ops->close(conn);
         return 0;
     }
     return -1;
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "http.h"
+#include "mtrie.h"
+#include "alog.h"
+#define LOGCAT_FILES_MAX    1024
+#define LOGCAT_INCREMENT    65536
+#define LOGCAT_TEXT         0x00
+#define LOGCAT_CSV          0x01
+typedef struct _LOGSTR
+{
+    char *s;
+    int n;
+}LOGSTR;
+typedef struct _LOGFILE
+{
+    char *name;
+    char *data;
+    off_t size;
+}LOGFILE;
+static LOGFILE files[LOGCAT_FILES_MAX];
+static int nfiles = 0;
+static LOGSTR *strs = NULL;
+static int nstrs = 0;
+static int strs_size = 0;
+static void *map = NULL;
+static char *ymonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/* check record at p, return record length or -1 */
+static int logcat_record(char *p, char *end)
+{
+    ALOGHEAD *head = (ALOGHEAD *)p;
+    int min = 0;
+
+    if((end - p) < (int)sizeof(ALOGHEAD)) return -1;
+    switch(head->type)
+    {
+        case ALOG_BEGIN:
+            min = sizeof(ALOGBEGIN);
+            break;
+        case ALOG_STRING:
+            min = sizeof(ALOGSTRING);
+            break;
+        case ALOG_ACCESS:
+            min = sizeof(ALOGACCESS);
+            break;
+        default:
+            return -1;
+    }
+    if(head->len < min || head->len > (end - p)) return -1;
+    if(head->type == ALOG_BEGIN && ((ALOGBEGIN *)p)->magic != ALOG_MAGIC) return -1;
+    if(head->type == ALOG_STRING && ((ALOGSTRING *)p)->nstring != (head->len - min)) return -1;
+    return head->len;
+}
+
+/* map file */
+static int logcat_open(LOGFILE *file)
+{
+    struct stat st = {0};
+    int fd = -1;
+
+    if((fd = open(file->name, O_RDONLY)) < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "open %s failed, %s\n", file->name, strerror(errno));
+        if(fd >= 0) close(fd);
+        return -1;
+    }
+    file->size = st.st_size;
+    if(file->size > 0 && (file->data = (char *)mmap(NULL, file->size, PROT_READ,
+                    MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap %s failed, %s\n", file->name, strerror(errno));
+        file->data = NULL;
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* pass one, collect string definitions of all files by epoch and id */
+static int logcat_strings(LOGFILE *file)
+{
+    char *p = file->data, *end = file->data + file->size, key[32];
+    ALOGSTRING *def = NULL;
+    LOGSTR *old = NULL;
+    int n = 0, nkey = 0;
+
+    while(p < end)
+    {
+        if((n = logcat_record(p, end)) < 0)
+        {
+            fprintf(stderr, "%s: bad record at offset %lld\n", file->name, (long long)(p - file->data));
+            return -1;
+        }
+        if(((ALOGHEAD *)p)->type == ALOG_STRING)
+        {
+            def = (ALOGSTRING *)p;
+            if(nstrs == strs_size)
+            {
+                old = strs;
+                if((strs = (LOGSTR *)realloc(strs, sizeof(LOGSTR)
+                                * (strs_size + LOGCAT_INCREMENT))) == NULL)
+                {
+                    free(old);
+                    return -1;
+                }
+                strs_size += LOGCAT_INCREMENT;
+            }
+            strs[nstrs].s = p + sizeof(ALOGSTRING);
+            strs[nstrs].n = def->nstring;
+            nkey = sprintf(key, "%x:%x", def->epoch, def->id);
+            mtrie_add(map, key, nkey, ++nstrs);
+        }
+        p += n;
+    }
+    return 0;
+}
+
+/* string of id in epoch */
+static LOGSTR *logcat_string(int epoch, int id)
+{
+    static LOGSTR empty = {"", 0}, unknown = {"-", 1};
+    char key[32];
+    int x = 0, nkey = 0;
+
+    if(id == 0) return &empty;
+    nkey = sprintf(key, "%x:%x", epoch, id);
+    if((x = mtrie_get(map, key, nkey)) > 0) return &(strs[x - 1]);
+    return &unknown;
+}
+
+/* csv field */
+static void logcat_csv(char *s, int n, int last)
+{
+    char *end = s + n;
+
+    fputc('"', stdout);
+    while(s < end)
+    {
+        if(*s == '"') fputc('"', stdout);
+        fputc(*s++, stdout);
+    }
+    fputc('"', stdout);
+    fputc((last ? '\n' : ','), stdout);
+    return ;
+}
+
+/* pass two, print access records */
+static void logcat_print(LOGFILE *file, int format)
+{
+    char *p = file->data, *end = file->data + file->size, ip[INET_ADDRSTRLEN],
+         date[64], *status = NULL, *method = NULL;
+    LOGSTR *host = NULL, *agent = NULL, *referer = NULL;
+    ALOGACCESS *rec = NULL;
+    struct tm tm = {0};
+    time_t sec = 0;
+    int n = 0;
+
+    while(p < end && (n = logcat_record(p, end)) > 0)
+    {
+        if(((ALOGHEAD *)p)->type == ALOG_ACCESS)
+        {
+            rec = (ALOGACCESS *)p;
+            sec = (time_t)rec->sec;
+            localtime_r(&sec, &tm);
+            inet_ntop(AF_INET, &(rec->ip), ip, INET_ADDRSTRLEN);
+            status = (rec->status < HTTP_RESPONSE_NUM) ? response_status[rec->status].e : "-";
+            method = (rec->method < HTTP_METHOD_NUM) ? http_methods[rec->method].e : "-";
+            host = logcat_string(rec->epoch, rec->host);
+            agent = logcat_string(rec->epoch, rec->agent);
+            referer = logcat_string(rec->epoch, rec->referer);
+            if(format == LOGCAT_CSV)
+            {
+                fprintf(stdout, "%04d-%02d-%02d %02d:%02d:%02d,%06u,%s,", 1900+tm.tm_year,
+                        tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, rec->usec, status);
+                logcat_csv(host->s, host->n, 0);
+                fprintf(stdout, "%s,", method);
+                logcat_csv(p + sizeof(ALOGACCESS), rec->head.len - sizeof(ALOGACCESS), 0);
+                fprintf(stdout, "%s,%d,", ip, rec->port);
+                logcat_csv(agent->s, agent->n, 0);
+                logcat_csv(referer->s, referer->n, 1);
+            }
+            else
+            {
+                sprintf(date, "[%02d/%s/%04d:%02d:%02d:%02d +%06u]", tm.tm_mday, ymonths[tm.tm_mon],
+                        1900+tm.tm_year, tm.tm_hour, tm.tm_min, tm.tm_sec, rec->usec);
+                fprintf(stdout, "%s %s host[%.*s] %s[%.*s] remote[%s:%d] agent[%.*s] referer[%.*s]\r\n",
+                        date, status, host->n, host->s, method, (int)(rec->head.len - sizeof(ALOGACCESS)),
+                        p + sizeof(ALOGACCESS), ip, rec->port, agent->n, agent->s, referer->n, referer->s);
+            }
+        }
+        p += n;
+    }
+    return ;
+}
+
+int main(int argc, char **argv)
+{
+    int i = 0, ch = 0, format = LOGCAT_TEXT, ret = 0;
+
+    while((ch = getopt(argc, argv, "c")) != -1)
+    {
+        switch(ch)
+        {
+            case 'c':
+                format = LOGCAT_CSV;
+                break;
+            case '?':
+            default:
+                goto usage;
+        }
+    }
+    if(optind >= argc) goto usage;
+    if((map = mtrie_init()) == NULL) return -1;
+    /* records may land in file after one defined strings, resolve over all files */
+    for(i = optind; i < argc && nfiles < LOGCAT_FILES_MAX; i++)
+    {
+        files[nfiles].name = argv[i];
+        if(logcat_open(&(files[nfiles])) != 0) {ret = -1; continue;}
+        if(logcat_strings(&(files[nfiles])) != 0) ret = -1;
+        ++nfiles;
+    }
+    if(format == LOGCAT_CSV)
+        fprintf(stdout, "time,usec,status,host,method,path,remote_ip,remote_port,agent,referer\n");
+    for(i = 0; i < nfiles; i++) logcat_print(&(files[i]), format);
+    for(i = 0; i < nfiles; i++)
+    {
+        if(files[i].data) munmap(files[i].data, files[i].size);
+    }
+    if(strs) free(strs);
+    mtrie_clean(map);
+    return ret;
+usage:
+    fprintf(stderr, "Usage:%s [-c] access.alog ...\n"
+            "\t-c output csv instead of text access log\n", argv[0]);
+    return -1;
+}
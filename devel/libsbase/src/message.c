@@ -1,5 +1,6 @@
 #include "message.h"
 #include "sbase.h"
+#include "service.h"
 #include "logger.h"
 #include "mutex.h"
 #include "xmm.h"
@@ -46,7 +47,7 @@ void qmessage_push(void *qmsg, int id, int index, int fd, int tid,
             if((i = q->nlist) < QMSG_LINE_MAX)
             {
                 //fprintf(stdout, "%s::%d q:%p qtotal:%d total:%d left:%d nlist:%d\n", __FILE__, __LINE__, q, q->qtotal, q->total, q->nleft, q->nlist);
-                if((msg = (MESSAGE *)xmm_new(QMSG_LINE_NUM * sizeof(MESSAGE))))
+                if((msg = (MESSAGE *)xmm_tag_new(XMM_TAG_QUEUE, QMSG_LINE_NUM * sizeof(MESSAGE))))
                 {
                     q->list[i] = msg;
                     q->nlist++;
@@ -122,7 +123,7 @@ void qmessage_clean(void *qmsg)
     {
         for(i = 0; i < q->nlist; i++)
         {
-            xmm_free(q->list[i], QMSG_LINE_NUM * sizeof(MESSAGE));
+            xmm_tag_free(XMM_TAG_QUEUE, q->list[i], QMSG_LINE_NUM * sizeof(MESSAGE));
         }
         MUTEX_DESTROY(q->mutex);
         xmm_free(q, sizeof(QMESSAGE));
@@ -193,9 +194,9 @@ void qmessage_handler(void *qmsg, void *logger)
             {
                 ERROR_LOGGER(logger, "Invalid MESSAGE[%d/%s] msg->fd[%d] conn->fd[%d] handler[%p] "
                         "parent[%p] service[%p]", msg->msg_id, messagelist[msg->msg_id], msg->fd, fd, conn, pth, pth->service);
-                goto next;
+                goto drop;
             }
-            if(index >= 0 && pth->service->connections[index] != conn) goto next;
+            if(index >= 0 && pth->service->connections[index] != conn) goto drop;
             DEBUG_LOGGER(logger, "Got message[%s] total[%d/%d] left:%d On service[%s] procthread[%p] "
                     "connection[%p][%s:%d] d_state:%d local[%s:%d] via %d", messagelist[msg->msg_id],
                     q->total, q->qtotal, q->nleft, pth->service->service_name, pth, 
@@ -208,13 +209,13 @@ void qmessage_handler(void *qmsg, void *logger)
                     pth->add_connection(pth, conn);
                     break;
                 case MESSAGE_SHUT :
-                    conn->shut_handler(conn);
+                    conn->ops->shut_handler(conn);
                     break;
                 case MESSAGE_SHUTOUT :
-                    conn->shutout_handler(conn);
+                    conn->ops->shutout_handler(conn);
                     break;
                 case MESSAGE_OUT :
-                    conn->outevent_handler(conn);
+                    conn->ops->outevent_handler(conn);
                     break;
                 case MESSAGE_OVER :
                     pth->over_connection(pth, conn);
@@ -223,42 +224,56 @@ void qmessage_handler(void *qmsg, void *logger)
                     pth->terminate_connection(pth, conn);
                     break;
                 case MESSAGE_INPUT :
-                    conn->read_handler(conn);
+                    conn->ops->read_handler(conn);
                     break;
                 case MESSAGE_OUTPUT :
-                    conn->write_handler(conn);
+                    conn->ops->write_handler(conn);
                     break;
                 case MESSAGE_BUFFER:
-                    conn->buffer_handler(conn);
+                    conn->ops->buffer_handler(conn);
                     break;
                 case MESSAGE_PACKET :
-                    conn->packet_handler(conn);
+                    conn->ops->packet_handler(conn);
                     break;
                 case MESSAGE_CHUNK :
-                    conn->chunk_handler(conn);
+                    conn->ops->chunk_handler(conn);
                     break;
                 case MESSAGE_CHUNKIO :
-                    conn->chunkio_handler(conn);
+                    conn->ops->chunkio_handler(conn);
                     break;
                 case MESSAGE_DATA :
-                    conn->data_handler(conn);
+                    conn->ops->data_handler(conn);
                     break;
                 case MESSAGE_END :
-                    conn->end_handler(conn);
+                    conn->ops->end_handler(conn);
+                    break;
+                case MESSAGE_WRITABLE :
+                    conn->ops->writable_handler(conn);
+                    break;
+                case MESSAGE_DGRAM :
+                    conn->ops->dgram_handler(conn, msg->arg);
                     break;
                 case MESSAGE_FREE :
-                    conn->free_handler(conn);
+                    conn->ops->free_handler(conn);
                     break;
                 case MESSAGE_TRANSACTION :
-                    conn->transaction_handler(conn, msg->tid);
+                    conn->ops->transaction_handler(conn, msg->tid);
                     break;
                 case MESSAGE_TIMEOUT :
-                    conn->timeout_handler(conn);
+                    conn->ops->timeout_handler(conn);
                     break;
                 case MESSAGE_PROXY :
-                    conn->proxy_handler(conn);
+                    conn->ops->proxy_handler(conn);
+                    break;
+                case MESSAGE_PROXY_READ :
+                    conn->ops->proxy_read_handler(conn);
                     break;
             }
+            goto next;
+drop:
+            /* datagram batch not handled goes back to service */
+            if(msg->msg_id == MESSAGE_DGRAM && msg->arg && pth && pth->service)
+                service_dgram_free(pth->service, (DGRAM *)msg->arg);
 next:
             qmessage_left(qmsg, msg);
         }
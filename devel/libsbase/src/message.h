@@ -35,7 +35,10 @@ extern "C" {
 #define MESSAGE_OUT             0x15
 #define MESSAGE_FREE            0x16
 #define MESSAGE_CHUNKIO         0x17
-#define MESSAGE_MAX		        0x17
+#define MESSAGE_WRITABLE        0x18
+#define MESSAGE_DGRAM           0x19
+#define MESSAGE_PROXY_READ      0x1a
+#define MESSAGE_MAX		        0x1a
 static char *messagelist[] = 
 {
     "",
@@ -61,7 +64,10 @@ static char *messagelist[] =
 	"MESSAGE_SHUTOUT",
     "MESSAGE_OUT",
     "MESSAGE_FREE",
-    "MESSAGE_CHUNKIO"
+    "MESSAGE_CHUNKIO",
+    "MESSAGE_WRITABLE",
+    "MESSAGE_DGRAM",
+    "MESSAGE_PROXY_READ"
 };
 typedef struct _MESSAGE
 {
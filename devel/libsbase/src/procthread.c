@@ -114,6 +114,7 @@ void procthread_run(void *arg)
             do
             {
                 i = pth->evbase->loop(pth->evbase, 0, NULL);
+                stime_tick();
                 if(pth->service->flag & SB_LOG_THREAD)
                 {
                     if(pth == pth->service->outdaemon)
@@ -186,6 +187,7 @@ void procthread_run(void *arg)
                 do
                 {
                     //DEBUG_LOGGER(pth->logger, "starting threads[%p]->qmessage[%p]_handler(%d)", (void *)(pth->threadid),pth->message_queue, QMTOTAL(pth->message_queue));
+                    stime_tick();
                     if(pth->evtimer){EVTIMER_CHECK(pth->evtimer);}
                     if(pth->message_queue && QMTOTAL(pth->message_queue) > 0)
                     {
@@ -280,6 +282,7 @@ int procthread_newconn(PROCTHREAD *pth, int fd, void *ssl)
             }
 #endif
             DEBUG_LOGGER(pth->logger, "adding new-connection[%d] failed,%s", fd, strerror(errno));
+            service_release_acl(service, fd);
             shutdown(fd, SHUT_RDWR);
             close(fd);
         }
@@ -319,7 +322,7 @@ int procthread_add_connection(PROCTHREAD *pth, CONN *conn)
         conn->outevbase     = pth->outevbase;
         conn->parent        = pth;
         conn->service       = pth->service;
-        if(pth->service->pushconn(pth->service, conn) == 0 && conn->set(conn) == 0)
+        if(pth->service->pushconn(pth->service, conn) == 0 && conn->ops->set(conn) == 0)
         {
             DEBUG_LOGGER(pth->logger, "Ready for add conn[%p][%s:%d] d_state:%d on %s:%d via %d to pool", conn, conn->remote_ip, conn->remote_port, conn->d_state, conn->local_ip, conn->local_port, conn->fd);
         }
@@ -374,14 +377,14 @@ int procthread_terminate_connection(PROCTHREAD *pth, CONN *conn)
     if(pth && conn)
     {
         ret = pth->service->popconn(pth->service, conn);
-        ret = conn->terminate(conn);
+        ret = conn->ops->terminate(conn);
         if(pth->lock)
         {
-            conn->clean(conn);
+            conn->ops->clean(conn);
         }
         else
         {
-            conn->reset(conn);
+            conn->ops->reset(conn);
             service_pushtoq(pth->service, conn);
         }
     }
@@ -0,0 +1,185 @@
+/* proxy read-side backpressure test, run by make check:
+ * upstream writes as fast as it can through the proxy service to a throttled client,
+ * failed when data lost or RSS of process grows over ceiling, with splice() and copy */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sbase.h>
+#define PT_PROXY_PORT       19961
+#define PT_UPSTREAM_PORT    19962
+#define PT_TOTAL            67108864
+#define PT_CEILING          25165824
+#define PT_WRITE_SIZE       65536
+#define PT_READ_SIZE        16384
+#define PT_READ_USEC        500
+#define PT_PATTERN(off)     ((unsigned char)((off) % 251))
+static SBASE *sbase = NULL;
+static SERVICE *service = NULL;
+static int upstream_fd = -1;
+static int is_copy = 0;
+static int result = -1;
+
+/* upstream writes PT_TOTAL bytes of pattern to each connection */
+static void *proxytest_upstream(void *arg)
+{
+    unsigned char buf[PT_WRITE_SIZE];
+    long long off = 0;
+    int fd = -1, i = 0, n = 0;
+
+    while((fd = accept(upstream_fd, NULL, NULL)) > 0)
+    {
+        for(off = 0; off < PT_TOTAL; off += n)
+        {
+            for(i = 0; i < PT_WRITE_SIZE; i++) buf[i] = PT_PATTERN(off + i);
+            if((n = write(fd, buf, PT_WRITE_SIZE)) <= 0) break;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/* bind client to a new upstream connection */
+int proxytest_packet_handler(CONN *conn, CB_DATA *packet)
+{
+    SESSION session = {0};
+    CONN *child = NULL;
+
+    if(conn)
+    {
+        /* no splice() to client, proxied data queued in user space */
+        if(is_copy) conn->pipe_size = -1;
+        session.packet_type = PACKET_PROXY;
+        if((child = service->newproxy(service, conn, -1, -1, "127.0.0.1",
+                        PT_UPSTREAM_PORT, &session)))
+        {
+            conn->xsession.packet_type = PACKET_PROXY;
+            child->ops->start_cstate(child);
+            return 0;
+        }
+        fprintf(stderr, "proxy to upstream failed, %s\n", strerror(errno));
+    }
+    return -1;
+}
+
+/* resident bytes of process */
+static long long proxytest_rss()
+{
+    long long size = 0, rss = 0;
+    FILE *fp = NULL;
+
+    if((fp = fopen("/proc/self/statm", "r")))
+    {
+        if(fscanf(fp, "%lld %lld", &size, &rss) != 2) rss = 0;
+        fclose(fp);
+    }
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+/* throttled client, 0 when all data came under memory ceiling */
+static int proxytest_client(char *mode)
+{
+    long long total = 0, base = 0, max = 0, rss = 0;
+    unsigned char buf[PT_READ_SIZE];
+    int fd = -1, n = 0, i = 0, nread = 0, bad = 0, opt = PT_READ_SIZE;
+    struct sockaddr_in sa = {0};
+
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sa.sin_port = htons(PT_PROXY_PORT);
+    if(connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || write(fd, "PROXY\r\n", 7) != 7)
+    {
+        fprintf(stderr, "connect to proxy failed, %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    max = base = proxytest_rss();
+    while(total < PT_TOTAL && (n = read(fd, buf, PT_READ_SIZE)) > 0)
+    {
+        for(i = 0; i < n; i++)
+        {
+            if(buf[i] != PT_PATTERN(total + i)) bad++;
+        }
+        total += n;
+        if((++nread % 64) == 0 && (rss = proxytest_rss()) > max) max = rss;
+        usleep(PT_READ_USEC);
+    }
+    close(fd);
+    fprintf(stdout, "%s: received %lld/%d bytes bad:%d rss %lld KB grew %lld KB (ceiling %d KB)\n",
+            mode, total, PT_TOTAL, bad, base/1024, (max - base)/1024, PT_CEILING/1024);
+    if(total == PT_TOTAL && bad == 0 && max - base < PT_CEILING) return 0;
+    return -1;
+}
+
+static void *proxytest_run(void *arg)
+{
+    usleep(200000);
+    is_copy = 0;
+    if(proxytest_client("splice") == 0)
+    {
+        is_copy = 1;
+        if(proxytest_client("copy") == 0) result = 0;
+    }
+    sbase->stop(sbase);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in sa = {0};
+    pthread_t upstream, client;
+    int opt = 1;
+
+    setlocale(LC_ALL, "C");
+    signal(SIGPIPE, SIG_IGN);
+    if((upstream_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) _exit(-1);
+    setsockopt(upstream_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sa.sin_port = htons(PT_UPSTREAM_PORT);
+    if(bind(upstream_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(upstream_fd, 8) != 0)
+    {
+        fprintf(stderr, "listen on %d failed, %s\n", PT_UPSTREAM_PORT, strerror(errno));
+        _exit(-1);
+    }
+    if((sbase = sbase_init()) == NULL || (service = service_init()) == NULL)
+    {
+        exit(EXIT_FAILURE);
+    }
+    sbase->nchilds = 0;
+    sbase->usec_sleep = SB_USEC_SLEEP;
+    service->family = AF_INET;
+    service->sock_type = SOCK_STREAM;
+    service->ip = "127.0.0.1";
+    service->port = PT_PROXY_PORT;
+    service->working_mode = WORKING_PROC;
+    service->service_type = S_SERVICE;
+    service->service_name = "proxytest";
+    service->nprocthreads = 1;
+    service->session.packet_type = PACKET_DELIMITER;
+    service->session.packet_delimiter = "\r\n";
+    service->session.packet_delimiter_length = 2;
+    service->session.buffer_size = SB_BUF_SIZE;
+    service->session.packet_handler = &proxytest_packet_handler;
+    if(sbase->add_service(sbase, service) != 0)
+    {
+        fprintf(stderr, "add service failed, %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pthread_create(&upstream, NULL, &proxytest_upstream, NULL);
+    pthread_create(&client, NULL, &proxytest_run, NULL);
+    sbase->running(sbase, 0);
+    pthread_join(client, NULL);
+    sbase->clean(sbase);
+    fprintf(stdout, "proxytest %s\n", (result == 0) ? "passed" : "failed");
+    return (result == 0) ? 0 : 1;
+}
@@ -8,6 +8,7 @@
 #include "logger.h"
 #include "message.h"
 #include "evtimer.h"
+#include "stime.h"
 #include "xssl.h"
 #include "xmm.h"
 /* set rlimit */
@@ -275,6 +276,8 @@ running:
         {
             //running evbase 
             i = sbase->evbase->loop(sbase->evbase, 0, &tv);
+            //refresh clock cache
+            stime_tick();
             //check evtimer for heartbeat and timeout
             EVTIMER_CHECK(sbase->evtimer);
             //running message queue
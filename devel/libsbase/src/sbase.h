@@ -22,6 +22,7 @@ extern "C" {
 #define SB_IP_MAX               16
 #define SB_XIDS_MAX             16
 #define SB_GROUPS_MAX           256
+#define SB_STEMPLATES_MAX       256
 #define SB_SERVICE_MAX          256
 #define SB_THREADS_MAX          256
 #define SB_INIT_CONNS           256
@@ -33,6 +34,16 @@ extern "C" {
 #define SB_BUF_SIZE             65536
 #define SB_USEC_SLEEP           1000
 #define SB_PROXY_TIMEOUT        20000000
+#define SB_PROXY_SENDQ_HIGH     1048576
+#define SB_PROXY_SENDQ_LOW      262144
+/* datagrams of one recvmmsg() and sendmmsg() */
+#define SB_DGRAM_BATCH          16
+#define SB_DGRAM_SIZE           2048
+#define SB_DGRAM_GRO_SIZE       65536
+#define SB_DGRAM_FREE_MAX       8
+#define SB_DGRAM_GSO_SEGS       64
+#define SB_DGRAM_GSO_SIZE       1472
+#define SB_DGRAM_GSO_MAX        65000
 #define SB_HEARTBEAT_INTERVAL   1000000
 #define SB_NWORKING_TOSLEEP     20000
 #define SB_SCHED_FIFO           0x01
@@ -119,6 +130,13 @@ typedef struct _MMBLOCK
 #ifndef __TYPEDEF__CHUNK
 #define __TYPEDEF__CHUNK
 #define CHUNK_FILE_NAME_MAX     256
+/* immutable refcounted data sent by many chunks */
+typedef struct _CHUNK_SHARED
+{
+    int refs;
+    int ndata;
+    char data[1];
+}CHUNK_SHARED;
 typedef struct _CHUNK
 {
     char *data;
@@ -135,14 +153,37 @@ typedef struct _CHUNK
     off_t mmoff;
     char *mmap;
     char *end;
-    char filename[CHUNK_FILE_NAME_MAX];
+    /* allocated by chunk_file() */
+    char *filename;
+    /* referenced by chunk_shared(), end points into it */
+    CHUNK_SHARED *shared;
 }CHUNK;
 #endif
 typedef struct _QBLOCK
 {
     CHUNK chunk;
+    /* bytes counted to send queue */
+    long long nbytes;
+    /* peer of datagram with SB_DGRAM */
+    struct sockaddr_in addr;
     struct _QBLOCK *next;
 }QBLOCK;
+/* batch of datagrams read by recvmmsg() */
+typedef struct _DGRAM
+{
+    int count;
+    int lens[SB_DGRAM_BATCH];
+    /* segment size of datagrams coalesced by UDP_GRO, 0 for one datagram */
+    int segs[SB_DGRAM_BATCH];
+    struct sockaddr_in addrs[SB_DGRAM_BATCH];
+    struct _DGRAM *next;
+    /* slot size, SB_DGRAM_SIZE for one MTU or SB_DGRAM_GRO_SIZE with SB_DGRAM_GRO */
+    int size;
+    /* SB_DGRAM_BATCH slots of size after the struct */
+    char *data;
+}DGRAM;
+#define DGRAM_DATA(dgram, i) ((dgram)->data + (i) * (dgram)->size)
+#define DGRAM_BYTES(size) (sizeof(DGRAM) + SB_DGRAM_BATCH * (size))
 typedef struct _CB_DATA
 {
     char *data;
@@ -154,6 +195,12 @@ typedef struct _CB_DATA
 #define SB_USE_OOB      0x02
 #define SB_MULTICAST    0x04
 #define SB_NONBLOCK     0x08
+/* datagrams to packet_handler with peer address, no connection per peer */
+#define SB_DGRAM        0x10
+/* same size datagrams to one peer in one send with UDP_SEGMENT */
+#define SB_DGRAM_GSO    0x20
+/* coalesced datagrams read with UDP_GRO, with SB_DGRAM */
+#define SB_DGRAM_GRO    0x40
 typedef struct _SESSION
 {
     /* SSL/timeout */
@@ -167,6 +214,13 @@ typedef struct _SESSION
     int  buffer_size;
     int  groupid;
     int  multicast_ttl;
+    /* send queue watermarks in bytes and chunks, 0 for none */
+    int  sendq_high;
+    int  sendq_low;
+    int  sendq_nhigh;
+    int  sendq_nlow;
+    /* id of session template, set by service and checked before use */
+    int  stid;
     int  xids[SB_XIDS_MAX];
 
 
@@ -189,7 +243,28 @@ typedef struct _SESSION
     int (*evtimeout_handler)(struct _CONN *);
     int (*transaction_handler)(struct _CONN *, int tid);
     int (*ok_handler)(struct _CONN *);
+    /* send queue fell to low watermark after reaching high */
+    int (*writable_handler)(struct _CONN *);
 }SESSION;
+/* per connection part of session, the rest is shared from template */
+typedef struct _XSESSION
+{
+    int  packet_type;
+    int  timeout;
+    int  childid;
+    int  parentid;
+    void *child;
+    void *parent;
+}XSESSION;
+/* immutable session shared by reference among connections of service,
+ * kept till service clean so lookup by id needs no lock */
+typedef struct _STEMPLATE
+{
+    SESSION session;
+    int id;
+    int refs;
+    struct _SERVICE *service;
+}STEMPLATE;
 
 typedef void (CALLBACK)(void *);
 typedef struct _SBASE
@@ -295,6 +370,25 @@ typedef struct _SERVICE
     /* mutex */
     void *mutex;
 
+    /* session templates by id - 1, smutex for adding */
+    int nstemplates;
+    void *smutex;
+    STEMPLATE *stemplates[SB_STEMPLATES_MAX];
+
+    /* datagram connections of procthreads and free batches with SB_DGRAM */
+    int ndgconns;
+    int ndgrams;
+    DGRAM *dgrams;
+    void *dmutex;
+    struct _CONN *dgconns[SB_THREADS_MAX];
+
+    /* access control of accepted connections */
+    void *acl;
+    void *acl_next;
+    void *aclfds;
+    int naclfds;
+    int (*set_acl)(struct _SERVICE *service, char *rules, int len);
+
     /* heartbeat */
     void *heartbeat_arg;
     CALLBACK *heartbeat_handler;
@@ -363,6 +457,10 @@ typedef struct _SERVICE
     int (*add_multicast)(struct _SERVICE *service, char *multicast_ip);
     int (*drop_multicast)(struct _SERVICE *service, char *multicast_ip);
     int (*broadcast)(struct _SERVICE *service, char *data, int len);
+    /* shared data pushed to many connections by conn->push_shared() */
+    void *(*newshared)(struct _SERVICE *service, char *data, int len);
+    void (*refshared)(struct _SERVICE *service, void *shared);
+    void (*freeshared)(struct _SERVICE *service, void *shared);
 
     /* group */
     int (*addgroup)(struct _SERVICE *service, char *ip, int port, int limit, SESSION *session);
@@ -459,68 +557,9 @@ typedef struct _PROCTHREAD
     void (*clean)(struct _PROCTHREAD *procthread);
 }PROCTHREAD;
 /* CONN */
-typedef struct _CONN
+/* methods of connection, one table shared by all connections */
+typedef struct _CONNOPS
 {
-    int index;
-    int groupid;
-    int gindex;
-    int xindex;
-    int s_id;
-    int s_state;
-    int timeout;
-    int evstate;
-    int status;
-    int i_state;
-    int c_state;
-    int e_state;
-    int c_id;
-    int d_state;
-    int evid;
-    int qid;
-    int nqleft;
-    int qblock_max;
-    int  sock_type;
-    int  fd;
-    int  remote_port;
-    int  local_port;
-    int  nsendq;
-    int  flags;
-    /* xid */
-    int xids[SB_XIDS_MAX];
-    EVENT event;
-    EVENT outevent;
-    /* buffer */
-    MMBLOCK buffer;
-    MMBLOCK packet;
-    MMBLOCK cache;
-    MMBLOCK header;
-    MMBLOCK oob;
-    MMBLOCK exchange;
-    CHUNK chunk;
-    QBLOCK qblocks[SB_QBLOCK_MAX];
-    QBLOCK *qleft[SB_QBLOCK_MAX];
-    QBLOCK *qhead;
-    QBLOCK *qtail;
-    /* evbase */
-    void *mutex;
-    EVBASE *evbase;
-    EVBASE *outevbase;
-    void *parent;
-    void *queue;
-    void *service;
-    //void *xqueue;
-    /* SSL */
-    void *ssl;
-    /* evtimer */
-    void *evtimer;
-    /* logger and timer */
-    void *logger;
-    /* message queue */
-    void *indaemon;
-    void *outdaemon;
-    void *inqmessage;
-    void *outqmessage;
-    void *message_queue;
     int (*set)(struct _CONN *);
     int (*close)(struct _CONN *);
     int (*over)(struct _CONN *);
@@ -560,6 +599,7 @@ typedef struct _CONN
     int (*data_handler)(struct _CONN *);
     int (*bind_proxy)(struct _CONN *, struct _CONN *);
     int (*proxy_handler)(struct _CONN *);
+    void(*proxy_read_handler)(struct _CONN *);
     int (*close_proxy)(struct _CONN *);
     int (*push_exchange)(struct _CONN *, void *data, int size);
     int (*transaction_handler)(struct _CONN *, int );
@@ -574,7 +614,10 @@ typedef struct _CONN
     int (*recv2_chunk)(struct _CONN *, int size, char *data, int ndata);
     int (*recv_file)(struct _CONN *, char *file, long long offset, long long size);
     int (*push_chunk)(struct _CONN *, void *data, int size);
+    int (*push_shared)(struct _CONN *, void *shared);
+    int (*push_shared_head)(struct _CONN *, void *head, int nhead, void *shared, int off);
     int (*push_file)(struct _CONN *, char *file, long long offset, long long size);
+    int (*push_fd)(struct _CONN *, int fd, long long offset, long long size);
     int (*send_chunk)(struct _CONN *, CB_DATA *chunk, int len);
     int (*over_chunk)(struct _CONN *);
     CB_DATA* (*newchunk)(struct _CONN *, int size);
@@ -584,6 +627,8 @@ typedef struct _CONN
     void(*chunkio_handler)(struct _CONN *);
     void(*free_handler)(struct _CONN *);
     void(*end_handler)(struct _CONN *);
+    void(*writable_handler)(struct _CONN *);
+    int (*dgram_handler)(struct _CONN *, void *dgram);
     void(*shut_handler)(struct _CONN *);
     void(*shutout_handler)(struct _CONN *);
     
@@ -598,14 +643,94 @@ typedef struct _CONN
     int (*newtask)(struct _CONN *, CALLBACK *);
     int (*add_multicast)(struct _CONN *, char *);
     int (*get_service_id)(struct _CONN *);
-    char remote_ip[SB_IP_MAX];
-    char local_ip[SB_IP_MAX];
-    SESSION session;
+    /* send queue watermarks, producers pause while not writable */
+    int (*set_watermark)(struct _CONN *, int high, int low, int nhigh, int nlow);
+    int (*writable)(struct _CONN *);
+}CONNOPS;
+typedef struct _CONN
+{
+    /* hot, touched on every event, keep in first two cache lines */
+    int  fd;
+    int  d_state;
+    int  s_state;
+    int  e_state;
+    int  c_state;
+    int  i_state;
+    int  evstate;
+    int  evid;
+    int  nsendq;
+    int  index;
+    CONNOPS *ops;
+    QBLOCK *qhead;
+    QBLOCK *qtail;
+    void *mutex;
+    void *ssl;
+    void *logger;
+    MMBLOCK buffer;
+    /* warm */
+    MMBLOCK packet;
+    SESSION *session;
+    XSESSION xsession;
+    void *evtimer;
+    void *parent;
+    void *indaemon;
+    void *inqmessage;
+    EVBASE *evbase;
+    EVBASE *outevbase;
+    long long   recv_data_total;
+    long long   sent_data_total;
+    /* send queue bytes and watermarks */
+    long long   sendq_bytes;
+    int sendq_high;
+    int sendq_low;
+    int sendq_nhigh;
+    int sendq_nlow;
+    int sendq_full;
+    /* proxy peer reading stopped on this send queue */
+    int proxy_blocked;
+    /* pipe spliced from proxy peer, pipe_size -1 for no splice() */
+    int pipe_size;
+    int pipes[2];
+    /* datagram batch in handling and peer of replies with SB_DGRAM */
+    DGRAM *dgram;
+    struct sockaddr_in dgram_addr;
+    int timeout;
+    int status;
+    int s_id;
+    int c_id;
+    int groupid;
+    int gindex;
+    int xindex;
+    int qid;
+    int  sock_type;
+    int  remote_port;
+    int  local_port;
+    int  flags;
+    /* free blocks of send queue, allocated on demand */
+    int nqleft;
+    QBLOCK *qleft;
+    EVENT event;
+    EVENT outevent;
+    /* buffer */
+    MMBLOCK cache;
+    MMBLOCK header;
+    MMBLOCK oob;
+    MMBLOCK exchange;
+    CHUNK chunk;
+    void *queue;
+    void *service;
+    //void *xqueue;
+    /* message queue */
+    void *outdaemon;
+    void *outqmessage;
+    void *message_queue;
     /* connection bytes stats */
     long long   recv_oob_total;
     long long   sent_oob_total;
-    long long   recv_data_total;
-    long long   sent_data_total;
+    char remote_ip[SB_IP_MAX];
+    char local_ip[SB_IP_MAX];
+    /* xid */
+    int xids[SB_XIDS_MAX];
     /* xid 64 bit */
     int64_t  xids64[SB_XIDS_MAX];
 }CONN, *PCONN;
@@ -5,16 +5,19 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include "sbase.h"
 #include "xssl.h"
 #include "logger.h"
 #include "service.h"
+#include "chunk.h"
 #include "mmblock.h"
 #include "message.h"
 #include "evtimer.h"
 #include "procthread.h"
 #include "xmm.h"
 #include "mutex.h"
+#include "cidr.h"
 #ifndef UI
 #define UI(_x_) ((unsigned int)(_x_))
 #endif
@@ -34,6 +37,13 @@ do
 #else 
 #define SERVICE_CHECK_SSL_CLIENT(service)
 #endif
+#define SB_ACLFDS_INCREMENT 1024
+/* access rule counted on accepted fd */
+typedef struct _SBACLFD
+{
+    CIDR *acl;
+    int id;
+}SBACLFD;
 
 /* set service */
 int service_set(SERVICE *service)
@@ -183,6 +193,19 @@ int service_run(SERVICE *service)
 
     if(service)
     {
+#ifdef UDP_GRO
+        //datagrams read coalesced 
+        if(service->sock_type == SOCK_DGRAM && service->fd > 0
+                && (service->session.flags & SB_DGRAM) && (service->session.flags & SB_DGRAM_GRO))
+        {
+            x = 1;
+            if(setsockopt(service->fd, IPPROTO_UDP, UDP_GRO, &x, sizeof(x)) != 0)
+            {
+                WARN_LOGGER(service->logger, "setsockopt(UDP_GRO) on service[%s] via %d failed, %s", service->service_name, service->fd, strerror(errno));
+            }
+            x = 0;
+        }
+#endif
         //added to evtimer 
         if((service->session.flags & SB_MULTICAST) 
                 || service->heartbeat_interval > 0 
@@ -460,6 +483,282 @@ int service_set_log_level(SERVICE *service, int level)
     return -1;
 }
 
+/* set access rules, swapped in by acceptor on next accept */
+int service_set_acl(SERVICE *service, char *rules, int len)
+{
+    CIDR *acl = NULL, *old = NULL;
+
+    if(service && rules && len >= 0 && (acl = cidr_init()))
+    {
+        if(cidr_add_line(acl, rules, rules + len) != 0)
+        {
+            WARN_LOGGER(service->logger, "invalid access rules:%.*s", len, rules);
+            cidr_unref(acl);
+            return -1;
+        }
+        if((old = (CIDR *)__sync_lock_test_and_set(&(service->acl_next), acl)))
+            cidr_unref(old);
+        return 0;
+    }
+    return -1;
+}
+
+/* count accepted fd on access rule */
+static int service_bind_acl(SERVICE *service, int fd, CIDR *acl, int id)
+{
+    SBACLFD *aclfds = NULL;
+    int ret = -1, n = 0;
+
+    MUTEX_LOCK(service->mutex);
+    if(fd >= service->naclfds)
+    {
+        n = fd + SB_ACLFDS_INCREMENT;
+        if((aclfds = (SBACLFD *)realloc(service->aclfds, sizeof(SBACLFD) * n)))
+        {
+            memset(aclfds + service->naclfds, 0, sizeof(SBACLFD) * (n - service->naclfds));
+            service->aclfds = aclfds;
+            service->naclfds = n;
+        }
+    }
+    if(fd < service->naclfds)
+    {
+        aclfds = (SBACLFD *)(service->aclfds);
+        cidr_ref(acl);
+        aclfds[fd].acl = acl;
+        aclfds[fd].id = id;
+        ret = 0;
+    }
+    MUTEX_UNLOCK(service->mutex);
+    return ret;
+}
+
+/* release access rule counted on fd, with service->mutex locked */
+static void service_unbind_acl(SERVICE *service, int fd)
+{
+    SBACLFD *aclfds = (SBACLFD *)(service->aclfds);
+    CIDR *acl = NULL;
+
+    if(fd >= 0 && fd < service->naclfds && (acl = aclfds[fd].acl))
+    {
+        cidr_release(acl, aclfds[fd].id);
+        cidr_unref(acl);
+        aclfds[fd].acl = NULL;
+    }
+    return ;
+}
+
+/* release access rule counted on accepted fd */
+void service_release_acl(SERVICE *service, int fd)
+{
+    if(service && service->aclfds)
+    {
+        MUTEX_LOCK(service->mutex);
+        service_unbind_acl(service, fd);
+        MUTEX_UNLOCK(service->mutex);
+    }
+    return ;
+}
+
+/* check access rules of accepted fd, return -1 if denied */
+static int service_check_acl(SERVICE *service, int fd, struct sockaddr_in *rsa)
+{
+    CIDR *acl = NULL, *old = NULL;
+    unsigned char addr[16];
+    int id = -1;
+
+    /* only acceptor swaps and reads current rules */
+    if(service->acl_next && (acl = (CIDR *)__sync_lock_test_and_set(&(service->acl_next), NULL)))
+    {
+        old = (CIDR *)(service->acl);
+        service->acl = acl;
+        if(old) cidr_unref(old);
+    }
+    if((acl = (CIDR *)(service->acl)))
+    {
+        CIDR_V4(addr, rsa->sin_addr.s_addr);
+        if((id = cidr_find(acl, addr)) >= 0)
+        {
+            if(cidr_acquire(acl, id) != 0) return -1;
+            if(acl->nodes[id].limit > 0 && service_bind_acl(service, fd, acl, id) != 0)
+            {
+                cidr_release(acl, id);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* datagram batch from free list */
+static DGRAM *service_dgram_pop(SERVICE *service)
+{
+    int size = SB_DGRAM_SIZE;
+    DGRAM *dgram = NULL;
+
+    MUTEX_LOCK(service->dmutex);
+    if((dgram = service->dgrams))
+    {
+        service->dgrams = dgram->next;
+        service->ndgrams--;
+    }
+    MUTEX_UNLOCK(service->dmutex);
+    /* 64K slots only for datagrams coalesced by UDP_GRO */
+    if(service->session.flags & SB_DGRAM_GRO) size = SB_DGRAM_GRO_SIZE;
+    if(dgram == NULL && (dgram = (DGRAM *)xmm_tag_new(XMM_TAG_MMBLOCK, DGRAM_BYTES(size))))
+    {
+        dgram->size = size;
+        dgram->data = (char *)dgram + sizeof(DGRAM);
+    }
+    return dgram;
+}
+
+/* return datagram batch to free list */
+void service_dgram_free(SERVICE *service, DGRAM *dgram)
+{
+    if(service && dgram)
+    {
+        dgram->count = 0;
+        MUTEX_LOCK(service->dmutex);
+        if(service->ndgrams < SB_DGRAM_FREE_MAX)
+        {
+            dgram->next = service->dgrams;
+            service->dgrams = dgram;
+            service->ndgrams++;
+            dgram = NULL;
+        }
+        MUTEX_UNLOCK(service->dmutex);
+        if(dgram) xmm_tag_free(XMM_TAG_MMBLOCK, dgram, DGRAM_BYTES(dgram->size));
+    }
+    return ;
+}
+
+/* datagram connection of next procthread, sharing service socket */
+static CONN *service_dgram_conn(SERVICE *service)
+{
+    PROCTHREAD *pth = NULL;
+    CONN *conn = NULL;
+    int i = 0, fd = -1;
+
+    if(service->working_mode == WORKING_THREAD && service->nprocthreads > 0)
+    {
+        i = (service->ndgconns++) % service->nprocthreads;
+        pth = service->procthreads[i];
+    }
+    else pth = service->daemon;
+    if(pth && (conn = service->dgconns[i]) == NULL 
+            && (fd = dup(service->fd)) > 0 && (conn = service_popfromq(service)))
+    {
+        conn->fd = fd;
+        conn->ssl = NULL;
+        conn->status = CONN_STATUS_FREE;
+        strcpy(conn->remote_ip, "0.0.0.0");
+        conn->remote_port = 0;
+        strcpy(conn->local_ip, service->ip);
+        conn->local_port = service->port;
+        conn->sock_type = SOCK_DGRAM;
+        conn->evtimer   = service->evtimer;
+        conn->logger    = service->logger;
+        conn->groupid   = service->session.groupid;
+        conn->service   = service;
+        conn->ops->set_session(conn, &(service->session));
+        pth->add_connection(pth, conn);
+        service->dgconns[i] = conn;
+        DEBUG_LOGGER(service->logger, "Added datagram connection[%p] to procthread[%d] via %d", conn, i, fd);
+    }
+    else if(fd > 0 && conn == NULL)
+    {
+        close(fd);
+    }
+    return conn;
+}
+
+/* read datagrams in batch with recvmmsg(), handled by datagram connections */
+static int service_dgram_handler(SERVICE *service)
+{
+    struct mmsghdr msgs[SB_DGRAM_BATCH];
+    struct iovec iovs[SB_DGRAM_BATCH];
+#ifdef UDP_GRO
+    char controls[SB_DGRAM_BATCH][CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg = NULL;
+#endif
+    PROCTHREAD *parent = NULL;
+    DGRAM *dgram = NULL;
+    CONN *conn = NULL;
+    int i = 0, n = 0, total = 0, flags = MSG_DONTWAIT;
+
+#ifdef MSG_WAITFORONE
+    /* acceptor thread owns a blocking fd, wait for the first datagram only */
+    if(service->working_mode == WORKING_THREAD) flags = MSG_WAITFORONE;
+#else
+    /* blocking recvfrom() for the first datagram, MSG_DONTWAIT after */
+    if(service->working_mode == WORKING_THREAD) flags = 0;
+#endif
+    while((dgram = service_dgram_pop(service)))
+    {
+#ifdef MSG_WAITFORONE
+        memset(msgs, 0, sizeof(msgs));
+        for(i = 0; i < SB_DGRAM_BATCH; i++)
+        {
+            iovs[i].iov_base = DGRAM_DATA(dgram, i);
+            iovs[i].iov_len = dgram->size;
+            msgs[i].msg_hdr.msg_name = &(dgram->addrs[i]);
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+            msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef UDP_GRO
+            msgs[i].msg_hdr.msg_control = controls[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+#endif
+        }
+        if((n = recvmmsg(service->fd, msgs, SB_DGRAM_BATCH, flags, NULL)) > 0)
+        {
+            for(i = 0; i < n; i++) 
+            {
+                dgram->lens[i] = msgs[i].msg_len;
+                dgram->segs[i] = 0;
+                if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                {
+                    WARN_LOGGER(service->logger, "datagram truncated to %d bytes", dgram->size);
+                }
+#ifdef UDP_GRO
+                for(cmsg = CMSG_FIRSTHDR(&(msgs[i].msg_hdr)); cmsg; 
+                        cmsg = CMSG_NXTHDR(&(msgs[i].msg_hdr), cmsg))
+                {
+                    if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+                        dgram->segs[i] = *((int *)CMSG_DATA(cmsg));
+                }
+#endif
+            }
+        }
+#else
+        for(n = 0; n < SB_DGRAM_BATCH; n++)
+        {
+            socklen_t rsa_len = sizeof(struct sockaddr_in);
+            if((i = recvfrom(service->fd, DGRAM_DATA(dgram, n), dgram->size, flags, 
+                            (struct sockaddr *)&(dgram->addrs[n]), &rsa_len)) < 0) break;
+            dgram->lens[n] = i;
+            dgram->segs[n] = 0;
+            flags = MSG_DONTWAIT;
+        }
+#endif
+        if(n <= 0 || (conn = service_dgram_conn(service)) == NULL 
+                || (parent = (PROCTHREAD *)(conn->parent)) == NULL)
+        {
+            if(n > 0) FATAL_LOGGER(service->logger, "NONE-RESOUCE for handling %d datagrams", n);
+            service_dgram_free(service, dgram);
+            break;
+        }
+        dgram->count = n;
+        qmessage_push(parent->message_queue, MESSAGE_DGRAM, conn->index, conn->fd, 
+                -1, parent, conn, dgram);
+        parent->wakeup(parent);
+        total += n;
+        if(n < SB_DGRAM_BATCH) break;
+        flags = MSG_DONTWAIT;
+    }
+    return total;
+}
+
 /* accept handler */
 int service_accept_handler(SERVICE *service)
 {
@@ -481,6 +780,12 @@ int service_accept_handler(SERVICE *service)
             {
                 ip = inet_ntoa(rsa.sin_addr);
                 port = ntohs(rsa.sin_port);
+                if((service->acl || service->acl_next) && service_check_acl(service, fd, &rsa) != 0)
+                {
+                    ACCESS_LOGGER(service->logger, "denied new-connection[%s:%d] via %d", ip, port, fd);
+                    close(fd);
+                    continue;
+                }
 #ifdef HAVE_SSL
                 if(service->is_use_SSL && service->s_ctx)
                 {
@@ -531,12 +836,17 @@ err_conn:
 #endif
                 if(fd > 0)
                 {
+                    service_release_acl(service, fd);
                     shutdown(fd, SHUT_RDWR);
                     close(fd);
                 }
                 break;
             }
         }
+        else if(service->sock_type == SOCK_DGRAM && (service->session.flags & SB_DGRAM))
+        {
+            i = service_dgram_handler(service);
+        }
         else if(service->sock_type == SOCK_DGRAM)
         {
             while((n = recvfrom(service->fd, buf, SB_BUF_SIZE, 
@@ -762,22 +1072,24 @@ CONN *service_newproxy(SERVICE *service, CONN *parent, int inet_family, int sock
     socklen_t lsa_len = sizeof(lsa);
     int fd = -1, family = -1, sock_type = -1, remote_port = -1, local_port = -1;
     char *local_ip = NULL, *remote_ip = NULL;
-    SESSION *sess = NULL;
+    SESSION *sess = NULL, proxy = {0};
     void *ssl = NULL;
 
     if(service && service->lock == 0 && parent)
     {
-        if(parent && (conn = parent->session.child))
+        if(parent && (conn = parent->xsession.child))
         {
-            conn->session.parent = NULL;
-            conn->over(conn);
+            conn->xsession.parent = NULL;
+            conn->ops->over(conn);
             conn = NULL;
         }
         family  = (inet_family > 0 ) ? inet_family : service->family;
         sock_type = (socket_type > 0 ) ? socket_type : service->sock_type;
         remote_ip = (inet_ip) ? inet_ip : service->ip;
         remote_port  = (inet_port > 0 ) ? inet_port : service->port;
-        sess = (session) ? session : &(service->session);
+        /* proxy changes of session stay off the caller's session */
+        memcpy(&proxy, ((session) ? session : &(service->session)), sizeof(SESSION));
+        sess = &proxy;
         rsa.sin_family = family;
         rsa.sin_addr.s_addr = inet_addr(remote_ip);
         rsa.sin_port = htons(remote_port);
@@ -800,9 +1112,9 @@ new_conn:
             getsockname(fd, (struct sockaddr *)&lsa, &lsa_len);
             local_ip    = inet_ntoa(lsa.sin_addr);
             local_port  = ntohs(lsa.sin_port);
-            if(parent->session.timeout == 0)
-                parent->session.timeout = SB_PROXY_TIMEOUT;
-            parent->session.packet_type |= PACKET_PROXY;
+            if(parent->xsession.timeout == 0)
+                parent->xsession.timeout = SB_PROXY_TIMEOUT;
+            parent->xsession.packet_type |= PACKET_PROXY;
             sess->packet_type |= PACKET_PROXY;
             sess->parent = parent;
             sess->parentid = parent->index;
@@ -860,7 +1172,8 @@ CONN *service_addconn(SERVICE *service, int sock_type, int fd, char *remote_ip,
             conn->evtimer   = service->evtimer;
             conn->logger    = service->logger;
             conn->groupid   = session->groupid;
-            conn->set_session(conn, session);
+            conn->service   = service;
+            conn->ops->set_session(conn, session);
             /* add  to procthread */
             if(service->working_mode == WORKING_PROC)
             {
@@ -965,14 +1278,14 @@ int service_pushconn(SERVICE *service, CONN *conn)
             }
         }
         //for proxy
-        if((conn->session.packet_type & PACKET_PROXY)
-                && (parent = (CONN *)(conn->session.parent)) 
-                && conn->session.parentid  > 0 
-                && conn->session.parentid <= service->index_max 
-                && conn->session.parent == service->connections[conn->session.parentid])
+        if((conn->xsession.packet_type & PACKET_PROXY)
+                && (parent = (CONN *)(conn->xsession.parent)) 
+                && conn->xsession.parentid  > 0 
+                && conn->xsession.parentid <= service->index_max 
+                && conn->xsession.parent == service->connections[conn->xsession.parentid])
         {
             //DEBUG_LOGGER(service->logger, "proxy conn[%p][%s:%d] on %s:%d via %d on parent:%d", conn, conn->remote_ip, conn->remote_port, conn->local_ip, conn->local_port, conn->fd, conn->session.parent);
-            parent->bind_proxy(parent, conn);
+            parent->ops->bind_proxy(parent, conn);
         }
         MUTEX_UNLOCK(service->mutex);
     }
@@ -987,6 +1300,7 @@ int service_popconn(SERVICE *service, CONN *conn)
     if(service && service->lock == 0 && service->connections && conn)
     {
         MUTEX_LOCK(service->mutex);
+        if(service->aclfds) service_unbind_acl(service, conn->fd);
         if(conn->index > 0 && conn->index <= service->index_max
                 && service->connections[conn->index] == conn)
         {
@@ -1075,7 +1389,7 @@ CONN *service_getconn(SERVICE *service, int groupid)
                         conn->gindex = -1;
                         service->groups[groupid].conns_free[x] = 0;
                         --(service->groups[groupid].nconns_free);
-                        conn->start_cstate(conn);
+                        conn->ops->start_cstate(conn);
                         break;
                     }
                     else 
@@ -1101,7 +1415,7 @@ CONN *service_getconn(SERVICE *service, int groupid)
                         conn->xindex = -1;
                         service->conns_free[x] = 0;
                         --(service->nconns_free);
-                        conn->start_cstate(conn);
+                        conn->ops->start_cstate(conn);
                         break;
                     }
                     else 
@@ -1129,7 +1443,7 @@ int service_freeconn(SERVICE *service, CONN *conn)
         {
             if(service->groups[id].limit <= 0)
             {
-                conn->close(conn);
+                conn->ops->close(conn);
             }
             else
             {
@@ -1141,7 +1455,7 @@ int service_freeconn(SERVICE *service, CONN *conn)
                         service->groups[id].conns_free[x] = conn->index;
                         ++(service->groups[id].nconns_free);
                         conn->gindex = x;
-                        conn->over_cstate(conn);
+                        conn->ops->over_cstate(conn);
                         break;
                     }
                     ++x;
@@ -1160,7 +1474,7 @@ int service_freeconn(SERVICE *service, CONN *conn)
                         service->nconns_free++;
                         service->conns_free[x] = conn->index;
                         conn->xindex = x;
-                        conn->over_cstate(conn);
+                        conn->ops->over_cstate(conn);
                         break;
                     }
                     ++x;
@@ -1168,7 +1482,7 @@ int service_freeconn(SERVICE *service, CONN *conn)
             }
             else
             {
-                conn->close(conn);
+                conn->ops->close(conn);
             }
         }
         MUTEX_UNLOCK(service->mutex);
@@ -1229,7 +1543,7 @@ int service_pushtoq(SERVICE *service, CONN *conn)
             service->nconn--;
         }
         MUTEX_UNLOCK(service->mutex);
-        if(x == -1) conn->clean(conn);
+        if(x == -1) conn->ops->clean(conn);
     }
     return x;
 }
@@ -1366,6 +1680,111 @@ int service_set_session(SERVICE *service, SESSION *session)
     return -1;
 }
 
+/* key of session template, peer links left out, zeroed with padding for memcmp() */
+static void service_session_key(SESSION *key, SESSION *session, int id)
+{
+    memset(key, 0, sizeof(SESSION));
+    key->flags = session->flags;
+    key->timeout = session->timeout;
+    key->packet_type = session->packet_type;
+    key->packet_length = session->packet_length;
+    key->packet_delimiter_length = session->packet_delimiter_length;
+    key->buffer_size = session->buffer_size;
+    key->groupid = session->groupid;
+    key->multicast_ttl = session->multicast_ttl;
+    key->sendq_high = session->sendq_high;
+    key->sendq_low = session->sendq_low;
+    key->sendq_nhigh = session->sendq_nhigh;
+    key->sendq_nlow = session->sendq_nlow;
+    key->stid = id;
+    memcpy(key->xids, session->xids, sizeof(int) * SB_XIDS_MAX);
+    key->ctx = session->ctx;
+    key->packet_delimiter = session->packet_delimiter;
+    key->quick_handler = session->quick_handler;
+    key->error_handler = session->error_handler;
+    key->packet_reader = session->packet_reader;
+    key->packet_handler = session->packet_handler;
+    key->data_handler = session->data_handler;
+    key->chunk_reader = session->chunk_reader;
+    key->chunk_handler = session->chunk_handler;
+    key->file_handler = session->file_handler;
+    key->oob_handler = session->oob_handler;
+    key->timeout_handler = session->timeout_handler;
+    key->evtimeout_handler = session->evtimeout_handler;
+    key->transaction_handler = session->transaction_handler;
+    key->ok_handler = session->ok_handler;
+    key->writable_handler = session->writable_handler;
+    return ;
+}
+
+/* template of ids from..to same as session */
+static STEMPLATE *service_session_find(SERVICE *service, SESSION *session, int from, int to)
+{
+    SESSION key;
+    int id = 0;
+
+    for(id = from; id <= to; id++)
+    {
+        service_session_key(&key, session, id);
+        if(memcmp(&(service->stemplates[id-1]->session), &key, sizeof(SESSION)) == 0)
+            return service->stemplates[id-1];
+    }
+    return NULL;
+}
+
+/* reference session template same as session, found by session->stid */
+SESSION *service_session_ref(SERVICE *service, SESSION *session)
+{
+    STEMPLATE *stemplate = NULL;
+    int id = 0, n = 0;
+
+    if(service && session)
+    {
+        /* templates never change once counted in nstemplates, no lock to find one */
+        n = service->nstemplates;
+        __sync_synchronize();
+        if((id = session->stid) > 0 && id <= n && session == &(service->stemplates[id-1]->session))
+            stemplate = service->stemplates[id-1];
+        else if(id > 0 && id <= n) 
+            stemplate = service_session_find(service, session, id, id);
+        if(stemplate == NULL && (stemplate = service_session_find(service, session, 1, n)) == NULL)
+        {
+            MUTEX_LOCK(service->smutex);
+            if((stemplate = service_session_find(service, session, n + 1, service->nstemplates)) == NULL
+                    && (id = service->nstemplates + 1) <= SB_STEMPLATES_MAX
+                    && (stemplate = (STEMPLATE *)xmm_mnew(sizeof(STEMPLATE))))
+            {
+                service_session_key(&(stemplate->session), session, id);
+                stemplate->id = id;
+                stemplate->service = service;
+                service->stemplates[id-1] = stemplate;
+                /* template complete before readers see id */
+                __sync_synchronize();
+                service->nstemplates = id;
+            }
+            MUTEX_UNLOCK(service->smutex);
+            if(stemplate == NULL)
+            {
+                WARN_LOGGER(service->logger, "no session template left of %d", SB_STEMPLATES_MAX);
+                return NULL;
+            }
+        }
+        /* copies of session find template by id next time */
+        if(session->stid != stemplate->id) session->stid = stemplate->id;
+        __sync_add_and_fetch(&(stemplate->refs), 1);
+    }
+    return (stemplate ? &(stemplate->session) : NULL);
+}
+
+/* release session template, freed with service */
+void service_session_unref(SESSION *session)
+{
+    STEMPLATE *stemplate = (STEMPLATE *)session;
+
+    if(stemplate) __sync_sub_and_fetch(&(stemplate->refs), 1);
+    return ;
+}
+
 /* add multicast */
 int service_add_multicast(SERVICE *service, char *multicast_ip)
 {
@@ -1408,21 +1827,45 @@ int service_drop_multicast(SERVICE *service, char *multicast_ip)
     return ret;
 }
 
+/* new shared data */
+void *service_newshared(SERVICE *service, char *data, int len)
+{
+    if(service && data && len > 0) return chunk_shared_new(data, len);
+    return NULL;
+}
+
+/* take one more reference of shared data, dropped by service_freeshared() */
+void service_refshared(SERVICE *service, void *shared)
+{
+    chunk_shared_ref((CHUNK_SHARED *)shared);
+    return ;
+}
+
+/* drop reference of shared data by service_newshared() */
+void service_freeshared(SERVICE *service, void *shared)
+{
+    chunk_shared_unref((CHUNK_SHARED *)shared);
+    return ;
+}
+
 /* broadcast */
 int service_broadcast(SERVICE *service, char *data, int len)
 {
     int ret = -1, i = 0;
     CONN *conn = NULL;
+    void *shared = NULL;
 
-    if(service && service->lock == 0 && service->running_connections > 0)
+    if(service && service->lock == 0 && service->running_connections > 0
+            && (shared = service_newshared(service, data, len)))
     {
         for(i = 1; i < service->index_max; i++)
         {
             if((conn = service->connections[i]))
             {
-                conn->push_chunk(conn, data, len);
+                conn->ops->push_shared(conn, shared);
             }
         }
+        service_freeshared(service, shared);
         ret = 0;
     }
     return ret;
@@ -1440,6 +1883,7 @@ int service_addgroup(SERVICE *service, char *ip, int port, int limit, SESSION *s
         service->groups[id].limit = limit;
         //MUTEX_INIT(service->groups[id].mutex);
         memcpy(&(service->groups[id].session), session, sizeof(SESSION));
+        service->groups[id].session.groupid = id;
         //fprintf(stdout, "%s::%d service[%s]->group[%d]->session.data_handler:%p\n", __FILE__, __LINE__, service->service_name, id, service->groups[id].session.data_handler);
     }
     return id;
@@ -1460,7 +1904,7 @@ int service_closegroup(SERVICE *service, int groupid)
             if((id = service->groups[groupid].conns_free[i]) >= 0
                 && (conn = service->connections[id]))
             {
-                conn->close(conn);
+                conn->ops->close(conn);
             }
         }
         MUTEX_UNLOCK(service->mutex);
@@ -1472,19 +1916,22 @@ int service_closegroup(SERVICE *service, int groupid)
 int service_castgroup(SERVICE *service, char *data, int len)
 {
     CONN *conn = NULL;
+    void *shared = NULL;
     int i = 0;
 
-    if(service && service->lock == 0 && data && len > 0 && service->ngroups > 0)
+    if(service && service->lock == 0 && data && len > 0 && service->ngroups > 0
+            && (shared = service_newshared(service, data, len)))
     {
         for(i = 1; i <= service->ngroups; i++)
         {
             if((conn = service_getconn(service, i)))
             {
-                conn->start_cstate(conn);
+                conn->ops->start_cstate(conn);
                 conn->groupid = i;
-                conn->push_chunk(conn, data, len);
+                conn->ops->push_shared(conn, shared);
             }
         }
+        service_freeshared(service, shared);
         return 0;
     }
     return -1;
@@ -1494,7 +1941,6 @@ int service_castgroup(SERVICE *service, char *data, int len)
 int service_stategroup(SERVICE *service)
 {
     CONN *conn = NULL;
-    SESSION session = {0};
     int i = 0;
 
     if(service && service->lock == 0 && service->ngroups > 0)
@@ -1507,12 +1953,10 @@ int service_stategroup(SERVICE *service)
                 continue;
             }
             //DEBUG_LOGGER(service->logger, "stategroup(%d) total:%d nconnected:%d limit:%d", i, service->groups[i].total, service->groups[i].nconnected, service->groups[i].limit);
-            memcpy(&session, &(service->groups[i].session), sizeof(SESSION));
-            session.groupid = i;
             while(service->groups[i].limit > 0  
                     && service->groups[i].total < service->groups[i].limit
                     && (conn = service_newconn(service, -1, -1, service->groups[i].ip,
-                            service->groups[i].port, &session)))
+                            service->groups[i].port, &(service->groups[i].session))))
             {
                 //conn->groupid = i;
                 service->groups[i].total++;
@@ -1606,11 +2050,12 @@ void service_stop(SERVICE *service)
             {
                 if((conn = service->connections[i]))
                 {
-                    conn->close(conn);
+                    conn->ops->close(conn);
                 }
             }
             MUTEX_UNLOCK(service->mutex);
         }
+        memset(service->dgconns, 0, sizeof(service->dgconns));
         //iodaemons
         if(service->niodaemons > 0)
         {
@@ -1769,6 +2214,8 @@ void service_evtimer_handler(void *arg)
 /* service clean */
 void service_clean(SERVICE *service)
 {
+    STEMPLATE *stemplate = NULL;
+    DGRAM *dgram = NULL;
     CONN *conn = NULL;
     //CHUNK *cp = NULL;
     int i = 0;
@@ -1816,16 +2263,40 @@ void service_clean(SERVICE *service)
             {
                 if((conn = (service->qconns[i]))) 
                 {
-                    conn->clean(conn);
+                    conn->ops->clean(conn);
                     service->nconn--;
                 }
             }
         }
+        /* access rules */
+        if(service->aclfds)
+        {
+            for(i = 0; i < service->naclfds; i++) service_unbind_acl(service, i);
+            free(service->aclfds);
+            service->aclfds = NULL;
+        }
+        if(service->acl) cidr_unref((CIDR *)(service->acl));
+        if(service->acl_next) cidr_unref((CIDR *)(service->acl_next));
         /* SSL */
 #ifdef HAVE_SSL
         if(service->s_ctx) SSL_CTX_free(XSSL_CTX(service->s_ctx));
         if(service->c_ctx) SSL_CTX_free(XSSL_CTX(service->c_ctx));
 #endif
+        /* session templates */
+        for(i = 0; i < service->nstemplates; i++)
+        {
+            if((stemplate = service->stemplates[i])) xmm_free(stemplate, sizeof(STEMPLATE));
+            service->stemplates[i] = NULL;
+        }
+        service->nstemplates = 0;
+        MUTEX_DESTROY(service->smutex);
+        /* datagram batches */
+        while((dgram = service->dgrams))
+        {
+            service->dgrams = dgram->next;
+            xmm_tag_free(XMM_TAG_MMBLOCK, dgram, DGRAM_BYTES(dgram->size));
+        }
+        MUTEX_DESTROY(service->dmutex);
         MUTEX_DESTROY(service->mutex);
         if(service->is_inside_logger) 
         {
@@ -1855,11 +2326,14 @@ SERVICE *service_init()
     if((service = (SERVICE *)xmm_mnew(sizeof(SERVICE))))
     {
         MUTEX_INIT(service->mutex);
+        MUTEX_INIT(service->smutex);
+        MUTEX_INIT(service->dmutex);
         service->etimer             = EVTIMER_INIT();
         service->set                = service_set;
         service->run                = service_run;
         service->set_log            = service_set_log;
         service->set_log_level      = service_set_log_level;
+        service->set_acl            = service_set_acl;
         service->stop               = service_stop;
         service->newproxy           = service_newproxy;
         service->newconn            = service_newconn;
@@ -1875,6 +2349,9 @@ SERVICE *service_init()
         service->add_multicast      = service_add_multicast;
         service->drop_multicast     = service_drop_multicast;
         service->broadcast          = service_broadcast;
+        service->newshared          = service_newshared;
+        service->refshared          = service_refshared;
+        service->freeshared         = service_freeshared;
         service->addgroup           = service_addgroup;
         service->closegroup         = service_closegroup;
         service->castgroup          = service_castgroup;
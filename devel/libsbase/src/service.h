@@ -47,12 +47,24 @@ CB_DATA *service_newchunk(SERVICE *service, int len);
 CB_DATA *service_mnewchunk(SERVICE *service, int len);
 /* set service session */
 int service_set_session(SERVICE *service, SESSION *session);
+/* reference session template same as session */
+SESSION *service_session_ref(SERVICE *service, SESSION *session);
+/* release session template */
+void service_session_unref(SESSION *session);
 /* add multicast */
 int service_add_multicast(SERVICE *service, char *multicast_ip);
 /* drop multicast */
 int service_drop_multicast(SERVICE *service, char *multicast_ip);
+/* return datagram batch to free list */
+void service_dgram_free(SERVICE *service, DGRAM *dgram);
 /* broadcast */
 int service_broadcast(SERVICE *service, char *data, int len);
+/* new shared data */
+void *service_newshared(SERVICE *service, char *data, int len);
+/* take one more reference of shared data, dropped by service_freeshared() */
+void service_refshared(SERVICE *service, void *shared);
+/* drop reference of shared data by service_newshared() */
+void service_freeshared(SERVICE *service, void *shared);
 /* add group */
 int service_addgroup(SERVICE *service, char *ip, int port, int limit, SESSION *session);
 /* close group */
@@ -67,6 +79,10 @@ int service_newtask(SERVICE *service, CALLBACK *callback, void *arg);
 int service_newtransaction(SERVICE *service, CONN *conn, int tid);
 /* set log */
 int service_set_log(SERVICE *service, char *logfile);
+/* set access rules as [allow prefix [limit]] [deny prefix] */
+int service_set_acl(SERVICE *service, char *rules, int len);
+/* release access rule counted on accepted fd */
+void service_release_acl(SERVICE *service, int fd);
 /* accept handler */
 int service_accept_handler(SERVICE *service);
 /* event handler */
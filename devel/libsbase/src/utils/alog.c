@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "logger.h"
+#include "mtrie.h"
+#include "stime.h"
+#include "alog.h"
+
+static ALOG *_alogs_ = NULL;
+static int _alog_atfork_ = 0;
+
+/* begin new epoch of interned strings, alog->mutex locked */
+static void alog_begin(ALOG *alog)
+{
+    ALOGBEGIN begin = {{0}};
+
+    /* old strings gone before new epoch seen */
+    if(alog->nstrings > 0) mtrie_destroy(alog->map);
+    alog->nstrings = 0;
+    __sync_synchronize();
+    alog->epoch++;
+    __sync_synchronize();
+    begin.head.type = ALOG_BEGIN;
+    begin.head.len = sizeof(ALOGBEGIN);
+    begin.magic = ALOG_MAGIC;
+    begin.version = ALOG_VERSION;
+    begin.epoch = alog->epoch;
+    begin.pid = (int)getpid();
+    begin.time = (int)stime_now();
+    logger_write_raw(PLOG(alog->logger), (char *)&begin, sizeof(ALOGBEGIN));
+    alog->nfiles = PLOG(alog->logger)->nfiles;
+    return ;
+}
+
+/* intern string, return id or 0 for empty */
+static int alog_string(ALOG *alog, char *s)
+{
+    char buf[sizeof(ALOGSTRING) + ALOG_STRING_MAX];
+    ALOGSTRING *def = (ALOGSTRING *)buf;
+    int id = 0, n = 0;
+
+    if(s == NULL || (n = strlen(s)) == 0) return 0;
+    if(n > ALOG_STRING_MAX) n = ALOG_STRING_MAX;
+    if((id = mtrie_get(alog->map, s, n)) > 0) return id;
+    MUTEX_LOCK(alog->mutex);
+    if((id = mtrie_get(alog->map, s, n)) <= 0)
+    {
+        if(alog->nstrings >= ALOG_STRINGS_MAX) alog_begin(alog);
+        id = ++(alog->nstrings);
+        def->head.type = ALOG_STRING;
+        def->head.len = sizeof(ALOGSTRING) + n;
+        def->epoch = alog->epoch;
+        def->nstring = n;
+        def->id = id;
+        memcpy(buf + sizeof(ALOGSTRING), s, n);
+        /* definition queued before any record can use id */
+        logger_write_raw(PLOG(alog->logger), buf, def->head.len);
+        mtrie_add(alog->map, s, n, id);
+    }
+    MUTEX_UNLOCK(alog->mutex);
+    return id;
+}
+
+/* write access record, status/method are indexes of response_status/http_methods */
+int alog_access(ALOG *alog, int status, int method, char *host, char *path,
+        unsigned int ip, int port, char *agent, char *referer)
+{
+    char buf[ALOG_RECORD_MAX];
+    ALOGACCESS *rec = (ALOGACCESS *)buf;
+    unsigned short epoch = 0;
+    long long now = 0;
+    int n = 0;
+
+    if(alog && path)
+    {
+        /* new epoch on rotated file or in forked child, records racing
+         * with it may still use strings defined in the previous file */
+        if(PLOG(alog->logger)->nfiles != alog->nfiles)
+        {
+            MUTEX_LOCK(alog->mutex);
+            if(PLOG(alog->logger)->nfiles != alog->nfiles) alog_begin(alog);
+            MUTEX_UNLOCK(alog->mutex);
+        }
+        do
+        {
+            epoch = alog->epoch;
+            __sync_synchronize();
+            rec->host = alog_string(alog, host);
+            rec->agent = alog_string(alog, agent);
+            rec->referer = alog_string(alog, referer);
+            __sync_synchronize();
+        }while(epoch != alog->epoch);
+        if((n = strlen(path)) > ALOG_PATH_MAX) n = ALOG_PATH_MAX;
+        now = stime_usec();
+        rec->head.type = ALOG_ACCESS;
+        rec->head.len = sizeof(ALOGACCESS) + n;
+        rec->sec = (unsigned int)(now / 1000000ll);
+        rec->usec = (unsigned int)(now % 1000000ll);
+        rec->ip = ip;
+        rec->port = port;
+        rec->epoch = epoch;
+        rec->status = status;
+        rec->method = method;
+        memcpy(buf + sizeof(ALOGACCESS), path, n);
+        return logger_write_raw(PLOG(alog->logger), buf, rec->head.len);
+    }
+    return -1;
+}
+
+/* fork() copies epoch and ids, children begin own epochs seeded by pid */
+static void alog_prepare()
+{
+    ALOG *alog = NULL;
+
+    for(alog = _alogs_; alog; alog = alog->next) MUTEX_LOCK(alog->mutex);
+    return ;
+}
+
+static void alog_parent()
+{
+    ALOG *alog = NULL;
+
+    for(alog = _alogs_; alog; alog = alog->next) MUTEX_UNLOCK(alog->mutex);
+    return ;
+}
+
+static void alog_child()
+{
+    ALOG *alog = NULL;
+
+    for(alog = _alogs_; alog; alog = alog->next)
+    {
+        alog->epoch = (unsigned short)(getpid() ^ time(NULL));
+        /* alog_begin() on next record */
+        alog->nfiles = -1;
+        MUTEX_UNLOCK(alog->mutex);
+    }
+    return ;
+}
+
+/* initialize binary access log on logger */
+ALOG *alog_init(void *logger)
+{
+    ALOG *alog = NULL;
+
+    if(logger && (alog = (ALOG *)calloc(1, sizeof(ALOG))))
+    {
+        if((alog->map = mtrie_init()) == NULL)
+        {
+            free(alog);
+            return NULL;
+        }
+        MUTEX_INIT(alog->mutex);
+        alog->logger = logger;
+        PLOG(logger)->raw = 1;
+        /* epochs of restarted process differ from last run */
+        alog->epoch = (unsigned short)(getpid() ^ time(NULL));
+        MUTEX_LOCK(alog->mutex);
+        alog_begin(alog);
+        MUTEX_UNLOCK(alog->mutex);
+        if(_alog_atfork_ == 0 && pthread_atfork(&alog_prepare, &alog_parent, &alog_child) == 0)
+            _alog_atfork_ = 1;
+        alog->next = _alogs_;
+        _alogs_ = alog;
+    }
+    return alog;
+}
+
+/* clean */
+void alog_clean(ALOG *alog)
+{
+    ALOG **prev = &_alogs_;
+
+    if(alog)
+    {
+        while(*prev && *prev != alog) prev = &((*prev)->next);
+        if(*prev) *prev = alog->next;
+        mtrie_clean(alog->map);
+        MUTEX_DESTROY(alog->mutex);
+        free(alog);
+    }
+    return ;
+}
+
+#ifdef _BENCH_ALOG
+#include <sys/stat.h>
+#include <sys/time.h>
+#define BENCH_AGENTS_NUM 16
+int main(int argc, char **argv)
+{
+    char *agents[BENCH_AGENTS_NUM], path[ALOG_PATH_MAX], agent[ALOG_STRING_MAX];
+    long long start = 0, used = 0;
+    int i = 0, count = 1000000;
+    void *logger = NULL;
+    struct stat st = {0};
+    ALOG *alog = NULL;
+
+    if(argc > 1) count = atoi(argv[1]);
+    for(i = 0; i < BENCH_AGENTS_NUM; i++)
+    {
+        sprintf(agent, "Mozilla/5.0 (X11; Linux x86_64; rv:%d.0) Gecko/20100101 Firefox/%d.0", 40 + i, 40 + i);
+        agents[i] = strdup(agent);
+    }
+    unlink("/tmp/bench_access.log.1");
+    unlink("/tmp/bench_access.alog.1");
+    LOGGER_INIT(logger, "/tmp/bench_access.log");
+    start = stime_usec();
+    for(i = 0; i < count; i++)
+    {
+        sprintf(path, "/images/%d.jpg", i % 1000);
+        logger_write(PLOG(logger), __REAL__, __FILE__, __LINE__, "%s host[%s] %s[%s] remote[%s:%d] agent[%s] referer[%s]",
+                "200", "www.example.com", "GET", path, "192.168.1.10", 1024 + (i % 60000),
+                agents[i % BENCH_AGENTS_NUM], "http://www.example.com/index.html");
+    }
+    used = stime_usec() - start;
+    stat("/tmp/bench_access.log.1", &st);
+    fprintf(stdout, "text %d records in %lld usec, %.0f records/s, %lld bytes\n",
+            count, used, count * 1000000.0/(used ? used : 1), (long long)st.st_size);
+    LOGGER_CLEAN(logger);
+    LOGGER_INIT(logger, "/tmp/bench_access.alog");
+    alog = alog_init(logger);
+    start = stime_usec();
+    for(i = 0; i < count; i++)
+    {
+        sprintf(path, "/images/%d.jpg", i % 1000);
+        alog_access(alog, 1, 1, "www.example.com", path, 0x0a01a8c0, 1024 + (i % 60000),
+                agents[i % BENCH_AGENTS_NUM], "http://www.example.com/index.html");
+    }
+    used = stime_usec() - start;
+    stat("/tmp/bench_access.alog.1", &st);
+    fprintf(stdout, "binary %d records in %lld usec, %.0f records/s, %lld bytes\n",
+            count, used, count * 1000000.0/(used ? used : 1), (long long)st.st_size);
+    alog_clean(alog);
+    LOGGER_CLEAN(logger);
+    for(i = 0; i < BENCH_AGENTS_NUM; i++) free(agents[i]);
+    return 0;
+}
+//gcc -O2 -o alog alog.c logger.c mtrie.c stime.c -D_BENCH_ALOG -lpthread && ./alog 1000000
+#endif
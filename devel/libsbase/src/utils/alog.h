@@ -0,0 +1,69 @@
+#ifndef _ALOG_H
+#define _ALOG_H
+#include "mutex.h"
+#define ALOG_MAGIC          0x474f4c41
+#define ALOG_VERSION        1
+#define ALOG_BEGIN          0x01
+#define ALOG_STRING         0x02
+#define ALOG_ACCESS         0x03
+#define ALOG_STRINGS_MAX    65536
+#define ALOG_STRING_MAX     1024
+#define ALOG_PATH_MAX       4096
+#define ALOG_RECORD_MAX     8192
+/* binary access log records, fixed fields in host order, strings interned */
+typedef struct _ALOGHEAD
+{
+    unsigned short type;
+    unsigned short len;
+}ALOGHEAD;
+/* written at start and each reset of interned strings */
+typedef struct _ALOGBEGIN
+{
+    ALOGHEAD head;
+    unsigned int magic;
+    unsigned short version;
+    unsigned short epoch;
+    int pid;
+    int time;
+}ALOGBEGIN;
+/* string definition followed by bytes */
+typedef struct _ALOGSTRING
+{
+    ALOGHEAD head;
+    unsigned short epoch;
+    unsigned short nstring;
+    int id;
+}ALOGSTRING;
+/* access record followed by path bytes */
+typedef struct _ALOGACCESS
+{
+    ALOGHEAD head;
+    unsigned int sec;
+    unsigned int usec;
+    unsigned int ip;
+    unsigned short port;
+    unsigned short epoch;
+    unsigned short status;
+    unsigned short method;
+    int host;
+    int agent;
+    int referer;
+}ALOGACCESS;
+typedef struct _ALOG
+{
+    void *logger;
+    void *map;
+    MUTEX *mutex;
+    int nfiles;
+    int nstrings;
+    volatile unsigned short epoch;
+    struct _ALOG *next;
+}ALOG;
+/* initialize binary access log on logger */
+ALOG *alog_init(void *logger);
+/* write access record, status/method are indexes of response_status/http_methods */
+int alog_access(ALOG *alog, int status, int method, char *host, char *path,
+        unsigned int ip, int port, char *agent, char *referer);
+/* clean */
+void alog_clean(ALOG *alog);
+#endif
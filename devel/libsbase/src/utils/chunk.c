@@ -1,4 +1,4 @@
-#define _XOPEN_SOURCE 500
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -8,8 +8,11 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
+#include <stdint.h>
 #include "chunk.h"
 #include "xmm.h"
 /* initialize chunk */
@@ -32,7 +35,7 @@ int chunk_set_bsize(void *chunk, int len)
             n = len / CHUNK_BLOCK_SIZE;
             if(len % CHUNK_BLOCK_SIZE) ++n;
             size = n * CHUNK_BLOCK_SIZE;
-            CHK(chunk)->data = (char *)xmm_renew(CHK(chunk)->data, CHK(chunk)->bsize, size);
+            CHK(chunk)->data = (char *)xmm_tag_renew(XMM_TAG_CHUNK, CHK(chunk)->data, CHK(chunk)->bsize, size);
             if(CHK(chunk)->data) CHK(chunk)->bsize = size;
             else CHK(chunk)->bsize = 0;
         }
@@ -56,7 +59,7 @@ int chunk_mem(void *chunk, int len)
             n = need/CHUNK_BLOCK_SIZE;
             if(need % CHUNK_BLOCK_SIZE) ++n;
             size = n * CHUNK_BLOCK_SIZE;
-            CHK(chunk)->data = (char *)xmm_renew(CHK(chunk)->data, CHK(chunk)->bsize, size);
+            CHK(chunk)->data = (char *)xmm_tag_renew(XMM_TAG_CHUNK, CHK(chunk)->data, CHK(chunk)->bsize, size);
             if(CHK(chunk)->data) CHK(chunk)->bsize = size;
             else CHK(chunk)->bsize = 0;
         }
@@ -75,6 +78,17 @@ int chunk_mem(void *chunk, int len)
     return -1;
 }
 
+/* free file name */
+static void chunk_filename_free(void *chunk)
+{
+    if(CHK(chunk)->filename)
+    {
+        xmm_tag_free(XMM_TAG_CHUNK, CHK(chunk)->filename, strlen(CHK(chunk)->filename) + 1);
+        CHK(chunk)->filename = NULL;
+    }
+    return ;
+}
+
 /* initialize chunk file */
 int chunk_file(void *chunk, char *file, off_t offset, off_t len)
 {
@@ -85,13 +99,149 @@ int chunk_file(void *chunk, char *file, off_t offset, off_t len)
         CHK(chunk)->size = CHK(chunk)->left = len;
         CHK(chunk)->offset = offset;
         CHK(chunk)->ndata = 0;
+        chunk_filename_free(chunk);
+        if((CHK(chunk)->filename = (char *)xmm_tag_new(XMM_TAG_CHUNK, strlen(file) + 1)) == NULL)
+            return -1;
         strcpy(CHK(chunk)->filename, file);
         return 0;
     }
     return -1;
 }
 
+/* initialize chunk file of opened fd, fd closed by chunk */
+int chunk_fd(void *chunk, int fd, off_t offset, off_t len)
+{
+    if(chunk && fd > 0 && offset >= 0 && len > 0)
+    {
+        CHK(chunk)->type = CHUNK_FILE;
+        CHK(chunk)->status = CHUNK_STATUS_ON;
+        CHK(chunk)->size = CHK(chunk)->left = len;
+        CHK(chunk)->offset = offset;
+        CHK(chunk)->ndata = 0;
+        chunk_filename_free(chunk);
+        CHK(chunk)->fd = fd;
+        return 0;
+    }
+    return -1;
+}
+
 /* reading to chunk */
+CHUNK_SHARED *chunk_shared_new(void *data, int ndata)
+{
+    CHUNK_SHARED *shared = NULL;
+
+    if(data && ndata > 0 && (shared = (CHUNK_SHARED *)xmm_tag_new(XMM_TAG_CHUNK, 
+                    sizeof(CHUNK_SHARED) + ndata)))
+    {
+        shared->refs = 1;
+        shared->ndata = ndata;
+        memcpy(shared->data, data, ndata);
+        shared->data[ndata] = 0;
+    }
+    return shared;
+}
+void chunk_shared_ref(CHUNK_SHARED *shared)
+{
+    if(shared) __sync_add_and_fetch(&(shared->refs), 1);
+    return ;
+}
+void chunk_shared_unref(CHUNK_SHARED *shared)
+{
+    if(shared && __sync_sub_and_fetch(&(shared->refs), 1) == 0)
+    {
+        xmm_tag_free(XMM_TAG_CHUNK, shared, sizeof(CHUNK_SHARED) + shared->ndata);
+    }
+    return ;
+}
+int chunk_shared(void *chunk, CHUNK_SHARED *shared)
+{
+    if(chunk && shared && shared->ndata > 0)
+    {
+        chunk_shared_ref(shared);
+        chunk_shared_unref(CHK(chunk)->shared);
+        CHK(chunk)->shared = shared;
+        CHK(chunk)->type = CHUNK_MEM;
+        CHK(chunk)->status = CHUNK_STATUS_ON;
+        CHK(chunk)->size = CHK(chunk)->left = shared->ndata;
+        CHK(chunk)->end = shared->data;
+        CHK(chunk)->ndata = 0;
+        return 0;
+    }
+    return -1;
+}
+int chunk_shared_head(void *chunk, void *head, int nhead, CHUNK_SHARED *shared, int off)
+{
+    if(chunk && head && nhead > 0 && shared && off >= 0 && off < shared->ndata
+            && chunk_mem(chunk, nhead) == 0 && CHK(chunk)->data)
+    {
+        memcpy(CHK(chunk)->data, head, nhead);
+        chunk_shared_ref(shared);
+        chunk_shared_unref(CHK(chunk)->shared);
+        CHK(chunk)->shared = shared;
+        CHK(chunk)->ndata = nhead;
+        CHK(chunk)->offset = off;
+        CHK(chunk)->size = CHK(chunk)->left = nhead + shared->ndata - off;
+        return 0;
+    }
+    return -1;
+}
+int chunk_pipe(void *chunk, int pipefd, off_t len)
+{
+    if(chunk && pipefd >= 0 && len > 0)
+    {
+        CHK(chunk)->type = CHUNK_PIPE;
+        CHK(chunk)->status = CHUNK_STATUS_ON;
+        CHK(chunk)->size = CHK(chunk)->left = len;
+        CHK(chunk)->offset = 0;
+        CHK(chunk)->ndata = 0;
+        CHK(chunk)->fd = pipefd;
+        return 0;
+    }
+    return -1;
+}
+int chunk_write_from_pipe(void *chunk, int fd)
+{
+    int n = -1;
+#ifdef SPLICE_F_MOVE
+    if(chunk && fd > 0 && CHK(chunk)->left > 0
+            && (n = splice(CHK(chunk)->fd, NULL, fd, NULL, CHK(chunk)->left, 
+                    SPLICE_F_MOVE|SPLICE_F_NONBLOCK)) > 0)
+    {
+        CHK(chunk)->offset += n;
+        CHK(chunk)->left -= n;
+        if(CHK(chunk)->left == 0) CHK(chunk)->status = CHUNK_STATUS_OVER;
+    }
+#endif
+    return n;
+}
+int chunk_pipe_open(int *pipes, int size)
+{
+    int ret = -1;
+#if defined(SPLICE_F_MOVE) && defined(F_SETPIPE_SZ)
+    if(pipes && pipe2(pipes, O_NONBLOCK|O_CLOEXEC) == 0)
+    {
+        if(size > 0) fcntl(pipes[1], F_SETPIPE_SZ, size);
+        if((ret = fcntl(pipes[1], F_GETPIPE_SZ)) <= 0)
+        {
+            close(pipes[0]);
+            close(pipes[1]);
+            ret = -1;
+        }
+    }
+#endif
+    return ret;
+}
+int chunk_pipe_read(int fd, int pipefd, int len)
+{
+    int n = -1;
+#ifdef SPLICE_F_MOVE
+    if(fd > 0 && len > 0)
+    {
+        n = splice(fd, NULL, pipefd, NULL, len, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    }
+#endif
+    return n;
+}
 int chunk_read(void *chunk, int fd)
 {
     int n = -2;
@@ -130,15 +280,32 @@ int chunk_read_SSL(void *chunk, void *ssl)
 /* writting from chunk */
 int chunk_write(void *chunk, int fd)
 {
-    int n = -1;
+    struct iovec iov[2];
+    int n = -1, sent = 0;
 
-    if(chunk && fd > 0 && CHK(chunk)->left > 0 && CHK(chunk)->data && CHK(chunk)->end
-            //&& (n = write(fd, CHK(chunk)->end, CHK(chunk)->left)) > 0)
-            //&& (n = send(fd, CHK(chunk)->end, CHK(chunk)->left, MSG_DONTWAIT)) > 0)
-            && (n = send(fd, CHK(chunk)->end, CHK(chunk)->left, 0)) > 0)
+    if(chunk && fd > 0 && CHK(chunk)->left > 0 && CHK(chunk)->end)
     {
-        CHK(chunk)->left -= n;
-        CHK(chunk)->end += n;
+        /* head of chunk_shared_head() left, sent with shared data in one call */
+        if(CHK(chunk)->shared && (sent = (int)(CHK(chunk)->size - CHK(chunk)->left)) < CHK(chunk)->ndata)
+        {
+            iov[0].iov_base = CHK(chunk)->end;
+            iov[0].iov_len = CHK(chunk)->ndata - sent;
+            iov[1].iov_base = CHK(chunk)->shared->data + CHK(chunk)->offset;
+            iov[1].iov_len = CHK(chunk)->left - iov[0].iov_len;
+            if((n = writev(fd, iov, 2)) > 0)
+            {
+                CHK(chunk)->left -= n;
+                if(n < (int)iov[0].iov_len) CHK(chunk)->end += n;
+                else CHK(chunk)->end = (char *)iov[1].iov_base + (n - iov[0].iov_len);
+            }
+        }
+        //else if((n = write(fd, CHK(chunk)->end, CHK(chunk)->left)) > 0)
+        //else if((n = send(fd, CHK(chunk)->end, CHK(chunk)->left, MSG_DONTWAIT)) > 0)
+        else if((n = send(fd, CHK(chunk)->end, CHK(chunk)->left, 0)) > 0)
+        {
+            CHK(chunk)->left -= n;
+            CHK(chunk)->end += n;
+        }
     }
     return n;
 }
@@ -151,7 +318,7 @@ int chunk_sendto(void *chunk, int fd, char *ip, int port)
     struct sockaddr_in sa;
 
     if(chunk && ip && port > 0 && fd > 0 && CHK(chunk)->left > 0 
-            && CHK(chunk)->data && CHK(chunk)->end)
+            && CHK(chunk)->end)
     {
         memset(&sa, 0, sizeof(struct sockaddr));
         sa.sin_family = AF_INET;
@@ -167,16 +334,82 @@ int chunk_sendto(void *chunk, int fd, char *ip, int port)
     return n;
 }
 
+/* sendto chunks of same size as datagrams in one call with UDP_SEGMENT, 
+ * the last may be shorter, only the first is sent without UDP_SEGMENT */
+int chunk_sendto_gso(void **chunks, int nchunks, int fd, char *ip, int port)
+{
+#ifdef UDP_SEGMENT
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec iovs[CHUNK_GSO_SEGS];
+    struct cmsghdr *cmsg = NULL;
+    struct sockaddr_in sa;
+    struct msghdr msg;
+    int n = -1, i = 0;
+
+    if(chunks && nchunks > 1 && nchunks <= CHUNK_GSO_SEGS && ip && port > 0 && fd > 0)
+    {
+        for(i = 0; i < nchunks; i++)
+        {
+            if(CHK(chunks[i])->left <= 0 || CHK(chunks[i])->end == NULL
+                    || CHK(chunks[i])->left > CHK(chunks[0])->left
+                    || (i < nchunks - 1 && CHK(chunks[i])->left < CHK(chunks[0])->left))
+                return chunk_sendto(chunks[0], fd, ip, port);
+            iovs[i].iov_base = CHK(chunks[i])->end;
+            iovs[i].iov_len = CHK(chunks[i])->left;
+        }
+        memset(&sa, 0, sizeof(struct sockaddr_in));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = inet_addr(ip);
+        sa.sin_port = htons(port);
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_name = &sa;
+        msg.msg_namelen = sizeof(struct sockaddr_in);
+        msg.msg_iov = iovs;
+        msg.msg_iovlen = nchunks;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *((uint16_t *)CMSG_DATA(cmsg)) = (uint16_t)CHK(chunks[0])->left;
+        if((n = sendmsg(fd, &msg, 0)) > 0)
+        {
+            for(i = 0; i < nchunks; i++)
+            {
+                CHK(chunks[i])->end += CHK(chunks[i])->left;
+                CHK(chunks[i])->left = 0;
+            }
+        }
+        return n;
+    }
+#endif
+    if(chunks && nchunks > 0) return chunk_sendto(chunks[0], fd, ip, port);
+    return -1;
+}
+
 /* writting from chunk with SSL */
 int chunk_write_SSL(void *chunk, void *ssl)
 {
-    int n = -1;
+    int n = -1, len = 0, sent = 0, is_head = 0;
 #ifdef HAVE_SSL
-    if(chunk && ssl && CHK(chunk)->left > 0 && CHK(chunk)->data && CHK(chunk)->end
-            && (n = SSL_write(XSSL(ssl), CHK(chunk)->end, CHK(chunk)->left)) > 0)
+    if(chunk && ssl && CHK(chunk)->left > 0 && CHK(chunk)->end)
     {
-        CHK(chunk)->left -= n;
-        CHK(chunk)->end += n;
+        len = CHK(chunk)->left;
+        /* head of chunk_shared_head() written before shared data */
+        if(CHK(chunk)->shared && (sent = (int)(CHK(chunk)->size - CHK(chunk)->left)) < CHK(chunk)->ndata)
+        {
+            len = CHK(chunk)->ndata - sent;
+            is_head = 1;
+        }
+        if((n = SSL_write(XSSL(ssl), CHK(chunk)->end, len)) > 0)
+        {
+            CHK(chunk)->left -= n;
+            if(is_head && n == len)
+                CHK(chunk)->end = CHK(chunk)->shared->data + CHK(chunk)->offset;
+            else 
+                CHK(chunk)->end += n;
+        }
     }
 #endif
     return n;
@@ -436,7 +669,10 @@ void chunk_reset(void *chunk)
         if(CHK(chunk)->mmap) munmap(CHK(chunk)->mmap, MMAP_CHUNK_SIZE);
         CHK(chunk)->mmap = NULL;
         CHK(chunk)->mmleft = 0;
-        if(CHK(chunk)->fd > 0) close(CHK(chunk)->fd);
+        if(CHK(chunk)->fd > 0 && CHK(chunk)->type != CHUNK_PIPE) close(CHK(chunk)->fd);
+        chunk_filename_free(chunk);
+        chunk_shared_unref(CHK(chunk)->shared);
+        CHK(chunk)->shared = NULL;
         CHK(chunk)->fd = 0;
         CHK(chunk)->status = 0;
         CHK(chunk)->type = 0;
@@ -447,7 +683,7 @@ void chunk_reset(void *chunk)
         CHK(chunk)->mmleft = 0;
         if(CHK(chunk)->bsize > CHUNK_BLOCK_MAX)
         {
-            xmm_free(CHK(chunk)->data, CHK(chunk)->bsize);
+            xmm_tag_free(XMM_TAG_CHUNK, CHK(chunk)->data, CHK(chunk)->bsize);
             CHK(chunk)->data = NULL;
             CHK(chunk)->bsize = 0;
         }
@@ -463,8 +699,10 @@ void chunk_destroy(void *chunk)
     if(chunk)
     {
         if(CHK(chunk)->mmap) munmap(CHK(chunk)->mmap, MMAP_CHUNK_SIZE);
-        xmm_free(CHK(chunk)->data, CHK(chunk)->bsize);
-        if(CHK(chunk)->fd > 0) close(CHK(chunk)->fd);
+        xmm_tag_free(XMM_TAG_CHUNK, CHK(chunk)->data, CHK(chunk)->bsize);
+        if(CHK(chunk)->fd > 0 && CHK(chunk)->type != CHUNK_PIPE) close(CHK(chunk)->fd);
+        chunk_filename_free(chunk);
+        chunk_shared_unref(CHK(chunk)->shared);
     }
     return ;
 }
@@ -475,8 +713,10 @@ void chunk_clean(void *chunk)
     if(chunk)
     {
         if(CHK(chunk)->mmap) munmap(CHK(chunk)->mmap, MMAP_CHUNK_SIZE);
-        xmm_free(CHK(chunk)->data, CHK(chunk)->bsize);
-        if(CHK(chunk)->fd > 0) close(CHK(chunk)->fd);
+        xmm_tag_free(XMM_TAG_CHUNK, CHK(chunk)->data, CHK(chunk)->bsize);
+        if(CHK(chunk)->fd > 0 && CHK(chunk)->type != CHUNK_PIPE) close(CHK(chunk)->fd);
+        chunk_filename_free(chunk);
+        chunk_shared_unref(CHK(chunk)->shared);
         xmm_free(chunk, sizeof(CHUNK));
     }
     return ;
@@ -511,3 +751,164 @@ int main()
 }
 //gcc -o chk chunk.c -D_DEBUG_CHUNK && ./chk
 #endif
+#ifdef _BENCH_CHUNK
+#include "stime.h"
+int main(int argc, char **argv)
+{
+    int i = 0, count = 10000, size = 65536;
+    long long start = 0, used = 0;
+    CHUNK_SHARED *shared = NULL;
+    CHUNK *chunks = NULL;
+    XMMSTATS stats = {{0}};
+    char *data = NULL;
+
+    if(argc > 1) count = atoi(argv[1]);
+    if(argc > 2) size = atoi(argv[2]);
+    if((chunks = (CHUNK *)calloc(count, sizeof(CHUNK))) == NULL 
+            || (data = (char *)malloc(size)) == NULL) return -1;
+    memset(data, 'x', size);
+    /* copy of data per chunk as push_chunk() */
+    start = stime_usec();
+    for(i = 0; i < count; i++)
+    {
+        chunk_mem(&(chunks[i]), size);
+        chunk_mem_copy(&(chunks[i]), data, size);
+    }
+    used = stime_usec() - start;
+    xmm_stats(&stats);
+    fprintf(stdout, "copy %d x %d bytes in %lld usec, chunk bytes %lld\n",
+            count, size, used, stats.tags[XMM_TAG_CHUNK]);
+    for(i = 0; i < count; i++) chunk_destroy(&(chunks[i]));
+    memset(chunks, 0, sizeof(CHUNK) * count);
+    /* one shared data referenced by chunks as push_shared() */
+    start = stime_usec();
+    shared = chunk_shared_new(data, size);
+    for(i = 0; i < count; i++)
+    {
+        chunk_shared(&(chunks[i]), shared);
+    }
+    chunk_shared_unref(shared);
+    used = stime_usec() - start;
+    xmm_stats(&stats);
+    fprintf(stdout, "shared %d x %d bytes in %lld usec, chunk bytes %lld refs %d\n",
+            count, size, used, stats.tags[XMM_TAG_CHUNK], shared->refs);
+    for(i = 0; i < count; i++) chunk_reset(&(chunks[i]));
+    xmm_stats(&stats);
+    fprintf(stdout, "reset chunk bytes %lld\n", stats.tags[XMM_TAG_CHUNK]);
+    free(chunks);
+    free(data);
+    return 0;
+}
+//gcc -O2 -o cbench chunk.c xmm.c stime.c -D_BENCH_CHUNK -lpthread && ./cbench 10000 65536
+#endif
+#ifdef _BENCH_GSO
+#include "stime.h"
+/* drain socket with recvmmsg(), return datagrams read */
+static int bench_gso_drain(int fd, int want, int *calls)
+{
+    static char buf[CHUNK_GSO_SEGS][65536];
+    char control[CHUNK_GSO_SEGS][CMSG_SPACE(sizeof(int))];
+    struct mmsghdr msgs[CHUNK_GSO_SEGS];
+    struct iovec iovs[CHUNK_GSO_SEGS];
+    struct cmsghdr *cmsg = NULL;
+    int got = 0, n = 0, i = 0, seg = 0;
+
+    while(got < want)
+    {
+        memset(msgs, 0, sizeof(msgs));
+        for(i = 0; i < CHUNK_GSO_SEGS; i++)
+        {
+            iovs[i].iov_base = buf[i];
+            iovs[i].iov_len = sizeof(buf[i]);
+            msgs[i].msg_hdr.msg_iov = &(iovs[i]);
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+        (*calls)++;
+        if((n = recvmmsg(fd, msgs, CHUNK_GSO_SEGS, MSG_DONTWAIT, NULL)) <= 0) break;
+        for(i = 0; i < n; i++)
+        {
+            seg = 0;
+            for(cmsg = CMSG_FIRSTHDR(&(msgs[i].msg_hdr)); cmsg; 
+                    cmsg = CMSG_NXTHDR(&(msgs[i].msg_hdr), cmsg))
+            {
+                if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+                    seg = *((int *)CMSG_DATA(cmsg));
+            }
+            got += (seg > 0) ? (msgs[i].msg_len + seg - 1) / seg : 1;
+        }
+    }
+    return got;
+}
+int main(int argc, char **argv)
+{
+    int i = 0, j = 0, count = 1000000, size = 64, rfd = -1, sfd = -1, opt = 0, mode = 0;
+    int port = 0, got = 0, calls = 0, nsegs = CHUNK_GSO_SEGS;
+    socklen_t len = sizeof(struct sockaddr_in);
+    long long start = 0, used = 0;
+    void *ptrs[CHUNK_GSO_SEGS];
+    CHUNK chunks[CHUNK_GSO_SEGS];
+    struct sockaddr_in sa;
+    char *data = NULL;
+
+    if(argc > 1) count = atoi(argv[1]);
+    if(argc > 2) size = atoi(argv[2]);
+    if(size * nsegs > 65000) nsegs = 65000 / size;
+    if((data = (char *)malloc(size)) == NULL) return -1;
+    memset(data, 'x', size);
+    memset(chunks, 0, sizeof(chunks));
+    for(mode = 0; mode < 2; mode++)
+    {
+        memset(&sa, 0, sizeof(struct sockaddr_in));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if((rfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || (sfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0
+                || bind(rfd, (struct sockaddr *)&sa, sizeof(sa)) != 0
+                || getsockname(rfd, (struct sockaddr *)&sa, &len) != 0) return -1;
+        port = ntohs(sa.sin_port);
+        opt = 4194304; setsockopt(rfd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+#ifdef UDP_GRO
+        opt = 1; if(mode) setsockopt(rfd, IPPROTO_UDP, UDP_GRO, &opt, sizeof(opt));
+#endif
+        got = calls = 0;
+        start = stime_usec();
+        for(i = 0; i < count; i += nsegs)
+        {
+            for(j = 0; j < nsegs; j++)
+            {
+                chunks[j].type = CHUNK_MEM;
+                chunks[j].end = data;
+                chunks[j].left = size;
+                ptrs[j] = &(chunks[j]);
+            }
+            if(mode)
+            {
+                calls++;
+                chunk_sendto_gso(ptrs, nsegs, sfd, "127.0.0.1", port);
+            }
+            else
+            {
+                for(j = 0; j < nsegs; j++)
+                {
+                    calls++;
+                    chunk_sendto(ptrs[j], sfd, "127.0.0.1", port);
+                }
+            }
+            got += bench_gso_drain(rfd, nsegs, &calls);
+        }
+        used = stime_usec() - start;
+        if(used < 1) used = 1;
+        fprintf(stdout, "%s %d x %d bytes: %d datagrams in %lld usec, %lld datagrams/s, "
+                "%d syscalls, %lld syscalls/s, %.2f syscalls per 100 datagrams\n",
+                (mode ? "gso+gro" : "sendto+recvmmsg"), count, size, got, used, 
+                (long long)got * 1000000ll / used, calls, (long long)calls * 1000000ll / used,
+                (got > 0) ? (double)calls * 100.0 / got : 0.0);
+        close(rfd);
+        close(sfd);
+    }
+    free(data);
+    return 0;
+}
+//gcc -O2 -o gbench chunk.c xmm.c stime.c -D_BENCH_GSO -lpthread && ./gbench 1000000 64
+#endif
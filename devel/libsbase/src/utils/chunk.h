@@ -12,6 +12,7 @@ extern "C" {
 #endif
 #define CHUNK_MEM   0x02
 #define CHUNK_FILE  0x04
+#define CHUNK_PIPE  0x08
 #define CHUNK_ALL  (CHUNK_MEM | CHUNK_FILE)
 #define CHUNK_BLOCK_MAX         524288
 //#define CHUNK_BLOCK_MAX       1024
@@ -31,9 +32,18 @@ extern "C" {
 #endif
 #define CHUNK_STATUS_ON         0x01
 #define CHUNK_STATUS_OVER       0x02
+/* max datagrams in one UDP_SEGMENT send, kernel UDP_MAX_SEGMENTS */
+#define CHUNK_GSO_SEGS          64
 #ifndef __TYPEDEF__CHUNK
 #define __TYPEDEF__CHUNK
 #define CHUNK_FILE_NAME_MAX     256
+/* immutable refcounted data sent by many chunks */
+typedef struct _CHUNK_SHARED
+{
+    int refs;
+    int ndata;
+    char data[1];
+}CHUNK_SHARED;
 typedef struct _CHUNK
 {
     char *data;
@@ -50,7 +60,10 @@ typedef struct _CHUNK
     off_t mmoff;
     char *mmap;
     char *end;
-    char filename[CHUNK_FILE_NAME_MAX];
+    /* allocated by chunk_file() */
+    char *filename;
+    /* referenced by chunk_shared(), end points into it */
+    CHUNK_SHARED *shared;
 }CHUNK;
 #endif
 typedef struct _CHUNK * PCHUNK;
@@ -80,6 +93,8 @@ int chunk_read_SSL(void *chunk, void *ssl);
 int chunk_write(void *chunk, int fd);
 /* chunk sendto */
 int chunk_sendto(void *chunk, int fd, char *ip, int port);
+/* sendto chunks of same size as datagrams in one call with UDP_SEGMENT */
+int chunk_sendto_gso(void **chunks, int nchunks, int fd, char *ip, int port);
 /* writting from chunk with SSL */
 int chunk_write_SSL(void *chunk, void *ssl);
 /* fill chunk memory */
@@ -104,10 +119,31 @@ void chunk_destroy(void *chunk);
 void chunk_clean(void *chunk);
 /* initialize chunk file */
 int chunk_file(void *chunk, char *file, off_t offset, off_t len);
+/* initialize chunk file of opened fd, fd closed by chunk */
+int chunk_fd(void *chunk, int fd, off_t offset, off_t len);
+/* new shared data of one reference */
+CHUNK_SHARED *chunk_shared_new(void *data, int ndata);
+/* reference shared data */
+void chunk_shared_ref(CHUNK_SHARED *shared);
+/* drop reference of shared data, freed on the last */
+void chunk_shared_unref(CHUNK_SHARED *shared);
+/* initialize chunk mem sending shared data without copy */
+int chunk_shared(void *chunk, CHUNK_SHARED *shared);
+/* initialize chunk mem sending private copy of head then shared data from off,
+ * head kept in data of chunk, ndata bytes, shared data from offset */
+int chunk_shared_head(void *chunk, void *head, int nhead, CHUNK_SHARED *shared, int off);
+/* initialize chunk of len bytes queued in pipe, pipe not owned by chunk */
+int chunk_pipe(void *chunk, int pipefd, off_t len);
+/* write from pipe with splice() */
+int chunk_write_from_pipe(void *chunk, int fd);
+/* open nonblocking pipe of size bytes, return pipe size or -1 if no splice() */
+int chunk_pipe_open(int *pipes, int size);
+/* move at most len bytes from fd to pipe with splice() */
+int chunk_pipe_read(int fd, int pipefd, int len);
 #define CHUNK_STATUS(ptr) ((CHK(ptr)->left == 0)?CHUNK_STATUS_OVER:CHUNK_STATUS_ON)
 #define CHUNK_READ(ptr, fd) ((CHK(ptr)->type == CHUNK_MEM)?chunk_read(ptr, fd):chunk_read_to_file(ptr, fd))
 #define CHUNK_READ_SSL(ptr, ssl) ((CHK(ptr)->type == CHUNK_MEM)?chunk_read_SSL(ptr, ssl):chunk_read_to_file_SSL(ptr, ssl))
-#define CHUNK_WRITE(ptr, fd) ((CHK(ptr)->type == CHUNK_MEM)?chunk_write(ptr, fd):chunk_write_from_file(ptr, fd))
+#define CHUNK_WRITE(ptr, fd) ((CHK(ptr)->type == CHUNK_MEM)?chunk_write(ptr, fd):((CHK(ptr)->type == CHUNK_PIPE)?chunk_write_from_pipe(ptr, fd):chunk_write_from_file(ptr, fd)))
 #define CHUNK_SENDTO(ptr, fd, ip, port) chunk_sendto(ptr, fd, ip, port)
 #define CHUNK_WRITE_SSL(ptr, ssl) ((CHK(ptr)->type == CHUNK_MEM)?chunk_write_SSL(ptr, ssl):chunk_write_from_file_SSL(ptr, ssl))
 #define CHUNK_FILL(ptr, data, ndata) ((CHK(ptr)->type == CHUNK_MEM)?chunk_mem_fill(ptr, data, ndata):chunk_file_fill(ptr, data, ndata))
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include "cidr.h"
+#define CIDR_BIT(addr, n) (((addr)[(n) >> 3] >> (7 - ((n) & 7))) & 0x01)
+#define CIDR_ISBLANK(c) (c == 0x20 || c == '\t' || c == '\r' || c == '\n')
+
+/* initialize cidr tree with one reference */
+CIDR *cidr_init()
+{
+    CIDR *cidr = NULL;
+
+    if((cidr = (CIDR *)calloc(1, sizeof(CIDR))))
+    {
+        cidr->root = -1;
+        cidr->refs = 1;
+    }
+    return cidr;
+}
+
+/* parse a.b.c.d[/n] or ipv6[/n] to 16 bytes address and bits */
+int cidr_parse(char *s, unsigned char *addr, int *bits)
+{
+    char ip[INET6_ADDRSTRLEN], *p = NULL;
+    struct in_addr in4;
+    int n = -1;
+
+    if(s && addr && bits)
+    {
+        if((p = strchr(s, '/')))
+        {
+            if((p - s) >= INET6_ADDRSTRLEN) return -1;
+            memcpy(ip, s, p - s);
+            ip[p - s] = '\0';
+            n = atoi(p+1);
+            s = ip;
+        }
+        if(inet_pton(AF_INET, s, &in4) == 1)
+        {
+            if(n > 32) return -1;
+            CIDR_V4(addr, in4.s_addr);
+            *bits = (n < 0) ? CIDR_BITS_MAX : (96 + n);
+            return 0;
+        }
+        if(inet_pton(AF_INET6, s, addr) == 1 && n <= CIDR_BITS_MAX)
+        {
+            *bits = (n < 0) ? CIDR_BITS_MAX : n;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* length of common prefix in bits, no more than max */
+static int cidr_common(unsigned char *a, unsigned char *b, int max)
+{
+    int n = 0, i = 0, c = 0;
+
+    for(i = 0; i < 16 && n < max; i++)
+    {
+        if((c = (a[i] ^ b[i])) == 0)
+        {
+            n += 8;
+            continue;
+        }
+        while((c & 0x80) == 0){c <<= 1; n++;}
+        break;
+    }
+    return (n < max) ? n : max;
+}
+
+/* new node of prefix, room reserved by caller */
+static int cidr_node(CIDR *cidr, unsigned char *addr, int bits)
+{
+    CIDRNODE *node = NULL;
+    int x = cidr->num++;
+
+    node = &(cidr->nodes[x]);
+    memset(node, 0, sizeof(CIDRNODE));
+    memcpy(node->addr, addr, bits >> 3);
+    if(bits & 7) node->addr[bits >> 3] = addr[bits >> 3] & (0xff << (8 - (bits & 7)));
+    node->bits = bits;
+    node->child[0] = node->child[1] = -1;
+    return x;
+}
+
+/* add prefix rule, return node id */
+int cidr_add(CIDR *cidr, unsigned char *addr, int bits, int flag, int limit)
+{
+    CIDRNODE *node = NULL, *nodes = NULL;
+    int *pos = NULL, x = -1, i = 0, n = 0;
+
+    if(cidr && addr && bits >= 0 && bits <= CIDR_BITS_MAX)
+    {
+        /* at most a glue and a leaf added, keep pos stable */
+        if((cidr->num + 2) > cidr->size)
+        {
+            if((nodes = (CIDRNODE *)realloc(cidr->nodes, sizeof(CIDRNODE)
+                            * (cidr->size + CIDR_INCREMENT))) == NULL) return -1;
+            cidr->nodes = nodes;
+            cidr->size += CIDR_INCREMENT;
+        }
+        pos = &(cidr->root);
+        while((x = *pos) >= 0)
+        {
+            node = &(cidr->nodes[x]);
+            n = cidr_common(addr, node->addr, (bits < node->bits) ? bits : node->bits);
+            if(n == node->bits)
+            {
+                if(n == bits) goto set;
+                pos = &(node->child[CIDR_BIT(addr, n)]);
+                continue;
+            }
+            /* new prefix covers node */
+            if(n == bits)
+            {
+                x = cidr_node(cidr, addr, bits);
+                cidr->nodes[x].child[CIDR_BIT(node->addr, bits)] = *pos;
+                *pos = x;
+                goto set;
+            }
+            /* diverged, glue at common prefix */
+            i = cidr_node(cidr, addr, n);
+            cidr->nodes[i].child[CIDR_BIT(node->addr, n)] = *pos;
+            x = cidr_node(cidr, addr, bits);
+            cidr->nodes[i].child[CIDR_BIT(addr, n)] = x;
+            *pos = i;
+            goto set;
+        }
+        x = cidr_node(cidr, addr, bits);
+        *pos = x;
+set:
+        node = &(cidr->nodes[x]);
+        node->flag = flag;
+        node->limit = limit;
+        return x;
+    }
+    return -1;
+}
+
+/* add rules line as [allow prefix [limit]] [deny prefix] */
+int cidr_add_line(CIDR *cidr, char *p, char *end)
+{
+    char *s = NULL, *e = NULL, *argv[3], arg[CIDR_LINE_MAX];
+    int n = 0, flag = 0, limit = 0, bits = 0, ret = 0;
+    unsigned char addr[16];
+
+    if(cidr && p && end)
+    {
+        while(p < end)
+        {
+            while(p < end && *p != '[') ++p;
+            if(p++ >= end) break;
+            if((e = memchr(p, ']', end - p)) == NULL) break;
+            n = 0;
+            s = arg;
+            while(p < e && n < 3)
+            {
+                while(p < e && CIDR_ISBLANK(*p)) ++p;
+                if(p == e) break;
+                argv[n++] = s;
+                while(p < e && !CIDR_ISBLANK(*p) && s < (arg + CIDR_LINE_MAX - 1)) *s++ = *p++;
+                *s++ = '\0';
+                if(s >= (arg + CIDR_LINE_MAX - 1)) break;
+            }
+            p = e + 1;
+            if(n < 2 || cidr_parse(argv[1], addr, &bits) != 0) {ret = -1; continue;}
+            limit = 0;
+            if(strcasecmp(argv[0], "allow") == 0)
+            {
+                flag = CIDR_ALLOW;
+                if(n > 2) limit = atoi(argv[2]);
+            }
+            else if(strcasecmp(argv[0], "deny") == 0) flag = CIDR_DENY;
+            else {ret = -1; continue;}
+            if(cidr_add(cidr, addr, bits, flag, limit) < 0) ret = -1;
+        }
+        return ret;
+    }
+    return -1;
+}
+
+/* return node id of longest prefix rule matched addr or -1 */
+int cidr_find(CIDR *cidr, unsigned char *addr)
+{
+    CIDRNODE *node = NULL;
+    int x = -1, id = -1, n = 0, i = 0;
+
+    if(cidr && addr)
+    {
+        x = cidr->root;
+        while(x >= 0)
+        {
+            node = &(cidr->nodes[x]);
+            n = node->bits >> 3;
+            if(memcmp(addr, node->addr, n) != 0) break;
+            if((i = (node->bits & 7)) && ((addr[n] ^ node->addr[n]) & (0xff << (8 - i)) & 0xff)) break;
+            if(node->flag) id = x;
+            if(node->bits >= CIDR_BITS_MAX) break;
+            x = node->child[CIDR_BIT(addr, node->bits)];
+        }
+    }
+    return id;
+}
+
+/* count connection on rule id, return -1 if denied or over limit */
+int cidr_acquire(CIDR *cidr, int id)
+{
+    CIDRNODE *node = NULL;
+
+    if(cidr && id >= 0 && id < cidr->num)
+    {
+        node = &(cidr->nodes[id]);
+        if(node->flag & CIDR_DENY) return -1;
+        /* only acceptor adds, check then add is safe */
+        if(node->limit > 0)
+        {
+            if(node->count >= node->limit) return -1;
+            __sync_add_and_fetch(&(node->count), 1);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/* uncount connection on rule id */
+void cidr_release(CIDR *cidr, int id)
+{
+    if(cidr && id >= 0 && id < cidr->num && cidr->nodes[id].limit > 0)
+    {
+        __sync_sub_and_fetch(&(cidr->nodes[id].count), 1);
+    }
+    return ;
+}
+
+/* add reference */
+void cidr_ref(CIDR *cidr)
+{
+    if(cidr) __sync_add_and_fetch(&(cidr->refs), 1);
+    return ;
+}
+
+/* drop reference, clean tree at last one */
+void cidr_unref(CIDR *cidr)
+{
+    if(cidr && __sync_sub_and_fetch(&(cidr->refs), 1) == 0)
+        cidr_clean(cidr);
+    return ;
+}
+
+/* clean cidr tree */
+void cidr_clean(CIDR *cidr)
+{
+    if(cidr)
+    {
+        if(cidr->nodes) free(cidr->nodes);
+        free(cidr);
+    }
+    return ;
+}
+
+#ifdef _DEBUG_CIDR
+#include <sys/time.h>
+#define DEBUG_ADDRS_NUM 4096
+/* match rules one by one */
+int cidr_scan(CIDR *cidr, unsigned char *addr)
+{
+    int i = 0, id = -1;
+
+    for(i = 0; i < cidr->num; i++)
+    {
+        if(cidr->nodes[i].flag && (id < 0 || cidr->nodes[i].bits > cidr->nodes[id].bits)
+                && cidr_common(addr, cidr->nodes[i].addr, cidr->nodes[i].bits) == cidr->nodes[i].bits)
+            id = i;
+    }
+    return id;
+}
+int main(int argc, char **argv)
+{
+    int i = 0, n = 0, nrules = 10000, count = 1000000, errors = 0;
+    unsigned char addrs[DEBUG_ADDRS_NUM][16];
+    struct timeval tv = {0};
+    long long start = 0, used = 0;
+    char line[CIDR_LINE_MAX];
+    unsigned int r = 1, ip = 0;
+    CIDR *cidr = NULL;
+
+    if(argc > 1) nrules = atoi(argv[1]);
+    if(argc > 2) count = atoi(argv[2]);
+    if((cidr = cidr_init()) == NULL) return -1;
+    n = sprintf(line, "[deny 0.0.0.0/0] [allow 10.0.0.0/8 64] [deny 2001:db8::/32] [allow ::1]");
+    cidr_add_line(cidr, line, line + n);
+    for(i = 0; i < nrules; i++)
+    {
+        r = r * 1103515245 + 12345;
+        ip = (r >> 16) | ((r * 69069) & 0xffff0000);
+        if(i % 8 == 0)
+            n = sprintf(line, "[allow 2001:db8:%x:%x::/%d]", ip >> 16, ip & 0xffff, 33 + (r % 32));
+        else
+            n = sprintf(line, "[%s %u.%u.%u.%u/%d %d]", (i % 3) ? "allow" : "deny", ip >> 24,
+                    (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff, 8 + (r % 25), i % 100);
+        if(cidr_add_line(cidr, line, line + n) != 0) fprintf(stderr, "bad rule:%s\n", line);
+    }
+    for(i = 0; i < DEBUG_ADDRS_NUM; i++)
+    {
+        r = r * 1103515245 + 12345;
+        ip = (r >> 16) | ((r * 69069) & 0xffff0000);
+        if(i % 8 == 0) n = sprintf(line, "2001:db8:%x:%x::%x", ip >> 16, ip & 0xffff, i);
+        else n = sprintf(line, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+        cidr_parse(line, addrs[i], &n);
+        if(cidr_find(cidr, addrs[i]) != cidr_scan(cidr, addrs[i])) errors++;
+    }
+    fprintf(stdout, "rules:%d nodes:%d addrs:%d mismatch:%d\n", nrules, cidr->num, DEBUG_ADDRS_NUM, errors);
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0, n = 0; i < count; i++)
+    {
+        if(cidr_acquire(cidr, cidr_find(cidr, addrs[i % DEBUG_ADDRS_NUM])) == 0) n++;
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "cidr_find() %d lookups(%d accepted) in %lld usec, %.0f q/s\n",
+            count, n, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    cidr_unref(cidr);
+    return 0;
+}
+//gcc -O2 -o cidr cidr.c -D_DEBUG_CIDR && ./cidr 10000 1000000
+#endif
@@ -0,0 +1,54 @@
+#ifndef _CIDR_H
+#define _CIDR_H
+#define CIDR_ALLOW          0x01
+#define CIDR_DENY           0x02
+#define CIDR_BITS_MAX       128
+#define CIDR_INCREMENT      256
+#define CIDR_LINE_MAX       256
+/* ipv4 as ipv4-mapped ipv6 address ::ffff:a.b.c.d */
+#define CIDR_V4(addr, s_addr)                                                   \
+do                                                                              \
+{                                                                               \
+    memset(addr, 0, 10);                                                        \
+    (addr)[10] = (addr)[11] = 0xff;                                             \
+    memcpy(((unsigned char *)(addr)) + 12, &(s_addr), 4);                       \
+}while(0)
+/* node of radix tree */
+typedef struct _CIDRNODE
+{
+    unsigned char addr[16];
+    short bits;
+    short flag;
+    int limit;
+    int count;
+    int child[2];
+}CIDRNODE;
+typedef struct _CIDR
+{
+    int root;
+    int num;
+    int size;
+    int refs;
+    CIDRNODE *nodes;
+}CIDR;
+/* initialize cidr tree with one reference */
+CIDR *cidr_init();
+/* parse a.b.c.d[/n] or ipv6[/n] to 16 bytes address and bits */
+int cidr_parse(char *s, unsigned char *addr, int *bits);
+/* add prefix rule, return node id */
+int cidr_add(CIDR *cidr, unsigned char *addr, int bits, int flag, int limit);
+/* add rules line as [allow prefix [limit]] [deny prefix] */
+int cidr_add_line(CIDR *cidr, char *p, char *end);
+/* return node id of longest prefix rule matched addr or -1 */
+int cidr_find(CIDR *cidr, unsigned char *addr);
+/* count connection on rule id, return -1 if denied or over limit */
+int cidr_acquire(CIDR *cidr, int id);
+/* uncount connection on rule id */
+void cidr_release(CIDR *cidr, int id);
+/* add reference */
+void cidr_ref(CIDR *cidr);
+/* drop reference, clean tree at last one */
+void cidr_unref(CIDR *cidr);
+/* clean cidr tree */
+void cidr_clean(CIDR *cidr);
+#endif
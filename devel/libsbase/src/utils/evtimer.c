@@ -6,6 +6,7 @@
 #include "xmm.h"
 #include "evtimer.h"
 #include "mutex.h"
+#include "stime.h"
 /* evtimer push */
 void evtimer_push(EVTIMER *evtimer, EVTNODE *node)
 {
@@ -53,7 +54,6 @@ void evtimer_push(EVTIMER *evtimer, EVTNODE *node)
 /* add event timer */
 int evtimer_add(EVTIMER *evtimer, off_t timeout, EVTCALLBACK *handler, void *arg)
 {
-    struct timeval tv = {0};
     EVTNODE *node = NULL;
     int evid = -1;
 
@@ -67,8 +67,7 @@ int evtimer_add(EVTIMER *evtimer, off_t timeout, EVTCALLBACK *handler, void *arg
             node->handler = handler;
             node->arg = arg;
             node->ison = 1;
-            gettimeofday(&tv, NULL);
-            node->evusec = (off_t)(tv.tv_sec * 1000000ll + tv.tv_usec * 1ll) + timeout;
+            node->evusec = (off_t)stime_usec() + timeout;
             evtimer_push(evtimer, node);
         }
         MUTEX_UNLOCK(evtimer->mutex);
@@ -79,7 +78,6 @@ int evtimer_add(EVTIMER *evtimer, off_t timeout, EVTCALLBACK *handler, void *arg
 /* update event timer */
 int evtimer_update(EVTIMER *evtimer, int evid, off_t timeout, EVTCALLBACK *handler, void *arg)
 {
-    struct timeval tv = {0};
     EVTNODE *node = NULL;
     int i = 0, ret = -1;
 
@@ -94,8 +92,7 @@ int evtimer_update(EVTIMER *evtimer, int evid, off_t timeout, EVTCALLBACK *handl
             if(node == evtimer->tail) evtimer->tail = node->prev;
             node->handler = handler;
             node->arg = arg;
-            gettimeofday(&tv, NULL);
-            node->evusec = (off_t)(tv.tv_sec * 1000000ll + tv.tv_usec * 1ll) + timeout;
+            node->evusec = (off_t)stime_usec() + timeout;
             evtimer_push(evtimer, node);
             ret = 0;
         }
@@ -133,15 +130,13 @@ int evtimer_delete(EVTIMER *evtimer, int evid)
 void evtimer_check(EVTIMER *evtimer)
 {
     EVTCALLBACK *handler = NULL;
-    struct timeval tv = {0};
     EVTNODE *node = NULL;
     int i = 0, id = 0;
     off_t now = 0;
 
     if(evtimer && evtimer->head)
     {
-        gettimeofday(&tv, NULL);
-        now = (off_t)(tv.tv_sec * 1000000ll + tv.tv_usec * 1ll);
+        now = (off_t)stime_usec();
         MUTEX_LOCK(evtimer->mutex);
         evtimer->ntimeout = 0;
         while((node = evtimer->head) && node->evusec < now)
@@ -51,6 +51,82 @@ do
     }                                                                               \
     else *pp++ = *s++;                                                              \
 }while(0)
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+/* perfect hash of header names on (length, first, last) lowercased,
+ * ids in slots, generated against http_headers[] of http.h */
+#define HTTP_HEADER_HASH_K      0xa7c02333u
+#define HTTP_HEADER_HASH_BITS   7
+#define HTTP_HEADER_HASH(len, c0, cn) ((((((unsigned int)(len)) << 16)                     \
+            | (((unsigned int)(c0)) << 8) | ((unsigned int)(cn))) * HTTP_HEADER_HASH_K)     \
+        >> (32 - HTTP_HEADER_HASH_BITS))
+#define HTTP_LOWER(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c))
+static const signed char http_headers_hash[1 << HTTP_HEADER_HASH_BITS] = {
+    -1, -1, -1, -1, -1, -1,  3, 23, -1, -1, 51, 26, -1, -1, -1, 20, 
+    -1, 16, -1, -1, -1, 49, -1, -1, -1, 42, -1, -1, 35, -1, 29, -1, 
+    -1, 53, -1, 15, -1, -1, -1, 47, -1, 24, -1, -1, -1,  2, -1, 28, 
+    12, -1,  5, 43, -1, -1, -1, 34, -1, 31, -1,  6, -1, 52, -1, -1, 
+    -1, -1, 38, 21, 44, 14, -1, -1, -1, -1, 13, -1, -1, 27, -1, 22, 
+    -1,  0, 19, -1, -1,  7, -1, 11, -1, 46, -1, 32, 39, -1,  1, 25, 
+    33,  9, 45, 36, 17, -1, -1, -1, 30, -1, -1, 37, 18, -1,  8, 48, 
+    -1, 50, 40, -1, -1, -1, -1, -1, -1,  4, 41, -1, -1, -1, -1, 10
+};
+/* length of leading run of bytes none of specials (at most 8) */
+static inline int http_span(char *s, char *end, const char *specials, int nspecials)
+{
+    char *x = s;
+    int i = 0;
+#ifdef __AVX2__
+    __m256i yv[8], y, ym;
+    unsigned int ymask = 0;
+
+    if((end - x) >= 32)
+    {
+        for(i = 0; i < nspecials; i++) yv[i] = _mm256_set1_epi8(specials[i]);
+        do
+        {
+            y = _mm256_loadu_si256((__m256i *)x);
+            ym = _mm256_cmpeq_epi8(y, yv[0]);
+            for(i = 1; i < nspecials; i++) ym = _mm256_or_si256(ym, _mm256_cmpeq_epi8(y, yv[i]));
+            if((ymask = (unsigned int)_mm256_movemask_epi8(ym)))
+                return (x - s) + __builtin_ctz(ymask);
+            x += 32;
+        }while((end - x) >= 32);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i xv[8], v, m;
+    int mask = 0;
+
+    if((end - x) >= 16)
+    {
+        for(i = 0; i < nspecials; i++) xv[i] = _mm_set1_epi8(specials[i]);
+        do
+        {
+            v = _mm_loadu_si128((__m128i *)x);
+            m = _mm_cmpeq_epi8(v, xv[0]);
+            for(i = 1; i < nspecials; i++) m = _mm_or_si128(m, _mm_cmpeq_epi8(v, xv[i]));
+            if((mask = _mm_movemask_epi8(m)))
+                return (x - s) + __builtin_ctz(mask);
+            x += 16;
+        }while((end - x) >= 16);
+    }
+#endif
+    while(x < end)
+    {
+        for(i = 0; i < nspecials; i++)
+        {
+            if(*x == specials[i]) return (x - s);
+        }
+        ++x;
+    }
+    return (x - s);
+}
+
 static const char *http_encodings[] = {"deflate", "gzip", "bzip2", "compress"}; 
 static unsigned long crc32_tab[] = {
     0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
@@ -289,7 +365,11 @@ int http_argv_parse(char *p, char *end, HTTP_REQ *http_req)
             else if(argv->k || argv->v)
             {
                 if(pp >= epp) break;
-                *pp++ = *s++;
+                /* copy run needs no decoding at once */
+                if((n = http_span(s + 1, end, "+=&%\r\n ", 7) + 1) > (epp - pp)) n = epp - pp;
+                memcpy(pp, s, n);
+                pp += n;
+                s += n;
             }
             else ++s;
         }
@@ -355,7 +435,11 @@ int http_cookie_parse(char *p, char *end, HTTP_REQ *http_req)
             else if(cookie->k || cookie->v)
             {
                 if(pp >= epp) break;
-                *pp++ = *s++;
+                /* copy run needs no decoding at once */
+                if((n = http_span(s + 1, end, "+=;%\r \t", 7) + 1) > (epp - pp)) n = epp - pp;
+                memcpy(pp, s, n);
+                pp += n;
+                s += n;
             }
             else ++s;
             if((s == end || *s == '\r') && cookie < ecookie && cookie->k && cookie->v)
@@ -550,7 +634,14 @@ int http_request_parse(char *p, char *end, HTTP_REQ *http_req, void *map)
         eps = ps + HTTP_URL_PATH_MAX;
         while(s < end && *s != 0x20 && *s != '\r' && *s != '?' && ps < eps)
 	    {
-		    URLDECODE(s, end, high, low, ps);
+            if(*s != '%' && (n = http_span(s, end, "% \r?", 4)) > 0)
+            {
+                if(n > (eps - ps)) n = eps - ps;
+                memcpy(ps, s, n);
+                ps += n;
+                s += n;
+            }
+            else URLDECODE(s, end, high, low, ps);
 	    }
         if(ps >= eps ) goto end;
         *ps = '\0';
@@ -638,6 +729,156 @@ end:
     return ret;
 }
 
+/* find first CR or LF of line */
+static inline char *http_eol(char *s, char *end)
+{
+#ifdef __SSE2__
+    __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n'), x;
+    int mask = 0;
+
+    while((end - s) >= 16)
+    {
+        x = _mm_loadu_si128((__m128i *)s);
+        if((mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, cr), 
+                            _mm_cmpeq_epi8(x, lf)))))
+            return s + __builtin_ctz(mask);
+        s += 16;
+    }
+#endif
+    while(s < end && *s != '\r' && *s != '\n') ++s;
+    return s;
+}
+
+/* header id of name by perfect hash */
+int http_header_id(char *name, int len)
+{
+    int id = -1;
+
+    if(name && len > 0 && len < HTTP_HEAD_MAX
+            && (id = http_headers_hash[HTTP_HEADER_HASH(len, HTTP_LOWER(name[0]), 
+                    HTTP_LOWER(name[len-1]))]) >= 0)
+    {
+        if(http_headers[id].elen != (len + 1) 
+                || strncasecmp(http_headers[id].e, name, len) != 0)
+            id = -1;
+    }
+    return id;
+}
+
+/* method id of name */
+int http_method_id(char *name, int len)
+{
+    int i = 0;
+
+    if(name && len > 0)
+    {
+        for(i = 0; i < HTTP_METHOD_NUM; i++)
+        {
+            if(http_methods[i].elen == len && strncasecmp(http_methods[i].e, name, len) == 0)
+                return i;
+        }
+    }
+    return -1;
+}
+
+/* HTTP HEADER parser without copy */
+int http_xrequest_parse(char *p, char *end, HTTP_XREQ *xreq, int flag)
+{
+    char *s = p, *e = NULL, *x = NULL, *v = NULL, *pp = NULL;
+    int i  = 0, n = 0, high = 0, low = 0, ret = -1;
+
+    if(p && end && p < end && xreq)
+    {
+        memset(xreq, 0, sizeof(HTTP_XREQ));
+        xreq->data = p;
+        //request line
+        while(s < end && (*s == 0x20 || *s == 0x09))++s;
+        x = s;
+        while(s < end && *s != 0x20 && *s != '\r' && *s != '\n') ++s;
+        xreq->method.off = x - p;
+        xreq->method.len = s - x;
+        xreq->reqid = http_method_id(x, s - x);
+        while(s < end && *s == 0x20)++s;
+        e = http_eol(s, end);
+        x = s;
+        while(s < e && *s != 0x20 && *s != '?') ++s;
+        if((s - x) <= 0 || (s - x) >= HTTP_URL_PATH_MAX) return -1;
+        xreq->path.off = x - p;
+        xreq->path.len = s - x;
+        if(s < e && *s == '?')
+        {
+            x = ++s;
+            while(s < e && *s != 0x20) ++s;
+            xreq->argv.off = x - p;
+            xreq->argv.len = s - x;
+        }
+        while(s < e && *s == 0x20)++s;
+        x = s;
+        s = e;
+        while(s > x && *(s-1) == 0x20) --s;
+        xreq->version.off = x - p;
+        xreq->version.len = s - x;
+        if((s = e) < end && *s == '\r') ++s;
+        if(s < end && *s == '\n') ++s;
+        ret = 0;
+        //headers
+        while(s < end)
+        {
+            if((e = http_eol(s, end)) == s)
+            {
+                if(s < end && *s == '\r') ++s;
+                if(s < end && *s == '\n') ++s;
+                xreq->header_size = s - p;
+                break;
+            }
+            if((x = memchr(s, ':', e - s)))
+            {
+                v = x + 1;
+                while(x > s && (*(x-1) == 0x20 || *(x-1) == 0x09)) --x;
+                if((i = http_header_id(s, x - s)) >= 0)
+                {
+                    while(v < e && (*v == 0x20 || *v == 0x09)) ++v;
+                    x = e;
+                    while(x > v && (*(x-1) == 0x20 || *(x-1) == 0x09)) --x;
+                    xreq->headers[i].off = v - p;
+                    xreq->headers[i].len = x - v;
+                    ret++;
+                }
+            }
+            if((s = e) < end && *s == '\r') ++s;
+            if(s < end && *s == '\n') ++s;
+        }
+        //terminate slices and decode path in place
+        if(flag & HTTP_XREQ_TERMINATE)
+        {
+            if((x = p + xreq->method.off + xreq->method.len) < end) *x = '\0';
+            if((x = p + xreq->version.off + xreq->version.len) < end) *x = '\0';
+            if(xreq->argv.len > 0 && (x = p + xreq->argv.off + xreq->argv.len) < end) *x = '\0';
+            for(i = 0; i < HTTP_HEADER_NUM; i++)
+            {
+                if(xreq->headers[i].off > 0 
+                        && (x = p + xreq->headers[i].off + xreq->headers[i].len) < end) 
+                    *x = '\0';
+            }
+            s = pp = p + xreq->path.off;
+            e = s + xreq->path.len;
+            while(s < e)
+            {
+                if(*s != '%' && (n = http_span(s, e, "%", 1)) > 0)
+                {
+                    if(pp != s) memmove(pp, s, n);
+                    pp += n;
+                    s += n;
+                }
+                else URLDECODE(s, e, high, low, pp);
+            }
+            xreq->path.len = pp - (p + xreq->path.off);
+            if(pp < end) *pp = '\0';
+        }
+    }
+    return ret;
+}
+
 /* HTTP response parser */
 int http_response_parse(char *p, char *end, HTTP_RESPONSE *http_resp, void *map)
 {
@@ -1063,3 +1304,148 @@ int main(int argc, char **argv)
     return 0;
 }
 #endif
+
+#ifdef _BENCH_HTTP
+#include <sys/time.h>
+/* browser request headers corpus */
+static char *http_corpus[] = {
+    "GET /search?q=sbase&ie=UTF-8&oe=UTF-8 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+    "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.2.1386528474.1697012345; _gid=GA1.2.214748364.1697712345; "
+    "session=eyJ1aWQiOjEyMzQ1Njc4OX0.ZTAxNjI3.abcdefghijklmnopqrstuvwxyz\r\n\r\n",
+    "GET /static/css/main.css?v=20231019 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: https://www.example.com/search?q=sbase\r\n"
+    "Cookie: _ga=GA1.2.1386528474.1697012345; session=eyJ1aWQiOjEyMzQ1Njc4OX0\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-Modified-Since: Thu, 19 Oct 2023 02:43:12 GMT\r\n"
+    "If-None-Match: \"65308c50-1f3a\"\r\n"
+    "Cache-Control: max-age=0\r\n\r\n",
+    "GET /images/%E4%BD%A0%E5%A5%BD/logo.png HTTP/1.1\r\n"
+    "Host: img.example.com\r\n"
+    "Accept: image/webp,image/avif,video/*;q=0.8,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Accept-Language: zh-cn\r\n"
+    "Connection: keep-alive\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 "
+    "(KHTML, like Gecko) Version/17.0 Safari/605.1.15\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Range: bytes=0-65535\r\n\r\n",
+    "GET /favicon.ico HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n\r\n"
+};
+#define HTTP_CORPUS_NUM (sizeof(http_corpus)/sizeof(char *))
+int main(int argc, char **argv)
+{
+    char buf[HTTP_BUFFER_SIZE], *p = NULL;
+    int i = 0, j = 0, n = 0, k = 0, count = 1000000, lens[HTTP_CORPUS_NUM];
+    void *map = NULL;
+    HTTP_REQ http_req;
+    HTTP_XREQ xreq;
+    struct timeval tv = {0};
+    long long start = 0, used = 0;
+
+    if(argc > 1) count = atoi(argv[1]);
+    if((map = http_headers_map_init()) == NULL) return -1;
+    for(j = 0; j < HTTP_CORPUS_NUM; j++) lens[j] = strlen(http_corpus[j]);
+    /* same headers from both parsers */
+    for(j = 0; j < HTTP_CORPUS_NUM; j++)
+    {
+        memset(&http_req, 0, sizeof(HTTP_REQ));
+        http_request_parse(http_corpus[j], http_corpus[j] + lens[j], &http_req, map);
+        memcpy(buf, http_corpus[j], lens[j]);
+        http_xrequest_parse(buf, buf + lens[j], &xreq, HTTP_XREQ_TERMINATE);
+        if(http_req.reqid != xreq.reqid || strcmp(http_req.path, buf + xreq.path.off) != 0)
+            fprintf(stderr, "corpus[%d] request line mismatch\n", j);
+        for(i = 0; i < HTTP_HEADER_NUM; i++)
+        {
+            if((http_req.headers[i] > 0) != (xreq.headers[i].off > 0) || (xreq.headers[i].off > 0 
+                        && i != HEAD_REQ_COOKIE && strcmp(http_req.hlines + http_req.headers[i], 
+                            buf + xreq.headers[i].off) != 0))
+                fprintf(stderr, "corpus[%d] header %s mismatch\n", j, http_headers[i].e);
+        }
+    }
+    /* http_request_parse() */
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < count; i++)
+    {
+        j = i % HTTP_CORPUS_NUM;
+        memset(&http_req, 0, sizeof(HTTP_REQ));
+        k += http_request_parse(http_corpus[j], http_corpus[j] + lens[j], &http_req, map);
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "http_request_parse() %d requests in %lld usec, %.0f req/s\n", 
+            count, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    /* http_xrequest_parse() */
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < count; i++)
+    {
+        j = i % HTTP_CORPUS_NUM;
+        k += http_xrequest_parse(http_corpus[j], http_corpus[j] + lens[j], &xreq, 0);
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "http_xrequest_parse() %d requests in %lld usec, %.0f req/s\n", 
+            count, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    /* http_xrequest_parse() terminated in place, with copy of packet */
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < count; i++)
+    {
+        j = i % HTTP_CORPUS_NUM;
+        p = buf; n = lens[j];
+        memcpy(p, http_corpus[j], n);
+        k += http_xrequest_parse(p, p + n, &xreq, HTTP_XREQ_TERMINATE);
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "http_xrequest_parse(TERMINATE) %d requests in %lld usec, %.0f req/s\n", 
+            count, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    /* http_argv_parse() on long api query */
+    p = buf;
+    p += sprintf(p, "%s", "appid=wx8d2a5c0e3f1b4a97&timestamp=1697712345&nonce=8f3e2a1c5b7d9e0f");
+    for(j = 0; j < 24; j++)
+    {
+        p += sprintf(p, "&field_%d=the_quick_brown_fox_jumps_over_the_lazy_dog_%d"
+                "&name_%d=%%E4%%BD%%A0%%E5%%A5%%BD+world", j, j, j);
+    }
+    n = p - buf;
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < count; i++)
+    {
+        http_req.nargvs = 0;
+        http_req.nline = 0;
+        k += http_argv_parse(buf, buf + n, &http_req);
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "http_argv_parse() %d queries(%d bytes %d argvs) in %lld usec, %.0f q/s\n", 
+            count, n, http_req.nargvs, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    fprintf(stdout, "sizeof(HTTP_REQ):%d sizeof(HTTP_XREQ):%d (%d)\n", 
+            (int)sizeof(HTTP_REQ), (int)sizeof(HTTP_XREQ), k);
+    http_headers_map_clean(map);
+    return 0;
+}
+//gcc -O2 -o hbench http.c mtrie.c stime.c -D_BENCH_HTTP && ./hbench 1000000
+#endif
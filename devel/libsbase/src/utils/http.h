@@ -36,6 +36,7 @@ typedef struct _HTTP_VHOST
     char *name;
     char *home;
     void *logger;
+    void *alog;
 }HTTP_VHOST;
 typedef struct _HTTPK
 {
@@ -576,12 +577,32 @@ typedef struct _HTTP_REQ
     char hlines[HTTP_HEADER_MAX];
     char line[HTTP_ARGV_LINE_MAX];
 }HTTP_REQ;
+/* request parsed in place, slices are (offset, length) of data */
+#define HTTP_XREQ_TERMINATE     0x01
+typedef struct _HTTP_XREQ
+{
+    int reqid;
+    int header_size;
+    char *data;
+    HTTPK method;
+    HTTPK path;
+    HTTPK argv;
+    HTTPK version;
+    HTTPK headers[HTTP_HEADER_NUM];
+}HTTP_XREQ;
 /* initialize headers map */
 void *http_headers_map_init();
 /* clean headers map */
 void http_headers_map_clean(void *map);
 /* HTTP request HEADER parser */
 int http_request_parse(char *p, char *end, HTTP_REQ *http_req, void *map);
+/* HTTP request HEADER parser without copy, HTTP_XREQ_TERMINATE for '\0' ended
+ * slices and url-decoded path written in place */
+int http_xrequest_parse(char *p, char *end, HTTP_XREQ *xreq, int flag);
+/* header id of name (without ':') by perfect hash, -1 if unknown */
+int http_header_id(char *name, int len);
+/* method id of name, -1 if unknown */
+int http_method_id(char *name, int len);
 /* HTTP argvs  parser */
 int http_argv_parse(char *p, char *end, HTTP_REQ *http_req);
 /* parse cookie */
@@ -12,12 +12,21 @@
 #include <sys/file.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/uio.h>
 #include "logger.h"
+#include "stime.h"
+#define LOGGER_IOV_MAX      256
+#define LOGREC_HEAD         16
+#define LOGREC_SIZE(len)    ((LOGREC_HEAD + (len) + 15) & ~15)
+/* record in ring, logger NULL for skipped tail of ring */
+typedef struct _LOGREC
+{
+    LOGGER *logger;
+    int len;
+}LOGREC;
 static char *_logger_level_s[] = {"DEBUG", "WARN", "ERROR", "FATAL", ""};
-#ifndef _STATIS_YMON
-#define _STATIS_YMON
-static char *ymonths[]= {"Jan", "Feb", "Mar", "Apr", "May", "Jun","Jul", "Aug", "Sep","Oct", "Nov", "Dec"};
-#endif
+static LOGASYNC *_logger_async_ = NULL;
+static __thread LOGRING *_logger_ring_ = NULL;
 /* mkdir force */
 int logger_mkdir(char *path)
 {
@@ -96,7 +105,7 @@ void logger_rotate_check(LOGGER *logger, struct tm *ptm)
         {
             if(logger->fd > 0)
             {
-                if(fstat(logger->fd, &st) == 0 && st.st_size > (off_t)ROTATE_LOG_SIZE)
+                if(logger->size > (off_t)ROTATE_LOG_SIZE)
                     x = ++(logger->total);
                 else 
                     x = 0;
@@ -115,6 +124,10 @@ void logger_rotate_check(LOGGER *logger, struct tm *ptm)
             if(logger->fd > 0){close(logger->fd);logger->fd = -1;}
             sprintf(line, "%s.%u", logger->file, (unsigned int)x);
             logger->fd = open(line, O_CREAT|O_WRONLY|O_APPEND, 0644);
+            /* bytes counted in process from now */
+            logger->size = 0;
+            if(logger->fd > 0 && fstat(logger->fd, &st) == 0) logger->size = st.st_size;
+            ++(logger->nfiles);
         }
     }
     return ;
@@ -123,9 +136,7 @@ void logger_rotate_check(LOGGER *logger, struct tm *ptm)
 LOGGER *logger_init(char *file, int rotate_flag)
 {
     LOGGER *logger = NULL;
-    struct tm *ptm = NULL;
-    struct timeval tv = {0};
-    time_t timep = 0;
+    struct tm tm = {0};
 
     if((logger = (LOGGER *)calloc(1, sizeof(LOGGER))))
     {
@@ -133,33 +144,38 @@ LOGGER *logger_init(char *file, int rotate_flag)
         strcpy(logger->file, file);
         logger_mkdir(file);
         logger->rflag = rotate_flag;
-        gettimeofday(&tv, NULL);
-        time(&timep);
-        ptm = localtime(&timep);
-        logger_rotate_check(logger, ptm);
+        logger->checked = stime_now();
+        stime_localtime(&tm);
+        logger_rotate_check(logger, &tm);
     }
     return logger;
 }
 
+/* check rotation once per second or on size over, logger->mutex locked */
+static void logger_check(LOGGER *logger)
+{
+    struct tm tm = {0};
+    time_t now = 0;
+
+    if((now = stime_now()) != logger->checked
+            || (!(logger->rflag & LOG_ROTATE_TIME) && logger->size > (off_t)ROTATE_LOG_SIZE))
+    {
+        logger->checked = now;
+        stime_localtime(&tm);
+        logger_rotate_check(logger, &tm);
+    }
+    return ;
+}
+
 int logger_header(LOGGER *logger, char *buf, int level, char *_file_, int _line_)
 {
-    struct tm *ptm = NULL;
-    struct timeval tv = {0};
-    time_t timep = 0;
     int n = 0;
     char *s = NULL;
 
     if(logger && (s = buf) && _file_ && level < __LEVEL__)
     {
-        gettimeofday(&tv, NULL);
-        time(&timep);
-        ptm = localtime(&timep);
-        MUTEX_LOCK(logger->mutex);
-        logger_rotate_check(logger, ptm);
-        MUTEX_UNLOCK(logger->mutex);
-        s += sprintf(s,"[%02d/%s/%04d:%02d:%02d:%02d +%06u] ", ptm->tm_mday, 
-                ymonths[ptm->tm_mon], (1900+ptm->tm_year), ptm->tm_hour, ptm->tm_min, 
-                ptm->tm_sec, (unsigned int)(tv.tv_usec));
+        s += stime_logdate(s);
+        s += sprintf(s, " +%06u] ", (unsigned int)(stime_usec() % 1000000ll));
         if(level >= 0)                                                          
         {                                                                           
             s += sprintf(s, "[%u/%p] #%s::%d# %s:", (unsigned int)getpid(), 
@@ -170,36 +186,354 @@ int logger_header(LOGGER *logger, char *buf, int level, char *_file_, int _line_
     return n;
 }
 
+/* ring of current thread, registered to flusher at first line */
+static LOGRING *logger_ring(LOGASYNC *async)
+{
+    LOGRING *ring = NULL;
+
+    if((ring = _logger_ring_) == NULL && async->nrings < LOGGER_RINGS_MAX
+            && (ring = (LOGRING *)calloc(1, sizeof(LOGRING))))
+    {
+        if((ring->data = (char *)calloc(1, async->size)))
+        {
+            ring->size = async->size;
+            MUTEX_LOCK(async->mutex);
+            if(async->nrings < LOGGER_RINGS_MAX)
+            {
+                async->rings[async->nrings] = ring;
+                __sync_synchronize();
+                async->nrings++;
+                _logger_ring_ = ring;
+            }
+            MUTEX_UNLOCK(async->mutex);
+        }
+        if(_logger_ring_ != ring)
+        {
+            if(ring->data) free(ring->data);
+            free(ring);
+            ring = NULL;
+        }
+    }
+    return ring;
+}
+
+/* append line to ring, return -1 if ring full */
+static int logger_ring_push(LOGRING *ring, LOGGER *logger, char *buf, int len)
+{
+    unsigned int need = LOGREC_SIZE(len), pos = 0, left = 0, total = 0;
+    LOGREC *rec = NULL;
+
+    pos = ring->tail & (ring->size - 1);
+    left = ring->size - pos;
+    total = (left < need) ? (left + need) : need;
+    if((ring->size - (ring->tail - ring->head)) < total) return -1;
+    if(left < need)
+    {
+        rec = (LOGREC *)(ring->data + pos);
+        rec->logger = NULL;
+        rec->len = left - LOGREC_HEAD;
+        pos = 0;
+    }
+    rec = (LOGREC *)(ring->data + pos);
+    rec->logger = logger;
+    rec->len = len;
+    memcpy(((char *)rec) + LOGREC_HEAD, buf, len);
+    /* publish record before tail */
+    __sync_synchronize();
+    ring->tail += total;
+    return 0;
+}
+
+/* write data as is, as a line through rings or directly */
+int logger_write_raw(LOGGER *logger, char *data, int len)
+{
+    LOGASYNC *async = NULL;
+    LOGRING *ring = NULL;
+    int ret = -1;
+
+    if(logger && data && len > 0 && len <= LOGGER_LINE_LIMIT)
+    {
+        if((async = _logger_async_) && async->running && (ring = logger_ring(async)))
+        {
+            while(logger_ring_push(ring, logger, data, len) != 0)
+            {
+                if(async->policy != LOGGER_FULL_BLOCK || !async->running)
+                {
+                    __sync_add_and_fetch(&(logger->dropped), 1);
+                    __sync_add_and_fetch(&(async->dropped), 1);
+                    return 0;
+                }
+                usleep(LOGGER_FLUSH_USEC/10);
+            }
+            return len;
+        }
+        //if(logger->fd > 0) ret = pwrite(logger->fd, buf, s - buf, (off_t)0);
+        MUTEX_LOCK(logger->mutex);
+        logger_check(logger);
+        if((ret = write(logger->fd, data, len)) > 0) logger->size += ret;
+        MUTEX_UNLOCK(logger->mutex);
+    }
+    return ret;
+}
+
 int logger_write(LOGGER *logger, int level, char *_file_, int _line_, char *format,...)
 {
     char buf[LOGGER_LINE_LIMIT], *s = NULL;
+    int ret = 0, n = 0;
     va_list ap;
-    int ret = 0;
     
     if((s = buf))
     {
         s += logger_header(logger, s, level, _file_, _line_);
+        n = LOGGER_LINE_LIMIT - (s - buf) - 2;
         va_start(ap, format);
-        s += vsnprintf(s, LOGGER_LINE_LIMIT - (s - buf), format, ap);
+        if((ret = vsnprintf(s, n, format, ap)) > 0) s += (ret < n) ? ret : (n - 1);
         va_end(ap);
         *s++ = '\r';
         *s++ = '\n';
-        //if(logger->fd > 0) ret = pwrite(logger->fd, buf, s - buf, (off_t)0);
-        MUTEX_LOCK(logger->mutex);
-        ret = write(logger->fd, buf, s - buf);
-        MUTEX_UNLOCK(logger->mutex);
+        ret = logger_write_raw(logger, buf, s - buf);
     }
     return ret;
 }
 
+/* write batch of one logger */
+static void logger_writev(LOGGER *logger, struct iovec *iov, int n)
+{
+    char line[LOGGER_LINE_SIZE], *s = NULL;
+    int x = 0;
+
+    if((x = logger->dropped) != logger->ndropped && !logger->raw)
+    {
+        s = line + logger_header(logger, line, __WARN__, __FILE__, __LINE__);
+        s += sprintf(s, "dropped %d lines on full log rings\r\n", x - logger->ndropped);
+        iov[n].iov_base = line;
+        iov[n].iov_len = s - line;
+        logger->ndropped = x;
+        ++n;
+    }
+    MUTEX_LOCK(logger->mutex);
+    logger_check(logger);
+    if((x = writev(logger->fd, iov, n)) > 0) logger->size += x;
+    MUTEX_UNLOCK(logger->mutex);
+    return ;
+}
+
+/* write out all queued lines, return lines written */
+int logger_async_flush()
+{
+    struct iovec iov[LOGGER_IOV_MAX + 1];
+    LOGASYNC *async = _logger_async_;
+    unsigned int head = 0, tail = 0;
+    LOGGER *logger = NULL;
+    LOGRING *ring = NULL;
+    LOGREC *rec = NULL;
+    int i = 0, n = 0, count = 0;
+
+    if(async)
+    {
+        MUTEX_LOCK(async->mutex);
+        for(i = 0; i < async->nrings; i++)
+        {
+            ring = async->rings[i];
+            head = ring->head;
+            tail = ring->tail;
+            __sync_synchronize();
+            logger = NULL;
+            n = 0;
+            while(head != tail)
+            {
+                rec = (LOGREC *)(ring->data + (head & (ring->size - 1)));
+                if(rec->logger == NULL)
+                {
+                    head += LOGREC_HEAD + rec->len;
+                    continue;
+                }
+                if(n > 0 && (rec->logger != logger || n == LOGGER_IOV_MAX))
+                {
+                    logger_writev(logger, iov, n);
+                    n = 0;
+                }
+                logger = rec->logger;
+                iov[n].iov_base = ((char *)rec) + LOGREC_HEAD;
+                iov[n].iov_len = rec->len;
+                head += LOGREC_SIZE(rec->len);
+                ++count;
+                ++n;
+            }
+            if(n > 0) logger_writev(logger, iov, n);
+            /* release space after written */
+            __sync_synchronize();
+            ring->head = head;
+        }
+        MUTEX_UNLOCK(async->mutex);
+    }
+    return count;
+}
+
+/* flusher thread */
+static void *logger_flusher(void *arg)
+{
+    LOGASYNC *async = (LOGASYNC *)arg;
+
+    while(async->running)
+    {
+        if(logger_async_flush() == 0) usleep(LOGGER_FLUSH_USEC);
+    }
+    return NULL;
+}
+
+/* fork() keeps no flusher, written lines stay with parent */
+static void logger_async_prepare()
+{
+    if(_logger_async_)
+    {
+        logger_async_flush();
+        MUTEX_LOCK(_logger_async_->mutex);
+    }
+    return ;
+}
+
+static void logger_async_parent()
+{
+    if(_logger_async_) MUTEX_UNLOCK(_logger_async_->mutex);
+    return ;
+}
+
+static void logger_async_child()
+{
+    LOGASYNC *async = _logger_async_;
+    int i = 0;
+
+    if(async)
+    {
+        for(i = 0; i < async->nrings; i++)
+            async->rings[i]->head = async->rings[i]->tail;
+        MUTEX_UNLOCK(async->mutex);
+        if(pthread_create(&(async->flusher), NULL, &logger_flusher, (void *)async) != 0)
+            async->running = 0;
+    }
+    return ;
+}
+
+/* start flusher, lines of all loggers go through per-thread rings of ring_size bytes */
+int logger_async_init(int ring_size, int policy)
+{
+    LOGASYNC *async = NULL;
+    int size = 4 * LOGGER_LINE_LIMIT;
+
+    if(_logger_async_ == NULL && ring_size > 0 && (async = (LOGASYNC *)calloc(1, sizeof(LOGASYNC))))
+    {
+        while(size < ring_size) size <<= 1;
+        async->size = size;
+        async->policy = policy;
+        async->running = 1;
+        MUTEX_INIT(async->mutex);
+        _logger_async_ = async;
+        if(pthread_atfork(&logger_async_prepare, &logger_async_parent, &logger_async_child) == 0
+                && pthread_create(&(async->flusher), NULL, &logger_flusher, (void *)async) == 0)
+            return 0;
+        _logger_async_ = NULL;
+        MUTEX_DESTROY(async->mutex);
+        free(async);
+    }
+    return -1;
+}
+
+/* lines dropped on full rings */
+long long logger_async_dropped()
+{
+    if(_logger_async_) return _logger_async_->dropped;
+    return 0;
+}
+
+/* flush and stop flusher, writing threads stopped already */
+void logger_async_clean()
+{
+    LOGASYNC *async = _logger_async_;
+    int i = 0;
+
+    if(async)
+    {
+        async->running = 0;
+        pthread_join(async->flusher, NULL);
+        logger_async_flush();
+        _logger_async_ = NULL;
+        _logger_ring_ = NULL;
+        for(i = 0; i < async->nrings; i++)
+        {
+            free(async->rings[i]->data);
+            free(async->rings[i]);
+        }
+        MUTEX_DESTROY(async->mutex);
+        free(async);
+    }
+    return ;
+}
+
 void logger_clean(void *ptr)
 {
     LOGGER *logger = (LOGGER *)ptr;
     if(logger)
     {
+        /* no queued line left to freed logger */
+        if(_logger_async_) logger_async_flush();
         if(logger->fd) close(logger->fd);
         MUTEX_DESTROY(logger->mutex);
         free(logger);
     }
     return ;
 }
+
+#ifdef _BENCH_LOGGER
+#define BENCH_THREADS_MAX 64
+static LOGGER *bench_logger = NULL;
+static int bench_lines = 100000;
+void *bench_writer(void *arg)
+{
+    int i = 0;
+
+    for(i = 0; i < bench_lines; i++)
+    {
+        REALLOG(bench_logger, "127.0.0.1 GET /index.html HTTP/1.1 200 %d %d", i, (int)(long)arg);
+    }
+    return NULL;
+}
+long long bench_run(int nthreads)
+{
+    pthread_t threads[BENCH_THREADS_MAX];
+    struct timeval tv = {0};
+    long long start = 0;
+    int i = 0;
+
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < nthreads; i++)
+        pthread_create(&threads[i], NULL, &bench_writer, (void *)(long)i);
+    for(i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec * 1000000ll + tv.tv_usec - start);
+}
+int main(int argc, char **argv)
+{
+    int nthreads = 4, policy = LOGGER_FULL_DROP;
+    long long used = 0, total = 0;
+
+    if(argc > 1) nthreads = atoi(argv[1]);
+    if(argc > 2) bench_lines = atoi(argv[2]);
+    if(argc > 3) policy = atoi(argv[3]);
+    if(nthreads > BENCH_THREADS_MAX) nthreads = BENCH_THREADS_MAX;
+    total = (long long)nthreads * bench_lines;
+    LOGGER_INIT(bench_logger, "/tmp/bench_logger/sync.log");
+    used = bench_run(nthreads);
+    fprintf(stdout, "sync  %lld lines in %lld usec, %.0f lines/s\n", total, used, total * 1000000.0/(used ? used : 1));
+    LOGGER_CLEAN(bench_logger);
+    LOGGER_INIT(bench_logger, "/tmp/bench_logger/async.log");
+    logger_async_init(LOGGER_RING_SIZE, policy);
+    used = bench_run(nthreads);
+    fprintf(stdout, "async %lld lines in %lld usec, %.0f lines/s, dropped:%lld\n", total, used, total * 1000000.0/(used ? used : 1), logger_async_dropped());
+    LOGGER_CLEAN(bench_logger);
+    logger_async_clean();
+    return 0;
+}
+//gcc -O2 -o lbench logger.c stime.c -D_BENCH_LOGGER -lpthread && ./lbench 4 100000 1
+#endif
@@ -23,6 +23,7 @@ extern "C" {
 #define LOG_ROTATE_WEEK             0x04
 #define LOG_ROTATE_MONTH            0x08
 #define LOG_ROTATE_SIZE             0x10
+#define LOG_ROTATE_TIME             0x0f
 #define ROTATE_LOG_SIZE             268435456
 #define LOGGER_LINE_SIZE            1024
 #define LOGGER_LINE_LIMIT  	        32768
@@ -34,6 +35,11 @@ extern "C" {
 #define	__FATAL__ 		3
 #define	__ACCESS__ 		4
 #define __LEVEL__       5
+#define LOGGER_RING_SIZE            262144
+#define LOGGER_RINGS_MAX            256
+#define LOGGER_FLUSH_USEC           1000
+#define LOGGER_FULL_DROP            0x00
+#define LOGGER_FULL_BLOCK           0x01
 typedef struct _LOGGER
 {
     int rflag;
@@ -44,8 +50,35 @@ typedef struct _LOGGER
     int bits;
     time_t uptime;
     MUTEX *mutex;
+    int dropped;
+    int ndropped;
+    off_t size;
+    time_t checked;
+    int nfiles;
+    /* binary records, no text lines added */
+    int raw;
     char file[LOGGER_PATH_MAX];
 }LOGGER;
+/* single producer ring of a writing thread, drained by flusher */
+typedef struct _LOGRING
+{
+    volatile unsigned int tail;
+    int size;
+    char pad[56];
+    volatile unsigned int head;
+    char *data;
+}LOGRING;
+typedef struct _LOGASYNC
+{
+    int running;
+    int size;
+    int policy;
+    int nrings;
+    long long dropped;
+    MUTEX *mutex;
+    pthread_t flusher;
+    LOGRING *rings[LOGGER_RINGS_MAX];
+}LOGASYNC;
 #endif
 #define PLOG(xxxxx) ((LOGGER *)xxxxx)
 #ifdef HAVE_PTHREAD
@@ -57,8 +90,18 @@ int logger_mkdir(char *path);
 void logger_rotate_check(LOGGER *logger, struct tm *ptm);
 int logger_header(LOGGER *logger, char *s, int level, char *_file_, int _line_);
 int logger_write(LOGGER *logger, int level, char *_file_, int _line_, char *format,...);
+/* write data as is, as a line through rings or directly */
+int logger_write_raw(LOGGER *logger, char *data, int len);
 LOGGER *logger_init(char *file, int rotate_flag);
 void logger_clean(void *ptr);
+/* start flusher, lines of all loggers go through per-thread rings of ring_size bytes */
+int logger_async_init(int ring_size, int policy);
+/* write out all queued lines, return lines written */
+int logger_async_flush();
+/* lines dropped on full rings */
+long long logger_async_dropped();
+/* flush and stop flusher */
+void logger_async_clean();
 #define LOGGER_ADD(ptr, __level__, format...)logger_write(PLOG(ptr),__level__,__FILE__, __LINE__,format) 
 #define LOGGER_INIT(ptr, file) (ptr = logger_init(file, 0))
 #define LOGGER_ROTATE_INIT(ptr, file, flag) (ptr = logger_init(file, flag))
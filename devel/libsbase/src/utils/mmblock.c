@@ -30,7 +30,7 @@ int mmblock_incre(MMBLOCK *mmblock, int incre_size)
 		if(size % MMBLOCK_BASE) ++n;
 		size = n * MMBLOCK_BASE;
 		//mmblock->data = (char *)realloc(mmblock->data, size);
-		if((mmblock->data = (char *)xmm_resize(mmblock->data, mmblock->size, size)))
+		if((mmblock->data = (char *)xmm_tag_resize(XMM_TAG_MMBLOCK, mmblock->data, mmblock->size, size)))
 		{
 			mmblock->end = mmblock->data + mmblock->ndata;
 			mmblock->left = size - mmblock->ndata - 1;
@@ -60,10 +60,18 @@ int mmblock_check(MMBLOCK *mmblock)
 /* recv() */
 int mmblock_recv(MMBLOCK *mmblock, int fd, int flag)
 {
+    char buf[MMBLOCK_SCRATCH];
 	int n = -1;
 
 	if(mmblock && fd > 0)
 	{
+        /* idle block, take memory only when data arrived */
+        if(mmblock->data == NULL)
+        {
+            if((n = recv(fd, buf, MMBLOCK_SCRATCH, flag)) > 0
+                    && mmblock_push(mmblock, buf, n) < 0) n = -1;
+            return n;
+        }
         if(mmblock->left < MMBLOCK_MIN) mmblock_incre(mmblock, MMBLOCK_BASE);
 		if(mmblock->data && mmblock->end && mmblock->left > 0
 		&& (n = recv(fd, mmblock->end, mmblock->left, flag)) > 0)
@@ -80,10 +88,17 @@ int mmblock_recv(MMBLOCK *mmblock, int fd, int flag)
 /* read() */
 int mmblock_read(MMBLOCK *mmblock, int fd)
 {
+    char buf[MMBLOCK_SCRATCH];
 	int n = -1;
 
 	if(mmblock && fd > 0)
 	{
+        if(mmblock->data == NULL)
+        {
+            if((n = recv(fd, buf, MMBLOCK_SCRATCH, MSG_DONTWAIT)) > 0
+                    && mmblock_push(mmblock, buf, n) < 0) n = -1;
+            return n;
+        }
         if(mmblock->left < MMBLOCK_MIN) mmblock_incre(mmblock, MMBLOCK_BASE);
 		if(mmblock->data && mmblock->end && mmblock->left > 0
 		    && (n = recv(fd, mmblock->end, mmblock->left, MSG_DONTWAIT)) > 0)
@@ -104,6 +119,16 @@ int mmblock_read_SSL(MMBLOCK *mmblock, void *ssl)
 	int n = -1;
 	if(mmblock && ssl)
 	{
+#ifdef HAVE_SSL
+        char buf[MMBLOCK_SCRATCH];
+
+        if(mmblock->data == NULL)
+        {
+            if((n = SSL_read(XSSL(ssl), buf, MMBLOCK_SCRATCH)) > 0
+                    && mmblock_push(mmblock, buf, n) < 0) n = -1;
+            return n;
+        }
+#endif
         if(mmblock->left < MMBLOCK_MIN) mmblock_incre(mmblock, MMBLOCK_BASE);
 #ifdef HAVE_SSL
 		if(mmblock->data && mmblock->end && mmblock->left > 0
@@ -174,7 +199,7 @@ void mmblock_reset(MMBLOCK *mmblock)
 		if(mmblock->size > MMBLOCK_MAX)
         {
 
-            xmm_free(mmblock->data, mmblock->size);
+            xmm_tag_free(XMM_TAG_MMBLOCK, mmblock->data, mmblock->size);
             mmblock->size = mmblock->ndata = mmblock->left = 0;
             mmblock->end = mmblock->data  = NULL;
         }
@@ -189,12 +214,24 @@ void mmblock_reset(MMBLOCK *mmblock)
 	return ;
 }
 
+/* release memory of empty block */
+void mmblock_release(MMBLOCK *mmblock)
+{
+	if(mmblock && mmblock->data && mmblock->ndata == 0)
+    {
+        xmm_tag_free(XMM_TAG_MMBLOCK, mmblock->data, mmblock->size);
+        mmblock->data = mmblock->end = NULL;
+        mmblock->size = mmblock->left = 0;
+    }
+	return ;
+}
+
 /* destroy */
 void mmblock_destroy(MMBLOCK *mmblock)
 {
 	if(mmblock)
     {
-        if(mmblock->data) xmm_free(mmblock->data, mmblock->size);
+        if(mmblock->data) xmm_tag_free(XMM_TAG_MMBLOCK, mmblock->data, mmblock->size);
         mmblock->data = mmblock->end = NULL;
         mmblock->size = mmblock->ndata = mmblock->left = 0;
     }
@@ -206,7 +243,7 @@ void mmblock_clean(MMBLOCK *mmblock)
 {
 	if(mmblock)
     {
-        if(mmblock->data) xmm_free(mmblock->data, mmblock->size);
+        if(mmblock->data) xmm_tag_free(XMM_TAG_MMBLOCK, mmblock->data, mmblock->size);
         xmm_free(mmblock, sizeof(MMBLOCK));
     }
 	return ;
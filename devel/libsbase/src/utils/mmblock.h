@@ -20,6 +20,8 @@ typedef struct _MMBLOCK
 //#define  MMBLOCK_BASE 	524288
 #define  MMBLOCK_MIN 	    1024
 #define  MMBLOCK_MAX 	    262144
+/* reads of block without memory go to stack first */
+#define  MMBLOCK_SCRATCH    16384
 //#define  MMBLOCK_MAX 	    1048576
 /* initialize() */
 MMBLOCK *mmblock_init();
@@ -35,6 +37,8 @@ int mmblock_push(MMBLOCK *mmblock, char *data, int ndata);
 int mmblock_del(MMBLOCK *mmblock, int ndata);
 /* reset() */
 void mmblock_reset(MMBLOCK *mmblock);
+/* release memory of empty block */
+void mmblock_release(MMBLOCK *mmblock);
 /* destroy */
 void mmblock_destroy(MMBLOCK *mmblock);
 /* clean() */
@@ -51,6 +55,7 @@ void mmblock_clean(MMBLOCK *mmblock);
 #define MMB_PUSH(x, pdata, ndata) mmblock_push(&x, pdata, ndata)
 #define MMB_DELETE(x, ndata) mmblock_del(&x, ndata)
 #define MMB_RESET(x) mmblock_reset(&x)
+#define MMB_RELEASE(x) mmblock_release(&x)
 #define MMB_DESTROY(x) mmblock_destroy(&x)
 #define MMB_CLEAN(x) mmblock_clean(&x)
 #endif
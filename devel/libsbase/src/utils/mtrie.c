@@ -6,8 +6,12 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sched.h>
 #include "mtrie.h"
 #include "mutex.h"
+/* address space reserved to grow map in place */
+#define MTRIE_NODES_VMAX  ((sizeof(void *) > 4) ? 268435456 : 8000000)
+#define MTRIE_MAP_VSIZE   ((off_t)sizeof(MTRSTATE) + (off_t)MTRIE_NODES_VMAX * (off_t)sizeof(MTRNODE))
 #define MTRNODE_COPY(new, old)                                                  \
 do                                                                              \
 {                                                                               \
@@ -24,6 +28,126 @@ do
     node.data = 0;                                                              \
     node.childs = 0;                                                            \
 }while(0)
+/* load childs/nchilds of node being walked without lock */
+#define MTRNODE_LOAD(node, pos, num)                                            \
+do                                                                              \
+{                                                                               \
+    pos = ((volatile MTRNODE *)&(node))->childs;                                \
+    num = ((volatile MTRNODE *)&(node))->nchilds;                               \
+}while(0)
+#if defined(__i386__) || defined(__x86_64__)
+#define MTRIE_RMB() __asm__ __volatile__("" ::: "memory")
+#else
+#define MTRIE_RMB() __sync_synchronize()
+#endif
+/* writer(with mutex locked) begin to modify nodes, readers will retry */
+#define MTRIE_MODIFY(x)                                                         \
+do                                                                              \
+{                                                                               \
+    if(((x)->seq & 1) == 0)                                                     \
+    {                                                                           \
+        (x)->seq++;                                                             \
+        __sync_synchronize();                                                   \
+    }                                                                           \
+}while(0)
+/* writer modified over */
+#define MTRIE_MODIFIED(x)                                                       \
+do                                                                              \
+{                                                                               \
+    if(((x)->seq & 1))                                                          \
+    {                                                                           \
+        __sync_synchronize();                                                   \
+        (x)->seq++;                                                             \
+    }                                                                           \
+}while(0)
+typedef int (MTRWALK)(MTRNODE *nodes, int total, char *key, int nkey, int *to);
+static int mtrie_nreaders = 0;
+static __thread int mtrie_reader = -1;
+
+/* wait all readers of epoch to leave */
+static void mtrie_drain(MTRIE *mtrie, int idx)
+{
+    int i = 0;
+
+    for(i = 0; i < MTRIE_READERS; i++)
+    {
+        while(mtrie->slots[i].count[idx] > 0) sched_yield();
+    }
+    return ;
+}
+
+/* wait lookups started before now over */
+static void mtrie_synchronize(MTRIE *mtrie)
+{
+    int idx = mtrie->epoch & 1;
+
+    mtrie_drain(mtrie, idx ^ 1);
+    __sync_add_and_fetch(&(mtrie->epoch), 1);
+    mtrie_drain(mtrie, idx);
+    return ;
+}
+
+/* lookup without lock, retry if nodes modified while walking */
+static int mtrie_read(MTRIE *mtrie, MTRWALK *walk, char *key, int nkey, int *to)
+{
+    int ret = 0, seq = 0, idx = 0, over = 0, n = 0;
+    MTRSLOT *slot = NULL;
+    char *map = NULL;
+
+    if(mtrie_reader < 0) 
+        mtrie_reader = __sync_fetch_and_add(&mtrie_nreaders, 1) % MTRIE_READERS;
+    slot = &(mtrie->slots[mtrie_reader]);
+    do
+    {
+        idx = mtrie->epoch & 1;
+        __sync_add_and_fetch(&(slot->count[idx]), 1);
+        if(((seq = mtrie->seq) & 1) == 0)
+        {
+            MTRIE_RMB();
+            if((map = mtrie->map))
+            {
+                n = 0;
+                ret = walk((MTRNODE *)(map + sizeof(MTRSTATE)), 
+                        ((MTRSTATE *)map)->total, key, nkey, &n);
+                MTRIE_RMB();
+                over = (mtrie->seq == seq);
+            }
+            else 
+            {
+                ret = 0;
+                over = 1;
+            }
+        }
+        __sync_sub_and_fetch(&(slot->count[idx]), 1);
+        if(!over) sched_yield();
+    }while(!over);
+    if(to) *to = n;
+    return ret;
+}
+
+/* new map of size, with address space reserved behind it up to *vsize to grow in place */
+static char *mtrie_map_new(off_t size, off_t *vsize)
+{
+    char *map = NULL;
+
+    if(*vsize < size) *vsize = size;
+    if((map = mmap(NULL, *vsize, PROT_NONE, MAP_ANON|MAP_PRIVATE|MAP_NORESERVE, -1, 0)) 
+            && map != (void *)-1)
+    {
+        if(mmap(map, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE|MAP_FIXED, -1, 0) 
+                == (void *)-1)
+        {
+            munmap(map, *vsize);
+            map = NULL;
+        }
+    }
+    else map = NULL;
+    if(map == NULL && (map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, 
+                    -1, 0)) == (void *)-1) map = NULL;
+    if(map == NULL) *vsize = 0;
+    return map;
+}
+
 /* initialize mmap */
 #define MTRIE_MAP_INIT(x)                                                                   \
 do                                                                                          \
@@ -34,12 +158,15 @@ do
         {                                                                                   \
             x->size = (off_t)sizeof(MTRSTATE)                                               \
             + (off_t)MTRIE_NODES_MAX * (off_t)sizeof(MTRNODE);                              \
-            if((x->map = mmap(NULL, x->size, PROT_READ|PROT_WRITE,                          \
-                            MAP_ANON|MAP_PRIVATE, -1, 0)) && x->map != (void *)-1)          \
+            x->vsize = MTRIE_MAP_VSIZE;                                                     \
+            x->flag = 0;                                                                    \
+            if((x->map = mtrie_map_new(x->size, &(x->vsize))))                              \
             {                                                                               \
                 x->map_size = x->size;                                                      \
                 x->state = (MTRSTATE *)(x->map);                                            \
                 memset(x->map, 0,sizeof(MTRSTATE)+(sizeof(MTRNODE)*MTRIE_LINE_MAX));        \
+                x->state->magic = MTRIE_MAGIC;                                              \
+                x->state->nodesize = sizeof(MTRNODE);                                       \
                 x->state->total = MTRIE_NODES_MAX;                                          \
                 x->state->left = MTRIE_NODES_MAX - MTRIE_LINE_MAX;                          \
                 x->state->current = MTRIE_LINE_MAX;                                         \
@@ -55,34 +182,53 @@ do
     }                                                                                       \
 }while(0)
 
-/* increment */
-#define MTRIE_INCREMENT(x)                                                                  \
-do                                                                                          \
-{                                                                                           \
-    if(x)                                                                                   \
-    {                                                                                       \
-        x->map_size += (off_t)MTRIE_INCREMENT_NUM * (off_t)sizeof(MTRNODE);                 \
-        x->old_map = x->map;                                                                \
-        if((x->map = mmap(NULL, x->map_size, PROT_READ|PROT_WRITE,                          \
-                        MAP_ANON|MAP_PRIVATE, -1, 0)) && x->map != (void *)-1)              \
-        {                                                                                   \
-            if(x->old_map) memcpy(x->map, x->old_map, x->size);                             \
-            x->state = (MTRSTATE *)(x->map);                                                \
-            x->state->total += MTRIE_INCREMENT_NUM;                                         \
-            x->state->left += MTRIE_INCREMENT_NUM;                                          \
-            x->nodes = (MTRNODE *)((char *)(x->map) + sizeof(MTRSTATE));                    \
-        }                                                                                   \
-        else                                                                                \
-        {                                                                                   \
-            x->map = NULL;                                                                  \
-            x->state = NULL;                                                                \
-            x->nodes = NULL;                                                                \
-        }                                                                                   \
-        if(x->old_map) munmap(x->old_map, x->size);                                         \
-        x->size = x->map_size;                                                              \
-        x->old_map = NULL;                                                                  \
-    }                                                                                       \
-}while(0)
+/* increment, grow in place over reserved address space or move to a new map, 
+ * old map is unmapped after readers of it left */
+static void mtrie_increment(MTRIE *x)
+{
+    off_t size = 0, vsize = 0;
+    char *map = NULL;
+
+    size = x->map_size + (off_t)MTRIE_INCREMENT_NUM * (off_t)sizeof(MTRNODE);
+    if(x->map && !(x->flag & MTRIE_FILEMAP) && size <= x->vsize
+            && mmap(x->map + x->map_size, size - x->map_size, PROT_READ|PROT_WRITE,
+                MAP_ANON|MAP_PRIVATE|MAP_FIXED, -1, 0) != (void *)-1)
+    {
+        x->state->total += MTRIE_INCREMENT_NUM;
+        x->state->left += MTRIE_INCREMENT_NUM;
+        x->map_size = x->size = size;
+        return ;
+    }
+    vsize = size * 2;
+    if(vsize < MTRIE_MAP_VSIZE) vsize = MTRIE_MAP_VSIZE;
+    x->old_map = x->map;
+    if((map = mtrie_map_new(size, &vsize)))
+    {
+        if(x->old_map) memcpy(map, x->old_map, x->map_size);
+        ((MTRSTATE *)map)->total += MTRIE_INCREMENT_NUM;
+        ((MTRSTATE *)map)->left += MTRIE_INCREMENT_NUM;
+        x->map = map;
+        x->state = (MTRSTATE *)(x->map);
+        x->nodes = (MTRNODE *)((char *)(x->map) + sizeof(MTRSTATE));
+    }
+    else
+    {
+        x->map = NULL;
+        x->state = NULL;
+        x->nodes = NULL;
+    }
+    if(x->old_map)
+    {
+        mtrie_synchronize(x);
+        munmap(x->old_map, x->vsize);
+    }
+    x->flag &= ~MTRIE_FILEMAP;
+    x->map_size = x->size = size;
+    x->vsize = vsize;
+    x->old_map = NULL;
+    return ;
+}
+#define MTRIE_INCREMENT(x) do{if(x){mtrie_increment(x);}}while(0)
 
 /* push node list */
 #define MTRIE_PUSH(x, num, pos)                                                            \
@@ -133,7 +279,7 @@ int mtrie_add(void *mtr, char *key, int nkey, int data)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)key;
             ep = (unsigned char *)(key + nkey);
@@ -167,6 +313,7 @@ int mtrie_add(void *mtr, char *key, int nkey, int data)
                 {
                     n  = nodes[i].nchilds + 1;
                     z = nodes[i].childs;
+                    MTRIE_MODIFY(mtrie);
                     MTRIE_POP(mtrie, n, pos);
                     nodes = mtrie->nodes;
                     if(pos < MTRIE_LINE_MAX || pos > mtrie->state->current) 
@@ -241,6 +388,7 @@ int mtrie_add(void *mtr, char *key, int nkey, int data)
             ret = -4;
         }
 end:
+        MTRIE_MODIFIED(mtrie);
         MUTEX_UNLOCK(mtrie->mutex);        
     }else ret = -5;
     
@@ -259,7 +407,7 @@ int mtrie_xadd(void *mtr, char *key, int nkey)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)key;
             ep = (unsigned char *)(key + nkey);
@@ -293,6 +441,7 @@ int mtrie_xadd(void *mtr, char *key, int nkey)
                 {
                     n  = nodes[i].nchilds + 1;
                     z = nodes[i].childs;
+                    MTRIE_MODIFY(mtrie);
                     MTRIE_POP(mtrie, n, pos);
                     nodes = mtrie->nodes;
                     if(pos < MTRIE_LINE_MAX || pos > mtrie->state->current) 
@@ -367,6 +516,7 @@ int mtrie_xadd(void *mtr, char *key, int nkey)
             ret = -4;
         }
 end:
+        MTRIE_MODIFIED(mtrie);
         MUTEX_UNLOCK(mtrie->mutex);        
     }
     else 
@@ -376,65 +526,66 @@ end:
     return ret;
 }
 
-/* get */
-int  mtrie_get(void *mtr, char *key, int nkey)
+/* walk for get */
+static int mtrie_get_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
 {
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
     unsigned char *p = NULL, *ep = NULL;
-    MTRIE *mtrie = (MTRIE *)mtr;
-    MTRNODE *nodes = NULL;
 
-    if(mtrie && key && nkey > 0)
+    p = (unsigned char *)key;
+    ep = (unsigned char *)(key + nkey);
+    i = *p++;
+    if(nkey == 1){ret = nodes[i].data; goto end;}
+    while(p < ep)
     {
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if(n > 0 && min >= MTRIE_LINE_MAX)
         {
-            p = (unsigned char *)key;
-            ep = (unsigned char *)(key + nkey);
-            i = *p++;
-            if(nkey == 1 && i >= 0 && i < mtrie->state->total){ret = nodes[i].data; goto end;}
-            while(p < ep)
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if(nodes[i].nchilds > 0 && nodes[i].childs >= MTRIE_LINE_MAX)
-                {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                }
-                if(i >= 0 && i < mtrie->state->total 
-                        && (nodes[i].nchilds == 0 || (p+1) == ep))
+                while(max > min)
                 {
-                    if(nodes[i].key != *p) goto end;
-                    if(p+1 == ep) ret = nodes[i].data;
-                    break;
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                ++p;
+                if(nodes[x].key != *p) goto end;
             }
+            i = x;
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        if(i >= 0 && i < total && (nodes[i].nchilds == 0 || (p+1) == ep))
+        {
+            if(nodes[i].key != *p) goto end;
+            if(p+1 == ep) ret = nodes[i].data;
+            break;
+        }
+        ++p;
     }
+end:
     return ret;
 }
 
+/* get */
+int  mtrie_get(void *mtr, char *key, int nkey)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+
+    if(mtrie && key && nkey > 0)
+    {
+        return mtrie_read(mtrie, &mtrie_get_walk, key, nkey, NULL);
+    }
+    return 0;
+}
+
 /* delete */
 int  mtrie_del(void *mtr, char *key, int nkey)
 {
@@ -446,7 +597,7 @@ int  mtrie_del(void *mtr, char *key, int nkey)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)key;
             ep = (unsigned char *)(key + nkey);
@@ -499,122 +650,123 @@ end:
     return ret;
 }
 
-/* find/min */
-int  mtrie_find(void *mtr, char *key, int nkey, int *to)
+/* walk for find/min */
+static int mtrie_find_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
 {
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
     unsigned char *p = NULL, *ep = NULL;
-    MTRIE *mtrie = (MTRIE *)mtr;
-    MTRNODE *nodes = NULL;
 
-    if(mtrie && key && nkey > 0)
+    p = (unsigned char *)key;
+    ep = (unsigned char *)(key + nkey);
+    i = *p++;
+    if((ret = nodes[i].data) != 0){*to = 1;goto end;}
+    while(p < ep)
     {
-        *to = 0;
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if((ret = nodes[i].data) != 0){*to = ((char *)(p+1) - key);goto end;}
+        else if(n > 0 && min >= MTRIE_LINE_MAX) 
         {
-            p = (unsigned char *)key;
-            ep = (unsigned char *)(key + nkey);
-            i = *p++;
-            if((ret = nodes[i].data) != 0){*to = 1;goto end;}
-            if(nkey == 1 && i >= 0 && i < mtrie->state->total && nodes[i].data != 0){ret = nodes[i].data; *to = 1; goto end;}
-            while(p < ep)
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if((ret = nodes[i].data) != 0){*to = ((char *)(p+1) - key);goto end;}
-                else if(nodes[i].nchilds  > 0 && nodes[i].childs >= MTRIE_LINE_MAX) 
+                while(max > min)
                 {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                    if((ret = nodes[i].data) != 0){*to = ((char *)(p+1) - key);goto end;}
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                else break; 
-                ++p;
+                if(nodes[x].key != *p) goto end;
             }
+            i = x;
+            if((ret = nodes[i].data) != 0){*to = ((char *)(p+1) - key);goto end;}
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        else break; 
+        ++p;
     }
+end:
     return ret;
 }
 
-/* find/max */
-int   mtrie_maxfind(void *mtr, char *key, int nkey, int *to)
+/* find/min */
+int  mtrie_find(void *mtr, char *key, int nkey, int *to)
 {
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
-    unsigned char *p = NULL, *ep = NULL;
     MTRIE *mtrie = (MTRIE *)mtr;
-    MTRNODE *nodes = NULL;
 
     if(mtrie && key && nkey > 0)
     {
-        *to = 0;
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        return mtrie_read(mtrie, &mtrie_find_walk, key, nkey, to);
+    }
+    return 0;
+}
+
+/* walk for find/max */
+static int mtrie_maxfind_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
+{
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
+    unsigned char *p = NULL, *ep = NULL;
+
+    p = (unsigned char *)key;
+    ep = (unsigned char *)(key + nkey);
+    i = *p++;
+    if((ret = nodes[i].data) != 0) *to = 1;
+    if(nkey == 1) goto end;
+    while(p < ep)
+    {
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if(n > 0 && min >= MTRIE_LINE_MAX) 
         {
-            p = (unsigned char *)key;
-            ep = (unsigned char *)(key + nkey);
-            i = *p++;
-            if(nodes[i].data != 0){*to = 1;ret = nodes[i].data;}
-            if(nkey == 1 && i >= 0 && i < mtrie->state->total && nodes[i].data != 0){ret = nodes[i].data; *to = 1; goto end;}
-            while(p < ep)
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if(nodes[i].nchilds  > 0 && nodes[i].childs >= MTRIE_LINE_MAX) 
+                while(max > min)
                 {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                    if(nodes[i].data != 0) 
-                    {
-                        ret = nodes[i].data;
-                        *to = (char *)(p+1) - key;
-                    }
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                else break; 
-                ++p;
+                if(nodes[x].key != *p) goto end;
+            }
+            i = x;
+            if(nodes[i].data != 0) 
+            {
+                ret = nodes[i].data;
+                *to = (char *)(p+1) - key;
             }
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        else break; 
+        ++p;
     }
+end:
     return ret;
 }
+
+/* find/max */
+int   mtrie_maxfind(void *mtr, char *key, int nkey, int *to)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+
+    if(mtrie && key && nkey > 0)
+    {
+        return mtrie_read(mtrie, &mtrie_maxfind_walk, key, nkey, to);
+    }
+    return 0;
+}
 /* add/reverse */
 int   mtrie_radd(void *mtr, char *key, int nkey, int data)
 {
@@ -627,7 +779,7 @@ int   mtrie_radd(void *mtr, char *key, int nkey, int data)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)(key + + nkey - 1);
             ep = (unsigned char *)key;
@@ -661,6 +813,7 @@ int   mtrie_radd(void *mtr, char *key, int nkey, int data)
                 {
                     n  = nodes[i].nchilds + 1;
                     z = nodes[i].childs;
+                    MTRIE_MODIFY(mtrie);
                     MTRIE_POP(mtrie, n, pos);
                     nodes = mtrie->nodes;
                     if(pos < MTRIE_LINE_MAX || pos > mtrie->state->current) goto end;
@@ -727,6 +880,7 @@ int   mtrie_radd(void *mtr, char *key, int nkey, int data)
                 ret = nodes[i].data = data;
         }else ret = -4;
 end:
+        MTRIE_MODIFIED(mtrie);
         MUTEX_UNLOCK(mtrie->mutex);        
     }else ret = -5;
     return ret;
@@ -744,7 +898,7 @@ int   mtrie_rxadd(void *mtr, char *key, int nkey)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)(key + + nkey - 1);
             ep = (unsigned char *)key;
@@ -778,6 +932,7 @@ int   mtrie_rxadd(void *mtr, char *key, int nkey)
                 {
                     n  = nodes[i].nchilds + 1;
                     z = nodes[i].childs;
+                    MTRIE_MODIFY(mtrie);
                     MTRIE_POP(mtrie, n, pos);
                     nodes = mtrie->nodes;
                     if(pos < MTRIE_LINE_MAX || pos > mtrie->state->current) goto end; 
@@ -844,70 +999,72 @@ int   mtrie_rxadd(void *mtr, char *key, int nkey)
                 ret =  nodes[i].data = ++(mtrie->state->id);
         }else ret = -4;
 end:
+        MTRIE_MODIFIED(mtrie);
         MUTEX_UNLOCK(mtrie->mutex);        
     }else ret = -5;
     return ret;
 }
 
-/* get/reverse */
-int   mtrie_rget(void *mtr, char *key, int nkey)
+/* walk for get/reverse */
+static int mtrie_rget_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
 {
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
     unsigned char *p = NULL, *ep = NULL;
-    MTRIE *mtrie = (MTRIE *)mtr;
-    MTRNODE *nodes = NULL;
 
-    if(mtrie && key && nkey > 0)
+    p = (unsigned char *)(key + nkey - 1);
+    ep = (unsigned char *)key;
+    i = *p--;
+    if(nkey == 1){ret = nodes[i].data; goto end;}
+    while(p >= ep)
     {
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if(n > 0 && min >= MTRIE_LINE_MAX)
         {
-            p = (unsigned char *)(key + nkey - 1);
-            ep = (unsigned char *)key;
-            i = *p--;
-            if(nkey == 1 && i >= 0 && i < mtrie->state->total){ret = nodes[i].data; goto end;}
-            while(p >= ep)
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if(nodes[i].nchilds > 0)
-                {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                }
-                if(i >= 0 && i < mtrie->state->total 
-                        && (nodes[i].nchilds == 0 || p == ep))
+                while(max > min)
                 {
-                    if(nodes[i].key != *p) goto end;
-                    if(p == ep) ret = nodes[i].data;
-                    break;
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                --p;
+                if(nodes[x].key != *p) goto end;
             }
+            i = x;
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        if(i >= 0 && i < total && (nodes[i].nchilds == 0 || p == ep))
+        {
+            if(nodes[i].key != *p) goto end;
+            if(p == ep) ret = nodes[i].data;
+            break;
+        }
+        --p;
     }
+end:
     return ret;
 }
 
+/* get/reverse */
+int   mtrie_rget(void *mtr, char *key, int nkey)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+
+    if(mtrie && key && nkey > 0)
+    {
+        return mtrie_read(mtrie, &mtrie_rget_walk, key, nkey, NULL);
+    }
+    return 0;
+}
+
 /* delete/reverse */
 int   mtrie_rdel(void *mtr, char *key, int nkey)
 {
@@ -919,7 +1076,7 @@ int   mtrie_rdel(void *mtr, char *key, int nkey)
     if(mtrie && key && nkey > 0)
     {
         MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state && !(mtrie->flag & MTRIE_RDONLY))
         {
             p = (unsigned char *)(key + nkey - 1);
             ep = (unsigned char *)key;
@@ -971,130 +1128,132 @@ end:
     return ret;
 }
 
-/* find/min/reverse */
-int   mtrie_rfind(void *mtr, char *key, int nkey, int *to)
+/* walk for find/min/reverse */
+static int mtrie_rfind_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
 {
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
     unsigned char *p = NULL, *ep = NULL;
-    MTRIE *mtrie = (MTRIE *)mtr;
-    MTRNODE *nodes = NULL;
 
-    if(mtrie && key && nkey > 0)
+    p = (unsigned char *)(key + nkey - 1);
+    ep = (unsigned char *)key;
+    i = *p--;
+    if((ret = nodes[i].data) != 0){*to = 1;goto end;}
+    while(p >= ep)
     {
-        *to = 0;
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if((ret = nodes[i].data) != 0)
         {
-            p = (unsigned char *)(key + nkey - 1);
-            ep = (unsigned char *)key;
-            i = *p--;
-            if((ret = nodes[i].data) != 0){*to = 1;goto end;}
-            while(p >= ep)
+            *to = nkey - ((char *)p+1 - key);
+            goto end;
+        }
+        else if(n > 0 && min >= MTRIE_LINE_MAX) 
+        {
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if((ret = nodes[i].data) != 0)
-                {
-                    *to = nkey - ((char *)p+1 - key);
-                    goto end;
-                }
-                else if(nodes[i].nchilds  > 0 && nodes[i].childs >= MTRIE_LINE_MAX) 
+                while(max > min)
                 {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                    if((ret = nodes[i].data) != 0)
-                    {
-                        *to = (nkey - ((char *)p+1 - key));
-                        goto end;
-                    }
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                else break; 
-                --p;
+                if(nodes[x].key != *p) goto end;
+            }
+            i = x;
+            if((ret = nodes[i].data) != 0)
+            {
+                *to = (nkey - ((char *)p+1 - key));
+                goto end;
             }
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        else break; 
+        --p;
     }
+end:
     return ret;
 }
 
-/* find/max/reverse */
-int   mtrie_rmaxfind(void *mtr, char *key, int nkey, int *to)
+/* find/min/reverse */
+int   mtrie_rfind(void *mtr, char *key, int nkey, int *to)
 {
     MTRIE *mtrie = (MTRIE *)mtr;
-    int ret = 0, x = 0, i = 0, z = 0, min = 0, max = 0;
-    unsigned char *p = NULL, *ep = NULL;
-    MTRNODE *nodes = NULL;
 
     if(mtrie && key && nkey > 0)
     {
-        *to = 0;
-        MUTEX_LOCK(mtrie->mutex);        
-        if((nodes = mtrie->nodes) && mtrie->map && mtrie->state)
+        return mtrie_read(mtrie, &mtrie_rfind_walk, key, nkey, to);
+    }
+    return 0;
+}
+
+/* walk for find/max/reverse */
+static int mtrie_rmaxfind_walk(MTRNODE *nodes, int total, char *key, int nkey, int *to)
+{
+    int ret = 0, x = 0, i = 0, z = 0, n = 0, min = 0, max = 0;
+    unsigned char *p = NULL, *ep = NULL;
+
+    p = (unsigned char *)(key+nkey-1);
+    ep = (unsigned char *)key;
+    i = *p--;
+    if((ret = nodes[i].data) != 0) *to = 1;
+    if(nkey == 1) goto end;
+    while(p >= ep)
+    {
+        x = 0;
+        //check 
+        MTRNODE_LOAD(nodes[i], min, n);
+        if(n > 0 && min >= MTRIE_LINE_MAX) 
         {
-            p = (unsigned char *)(key+nkey-1);
-            ep = (unsigned char *)key;
-            i = *p--;
-            if(nodes[i].data != 0){*to = 1;ret = nodes[i].data;}
-            if(nkey == 1 && i >= 0 && i < mtrie->state->total){ret = nodes[i].data;*to = 1;goto end;}
-            while(p >= ep)
+            if((max = min + n - 1) >= total) goto end;
+            if(*p == nodes[min].key) x = min;
+            else if(*p == nodes[max].key) x = max;
+            else if(*p < nodes[min].key) goto end;
+            else if(*p > nodes[max].key) goto end;
+            else
             {
-                x = 0;
-                //check 
-                if(nodes[i].nchilds  > 0 && nodes[i].childs >= MTRIE_LINE_MAX) 
+                while(max > min)
                 {
-                    min = nodes[i].childs;
-                    max = min + nodes[i].nchilds - 1;
-                    if(*p == nodes[min].key) x = min;
-                    else if(*p == nodes[max].key) x = max;
-                    else if(*p < nodes[min].key) goto end;
-                    else if(*p > nodes[max].key) goto end;
-                    else
-                    {
-                        while(max > min)
-                        {
-                            z = (max + min)/2;
-                            if(z == min){x = z;break;}
-                            if(nodes[z].key == *p){x = z;break;}
-                            else if(nodes[z].key < *p) min = z;
-                            else max = z;
-                        }
-                        if(nodes[x].key != *p) goto end;
-                    }
-                    i = x;
-                    if(nodes[i].data != 0) 
-                    {
-                        ret = nodes[i].data;
-                        *to = nkey - ((char *)p - key);
-                    }
+                    z = (max + min)/2;
+                    if(z == min){x = z;break;}
+                    if(nodes[z].key == *p){x = z;break;}
+                    else if(nodes[z].key < *p) min = z;
+                    else max = z;
                 }
-                else break; 
-                --p;
+                if(nodes[x].key != *p) goto end;
+            }
+            i = x;
+            if(nodes[i].data != 0) 
+            {
+                ret = nodes[i].data;
+                *to = nkey - ((char *)p - key);
             }
         }
-end:
-        MUTEX_UNLOCK(mtrie->mutex);        
+        else break; 
+        --p;
     }
+end:
     return ret;
 }
 
+/* find/max/reverse */
+int   mtrie_rmaxfind(void *mtr, char *key, int nkey, int *to)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+
+    if(mtrie && key && nkey > 0)
+    {
+        return mtrie_read(mtrie, &mtrie_rmaxfind_walk, key, nkey, to);
+    }
+    return 0;
+}
+
 /* import dict */
 int mtrie_import(void *mtr, char *dictfile, int direction)
 {
@@ -1128,20 +1287,123 @@ int mtrie_import(void *mtr, char *dictfile, int direction)
     return -1;
 }
 
+/* save nodes map as image file */
+int mtrie_save(void *mtr, char *file)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+    char path[MTRIE_PATH_MAX], *p = NULL;
+    int fd = -1, ret = -1, n = 0;
+    off_t left = 0;
+    MTRSTATE state;
+
+    if(mtrie && file && snprintf(path, MTRIE_PATH_MAX, "%s.tmp", file) < MTRIE_PATH_MAX)
+    {
+        MUTEX_LOCK(mtrie->mutex);
+        if(mtrie->map && mtrie->state 
+                && (fd = open(path, O_CREAT|O_WRONLY|O_TRUNC, 0644)) > 0)
+        {
+            memcpy(&state, mtrie->state, sizeof(MTRSTATE));
+            /* image holds used nodes only, grows to new map when adding after load */
+            state.total = state.current;
+            state.left = 0;
+            if(write(fd, &state, sizeof(MTRSTATE)) == sizeof(MTRSTATE))
+            {
+                p = (char *)(mtrie->nodes);
+                left = (off_t)state.current * (off_t)sizeof(MTRNODE);
+                while(left > 0 && (n = write(fd, p, (left > 0x40000000 ? 0x40000000 : left))) > 0)
+                {
+                    p += n;
+                    left -= n;
+                }
+                if(left == 0) ret = 0;
+            }
+            close(fd);
+            /* replaced by rename, processes mapping old image keep their nodes */
+            if(ret == 0 && rename(path, file) != 0) ret = -1;
+            if(ret != 0) unlink(path);
+        }
+        MUTEX_UNLOCK(mtrie->mutex);
+    }
+    return ret;
+}
+
+/* load image file saved by mtrie_save() */
+int mtrie_load(void *mtr, char *file, int flag)
+{
+    MTRIE *mtrie = (MTRIE *)mtr;
+    off_t vsize = 0, need = 0;
+    char *map = NULL, *old = NULL;
+    MTRSTATE *state = NULL;
+    struct stat st = {0};
+    int fd = -1, ret = -1;
+
+    if(mtrie && file && (fd = open(file, O_RDONLY)) > 0)
+    {
+        if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(MTRSTATE)
+                && (map = mmap(NULL, st.st_size, ((flag & MTRIE_RDONLY) ? PROT_READ 
+                            : (PROT_READ|PROT_WRITE)), ((flag & MTRIE_RDONLY) ? MAP_SHARED
+                            : MAP_PRIVATE), fd, 0)) != (void *)-1)
+        {
+            state = (MTRSTATE *)map;
+            need = (off_t)sizeof(MTRSTATE) + (off_t)state->total * (off_t)sizeof(MTRNODE);
+            if(state->magic != MTRIE_MAGIC || state->nodesize != sizeof(MTRNODE)
+                    || state->total < MTRIE_LINE_MAX || state->current != state->total
+                    || need > st.st_size)
+            {
+                munmap(map, st.st_size);
+                map = NULL;
+            }
+        }
+        else map = NULL;
+        close(fd);
+        if(map)
+        {
+            MUTEX_LOCK(mtrie->mutex);
+            MTRIE_MODIFY(mtrie);
+            old = mtrie->map;
+            vsize = mtrie->vsize;
+            mtrie->map = map;
+            mtrie->state = (MTRSTATE *)map;
+            mtrie->nodes = (MTRNODE *)(map + sizeof(MTRSTATE));
+            mtrie->map_size = mtrie->size = mtrie->vsize = st.st_size;
+            mtrie->flag = MTRIE_FILEMAP | (flag & MTRIE_RDONLY);
+            if(old)
+            {
+                mtrie_synchronize(mtrie);
+                munmap(old, vsize);
+            }
+            MTRIE_MODIFIED(mtrie);
+            MUTEX_UNLOCK(mtrie->mutex);
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
 /* destroy */
 void mtrie_destroy(void *mtr)
 {
     MTRIE *mtrie = (MTRIE *)mtr;
+    off_t map_size = 0;
+    char *map = NULL;
+
     if(mtrie)
     {
         MUTEX_LOCK(mtrie->mutex);
-        if(mtrie->map) 
+        MTRIE_MODIFY(mtrie);
+        if((map = mtrie->map)) 
         {
-            munmap(mtrie->map, mtrie->map_size);
+            map_size = mtrie->vsize;
             mtrie->map = NULL;
         }
         mtrie->map_size = 0;
         MTRIE_MAP_INIT(mtrie); 
+        if(map)
+        {
+            mtrie_synchronize(mtrie);
+            munmap(map, map_size);
+        }
+        MTRIE_MODIFIED(mtrie);
         MUTEX_UNLOCK(mtrie->mutex);
     }
     return ;
@@ -1156,7 +1418,7 @@ void  mtrie_clean(void *mtr)
         MUTEX_DESTROY(mtrie->mutex);
         if(mtrie->map) 
         {
-            munmap(mtrie->map, mtrie->map_size);
+            munmap(mtrie->map, mtrie->vsize);
         }
         free(mtrie);
     }
@@ -1185,6 +1447,8 @@ MTRIE *mtrie_init()
         mtrie->rfind       = mtrie_rfind;
         mtrie->rmaxfind    = mtrie_rmaxfind;
         mtrie->import      = mtrie_import;
+        mtrie->save        = mtrie_save;
+        mtrie->load        = mtrie_load;
         mtrie->clean       = mtrie_clean;
     }
     return mtrie;
@@ -1309,3 +1573,162 @@ int main(int argc, char **argv)
     }
 }
 #endif
+
+#ifdef _BENCH_MTRIE
+#include <sys/time.h>
+#include <pthread.h>
+#define BENCH_THREADS_MAX 64
+#define BENCH_KEYS_NUM    100000
+typedef struct _MTRBENCH
+{
+    MTRIE *mtrie;
+    int locked;
+    int count;
+    int errors;
+    unsigned int seed;
+}MTRBENCH;
+static char *bench_keys[BENCH_KEYS_NUM];
+static int bench_lens[BENCH_KEYS_NUM];
+static volatile int bench_running = 0;
+/* lookup random preloaded keys, with trie mutex as before or lock free */
+static void *mtrie_bench_reader(void *arg)
+{
+    MTRBENCH *bench = (MTRBENCH *)arg;
+    unsigned int r = bench->seed;
+    int i = 0, k = 0, x = 0;
+
+    for(i = 0; i < bench->count; i++)
+    {
+        r = r * 1103515245 + 12345;
+        k = (r >> 8) % BENCH_KEYS_NUM;
+        if(bench->locked)
+        {
+            MUTEX_LOCK(bench->mtrie->mutex);
+            x = mtrie_get_walk(bench->mtrie->nodes, bench->mtrie->state->total, 
+                    bench_keys[k], bench_lens[k], NULL);
+            MUTEX_UNLOCK(bench->mtrie->mutex);
+        }
+        else
+        {
+            x = mtrie_get(bench->mtrie, bench_keys[k], bench_lens[k]);
+        }
+        if(x != (k + 1)) bench->errors++;
+    }
+    return NULL;
+}
+/* add/delete keys while reading, map grows under readers if stress */
+static void *mtrie_bench_writer(void *arg)
+{
+    MTRBENCH *bench = (MTRBENCH *)arg;
+    char word[256];
+    int n = 0;
+
+    while(bench_running)
+    {
+        n = sprintf(word, "upstream-%d.backend.example.com", bench->count++);
+        mtrie_add(bench->mtrie, word, n, bench->count);
+        if((bench->count % 3) == 0) mtrie_del(bench->mtrie, word, n);
+        if(bench->locked == 0) usleep(1000);
+    }
+    return NULL;
+}
+int main(int argc, char **argv)
+{
+    int i = 0, j = 0, n = 0, locked = 0, nthreads = 16, count = 1000000, errors = 0, stress = 0,
+        nwords = 1000000, x = 0, k = 0;
+    pthread_t threads[BENCH_THREADS_MAX], writer;
+    MTRBENCH benchs[BENCH_THREADS_MAX], wbench;
+    struct timeval tv = {0};
+    long long start = 0, used = 0;
+    char word[256], *image = "/tmp/bench.mtrie";
+    MTRIE *mtrie = NULL, *dict = NULL;
+
+    if(argc > 1) nthreads = atoi(argv[1]);
+    if(argc > 2) count = atoi(argv[2]);
+    /* nonzero to add keys without pause(growing map) while reading */
+    if(argc > 3) stress = atoi(argv[3]);
+    if(argc > 4) nwords = atoi(argv[4]);
+    if(nthreads < 1 || nthreads > BENCH_THREADS_MAX) nthreads = 16;
+    if((mtrie = mtrie_init()) == NULL) return -1;
+    for(i = 0; i < BENCH_KEYS_NUM; i++)
+    {
+        n = sprintf(word, "vhost%d.site%d.example.com", i, i % 97);
+        bench_keys[i] = strdup(word);
+        bench_lens[i] = n;
+        mtrie_add(mtrie, word, n, i + 1);
+    }
+    for(j = 1; j <= nthreads; j *= 2)
+    {
+        for(locked = 1; locked >= 0; locked--)
+        {
+            memset(&wbench, 0, sizeof(MTRBENCH));
+            wbench.mtrie = mtrie;
+            wbench.locked = stress;
+            bench_running = 1;
+            pthread_create(&writer, NULL, &mtrie_bench_writer, &wbench);
+            gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+            for(i = 0; i < j; i++)
+            {
+                memset(&(benchs[i]), 0, sizeof(MTRBENCH));
+                benchs[i].mtrie = mtrie;
+                benchs[i].locked = locked;
+                benchs[i].count = count;
+                benchs[i].seed = i * 7919 + 1;
+                pthread_create(&(threads[i]), NULL, &mtrie_bench_reader, &(benchs[i]));
+            }
+            errors = 0;
+            for(i = 0; i < j; i++)
+            {
+                pthread_join(threads[i], NULL);
+                errors += benchs[i].errors;
+            }
+            gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+            bench_running = 0;
+            pthread_join(writer, NULL);
+            fprintf(stdout, "%s threads:%d lookups:%lld in %lld usec, %.0f q/s "
+                    "writes:%d errors:%d\n", (locked ? "mutex   " : "lockfree"), j, 
+                    (long long)j * count, used, (double)j * count * 1000000.0/(double)(used ? used : 1), 
+                    wbench.count, errors);
+        }
+    }
+    /* rebuild dictionary against loading saved image */
+    if((dict = mtrie_init()) == NULL) return -1;
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < nwords; i++)
+    {
+        n = sprintf(word, "dict_word_%d", i);
+        mtrie_add(dict, word, n, i + 1);
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "build %d words(%d nodes) in %lld usec\n", nwords, dict->state->current, used);
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    x = mtrie_save(dict, image);
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "save %s => %d in %lld usec\n", image, x, used);
+    mtrie_clean(dict);
+    for(locked = MTRIE_RDONLY; locked >= 0; locked -= MTRIE_RDONLY)
+    {
+        if((dict = mtrie_init()) == NULL) return -1;
+        gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+        x = mtrie_load(dict, image, locked);
+        gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+        errors = 0;
+        for(i = 0; i < nwords; i++)
+        {
+            n = sprintf(word, "dict_word_%d", i);
+            if(mtrie_get(dict, word, n) != (i + 1)) errors++;
+        }
+        /* adding fails on read-only image, moves private image to new map */
+        n = sprintf(word, "dict_word_new");
+        k = mtrie_add(dict, word, n, nwords + 1);
+        fprintf(stdout, "load(%s) => %d in %lld usec, errors:%d add:%d get:%d\n", 
+                (locked ? "RDONLY" : "PRIVATE"), x, used, errors, k, mtrie_get(dict, word, n));
+        mtrie_clean(dict);
+    }
+    unlink(image);
+    for(i = 0; i < BENCH_KEYS_NUM; i++) free(bench_keys[i]);
+    mtrie_clean(mtrie);
+    return 0;
+}
+//gcc -O2 -o mtrbench mtrie.c -D_BENCH_MTRIE -lpthread && ./mtrbench 16 1000000 0 1000000
+#endif
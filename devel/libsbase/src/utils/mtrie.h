@@ -8,6 +8,10 @@ extern "C" {
 #define MTRIE_INCREMENT_NUM        100000
 #define MTRIE_NODES_MAX            1000000
 #define MTRIE_WORD_MAX             4096
+#define MTRIE_READERS              64
+#define MTRIE_MAGIC                0x4952544d
+#define MTRIE_FILEMAP              0x01
+#define MTRIE_RDONLY               0x02
 #include "mutex.h"
 typedef struct _MTRLIST
 {
@@ -25,12 +29,20 @@ typedef struct _MTRNODE
 /* state */
 typedef struct _MTRSTATE
 {
+    int magic;
+    int nodesize;
     int id;
     int current;
     int total;
     int left;
     MTRLIST list[MTRIE_LINE_MAX];
 }MTRSTATE;
+/* readers slot, counters of lookups in progress by epoch */
+typedef struct _MTRSLOT
+{
+    volatile int count[2];
+    char pad[56];
+}MTRSLOT;
 /* MEM trie */
 typedef struct _MTRIE
 {
@@ -41,6 +53,13 @@ typedef struct _MTRIE
     MUTEX       *mutex;
     off_t       map_size;
     off_t       size;
+    off_t       vsize;
+    int         flag;
+    /* lookups take no lock, writers bump seq to odd while modifying nodes 
+     * and wait readers of old epoch to leave before unmapping old map */
+    volatile int seq;
+    volatile int epoch;
+    MTRSLOT     slots[MTRIE_READERS];
 
     int  (*add)(void *, char *key, int nkey, int data);
     int  (*xadd)(void *, char *key, int nkey);
@@ -55,6 +74,8 @@ typedef struct _MTRIE
     int  (*rfind)(void *, char *key, int nkey, int *len);
     int  (*rmaxfind)(void *, char *key, int nkey, int *len);
     int  (*import)(void *, char *dictfile, int direction);
+    int  (*save)(void *, char *file);
+    int  (*load)(void *, char *file, int flag);
     void (*clean)(void *);
 }MTRIE;
 /* initialize */
@@ -85,6 +106,10 @@ int   mtrie_rfind(void *, char *key, int nkey, int *len);
 int   mtrie_rmaxfind(void *, char *key, int nkey, int *len);
 /* import dict if direction value is -1, add word reverse */
 int   mtrie_import(void *, char *dictfile, int direction);
+/* save nodes map as image file */
+int   mtrie_save(void *, char *file);
+/* load image file saved by mtrie_save(), MTRIE_RDONLY to map it read-only shared */
+int   mtrie_load(void *, char *file, int flag);
 /* destroy */
 void mtrie_destroy(void *);
 /* clean/reverse */
@@ -40,7 +40,7 @@ QNODE *queue_new(void *queue)
     else 
     {
         if((k = q->nlist) < QNODE_LINE_MAX 
-                && (nodes = (QNODE *)xmm_new(QNODE_LINE_NUM * sizeof(QNODE))))
+                && (nodes = (QNODE *)xmm_tag_new(XMM_TAG_QUEUE, QNODE_LINE_NUM * sizeof(QNODE))))
         {
             q->list[k] = nodes;
             q->nlist++;
@@ -155,7 +155,7 @@ void queue_clean(void *queue)
         //fprintf(stdout, "%s::%d q:%p nleft:%d qtotal:%d qleft:%p\n", __FILE__, __LINE__, q, q->nleft, q->qtotal, q->left);
         for(i = 0; i < q->nlist; i++);
         {
-            xmm_free(q->list[i], QNODE_LINE_NUM * sizeof(QNODE));
+            xmm_tag_free(XMM_TAG_QUEUE, q->list[i], QNODE_LINE_NUM * sizeof(QNODE));
         }
         MUTEX_DESTROY(q->mutex);
         xmm_free(q, sizeof(QUEUE));
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include "mtrie.h"
+#include "route.h"
+#define ROUTE_ISBLANK(c) (c == 0x20 || c == '\t' || c == '\r' || c == '\n')
+
+/* add route, return route id */
+int route_add(ROUTE_MAP *route_map, char *prefix, int nprefix, int type, char *arg, int code, int port)
+{
+    ROUTE *route = NULL;
+    int id = -1;
+
+    if(route_map && route_map->map && prefix && nprefix > 0 && nprefix < 32768)
+    {
+        if((id = mtrie_get(route_map->map, prefix, nprefix) - 1) < 0)
+        {
+            if(route_map->num >= ROUTE_NUM_MAX) return -1;
+            if(route_map->num == route_map->size)
+            {
+                if((route = (ROUTE *)realloc(route_map->routes, sizeof(ROUTE)
+                                * (route_map->size + ROUTE_INCREMENT))) == NULL) return -1;
+                route_map->routes = route;
+                route_map->size += ROUTE_INCREMENT;
+            }
+            id = route_map->num;
+            route = &(route_map->routes[id]);
+            memset(route, 0, sizeof(ROUTE));
+            if((route->prefix = (char *)calloc(1, nprefix + 1)) == NULL) return -1;
+            memcpy(route->prefix, prefix, nprefix);
+            route->nprefix = nprefix;
+            ++(route_map->num);
+            mtrie_add(route_map->map, prefix, nprefix, id + 1);
+        }
+        /* replace route of same prefix */
+        route = &(route_map->routes[id]);
+        if(route->arg) free(route->arg);
+        route->arg = (arg) ? strdup(arg) : NULL;
+        route->type = type;
+        route->code = code;
+        route->port = port;
+    }
+    return id;
+}
+
+/* add routes line */
+int route_add_line(ROUTE_MAP *route_map, char *p, char *end)
+{
+    char *s = NULL, *e = NULL, *argv[4], arg[ROUTE_LINE_MAX];
+    int n = 0, i = 0, type = 0, code = 0, port = 0, ret = 0;
+
+    if(route_map && p && end)
+    {
+        while(p < end)
+        {
+            while(p < end && *p != '[') ++p;
+            if(p++ >= end) break;
+            if((e = memchr(p, ']', end - p)) == NULL) break;
+            /* [prefix action arg arg] */
+            n = 0;
+            s = arg;
+            while(p < e && n < 4)
+            {
+                while(p < e && ROUTE_ISBLANK(*p)) ++p;
+                if(p == e) break;
+                argv[n++] = s;
+                while(p < e && !ROUTE_ISBLANK(*p) && s < (arg + ROUTE_LINE_MAX - 1)) *s++ = *p++;
+                *s++ = '\0';
+                if(s >= (arg + ROUTE_LINE_MAX - 1)) break;
+            }
+            p = e + 1;
+            if(n < 2) {ret = -1; continue;}
+            type = code = port = 0;
+            if(strcasecmp(argv[1], "root") == 0 && n > 2) type = ROUTE_ROOT;
+            else if(strcasecmp(argv[1], "alias") == 0 && n > 2) type = ROUTE_ALIAS;
+            else if(strcasecmp(argv[1], "proxy") == 0 && n > 2
+                    && (s = strrchr(argv[2], ':')) && (port = atoi(s+1)) > 0)
+            {
+                *s = '\0';
+                type = ROUTE_PROXY;
+            }
+            else if(strcasecmp(argv[1], "status") == 0 && n > 2
+                    && (code = atoi(argv[2])) >= 100 && code < 600)
+            {
+                type = ROUTE_STATUS;
+                argv[2] = (n > 3) ? argv[3] : NULL;
+            }
+            else {ret = -1; continue;}
+            i = strlen(argv[0]);
+            if(route_add(route_map, argv[0], i, type, argv[2], code, port) < 0) ret = -1;
+        }
+        return ret;
+    }
+    return -1;
+}
+
+/* return route of longest prefix matched path */
+ROUTE *route_find(ROUTE_MAP *route_map, char *path, int npath)
+{
+    int id = -1, n = 0;
+
+    if(route_map && route_map->num > 0 && path && npath > 0
+            && (id = mtrie_maxfind(route_map->map, path, npath, &n) - 1) >= 0
+            && id < route_map->num)
+    {
+        return &(route_map->routes[id]);
+    }
+    return NULL;
+}
+
+/* route map init */
+int route_map_init(ROUTE_MAP *route_map)
+{
+    if(route_map && route_map->map == NULL)
+    {
+        route_map->num = route_map->size = 0;
+        route_map->routes = NULL;
+        if((route_map->map = mtrie_init())) return 0;
+    }
+    return -1;
+}
+
+/* clean route map */
+void route_map_clean(ROUTE_MAP *route_map)
+{
+    int i = 0;
+
+    if(route_map)
+    {
+        for(i = 0; i < route_map->num; i++)
+        {
+            if(route_map->routes[i].prefix) free(route_map->routes[i].prefix);
+            if(route_map->routes[i].arg) free(route_map->routes[i].arg);
+        }
+        if(route_map->routes) free(route_map->routes);
+        route_map->routes = NULL;
+        route_map->num = route_map->size = 0;
+        if(route_map->map) mtrie_clean(route_map->map);
+        route_map->map = NULL;
+    }
+    return ;
+}
+
+#ifdef _BENCH_ROUTE
+#include <sys/time.h>
+#define BENCH_PATHS_NUM 4096
+/* scan prefixes one by one as string compare in packet handler */
+ROUTE *route_scan(ROUTE_MAP *route_map, char *path, int npath)
+{
+    ROUTE *route = NULL;
+    int i = 0;
+
+    for(i = 0; i < route_map->num; i++)
+    {
+        if(route_map->routes[i].nprefix <= npath
+                && (route == NULL || route_map->routes[i].nprefix > route->nprefix)
+                && memcmp(route_map->routes[i].prefix, path, route_map->routes[i].nprefix) == 0)
+            route = &(route_map->routes[i]);
+    }
+    return route;
+}
+int main(int argc, char **argv)
+{
+    int i = 0, n = 0, nroutes = 5000, count = 1000000, errors = 0, lens[BENCH_PATHS_NUM];
+    char line[ROUTE_LINE_MAX], *paths[BENCH_PATHS_NUM];
+    struct timeval tv = {0};
+    long long start = 0, used = 0;
+    ROUTE_MAP route_map = {0};
+    ROUTE *route = NULL;
+    unsigned int r = 1;
+
+    if(argc > 1) nroutes = atoi(argv[1]);
+    if(argc > 2) count = atoi(argv[2]);
+    if(route_map_init(&route_map) != 0) return -1;
+    /* a service per tenant, each with a few versioned locations */
+    for(i = 0; i < nroutes; i++)
+    {
+        switch(i % 4)
+        {
+            case 0:
+                n = sprintf(line, "[/t%d/ root /data/t%d]", i/4, i/4);
+                break;
+            case 1:
+                n = sprintf(line, "[/t%d/static/ alias /cdn/t%d/]", i/4, i/4);
+                break;
+            case 2:
+                n = sprintf(line, "[/t%d/api/v%d/ proxy 10.0.%d.%d:8080]", i/4, i%7, (i/256)%256, i%256);
+                break;
+            default:
+                n = sprintf(line, "[/t%d/old/ status 301 http://new.example.com/t%d/]", i/4, i/4);
+                break;
+        }
+        route_add_line(&route_map, line, line + n);
+    }
+    for(i = 0; i < BENCH_PATHS_NUM; i++)
+    {
+        r = r * 1103515245 + 12345;
+        n = (r >> 8) % (nroutes/4 + 1);
+        switch(i % 5)
+        {
+            case 0: lens[i] = sprintf(line, "/t%d/index.html", n);break;
+            case 1: lens[i] = sprintf(line, "/t%d/static/js/app.%d.js", n, i);break;
+            case 2: lens[i] = sprintf(line, "/t%d/api/v%d/users/%d/orders", n, (n*4+2)%7, i);break;
+            case 3: lens[i] = sprintf(line, "/t%d/old/page/%d", n, i);break;
+            default: lens[i] = sprintf(line, "/unrouted/%d", i);break;
+        }
+        paths[i] = strdup(line);
+        if(route_find(&route_map, paths[i], lens[i]) != route_scan(&route_map, paths[i], lens[i]))
+            errors++;
+    }
+    fprintf(stdout, "routes:%d paths:%d mismatch:%d\n", route_map.num, BENCH_PATHS_NUM, errors);
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0, n = 0; i < count; i++)
+    {
+        if((route = route_find(&route_map, paths[i % BENCH_PATHS_NUM], lens[i % BENCH_PATHS_NUM]))) n++;
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "route_find() %d lookups(%d routed) in %lld usec, %.0f q/s\n",
+            count, n, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    count /= 100;
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0, n = 0; i < count; i++)
+    {
+        if((route = route_scan(&route_map, paths[i % BENCH_PATHS_NUM], lens[i % BENCH_PATHS_NUM]))) n++;
+    }
+    gettimeofday(&tv, NULL);used = tv.tv_sec * 1000000ll + tv.tv_usec - start;
+    fprintf(stdout, "linear scan %d lookups(%d routed) in %lld usec, %.0f q/s\n",
+            count, n, used, (double)count * 1000000.0/(double)(used ? used : 1));
+    for(i = 0; i < BENCH_PATHS_NUM; i++) free(paths[i]);
+    route_map_clean(&route_map);
+    return 0;
+}
+//gcc -O2 -o rbench route.c mtrie.c -D_BENCH_ROUTE -lpthread && ./rbench 5000 1000000
+#endif
@@ -0,0 +1,38 @@
+#ifndef _ROUTE_H
+#define _ROUTE_H
+#define ROUTE_NUM_MAX       65536
+#define ROUTE_INCREMENT     256
+#define ROUTE_LINE_MAX      1024
+#define ROUTE_ROOT          0x01
+#define ROUTE_ALIAS         0x02
+#define ROUTE_PROXY         0x04
+#define ROUTE_STATUS        0x08
+/* route of path prefix */
+typedef struct _ROUTE
+{
+    short type;
+    short nprefix;
+    int  code;
+    int  port;
+    int  data;
+    char *prefix;
+    char *arg;
+}ROUTE;
+typedef struct _ROUTE_MAP
+{
+    void *map;
+    int num;
+    int size;
+    ROUTE *routes;
+}ROUTE_MAP;
+/* initialize route map */
+int route_map_init(ROUTE_MAP *route_map);
+/* add route, return route id */
+int route_add(ROUTE_MAP *route_map, char *prefix, int nprefix, int type, char *arg, int code, int port);
+/* add routes line as [prefix root dir][prefix alias dir][prefix proxy ip:port][prefix status code location] */
+int route_add_line(ROUTE_MAP *route_map, char *p, char *end);
+/* return route of longest prefix matched path */
+ROUTE *route_find(ROUTE_MAP *route_map, char *path, int npath);
+/* clean route map */
+void route_map_clean(ROUTE_MAP *route_map);
+#endif
@@ -6,6 +6,12 @@
 static char *_wdays_[]={"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
 static char *_ymonths_[]= {"Jan", "Feb", "Mar","Apr", "May", "Jun",
     "Jul", "Aug", "Sep","Oct", "Nov", "Dec"};
+/* two slots, formatted one is published by index when second changed */
+static STSLOT _stslots_[2];
+static volatile int _stindex_ = 0;
+static volatile int _stlock_ = 0;
+static volatile int _stdriven_ = 0;
+static volatile long long _stusec_ = 0;
 
 //convert str datetime to time
 time_t str2time(char *datestr)
@@ -80,22 +86,13 @@ time_t str2time(char *datestr)
 /* time to GMT */
 int GMTstrdate(time_t times, char *date)
 {
-    struct tm *tp = NULL;
-    time_t timep = 0;
+    struct tm *tp = NULL, tm;
     int n = 0;
 
     if(date)
     {
-        if(times > 0) 
-        {
-            tp = gmtime(&times);
-        }
-        else
-        {
-            time(&timep);
-            tp = gmtime(&timep);
-        }
-        if(tp)
+        if(times <= 0 || times == stime_now()) return stime_date(date);
+        if((tp = gmtime_r(&times, &tm)))
         {
             n = sprintf(date, "%s, %02d %s %d %02d:%02d:%02d GMT", _wdays_[tp->tm_wday],
                     tp->tm_mday, _ymonths_[tp->tm_mon], 1900+tp->tm_year, tp->tm_hour,
@@ -173,6 +170,106 @@ void timetospec(struct timespec *ts, int usecs)
     return ;
 }
 
+/* refresh clock cache */
+void stime_refresh()
+{
+    struct timeval tv = {0};
+    STSLOT *slot = NULL;
+    struct tm *tp = NULL, tm;
+    int x = 0;
+
+    gettimeofday(&tv, NULL);
+    _stusec_ = tv.tv_sec * 1000000ll + tv.tv_usec * 1ll;
+    if(tv.tv_sec != _stslots_[_stindex_].sec && __sync_lock_test_and_set(&_stlock_, 1) == 0)
+    {
+        if(tv.tv_sec != _stslots_[_stindex_].sec)
+        {
+            x = (_stindex_ + 1) % 2;
+            slot = &(_stslots_[x]);
+            if((tp = gmtime_r(&(tv.tv_sec), &tm)))
+            {
+                slot->ndate = sprintf(slot->date, "%s, %02d %s %d %02d:%02d:%02d GMT", 
+                        _wdays_[tp->tm_wday], tp->tm_mday, _ymonths_[tp->tm_mon], 
+                        1900+tp->tm_year, tp->tm_hour, tp->tm_min, tp->tm_sec);
+            }
+            if((tp = localtime_r(&(tv.tv_sec), &(slot->tm))))
+            {
+                slot->nlog = sprintf(slot->log, "[%02d/%s/%04d:%02d:%02d:%02d", tp->tm_mday, 
+                        _ymonths_[tp->tm_mon], (1900+tp->tm_year), tp->tm_hour, 
+                        tp->tm_min, tp->tm_sec);
+            }
+            slot->sec = tv.tv_sec;
+            __sync_synchronize();
+            _stindex_ = x;
+        }
+        __sync_lock_release(&_stlock_);
+    }
+    return ;
+}
+
+/* refresh clock cache, called by loop once per tick */
+void stime_tick()
+{
+    _stdriven_ = 1;
+    stime_refresh();
+    return ;
+}
+
+/* now in usec */
+long long stime_usec()
+{
+    if(!_stdriven_) stime_refresh();
+    return _stusec_;
+}
+
+/* now in sec */
+time_t stime_now()
+{
+    if(!_stdriven_) stime_refresh();
+    return _stslots_[_stindex_].sec;
+}
+
+/* RFC1123 date of now */
+int stime_date(char *date)
+{
+    STSLOT *slot = NULL;
+
+    if(date)
+    {
+        if(!_stdriven_) stime_refresh();
+        slot = &(_stslots_[_stindex_]);
+        memcpy(date, slot->date, slot->ndate + 1);
+        return slot->ndate;
+    }
+    return 0;
+}
+
+/* log timestamp prefix of now */
+int stime_logdate(char *date)
+{
+    STSLOT *slot = NULL;
+
+    if(date)
+    {
+        if(!_stdriven_) stime_refresh();
+        slot = &(_stslots_[_stindex_]);
+        memcpy(date, slot->log, slot->nlog + 1);
+        return slot->nlog;
+    }
+    return 0;
+}
+
+/* local time of now */
+void stime_localtime(struct tm *tm)
+{
+    if(tm)
+    {
+        if(!_stdriven_) stime_refresh();
+        memcpy(tm, &(_stslots_[_stindex_].tm), sizeof(struct tm));
+    }
+    return ;
+}
+
 #ifdef _DEBUG_TM
 int main(int argc, char **argv)
 {
@@ -199,6 +296,9 @@ int main(int argc, char **argv)
     {
         fprintf(stdout, "|%ld|%s|\n", time, buf);
     }
+    stime_tick();
+    if(stime_date(buf) > 0) fprintf(stdout, "|%lld|%s|\n", stime_usec(), buf);
+    if(stime_logdate(buf) > 0) fprintf(stdout, "|%ld|%s|\n", stime_now(), buf);
     return 0;
 }
 //gcc -o tm stime.c -D_DEBUG_TM && ./tm
@@ -12,4 +12,27 @@ int strdate(time_t time, char *date);
 int datetime(time_t times, char *date);
 /* timetospec */
 void timetospec(struct timespec *ts, int usecs);
+/* clock cache refreshed by event loops */
+#define STIME_DATE_MAX  32
+typedef struct _STSLOT
+{
+    time_t sec;
+    int ndate;
+    int nlog;
+    struct tm tm;
+    char date[STIME_DATE_MAX];
+    char log[STIME_DATE_MAX];
+}STSLOT;
+/* refresh clock cache, called by loop once per tick */
+void stime_tick();
+/* now in usec */
+long long stime_usec();
+/* now in sec */
+time_t stime_now();
+/* RFC1123 date of now */
+int stime_date(char *date);
+/* log timestamp prefix of now "[dd/Mon/yyyy:HH:MM:SS" */
+int stime_logdate(char *date);
+/* local time of now */
+void stime_localtime(struct tm *tm);
 #endif
@@ -1,126 +1,563 @@
+#define _GNU_SOURCE
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include "xmm.h"
 //#define M_PAGE_SIZE getpagesize()
 #define M_PAGE_SIZE 4096
 #define MMSIZE(xxx) (((xxx/M_PAGE_SIZE) + ((xxx%M_PAGE_SIZE) != 0)) * M_PAGE_SIZE)
-/* new memory */
-void *xmm_mnew(size_t size)
+#define XMM_CLASS_SIZE(c) ((size_t)1 << ((c) + XMM_CLASS_SHIFT_MIN))
+/* free block, chained in thread cache and batches of depot */
+typedef struct _XMMBLOCK
 {
-    void *m = NULL;
-    if(size > 0)
+    struct _XMMBLOCK *next;
+    struct _XMMBLOCK *batch;
+    int count;
+}XMMBLOCK;
+/* blocks shared by threads, freed blocks over XMM_DEPOT_BYTES are unmapped */
+typedef struct _XMMDEPOT
+{
+    pthread_mutex_t mutex;
+    XMMBLOCK *batches;
+    int nfree;
+    char *slab;
+    char *end;
+}XMMDEPOT;
+/* per-thread cache and counters */
+typedef struct _XMMCACHE
+{
+    XMMBLOCK *heads[XMM_CLASS_NUM];
+    int counts[XMM_CLASS_NUM];
+    long long inuse[XMM_CLASS_NUM + 2];
+    long long tags[XMM_TAGS_MAX];
+    long long hits;
+    long long misses;
+    struct _XMMCACHE *prev;
+    struct _XMMCACHE *next;
+}XMMCACHE;
+static XMMDEPOT _xmm_depots_[XMM_CLASS_NUM];
+static XMMCACHE *_xmm_caches_ = NULL;
+/* counters of exited threads */
+static XMMCACHE _xmm_retired_;
+static long long _xmm_slabs_ = 0;
+static pthread_mutex_t _xmm_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t _xmm_once_ = PTHREAD_ONCE_INIT;
+static pthread_key_t _xmm_key_;
+static __thread XMMCACHE *_xmm_cache_ = NULL;
+static char *_xmm_tags_[XMM_TAGS_MAX] = {"none", "chunk", "mmblock", "conn", "queue"};
+
+/* class of size */
+static int xmm_class(size_t size)
+{
+    if(size < M_PAGE_SIZE) return XMM_CLASS_SMALL;
+    if(size > XMM_CLASS_SIZE(XMM_CLASS_NUM - 1)) return XMM_CLASS_LARGE;
+    return (64 - __builtin_clzll((unsigned long long)(size - 1))) - XMM_CLASS_SHIFT_MIN;
+}
+
+/* blocks of class kept in thread cache */
+static int xmm_cache_limit(int c)
+{
+    int n = (int)(XMM_CACHE_BYTES / XMM_CLASS_SIZE(c));
+
+    return (n < XMM_CACHE_MIN) ? XMM_CACHE_MIN : n;
+}
+
+/* blocks of class kept in depot */
+static int xmm_depot_limit(int c)
+{
+    int n = (int)(XMM_DEPOT_BYTES / XMM_CLASS_SIZE(c));
+
+    return (n < XMM_CACHE_MIN) ? XMM_CACHE_MIN : n;
+}
+
+/* push chain of blocks to depot as one batch, unmap it when depot is full */
+static void xmm_depot_push(int c, XMMBLOCK *head, int count)
+{
+    XMMDEPOT *depot = &(_xmm_depots_[c]);
+    XMMBLOCK *block = NULL;
+
+    head->count = count;
+    pthread_mutex_lock(&(depot->mutex));
+    if((depot->nfree + count) <= xmm_depot_limit(c))
     {
-        if(size < M_PAGE_SIZE)
-            m = calloc(1, size);
-        else
+        head->batch = depot->batches;
+        depot->batches = head;
+        depot->nfree += count;
+        head = NULL;
+    }
+    pthread_mutex_unlock(&(depot->mutex));
+    /* blocks are page aligned in slab, pages go back to system one block at a time */
+    while((block = head))
+    {
+        head = block->next;
+        munmap(block, XMM_CLASS_SIZE(c));
+        __sync_sub_and_fetch(&_xmm_slabs_, XMM_CLASS_SIZE(c));
+    }
+    return ;
+}
+
+/* thread exited, hand cached blocks and counters back */
+static void xmm_cache_exit(void *arg)
+{
+    XMMCACHE *cache = (XMMCACHE *)arg;
+    int i = 0;
+
+    if(cache)
+    {
+        for(i = 0; i < XMM_CLASS_NUM; i++)
         {
-            m = mmap(NULL, MMSIZE(size), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-            if(m == NULL || m == (void *)-1) m = NULL;
-            else memset(m, 0, MMSIZE(size));
+            if(cache->heads[i]) xmm_depot_push(i, cache->heads[i], cache->counts[i]);
         }
+        pthread_mutex_lock(&_xmm_mutex_);
+        for(i = 0; i < (XMM_CLASS_NUM + 2); i++) _xmm_retired_.inuse[i] += cache->inuse[i];
+        for(i = 0; i < XMM_TAGS_MAX; i++) _xmm_retired_.tags[i] += cache->tags[i];
+        _xmm_retired_.hits += cache->hits;
+        _xmm_retired_.misses += cache->misses;
+        if(cache->prev) cache->prev->next = cache->next;
+        else _xmm_caches_ = cache->next;
+        if(cache->next) cache->next->prev = cache->prev;
+        pthread_mutex_unlock(&_xmm_mutex_);
+        if(_xmm_cache_ == cache) _xmm_cache_ = NULL;
+        free(cache);
     }
-    return m;
+    return ;
 }
 
-void *xmm_new(size_t size)
+static void xmm_once()
 {
-    void *m = NULL;
-    if(size > 0)
+    int i = 0;
+
+    for(i = 0; i < XMM_CLASS_NUM; i++)
+        pthread_mutex_init(&(_xmm_depots_[i].mutex), NULL);
+    pthread_key_create(&_xmm_key_, &xmm_cache_exit);
+    return ;
+}
+
+/* cache of current thread */
+static XMMCACHE *xmm_cache()
+{
+    XMMCACHE *cache = NULL;
+
+    if((cache = _xmm_cache_) == NULL)
     {
-        if(size < M_PAGE_SIZE)
-            m = calloc(1, size);
-        else
+        pthread_once(&_xmm_once_, &xmm_once);
+        if((cache = (XMMCACHE *)calloc(1, sizeof(XMMCACHE))))
         {
-            m = mmap(NULL, MMSIZE(size), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-            if(m == NULL || m == (void *)-1) m = NULL;
-            //else memset(m, 0, MMSIZE(size));
+            pthread_mutex_lock(&_xmm_mutex_);
+            if((cache->next = _xmm_caches_)) _xmm_caches_->prev = cache;
+            _xmm_caches_ = cache;
+            pthread_mutex_unlock(&_xmm_mutex_);
+            pthread_setspecific(_xmm_key_, cache);
+            _xmm_cache_ = cache;
         }
     }
-    return m;
+    return cache;
 }
-/* resize */
-void *xmm_mresize(void *old, size_t old_size, size_t new_size)
+
+/* block of class from thread cache, depot or slab */
+static void *xmm_class_new(XMMCACHE *cache, int c)
 {
-    void *m = NULL;
-    if(new_size > 0 && new_size > old_size)
+    XMMDEPOT *depot = &(_xmm_depots_[c]);
+    XMMBLOCK *block = NULL, *left = NULL;
+    char *slab = NULL;
+
+    if(cache && (block = cache->heads[c]))
+    {
+        cache->heads[c] = block->next;
+        cache->counts[c]--;
+        cache->hits++;
+        return block;
+    }
+    if(cache) cache->misses++;
+    pthread_mutex_lock(&(depot->mutex));
+    if((block = depot->batches))
     {
-        if(new_size < M_PAGE_SIZE)
+        depot->batches = block->batch;
+        depot->nfree -= block->count;
+        if(cache)
         {
-            m = calloc(1, new_size);
+            cache->heads[c] = block->next;
+            cache->counts[c] = block->count - 1;
         }
-        else
+        else if((left = block->next))
         {
-            m = mmap(NULL, MMSIZE(new_size), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-            if(m == (void *)-1) m = NULL;
-            else memset(m, 0, MMSIZE(new_size));
+            left->count = block->count - 1;
+            left->batch = depot->batches;
+            depot->batches = left;
+            depot->nfree += left->count;
         }
-        if(old)
+    }
+    else
+    {
+        if(depot->slab == depot->end)
         {
-            if(old_size > 0)
+            slab = (char *)mmap(NULL, XMM_SLAB_SIZE, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+            if(slab != (char *)-1 && slab != NULL)
             {
-                if(m) memcpy(m, old, old_size);
-                if(old_size < M_PAGE_SIZE) free(old);
-                else 
-                    munmap(old, MMSIZE(old_size));
+                depot->slab = slab;
+                depot->end = slab + XMM_SLAB_SIZE;
+                __sync_add_and_fetch(&_xmm_slabs_, XMM_SLAB_SIZE);
             }
         }
+        if(depot->slab != depot->end)
+        {
+            block = (XMMBLOCK *)depot->slab;
+            depot->slab += XMM_CLASS_SIZE(c);
+        }
     }
-    return m;
+    pthread_mutex_unlock(&(depot->mutex));
+    return block;
 }
-/* resize */
-void *xmm_resize(void *old, size_t old_size, size_t new_size)
+
+/* block back to thread cache, whole cache moved to depot when full */
+static void xmm_class_free(XMMCACHE *cache, int c, void *m)
+{
+    XMMBLOCK *block = (XMMBLOCK *)m;
+
+    if(cache)
+    {
+        if(cache->counts[c] >= xmm_cache_limit(c))
+        {
+            xmm_depot_push(c, cache->heads[c], cache->counts[c]);
+            cache->heads[c] = NULL;
+            cache->counts[c] = 0;
+        }
+        block->next = cache->heads[c];
+        cache->heads[c] = block;
+        cache->counts[c]++;
+    }
+    else
+    {
+        block->next = NULL;
+        xmm_depot_push(c, block, 1);
+    }
+    return ;
+}
+
+/* count bytes of class and tag */
+static void xmm_count(XMMCACHE *cache, int tag, int c, size_t size, int sign)
 {
+    long long bytes = (long long)size;
+
+    if(cache)
+    {
+        if(c < XMM_CLASS_NUM) bytes = (long long)XMM_CLASS_SIZE(c);
+        else if(c == XMM_CLASS_LARGE) bytes = (long long)MMSIZE(size);
+        cache->inuse[c] += sign * bytes;
+        if(tag >= 0 && tag < XMM_TAGS_MAX) cache->tags[tag] += sign * (long long)size;
+    }
+    return ;
+}
+
+static void *xmm_alloc(int tag, size_t size, int zero)
+{
+    XMMCACHE *cache = NULL;
     void *m = NULL;
-    if(new_size > 0 && new_size > old_size)
+    int c = 0;
+
+    if(size > 0)
     {
-        if(new_size < M_PAGE_SIZE)
+        cache = xmm_cache();
+        c = xmm_class(size);
+        if(c == XMM_CLASS_SMALL)
+            m = calloc(1, size);
+        else if(c == XMM_CLASS_LARGE)
         {
-            m = calloc(1, new_size);
+            /* anonymous pages come zeroed */
+            m = mmap(NULL, MMSIZE(size), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+            if(m == NULL || m == (void *)-1) m = NULL;
         }
         else
         {
-            m = mmap(NULL, MMSIZE(new_size), PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
-            if(m == (void *)-1) m = NULL;
-            //else memset(m, 0, MMSIZE(new_size));
+            if((m = xmm_class_new(cache, c)) && zero) memset(m, 0, size);
         }
-        if(old)
+        if(m) xmm_count(cache, tag, c, size, 1);
+    }
+    return m;
+}
+
+/* new memory */
+void *xmm_tag_mnew(int tag, size_t size)
+{
+    return xmm_alloc(tag, size, 1);
+}
+
+void *xmm_tag_new(int tag, size_t size)
+{
+    return xmm_alloc(tag, size, 1);
+}
+
+/* free memory */
+void xmm_tag_free(int tag, void *m, size_t size)
+{
+    XMMCACHE *cache = NULL;
+    int c = 0;
+
+    if(m && size > 0)
+    {
+        cache = xmm_cache();
+        c = xmm_class(size);
+        if(c == XMM_CLASS_SMALL) free(m);
+        else if(c == XMM_CLASS_LARGE) munmap(m, MMSIZE(size));
+        else xmm_class_free(cache, c, m);
+        xmm_count(cache, tag, c, size, -1);
+    }
+    return ;
+}
+
+static void *xmm_realloc(int tag, void *old, size_t old_size, size_t new_size, int zero)
+{
+    void *m = NULL;
+    int c = 0;
+
+    if(new_size > 0 && new_size > old_size)
+    {
+        if(old && old_size > 0)
         {
-            if(old_size > 0)
+            /* block of class has room already */
+            if((c = xmm_class(old_size)) < XMM_CLASS_NUM && c == xmm_class(new_size))
+            {
+                if(zero) memset((char *)old + old_size, 0, new_size - old_size);
+                xmm_count(xmm_cache(), tag, c, old_size, -1);
+                xmm_count(xmm_cache(), tag, c, new_size, 1);
+                return old;
+            }
+#ifdef MREMAP_MAYMOVE
+            if(c == XMM_CLASS_LARGE)
             {
-                if(m) memcpy(m, old, old_size);
-                if(old_size < M_PAGE_SIZE) free(old);
-                else
-                    munmap(old, MMSIZE(old_size));
+                m = mremap(old, MMSIZE(old_size), MMSIZE(new_size), MREMAP_MAYMOVE);
+                if(m == (void *)-1) m = NULL;
+                if(m)
+                {
+                    xmm_count(xmm_cache(), tag, c, old_size, -1);
+                    xmm_count(xmm_cache(), tag, c, new_size, 1);
+                    return m;
+                }
             }
+#endif
+        }
+        m = xmm_alloc(tag, new_size, zero);
+        if(old && old_size > 0)
+        {
+            if(m) memcpy(m, old, old_size);
+            xmm_tag_free(tag, old, old_size);
         }
     }
     return m;
 }
 
+/* resize */
+void *xmm_tag_mresize(int tag, void *old, size_t old_size, size_t new_size)
+{
+    return xmm_realloc(tag, old, old_size, new_size, 1);
+}
+
+/* resize */
+void *xmm_tag_resize(int tag, void *old, size_t old_size, size_t new_size)
+{
+    return xmm_realloc(tag, old, old_size, new_size, 0);
+}
+
+static void *xmm_rebuild(int tag, void *old, size_t old_size, size_t new_size, int zero)
+{
+    int c = 0;
+
+    /* content dropped, block of same class reused */
+    if(old && old_size > 0 && new_size > 0 && (c = xmm_class(old_size)) < XMM_CLASS_NUM
+            && c == xmm_class(new_size))
+    {
+        if(zero) memset(old, 0, new_size);
+        xmm_count(xmm_cache(), tag, c, old_size, -1);
+        xmm_count(xmm_cache(), tag, c, new_size, 1);
+        return old;
+    }
+    xmm_tag_free(tag, old, old_size);
+    return xmm_alloc(tag, new_size, zero);
+}
+
 /* remalloc */
-void *xmm_mrenew(void *old, size_t old_size, size_t new_size)
+void *xmm_tag_mrenew(int tag, void *old, size_t old_size, size_t new_size)
 {
-    xmm_free(old, old_size);
-    return xmm_mnew(new_size);
+    return xmm_rebuild(tag, old, old_size, new_size, 1);
 }
 
 /* remalloc */
+void *xmm_tag_renew(int tag, void *old, size_t old_size, size_t new_size)
+{
+    return xmm_rebuild(tag, old, old_size, new_size, 0);
+}
+
+void *xmm_mnew(size_t size)
+{
+    return xmm_alloc(XMM_TAG_NONE, size, 1);
+}
+
+void *xmm_new(size_t size)
+{
+    return xmm_alloc(XMM_TAG_NONE, size, 1);
+}
+
+void *xmm_mresize(void *old, size_t old_size, size_t new_size)
+{
+    return xmm_realloc(XMM_TAG_NONE, old, old_size, new_size, 1);
+}
+
+void *xmm_resize(void *old, size_t old_size, size_t new_size)
+{
+    return xmm_realloc(XMM_TAG_NONE, old, old_size, new_size, 0);
+}
+
+void *xmm_mrenew(void *old, size_t old_size, size_t new_size)
+{
+    return xmm_rebuild(XMM_TAG_NONE, old, old_size, new_size, 1);
+}
+
 void *xmm_renew(void *old, size_t old_size, size_t new_size)
 {
-    xmm_free(old, old_size);
-    return xmm_new(new_size);
+    return xmm_rebuild(XMM_TAG_NONE, old, old_size, new_size, 0);
 }
 
-/* free memory */
 void xmm_free(void *m, size_t size)
 {
-    if(m && size > 0)
+    xmm_tag_free(XMM_TAG_NONE, m, size);
+    return ;
+}
+
+/* add counters of cache */
+static void xmm_stats_add(XMMSTATS *stats, XMMCACHE *cache)
+{
+    int i = 0;
+
+    for(i = 0; i < (XMM_CLASS_NUM + 2); i++) stats->inuse[i] += cache->inuse[i];
+    for(i = 0; i < XMM_CLASS_NUM; i++)
+        stats->cached[i] += (long long)cache->counts[i] * XMM_CLASS_SIZE(i);
+    for(i = 0; i < XMM_TAGS_MAX; i++) stats->tags[i] += cache->tags[i];
+    stats->hits += cache->hits;
+    stats->misses += cache->misses;
+    return ;
+}
+
+/* stats summed over threads */
+void xmm_stats(XMMSTATS *stats)
+{
+    XMMCACHE *cache = NULL;
+    int i = 0;
+
+    if(stats)
     {
-        if(size < M_PAGE_SIZE) free(m);
-        else 
-            munmap(m, MMSIZE(size));
+        memset(stats, 0, sizeof(XMMSTATS));
+        pthread_mutex_lock(&_xmm_mutex_);
+        xmm_stats_add(stats, &_xmm_retired_);
+        for(cache = _xmm_caches_; cache; cache = cache->next) xmm_stats_add(stats, cache);
+        pthread_mutex_unlock(&_xmm_mutex_);
+        for(i = 0; i < XMM_CLASS_NUM; i++)
+            stats->cached[i] += (long long)_xmm_depots_[i].nfree * XMM_CLASS_SIZE(i);
+        stats->slabs = _xmm_slabs_;
     }
     return ;
 }
+
+/* print stats to buf, return length */
+int xmm_stats_print(char *buf, int size)
+{
+    char *p = buf, *end = buf + size;
+    XMMSTATS stats;
+    int i = 0;
+
+    if(buf && size > 0)
+    {
+        xmm_stats(&stats);
+        p += snprintf(p, end - p, "xmm slabs:%lld hits:%lld misses:%lld small:%lld large:%lld\n",
+                stats.slabs, stats.hits, stats.misses, stats.inuse[XMM_CLASS_SMALL],
+                stats.inuse[XMM_CLASS_LARGE]);
+        for(i = 0; i < XMM_CLASS_NUM && p < end; i++)
+        {
+            if(stats.inuse[i] == 0 && stats.cached[i] == 0) continue;
+            p += snprintf(p, end - p, "xmm class:%uK inuse:%lld cached:%lld\n",
+                    (unsigned int)(XMM_CLASS_SIZE(i) >> 10), stats.inuse[i], stats.cached[i]);
+        }
+        for(i = 0; i < XMM_TAGS_MAX && p < end; i++)
+        {
+            if(stats.tags[i] == 0) continue;
+            if(_xmm_tags_[i]) p += snprintf(p, end - p, "xmm tag:%s bytes:%lld\n", _xmm_tags_[i], stats.tags[i]);
+            else p += snprintf(p, end - p, "xmm tag:%d bytes:%lld\n", i, stats.tags[i]);
+        }
+        if(p > end) p = end;
+        return p - buf;
+    }
+    return 0;
+}
+
+#ifdef _BENCH_XMM
+#include <sys/time.h>
+#define BENCH_THREADS_MAX 64
+static int bench_count = 100000;
+/* grow buffer 4K to 256K and free, as chunk_mem() of growing request */
+static void *bench_grow(void *arg)
+{
+    size_t size = 0;
+    void *m = NULL;
+    int i = 0;
+
+    for(i = 0; i < bench_count; i++)
+    {
+        m = NULL;
+        for(size = 4096; size <= 262144; size <<= 1)
+            m = xmm_tag_renew(XMM_TAG_CHUNK, m, (size == 4096) ? 0 : (size >> 1), size);
+        xmm_tag_free(XMM_TAG_CHUNK, m, 262144);
+    }
+    return NULL;
+}
+/* same by mmap/munmap per buffer */
+static void *bench_mmap(void *arg)
+{
+    size_t size = 0;
+    void *m = NULL;
+    int i = 0;
+
+    for(i = 0; i < bench_count; i++)
+    {
+        m = NULL;
+        for(size = 4096; size <= 262144; size <<= 1)
+        {
+            if(m) munmap(m, size >> 1);
+            m = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+        }
+        munmap(m, 262144);
+    }
+    return NULL;
+}
+static long long bench_run(void *(*func)(void *), int nthreads)
+{
+    pthread_t threads[BENCH_THREADS_MAX];
+    struct timeval tv = {0};
+    long long start = 0;
+    int i = 0;
+
+    gettimeofday(&tv, NULL);start = tv.tv_sec * 1000000ll + tv.tv_usec;
+    for(i = 0; i < nthreads; i++) pthread_create(&threads[i], NULL, func, NULL);
+    for(i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ll + tv.tv_usec - start;
+}
+int main(int argc, char **argv)
+{
+    long long used = 0, total = 0;
+    int nthreads = 4;
+    char buf[4096];
+
+    if(argc > 1) bench_count = atoi(argv[1]);
+    if(argc > 2 && (nthreads = atoi(argv[2])) > BENCH_THREADS_MAX) nthreads = BENCH_THREADS_MAX;
+    total = (long long)bench_count * nthreads * 7;
+    used = bench_run(&bench_mmap, nthreads);
+    fprintf(stdout, "mmap/munmap %lld buffers in %lld usec, %.0f buffers/s\n", total, used, total * 1000000.0/(used ? used : 1));
+    used = bench_run(&bench_grow, nthreads);
+    fprintf(stdout, "xmm slabs %lld buffers in %lld usec, %.0f buffers/s\n", total, used, total * 1000000.0/(used ? used : 1));
+    if(xmm_stats_print(buf, sizeof(buf)) > 0) fputs(buf, stdout);
+    return 0;
+}
+//gcc -O2 -o xmm xmm.c -D_BENCH_XMM -lpthread && ./xmm 100000 4
+#endif
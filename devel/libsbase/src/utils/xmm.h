@@ -1,5 +1,37 @@
 #ifndef _XMM_H_
 #define _XMM_H_
+/* size classes of 4KB << n up to 4MB carved from slabs, smaller by calloc, larger by mmap */
+#define XMM_CLASS_SHIFT_MIN     12
+#define XMM_CLASS_SHIFT_MAX     22
+#define XMM_CLASS_NUM           (XMM_CLASS_SHIFT_MAX - XMM_CLASS_SHIFT_MIN + 1)
+#define XMM_CLASS_SMALL         XMM_CLASS_NUM
+#define XMM_CLASS_LARGE         (XMM_CLASS_NUM + 1)
+#define XMM_SLAB_SIZE           4194304
+/* bytes of one class kept by a thread before moving them to depot */
+#define XMM_CACHE_BYTES         1048576
+#define XMM_CACHE_MIN           2
+/* bytes of one class kept in depot, blocks freed over it are unmapped */
+#define XMM_DEPOT_BYTES         16777216
+/* caller tags */
+#define XMM_TAG_NONE            0
+#define XMM_TAG_CHUNK           1
+#define XMM_TAG_MMBLOCK         2
+#define XMM_TAG_CONN            3
+#define XMM_TAG_QUEUE           4
+#define XMM_TAGS_MAX            8
+typedef struct _XMMSTATS
+{
+    /* bytes in use of classes, small and large */
+    long long inuse[XMM_CLASS_NUM + 2];
+    /* free bytes of classes held in thread caches and depot */
+    long long cached[XMM_CLASS_NUM];
+    /* bytes requested by tags */
+    long long tags[XMM_TAGS_MAX];
+    long long slabs;
+    long long hits;
+    long long misses;
+}XMMSTATS;
+/* new memory comes zeroed, resize keeps old content and renew drops it, only m* zero the rest */
 void* xmm_mnew(size_t size);
 void* xmm_new(size_t size);
 void* xmm_mrenew(void *old, size_t old_size, size_t new_size);
@@ -7,4 +39,16 @@ void* xmm_renew(void *old, size_t old_size, size_t new_size);
 void* xmm_mresize(void *old, size_t old_size, size_t new_size);
 void* xmm_resize(void *old, size_t old_size, size_t new_size);
 void xmm_free(void *m, size_t size);
+/* same as above, bytes counted to tag */
+void* xmm_tag_mnew(int tag, size_t size);
+void* xmm_tag_new(int tag, size_t size);
+void* xmm_tag_mrenew(int tag, void *old, size_t old_size, size_t new_size);
+void* xmm_tag_renew(int tag, void *old, size_t old_size, size_t new_size);
+void* xmm_tag_mresize(int tag, void *old, size_t old_size, size_t new_size);
+void* xmm_tag_resize(int tag, void *old, size_t old_size, size_t new_size);
+void xmm_tag_free(int tag, void *m, size_t size);
+/* stats summed over threads */
+void xmm_stats(XMMSTATS *stats);
+/* print stats to buf, return length */
+int xmm_stats_print(char *buf, int size);
 #endif
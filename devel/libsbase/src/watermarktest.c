@@ -0,0 +1,175 @@
+/* send queue watermark test, run by make check:
+ * server pushes chunks while conn->ops->writable() to a throttled client and resumes in
+ * writable_handler, failed when handler is called without the queue falling from high
+ * to low watermark, queue grows over high watermark or data lost */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sbase.h>
+#define WT_PORT             19963
+#define WT_TOTAL            16777216
+#define WT_CHUNK            16384
+#define WT_HIGH             262144
+#define WT_LOW              65536
+#define WT_SOCKBUF          16384
+#define WT_READ_SIZE        16384
+#define WT_READ_USEC        200
+#define WT_PATTERN(off)     ((unsigned char)((off) % 251))
+static SBASE *sbase = NULL;
+static SERVICE *service = NULL;
+static long long sent = 0;
+static long long peak = 0;
+static int waiting = 0;
+static int nblocked = 0;
+static int nwritable = 0;
+static int nspurious = 0;
+static int result = -1;
+
+/* push chunks till send queue over high watermark or all sent */
+static void wmtest_produce(CONN *conn)
+{
+    unsigned char buf[WT_CHUNK];
+    int i = 0;
+
+    while(conn)
+    {
+        if(conn->ops->writable(conn) == 0)
+        {
+            nblocked++;
+            waiting = 1;
+            break;
+        }
+        if(sent >= WT_TOTAL) break;
+        for(i = 0; i < WT_CHUNK; i++) buf[i] = WT_PATTERN(sent + i);
+        if(conn->ops->push_chunk(conn, buf, WT_CHUNK) != 0) break;
+        sent += WT_CHUNK;
+        if(conn->sendq_bytes > peak) peak = conn->sendq_bytes;
+    }
+    return ;
+}
+
+/* start sending on request */
+int wmtest_packet_handler(CONN *conn, CB_DATA *packet)
+{
+    int opt = WT_SOCKBUF;
+
+    if(conn)
+    {
+        /* small socket buffer, queue can not fall from high to low between push and check */
+        setsockopt(conn->fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt));
+        sent = 0;
+        wmtest_produce(conn);
+        return 0;
+    }
+    return -1;
+}
+
+/* send queue fell to low watermark */
+int wmtest_writable_handler(CONN *conn)
+{
+    if(conn)
+    {
+        nwritable++;
+        if(waiting == 0) nspurious++;
+        waiting = 0;
+        wmtest_produce(conn);
+        return 0;
+    }
+    return -1;
+}
+
+/* throttled client, 0 when all data came */
+static int wmtest_client()
+{
+    unsigned char buf[WT_READ_SIZE];
+    int fd = -1, n = 0, i = 0, bad = 0, opt = WT_SOCKBUF;
+    struct sockaddr_in sa = {0};
+    long long total = 0;
+
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sa.sin_port = htons(WT_PORT);
+    if(connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || write(fd, "SEND\r\n", 6) != 6)
+    {
+        fprintf(stderr, "connect to service failed, %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    while(total < WT_TOTAL && (n = read(fd, buf, WT_READ_SIZE)) > 0)
+    {
+        for(i = 0; i < n; i++)
+        {
+            if(buf[i] != WT_PATTERN(total + i)) bad++;
+        }
+        total += n;
+        usleep(WT_READ_USEC);
+    }
+    /* handler of last fall to low watermark */
+    usleep(200000);
+    close(fd);
+    fprintf(stdout, "received %lld/%d bytes bad:%d blocked:%d writable:%d spurious:%d "
+            "peak %lld KB (high %d KB)\n", total, WT_TOTAL, bad, nblocked, nwritable,
+            nspurious, peak/1024, WT_HIGH/1024);
+    if(total == WT_TOTAL && bad == 0 && nblocked > 0 && nwritable == nblocked
+            && nspurious == 0 && peak < WT_HIGH + WT_CHUNK) return 0;
+    return -1;
+}
+
+static void *wmtest_run(void *arg)
+{
+    usleep(200000);
+    if(wmtest_client() == 0) result = 0;
+    sbase->stop(sbase);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t client;
+
+    setlocale(LC_ALL, "C");
+    signal(SIGPIPE, SIG_IGN);
+    if((sbase = sbase_init()) == NULL || (service = service_init()) == NULL)
+    {
+        exit(EXIT_FAILURE);
+    }
+    sbase->nchilds = 0;
+    sbase->usec_sleep = SB_USEC_SLEEP;
+    service->family = AF_INET;
+    service->sock_type = SOCK_STREAM;
+    service->ip = "127.0.0.1";
+    service->port = WT_PORT;
+    service->working_mode = WORKING_PROC;
+    service->service_type = S_SERVICE;
+    service->service_name = "watermarktest";
+    service->nprocthreads = 1;
+    service->session.packet_type = PACKET_DELIMITER;
+    service->session.packet_delimiter = "\r\n";
+    service->session.packet_delimiter_length = 2;
+    service->session.buffer_size = SB_BUF_SIZE;
+    service->session.sendq_high = WT_HIGH;
+    service->session.sendq_low = WT_LOW;
+    service->session.packet_handler = &wmtest_packet_handler;
+    service->session.writable_handler = &wmtest_writable_handler;
+    if(sbase->add_service(sbase, service) != 0)
+    {
+        fprintf(stderr, "add service failed, %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pthread_create(&client, NULL, &wmtest_run, NULL);
+    sbase->running(sbase, 0);
+    pthread_join(client, NULL);
+    sbase->clean(sbase);
+    fprintf(stdout, "watermarktest %s\n", (result == 0) ? "passed" : "failed");
+    return (result == 0) ? 0 : 1;
+}
@@ -88,10 +88,10 @@ int http_request(CONN *conn)
         if(n >= ntasks)
         {
             //WARN_LOGGER(logger, "close-conn[%s:%d] via %d", conn->local_ip, conn->local_port, conn->fd);
-            conn->close(conn);
+            conn->ops->close(conn);
             return -1;
         }
-        conn->set_timeout(conn, req_timeout);
+        conn->ops->set_timeout(conn, req_timeout);
         if(fp && fgets(path, HTTP_PATH_MAX, fp))
         {
             //fprintf(stdout, "%s::%d conn[%s:%d][%d]->status:%d\n", __FILE__, __LINE__, conn->local_ip, conn->local_port, conn->fd, conn->status);
@@ -122,12 +122,12 @@ int http_request(CONN *conn)
                 n = p - buf;
             }
             if(is_verbosity && is_quiet == 0) fprintf(stdout, "%s", buf);
-            conn->save_cache(conn, path, strlen(path)+1);
-            return conn->push_chunk(conn, buf, n);
+            conn->ops->save_cache(conn, path, strlen(path)+1);
+            return conn->ops->push_chunk(conn, buf, n);
         }
         else
         {
-            return conn->push_chunk(conn, request, request_len);
+            return conn->ops->push_chunk(conn, request, request_len);
         }
     }
     return -1;
@@ -207,7 +207,7 @@ int http_over(CONN *conn, int respcode)
             }
             else
             {
-                if(is_keepalive) conn->close(conn);
+                if(is_keepalive) conn->ops->close(conn);
                 //if(respcode != 0 && respcode != 200)nerrors++;
                 if(http_newconn(id, server_ip, server_port, server_is_ssl)  == NULL) 
                 {
@@ -218,7 +218,7 @@ int http_over(CONN *conn, int respcode)
         else 
         {
             --ncurrent;
-            conn->close(conn);
+            conn->ops->close(conn);
         }
         if(running_status && n == ntasks)
         {
@@ -232,7 +232,7 @@ int http_check_over(CONN *conn)
 {
     if(conn)
     {
-        conn->over_timeout(conn);
+        conn->ops->over_timeout(conn);
         if(is_keepalive) return http_over(conn, conn->s_id);
         return 0;
     }
@@ -252,7 +252,7 @@ int benchmark_packet_handler(CONN *conn, CB_DATA *packet)
 
 	if(conn)
     {
-        conn->over_timeout(conn);
+        conn->ops->over_timeout(conn);
         p = packet->data;end = packet->data + packet->ndata;
         //check response code 
         if((s = strstr(p, "HTTP/")))
@@ -268,7 +268,7 @@ int benchmark_packet_handler(CONN *conn, CB_DATA *packet)
         if(respcode != 200)
         {
             //fprintf(stdout, "HTTP:%s\n", p);
-            conn->over_timeout(conn);
+            conn->ops->over_timeout(conn);
             return http_over(conn, respcode);
         }
         */
@@ -283,7 +283,7 @@ int benchmark_packet_handler(CONN *conn, CB_DATA *packet)
             }
             if(*s >= '0' && *s <= '9' && (len = atoll(s)) > 0) 
             {
-                conn->recv_chunk(conn, len);
+                conn->ops->recv_chunk(conn, len);
             }
             else
             {
@@ -352,10 +352,10 @@ int benchmark_timeout_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DA
             WARN_LOGGER(logger, "timeout on conn[%s:%d] via %d status:%d", conn->local_ip, conn->local_port, conn->fd, conn->status);
         }
         ntimeouts++;
-        conn->over_estate(conn);
-        conn->over_timeout(conn);
+        conn->ops->over_estate(conn);
+        conn->ops->over_timeout(conn);
         http_over(conn, 0);
-        return conn->close(conn);
+        return conn->ops->close(conn);
     }
     return -1;
 }
@@ -52,7 +52,7 @@ CONN *http_newconn(int id, char *ip, int port, int is_ssl)
         if((conn = service->newconn(service, -1, -1, ip, port, NULL)))
         {
             conn->c_id = id;
-            conn->start_cstate(conn);
+            conn->ops->start_cstate(conn);
             //service->newtransaction(service, conn, id);
             //usleep(10);
         }
@@ -82,8 +82,8 @@ int http_request(CONN *conn)
             TIMER_INIT(timer);
         }
         ++nrequests;
-        conn->start_cstate(conn);
-        conn->set_timeout(conn, req_timeout);
+        conn->ops->start_cstate(conn);
+        conn->ops->set_timeout(conn, req_timeout);
         if(fp && fgets(path, HTTP_PATH_MAX, fp))
         {
             //fprintf(stdout, "%s::%d conn[%s:%d][%d]->status:%d\n", __FILE__, __LINE__, conn->local_ip, conn->local_port, conn->fd, conn->status);
@@ -114,12 +114,12 @@ int http_request(CONN *conn)
                 n = p - buf;
             }
             if(is_verbosity && is_quiet == 0) fprintf(stdout, "%s", buf);
-            conn->save_cache(conn, path, strlen(path)+1);
-            return conn->push_chunk(conn, buf, n);
+            conn->ops->save_cache(conn, path, strlen(path)+1);
+            return conn->ops->push_chunk(conn, buf, n);
         }
         else
         {
-            return conn->push_chunk(conn, request, request_len);
+            return conn->ops->push_chunk(conn, request, request_len);
         }
     }
     return -1;
@@ -158,12 +158,12 @@ int http_over(CONN *conn, int respcode)
 
     if(conn)
     {
-        conn->over_cstate(conn);
+        conn->ops->over_cstate(conn);
         id = conn->c_id;
         if(ncompleted < ntasks) 
             ++ncompleted;
         else 
-            return conn->over(conn);
+            return conn->ops->over(conn);
         n = ncompleted;
         if(n > 0 && n <= ntasks && (n%1000) == 0)
         {
@@ -179,7 +179,7 @@ int http_over(CONN *conn, int respcode)
                 return http_request(conn);
             else
             {
-                conn->close(conn);
+                conn->ops->close(conn);
                 if(respcode != 0 && respcode != 200)nerrors++;
                 if(http_newconn(id, server_ip, server_port, server_is_ssl)  == NULL) 
                 {
@@ -189,7 +189,7 @@ int http_over(CONN *conn, int respcode)
         }
         else 
         {
-            conn->close(conn);
+            conn->ops->close(conn);
             if(n == ntasks) return http_show_state(n);
         }
     }
@@ -239,7 +239,7 @@ int benchmark_packet_handler(CONN *conn, CB_DATA *packet)
                 else++s;
             }
             if(*s >= '0' && *s <= '9' && (len = atoll(s)) > 0) 
-                return conn->recv_chunk(conn, len);
+                return conn->ops->recv_chunk(conn, len);
         }
         return http_check_over(conn);
     }
@@ -277,8 +277,8 @@ int benchmark_trans_handler(CONN *conn, int tid)
             }
             else
             {
-                conn->wait_evstate(conn);
-                return conn->set_timeout(conn, req_timeout - conn->timeout);
+                conn->ops->wait_evstate(conn);
+                return conn->ops->set_timeout(conn, req_timeout - conn->timeout);
             }
             //return service->newtransaction(service, conn, tid);
         }
@@ -8,6 +8,7 @@
 #include <locale.h>
 #include <dirent.h>
 #include <pwd.h>
+#include <netdb.h>
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -21,21 +22,155 @@
 #include "iniparser.h"
 #include "http.h"
 #include "mime.h"
+#include "route.h"
 #include "mtrie.h"
 #include "stime.h"
 #include "logger.h"
+#include "alog.h"
+#include "xmm.h"
 #include "message.h"
 #define XHTTPD_VERSION 		    "1.0.4"
 #define HTTP_RESP_OK            "HTTP/1.1 200 OK"
 #define HTTP_BAD_REQUEST        "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n"
 #define HTTP_NOT_FOUND          "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n" 
 #define HTTP_NOT_MODIFIED       "HTTP/1.1 304 Not Modified\r\nContent-Length: 0\r\n\r\n"
+#define HTTP_BAD_GATEWAY        "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n"
 #define HTTP_NO_CONTENT         "HTTP/1.1 206 No Content\r\nContent-Length: 0\r\n\r\n"
 #define HTTP_LINE_SIZE          65536
 #define HTTP_VIEW_SIZE          131072
 #define HTTPD_TIMEOUT           10000000
 #define LL(x) ((long long)x)
 #define UL(x) ((unsigned long int)x)
+#define XCACHE_SLOT_MAX         65536
+#define XCACHE_SLOT_MIN         64
+/* slots of cache sized by budget of bytes per slot */
+#define XCACHE_SLOT_BYTES       1024
+#define XCACHE_FILE_MAX         65536
+//#define XCACHE_FILE_MAX       262144
+#define XCACHE_KEY_MAX          (HTTP_PATH_MAX + 8)
+/* hot object: [key][pre-rendered headers][body] in one shared block sent by reference */
+typedef struct _XCSLOT
+{
+    CHUNK_SHARED *shared;
+    int  ndata;
+    int  nkey;
+    int  nhead;
+    int  bits;
+    time_t mtime;
+    off_t size;
+}XCSLOT;
+typedef struct _XCACHE
+{
+    MUTEX *mutex;
+    void *map;
+    int  hand;
+    int  nslots;
+    int  nleft;
+    int  file_max;
+    off_t total;
+    off_t limit;
+    long long hits;
+    long long misses;
+    long long evicts;
+    int  slot_max;
+    int  *left;
+    XCSLOT *slots;
+}XCACHE;
+static XCACHE *xcache = NULL;
+#ifdef HAVE_ZLIB
+#define XZSTREAM_MAX            1024
+/* idle streams kept in pool, the others freed when pushed back */
+#define XZSTREAM_IDLE_MAX       16
+#define XZSTREAM_BLOCK          65536
+#define XZSTREAM_BATCH          65536
+//#define XZSTREAM_BATCH        262144
+#define XZSTREAM_EXTRA          32
+/* send queue watermarks of stream, batches produced till high, resumed under low */
+#define XZSTREAM_SENDQ_HIGH     (XZSTREAM_BATCH * 4)
+#define XZSTREAM_SENDQ_LOW      XZSTREAM_BATCH
+#define XHTTPD_XID_ZSTREAM      0
+/* pooled compress stream, state of one chunked response */
+typedef struct _XZSTREAM
+{
+    z_stream z;
+    int  index;
+    int  encid;
+    int  fd;
+    int  keepalive;
+    off_t offset;
+    off_t to;
+    void *conn;
+    MUTEX *mutex;
+    unsigned char *in;
+}XZSTREAM;
+static XZSTREAM *xzstreams[XZSTREAM_MAX];
+static int xzleft[XZSTREAM_MAX];
+static int xzfree[XZSTREAM_MAX];
+static int nxzstreams = 0;
+static int nxzleft = 0;
+static int nxzfree = 0;
+static MUTEX *xzmutex = NULL;
+#endif
+#define ZCACHE_ENTRY_MAX        262144
+#define ZCACHE_FILE_MAX         67108864
+#define ZCACHE_SIZE_MAX         1073741824
+#define ZCACHE_KEY_MAX          (HTTP_PATH_MAX * 2)
+#define ZENTRY_PENDING          0x01
+#define ZENTRY_READY            0x02
+#define ZENTRY_FAILED           0x04
+/* compressed content, [offset, offset+length) of store file */
+typedef struct _ZENTRY
+{
+    off_t offset;
+    int   length;
+    int   status;
+}ZENTRY;
+/* compressed content cache: in-memory index and append-only store */
+typedef struct _ZCACHE
+{
+    MUTEX *mutex;
+    void *index;
+    int  fd;
+    int  gen;
+    int  nentries;
+    off_t size;
+    off_t limit;
+    char dir[HTTP_PATH_MAX];
+    char file[HTTP_PATH_MAX];
+    ZENTRY entries[ZCACHE_ENTRY_MAX];
+}ZCACHE;
+typedef struct _ZCTASK
+{
+    int id;
+    int gen;
+    int encid;
+    off_t from;
+    off_t to;
+    char file[HTTP_PATH_MAX];
+}ZCTASK;
+static ZCACHE *zcache = NULL;
+#define XWARMUP_THREADS_MAX     64
+#define XWARMUP_REPORT          1000
+/* running cleared by xhttpd_warmup_clean() while workers read it unlocked */
+#define XWARMUP_RUNNING(x)      __sync_fetch_and_add(&((x)->running), 0)
+typedef struct _XWARMUP
+{
+    MUTEX *mutex;
+    int running;
+    int nthreads;
+    int nworkers;
+    int nbusy;
+    int ndirs;
+    int mdirs;
+    char **dirs;
+    time_t start;
+    long long nfiles;
+    long long ncached;
+    long long ncompressed;
+    long long nbytes;
+    pthread_t threads[XWARMUP_THREADS_MAX];
+}XWARMUP;
+static XWARMUP *xwarmup = NULL;
 static const char *http_encodings[] = {"deflate", "gzip", "bzip2", "compress"}; 
 static SBASE *sbase = NULL;
 static SERVICE *httpd = NULL;
@@ -55,8 +190,12 @@ static int httpd_proxy_timeout = 0;
 static void *namemap = NULL;
 static void *hostmap = NULL;
 static void *urlmap = NULL;
-static void *http_headers_map = NULL;
+static ROUTE_MAP route_map = {0};
+static char *httpd_access_rules = NULL;
+static time_t httpd_access_mtime = 0;
 static void *default_logger = NULL;
+static void *default_alog = NULL;
+static int httpd_access_log_binary = 0;
 
 /* mkdir recursive */
 int xhttpd_mkdir(char *path, int mode)
@@ -92,6 +231,231 @@ int xhttpd_mkdir(char *path, int mode)
     return -1;
 }
 
+/* initialize hot-object cache */
+int xhttpd_xcache_init(off_t limit, int file_max)
+{
+    off_t n = limit / XCACHE_SLOT_BYTES;
+
+    if(limit > 0 && (xcache = (XCACHE *)calloc(1, sizeof(XCACHE))))
+    {
+        if(n < XCACHE_SLOT_MIN) n = XCACHE_SLOT_MIN;
+        if(n > XCACHE_SLOT_MAX) n = XCACHE_SLOT_MAX;
+        xcache->slot_max = (int)n;
+        if((xcache->map = mtrie_init()) == NULL
+                || (xcache->slots = (XCSLOT *)calloc(n, sizeof(XCSLOT))) == NULL
+                || (xcache->left = (int *)calloc(n, sizeof(int))) == NULL)
+        {
+            if(xcache->map) mtrie_clean(xcache->map);
+            if(xcache->slots) free(xcache->slots);
+            free(xcache);
+            xcache = NULL;
+            return -1;
+        }
+        MUTEX_INIT(xcache->mutex);
+        xcache->limit = limit;
+        xcache->file_max = file_max;
+        return 0;
+    }
+    return -1;
+}
+
+/* encoding id of cache key, 0 for identity */
+int xhttpd_xcache_encid(int is_need_compress)
+{
+    int i = 0;
+
+    for(i = 0; i < HTTP_ENCODING_NUM; i++)
+    {
+        if(is_need_compress & (1 << i)) return (i + 1);
+    }
+    return 0;
+}
+
+/* drop slot (must hold xcache->mutex) */
+void xhttpd_xcache_drop(int x)
+{
+    XCSLOT *slot = NULL;
+
+    if(xcache && x >= 0 && x < xcache->nslots && (slot = &(xcache->slots[x]))->shared)
+    {
+        xcache->total -= slot->ndata;
+        /* responses in flight keep their own reference */
+        httpd->freeshared(httpd, slot->shared);
+        memset(slot, 0, sizeof(XCSLOT));
+        xcache->left[xcache->nleft++] = x;
+    }
+    return ;
+}
+
+/* render static headers of cached response */
+int xhttpd_xcache_head(char *buf, int mimeid, int nmime, char *encoding, char *name,
+        time_t mtime, off_t len)
+{
+    char *p = buf;
+
+    p += sprintf(p, "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\n");
+    if(mimeid >= 0)
+        p += sprintf(p, "Content-Type: %s; charset=%s\r\n", http_mime_types[mimeid].s, http_default_charset);
+    else if(nmime > 0)
+        p += sprintf(p, "Content-Type: application/octet-stream; charset=%s\r\n",  http_default_charset);
+    else
+        p += sprintf(p, "Content-Type: text/plain; charset=%s\r\n",  http_default_charset);
+    p += sprintf(p, "Last-Modified:");
+    p += GMTstrdate(mtime, p);
+    p += sprintf(p, "%s", "\r\n");//date end
+    if(encoding) p += sprintf(p, "Content-Encoding: %s\r\n", encoding);
+    if(name) p += sprintf(p, "Content-Disposition: attachment; filename=\"%s\"\r\n",name);
+    p += sprintf(p, "Content-Length: %lld\r\n", LL(len));
+    p += sprintf(p, "Server: xhttpd/%s\r\n", XHTTPD_VERSION);
+    return (p - buf);
+}
+
+/* add to hot-object cache, body from memory or read from file or opened fd */
+int xhttpd_xcache_add(char *key, int nkey, char *head, int nhead,
+        unsigned char *body, int nbody, char *file, int ffd, off_t offset, struct stat *st)
+{
+    int x = 0, n = 0, fd = -1, size = 0;
+    CHUNK_SHARED *shared = NULL;
+    XCSLOT *slot = NULL;
+    char *data = NULL;
+
+    if(xcache && key && nkey > 0 && head && nhead > 0 && nbody > 0
+            && nbody <= xcache->file_max && (body || file || ffd > 0) && st
+            && (size = (nkey + nhead + nbody)) <= xcache->limit
+            && (data = (char *)calloc(1, size)))
+    {
+        memcpy(data, key, nkey);
+        memcpy(data + nkey, head, nhead);
+        if(body) memcpy(data + nkey + nhead, body, nbody);
+        else if((fd = ((ffd > 0) ? ffd : open(file, O_RDONLY))) > 0)
+        {
+            while(n < nbody && (x = pread(fd, data + nkey + nhead + n, nbody - n, offset + n)) > 0) n += x;
+            if(fd != ffd) close(fd);
+            if(n != nbody) goto err;
+        }
+        else goto err;
+        shared = (CHUNK_SHARED *)httpd->newshared(httpd, data, size);
+        free(data);
+        if(shared == NULL) return -1;
+        MUTEX_LOCK(xcache->mutex);
+        if((x = mtrie_del(xcache->map, key, nkey) - 1) >= 0) xhttpd_xcache_drop(x);
+        /* CLOCK sweep until budget and slot fit */
+        while((xcache->total > 0 && (xcache->total + size) > xcache->limit)
+                || (xcache->nleft == 0 && xcache->nslots == xcache->slot_max))
+        {
+            if(xcache->hand >= xcache->nslots) xcache->hand = 0;
+            slot = &(xcache->slots[xcache->hand]);
+            if(slot->shared)
+            {
+                if(slot->bits) slot->bits = 0;
+                else
+                {
+                    mtrie_del(xcache->map, slot->shared->data, slot->nkey);
+                    xhttpd_xcache_drop(xcache->hand);
+                    xcache->evicts++;
+                }
+            }
+            xcache->hand++;
+        }
+        if(xcache->nleft > 0) x = xcache->left[--(xcache->nleft)];
+        else x = xcache->nslots++;
+        slot = &(xcache->slots[x]);
+        slot->shared = shared;
+        slot->ndata = size;
+        slot->nkey = nkey;
+        slot->nhead = nhead;
+        slot->bits = 1;
+        slot->mtime = st->st_mtime;
+        slot->size = st->st_size;
+        xcache->total += size;
+        mtrie_add(xcache->map, key, nkey, x + 1);
+        MUTEX_UNLOCK(xcache->mutex);
+        return 0;
+    }
+    return -1;
+err:
+    free(data);
+    return -1;
+}
+
+/* serve from hot-object cache with one chunk, body sent by reference of slot */
+int xhttpd_xcache_serve(CONN *conn, HTTP_XREQ *http_req, char *key, int nkey, struct stat *st)
+{
+    int x = 0, n = 0, nhead = 0, off = 0, keepalive = 0, ret = -1;
+    char buf[HTTP_BUF_SIZE], *p = NULL;
+    CHUNK_SHARED *shared = NULL;
+    XCSLOT *slot = NULL;
+
+    if(xcache && conn && http_req && key && nkey > 0 && st)
+    {
+        MUTEX_LOCK(xcache->mutex);
+        if((x = mtrie_get(xcache->map, key, nkey) - 1) >= 0 && x < xcache->nslots)
+        {
+            slot = &(xcache->slots[x]);
+            if(slot->mtime != st->st_mtime || slot->size != st->st_size)
+            {
+                mtrie_del(xcache->map, key, nkey);
+                xhttpd_xcache_drop(x);
+            }
+            else
+            {
+                shared = slot->shared;
+                httpd->refshared(httpd, shared);
+                nhead = slot->nhead;
+                off = slot->nkey + slot->nhead;
+                slot->bits = 1;
+                xcache->hits++;
+            }
+        }
+        if(shared == NULL) xcache->misses++;
+        MUTEX_UNLOCK(xcache->mutex);
+        if(shared == NULL) return -1;
+        /* headers of slot and of request copied, body referenced */
+        p = buf;
+        memcpy(p, shared->data + off - nhead, nhead);
+        p += nhead;
+        if((n = http_req->headers[HEAD_GEN_CONNECTION].off) > 0
+                && (int)strlen(http_req->data + n) < (HTTP_BUF_SIZE - nhead - 128))
+        {
+            p += sprintf(p, "Connection: %s\r\n", http_req->data + n);
+            if(strcasestr(http_req->data + n, "close") == NULL)
+                keepalive = 1;
+        }
+        else
+        {
+            p += sprintf(p, "Connection: close\r\n");
+        }
+        p += sprintf(p, "Date: ");p += stime_date(p);p += sprintf(p, "\r\n\r\n");
+        ret = conn->ops->push_shared_head(conn, buf, (p - buf), shared, off);
+        httpd->freeshared(httpd, shared);
+        if(ret != 0) return -1;
+        if(!keepalive) conn->ops->over(conn);
+        else conn->ops->set_timeout(conn, HTTPD_TIMEOUT);
+        return 0;
+    }
+    return -1;
+}
+
+/* clean hot-object cache */
+void xhttpd_xcache_clean()
+{
+    int i = 0;
+
+    if(xcache)
+    {
+        for(i = 0; i < xcache->nslots; i++)
+        {
+            if(xcache->slots[i].shared) httpd->freeshared(httpd, xcache->slots[i].shared);
+        }
+        free(xcache->slots);
+        free(xcache->left);
+        if(xcache->map) mtrie_clean(xcache->map);
+        MUTEX_DESTROY(xcache->mutex);
+        free(xcache);
+        xcache = NULL;
+    }
+    return ;
+}
 
 /* xhttpd packet reader */
 int xhttpd_packet_reader(CONN *conn, CB_DATA *buffer)
@@ -99,13 +463,13 @@ int xhttpd_packet_reader(CONN *conn, CB_DATA *buffer)
     /*
     char *s = NULL, buf[1024];
     int x = 0, n = 0; 
-    s = "sdklhafkllllllllllllllllllllllllllllllllllllllllllllllllllllllllllllhflkdfklasdjfkldsakfldsalkfkasdfjksdjfkdasjfklasdjfklsdjfklsjdkfljdssssssssssssssssssssssssssssssssssssssssldkfjsakldjflkajsdfkljadkfjkldajfkljd";x = strlen(s);n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n", 0);conn->push_chunk(conn, buf, n);return 0;
+    s = "sdklhafkllllllllllllllllllllllllllllllllllllllllllllllllllllllllllllhflkdfklasdjfkldsakfldsalkfkasdfjksdjfkdasjfklasdjfklsdjfklsjdkfljdssssssssssssssssssssssssssssssssssssssssldkfjsakldjflkajsdfkljadkfjkldajfkljd";x = strlen(s);n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n", 0);conn->ops->push_chunk(conn, buf, n);return 0;
     */
     return 0;
 }
 
 /* xhttpd index view */
-int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
+int xhttpd_index_view(CONN *conn, HTTP_XREQ *http_req, char *dir, char *path)
 {
     char buf[HTTP_BUF_SIZE], url[HTTP_PATH_MAX], line[HTTP_PATH_MAX],
          *p = NULL, *e = NULL, *pp = NULL;
@@ -117,7 +481,7 @@ int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
 
     if(conn && dir && path && (dirp = opendir(dir)))
     {
-        if((block = conn->newchunk(conn, HTTP_VIEW_SIZE)))
+        if((block = conn->ops->newchunk(conn, HTTP_VIEW_SIZE)))
         {
             p = pp = block->data;
             p += sprintf(p, "<html><head><title>Indexes Of %s</title>"
@@ -164,24 +528,24 @@ int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
             p += sprintf(p, "HTTP/1.1 200 OK\r\nContent-Length:%lld\r\n"
                     "Content-Type: text/html; charset=%s\r\n",
                     LL(len), http_default_charset);
-            if((n = http_req->headers[HEAD_GEN_CONNECTION]) > 0)
+            if((n = http_req->headers[HEAD_GEN_CONNECTION].off) > 0)
             {
-                p += sprintf(p, "Connection: %s\r\n", http_req->hlines + n);
-                if(strcasestr(http_req->hlines + n, "close") == NULL )
+                p += sprintf(p, "Connection: %s\r\n", http_req->data + n);
+                if(strcasestr(http_req->data + n, "close") == NULL )
                     keepalive = 1;
             }
             else 
             {
                 p += sprintf(p, "Connection: close\r\n");
             }
-            p += sprintf(p, "Date: ");p += GMTstrdate(time(NULL), p);p += sprintf(p, "\r\n");
+            p += sprintf(p, "Date: ");p += stime_date(p);p += sprintf(p, "\r\n");
             p += sprintf(p, "Server: xhttpd/%s\r\n\r\n", XHTTPD_VERSION);
-            conn->push_chunk(conn, buf, p - buf);
-            if(conn->send_chunk(conn, block, len) != 0)
-                conn->freechunk(conn, block);
+            conn->ops->push_chunk(conn, buf, p - buf);
+            if(conn->ops->send_chunk(conn, block, len) != 0)
+                conn->ops->freechunk(conn, block);
             //fprintf(stdout, "buf:%s pp:%s\n", buf, pp);
-            if(!keepalive) conn->over(conn);
-            else conn->set_timeout(conn, HTTPD_TIMEOUT);
+            if(!keepalive) conn->ops->over(conn);
+            else conn->ops->set_timeout(conn, HTTPD_TIMEOUT);
         }
         closedir(dirp);
         return 0;
@@ -189,119 +553,260 @@ int xhttpd_index_view(CONN *conn, HTTP_REQ *http_req, char *dir, char *path)
     return -1;
 }
 #ifdef HAVE_ZLIB
-int xhttpd_gzip(unsigned char **zstream, unsigned char *in, int inlen, time_t mtime)
+/* pop compress stream from pool, (re)initialized for encoding */
+XZSTREAM *xhttpd_zstream_pop(int encid)
 {
-    unsigned char *c = NULL, *out = NULL;
-    unsigned long crc = 0;
-    int outlen = 0;
-    z_stream z = {0};
+    XZSTREAM *zs = NULL;
+    int wbits = 0;
 
-    if(in && inlen > 0)
+    MUTEX_LOCK(xzmutex);
+    if(nxzleft > 0)
+    {
+        zs = xzstreams[xzleft[--nxzleft]];
+    }
+    else if((nxzfree > 0 || nxzstreams < XZSTREAM_MAX) 
+            && (zs = (XZSTREAM *)calloc(1, sizeof(XZSTREAM))))
     {
-        z.zalloc = Z_NULL;
-        z.zfree = Z_NULL;
-        z.opaque = Z_NULL;
-        if(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 
-                    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        if((zs->in = (unsigned char *)calloc(1, XZSTREAM_BLOCK)) == NULL)
         {
-            return -1;
+            free(zs);
+            zs = NULL;
         }
-        z.next_in = (unsigned char *)in;
-        z.avail_in = inlen;
-        z.total_in = 0;
-        outlen = (inlen * 1.1) + 12 + 18;
-        if((*zstream = out = (unsigned char *)calloc(1, outlen)))
+        else
         {
-            c = out;
-            c[0] = 0x1f;
-            c[1] = 0x8b;
-            c[2] = Z_DEFLATED;
-            c[3] = 0; /* options */
-            c[4] = (mtime >>  0) & 0xff;
-            c[5] = (mtime >>  8) & 0xff;
-            c[6] = (mtime >> 16) & 0xff;
-            c[7] = (mtime >> 24) & 0xff;
-            c[8] = 0x00; /* extra flags */
-            c[9] = 0x03; /* UNIX */
-            z.next_out = out + 10;
-            z.avail_out = outlen - 10 - 8;
-            z.total_out = 0;
-            if(deflate(&z, Z_FINISH) != Z_STREAM_END)
+            MUTEX_INIT(zs->mutex);
+            /* index of stream freed reused */
+            if(nxzfree > 0) zs->index = xzfree[--nxzfree];
+            else zs->index = nxzstreams++;
+            xzstreams[zs->index] = zs;
+        }
+    }
+    MUTEX_UNLOCK(xzmutex);
+    if(zs)
+    {
+        if(zs->encid != encid)
+        {
+            if(zs->encid) deflateEnd(&(zs->z));
+            zs->encid = 0;
+            memset(&(zs->z), 0, sizeof(z_stream));
+            /* gzip wrapper (header and crc trailer) by zlib itself */
+            wbits = (encid == HTTP_ENCODING_GZIP) ? (MAX_WBITS + 16) : -MAX_WBITS;
+            if(deflateInit2(&(zs->z), Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                        wbits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
             {
-                deflateEnd(&z);
-                free(*zstream);
-                *zstream = NULL;
-                return -1;
+                MUTEX_LOCK(xzmutex);
+                xzleft[nxzleft++] = zs->index;
+                MUTEX_UNLOCK(xzmutex);
+                return NULL;
             }
-            //crc
-            crc = http_crc32(in, inlen);
-            c = *zstream + 10 + z.total_out;
-            c[0] = (crc >>  0) & 0xff;
-            c[1] = (crc >>  8) & 0xff;
-            c[2] = (crc >> 16) & 0xff;
-            c[3] = (crc >> 24) & 0xff;
-            c[4] = (z.total_in >>  0) & 0xff;
-            c[5] = (z.total_in >>  8) & 0xff;
-            c[6] = (z.total_in >> 16) & 0xff;
-            c[7] = (z.total_in >> 24) & 0xff;
-            outlen = (10 + 8 + z.total_out);
-            if(deflateEnd(&z) != Z_OK)
+            zs->encid = encid;
+        }
+        else deflateReset(&(zs->z));
+        zs->fd = -1;
+        zs->conn = NULL;
+        zs->keepalive = 0;
+        zs->offset = zs->to = 0;
+        zs->z.avail_in = 0;
+    }
+    return zs;
+}
+
+/* free compress stream */
+void xhttpd_zstream_free(XZSTREAM *zs)
+{
+    if(zs)
+    {
+        if(zs->encid) deflateEnd(&(zs->z));
+        MUTEX_DESTROY(zs->mutex);
+        free(zs->in);
+        free(zs);
+    }
+    return ;
+}
+
+/* push compress stream back to pool, freed if pool has XZSTREAM_IDLE_MAX idle
+ * (never with zs->mutex held) */
+void xhttpd_zstream_push(XZSTREAM *zs)
+{
+    CONN *conn = NULL;
+
+    if(zs)
+    {
+        if(zs->fd > 0) close(zs->fd);
+        if((conn = (CONN *)zs->conn))
+        {
+            conn->xids[XHTTPD_XID_ZSTREAM] = 0;
+            conn->ops->set_watermark(conn, conn->session->sendq_high, conn->session->sendq_low,
+                    conn->session->sendq_nhigh, conn->session->sendq_nlow);
+        }
+        zs->fd = -1;
+        zs->conn = NULL;
+        MUTEX_LOCK(xzmutex);
+        if(nxzleft < XZSTREAM_IDLE_MAX)
+        {
+            xzleft[nxzleft++] = zs->index;
+            zs = NULL;
+        }
+        else
+        {
+            xzstreams[zs->index] = NULL;
+            xzfree[nxzfree++] = zs->index;
+        }
+        MUTEX_UNLOCK(xzmutex);
+        xhttpd_zstream_free(zs);
+    }
+    return ;
+}
+
+/* compress range at once with pooled stream */
+int xhttpd_zcompress(unsigned char **zstream, int encid, char *file, off_t from, off_t to)
+{
+    int fd = -1, n = 0, outlen = -1, flush = 0, ret = Z_OK;
+    unsigned char *out = NULL;
+    XZSTREAM *zs = NULL;
+    off_t offset = from;
+
+    if(zstream && file && (to - from) > 0 && (zs = xhttpd_zstream_pop(encid)))
+    {
+        if((fd = open(file, O_RDONLY)) > 0)
+        {
+            n = deflateBound(&(zs->z), (uLong)(to - from)) + 18;
+            if((*zstream = out = (unsigned char *)calloc(1, n)))
             {
-                free(*zstream);
-                *zstream = NULL;
-                return -1;
+                zs->z.next_out = out;
+                zs->z.avail_out = n;
+                do
+                {
+                    if(zs->z.avail_in == 0 && offset < to)
+                    {
+                        n = XZSTREAM_BLOCK;
+                        if((to - offset) < n) n = (int)(to - offset);
+                        if((n = pread(fd, zs->in, n, offset)) <= 0) break;
+                        offset += n;
+                        zs->z.next_in = zs->in;
+                        zs->z.avail_in = n;
+                    }
+                    flush = (offset < to) ? Z_NO_FLUSH : Z_FINISH;
+                }while((ret = deflate(&(zs->z), flush)) == Z_OK);
+                if(ret == Z_STREAM_END) outlen = zs->z.total_out;
+                else
+                {
+                    free(out);
+                    *zstream = NULL;
+                }
             }
-            return outlen;
+            close(fd);
         }
+        xhttpd_zstream_push(zs);
     }
-    return -1;
+    return outlen;
 }
 
-/* deflate */
-int xhttpd_deflate(unsigned char **zstream, unsigned char *in, int inlen)
+/* compress next batch as one http chunk, return 1 if stream over */
+int xhttpd_zstream_produce(CONN *conn, XZSTREAM *zs)
 {
-    unsigned char *out = NULL;
-    z_stream z = {0};
-    int outlen = 0;
+    int n = 0, nout = 0, len = 0, flush = 0, over = 0, keepalive = 0;
+    CB_DATA *block = NULL;
+    char *p = NULL, line[XZSTREAM_EXTRA];
 
-    if(in && inlen > 0)
+    if(conn && zs && zs->conn == conn)
     {
-        z.zalloc = Z_NULL;
-        z.zfree = Z_NULL;
-        z.opaque = Z_NULL;
-        if(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 
-                    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        MUTEX_LOCK(zs->mutex);
+        if(zs->conn != conn)
         {
+            MUTEX_UNLOCK(zs->mutex);
             return -1;
         }
-        z.next_in = (unsigned char *)in;
-        z.avail_in = inlen;
-        z.total_in = 0;
-        outlen = (inlen * 1.1) + 12 + 18;
-        if((*zstream = out = (unsigned char *)calloc(1, outlen)))
+        if((block = conn->ops->newchunk(conn, XZSTREAM_BATCH + XZSTREAM_EXTRA)) == NULL) goto err;
+        p = block->data;
+        zs->z.next_out = (unsigned char *)(p + 10);
+        zs->z.avail_out = XZSTREAM_BATCH;
+        while(zs->z.avail_out > 0)
         {
-            z.next_out = out;
-            z.avail_out = outlen;
-            z.total_out = 0;
-            if(deflate(&z, Z_FINISH) != Z_STREAM_END)
+            if(zs->z.avail_in == 0 && zs->offset < zs->to)
             {
-                deflateEnd(&z);
-                free(*zstream);
-                *zstream = NULL;
-                return -1;
+                n = XZSTREAM_BLOCK;
+                if((zs->to - zs->offset) < n) n = (int)(zs->to - zs->offset);
+                if((n = pread(zs->fd, zs->in, n, zs->offset)) <= 0) goto err;
+                zs->offset += n;
+                zs->z.next_in = zs->in;
+                zs->z.avail_in = n;
             }
-            outlen = z.total_out;
-            if(deflateEnd(&z) != Z_OK)
-            {
-                free(*zstream);
-                *zstream = NULL;
-                return -1;
-            }
-            return outlen;
+            flush = (zs->offset < zs->to) ? Z_NO_FLUSH : Z_FINISH;
+            if((n = deflate(&(zs->z), flush)) == Z_STREAM_END){over = 1;break;}
+            if(n != Z_OK && n != Z_BUF_ERROR) goto err;
+        }
+        if((nout = XZSTREAM_BATCH - zs->z.avail_out) > 0)
+        {
+            sprintf(line, "%08x\r\n", nout);
+            memcpy(p, line, 10);
+            len = 10 + nout;
+            p[len++] = '\r';
+            p[len++] = '\n';
         }
+        if(over)
+        {
+            memcpy(p + len, "0\r\n\r\n", 5);
+            len += 5;
+        }
+        keepalive = zs->keepalive;
+        if(conn->ops->send_chunk(conn, block, len) != 0)
+        {
+            MUTEX_UNLOCK(zs->mutex);
+            conn->ops->freechunk(conn, block);
+            xhttpd_zstream_push(zs);
+            return -1;
+        }
+        MUTEX_UNLOCK(zs->mutex);
+        if(over) xhttpd_zstream_push(zs);
+        if(over && !keepalive) conn->ops->over(conn);
+        else conn->ops->set_timeout(conn, HTTPD_TIMEOUT);
+        return over;
+err:
+        MUTEX_UNLOCK(zs->mutex);
+        if(block) conn->ops->freechunk(conn, block);
+        xhttpd_zstream_push(zs);
+        conn->ops->over(conn);
     }
     return -1;
 }
+
+/* produce batches till send queue reaches high watermark, return 1 if stream over */
+int xhttpd_zstream_fill(CONN *conn, XZSTREAM *zs)
+{
+    int ret = -1;
+
+    while((ret = xhttpd_zstream_produce(conn, zs)) == 0 && conn->ops->writable(conn));
+    return ret;
+}
+
+/* get compress stream of connection */
+XZSTREAM *xhttpd_zstream_get(CONN *conn)
+{
+    XZSTREAM *zs = NULL;
+    int x = 0;
+
+    if(conn && (x = conn->xids[XHTTPD_XID_ZSTREAM] - 1) >= 0 && x < nxzstreams
+            && (zs = xzstreams[x]) && zs->conn == conn)
+        return zs;
+    return NULL;
+}
+
+/* clean compress streams */
+void xhttpd_zstream_clean()
+{
+    int i = 0;
+
+    for(i = 0; i < nxzstreams; i++)
+    {
+        xhttpd_zstream_free(xzstreams[i]);
+        xzstreams[i] = NULL;
+    }
+    nxzstreams = nxzleft = nxzfree = 0;
+    MUTEX_DESTROY(xzmutex);
+    xzmutex = NULL;
+    return ;
+}
 #endif
 #ifdef HAVE_BZ2LIB
 int xhttpd_bzip2(unsigned char **zstream, unsigned char *in, int inlen)
@@ -350,12 +855,404 @@ int xhttpd_bzip2(unsigned char **zstream, unsigned char *in, int inlen)
                 *zstream = NULL;
                 return -1;
             }
+            return outlen;
         }
     }
     return -1;
 }
 #endif
 
+/* compress range of file with encoding */
+int xhttpd_compress(unsigned char **zstream, int encid, char *file, off_t from, off_t to)
+{
+    unsigned char *block = NULL;
+    int fd = -1, zlen = -1;
+
+#ifdef HAVE_ZLIB
+    if(encid == HTTP_ENCODING_DEFLATE || encid == HTTP_ENCODING_GZIP)
+        return xhttpd_zcompress(zstream, encid, file, from, to);
+#endif
+#ifdef HAVE_BZ2LIB
+    if(encid == HTTP_ENCODING_BZIP2 && to < HTTP_MMAP_MAX && (fd = open(file, O_RDONLY)) > 0)
+    {
+        if((block = (unsigned char *)mmap(NULL, to, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+        {
+            zlen = xhttpd_bzip2(zstream, block + from, (int)(to - from));
+            munmap(block, to);
+        }
+        close(fd);
+    }
+#endif
+    return zlen;
+}
+
+/* reset compressed content store to new generation (hold zcache->mutex),
+ * store unlinked once opened, old generation lives until the last fd dup()ed to chunks closed */
+int xhttpd_zcache_reset()
+{
+    if(zcache)
+    {
+        if(zcache->fd > 0) close(zcache->fd);
+        zcache->gen++;
+        snprintf(zcache->file, HTTP_PATH_MAX, "%.*s/xhttpd.%d.%d.zcache", HTTP_PATH_MAX - 64,
+                zcache->dir, (int)getpid(), zcache->gen);
+        if((zcache->fd = open(zcache->file, O_CREAT|O_TRUNC|O_RDWR, 0644)) <= 0)
+        {
+            FATAL_LOGGER(default_logger, "open zcache store %s failed, %s", 
+                    zcache->file, strerror(errno));
+            zcache->fd = -1;
+            return -1;
+        }
+        unlink(zcache->file);
+        if(zcache->index) mtrie_clean(zcache->index);
+        zcache->index = mtrie_init();
+        zcache->nentries = 0;
+        zcache->size = 0;
+        return 0;
+    }
+    return -1;
+}
+
+/* initialize compressed content cache */
+int xhttpd_zcache_init(char *dir, off_t limit)
+{
+    if(dir && (zcache = (ZCACHE *)calloc(1, sizeof(ZCACHE))))
+    {
+        MUTEX_INIT(zcache->mutex);
+        strcpy(zcache->dir, dir);
+        zcache->limit = limit;
+        return xhttpd_zcache_reset();
+    }
+    return -1;
+}
+
+/* lookup compressed content, claim pending entry if not found,
+ * fd of ready content dup()ed from store and closed by caller */
+int xhttpd_zcache_get(char *key, int nkey, int *fd, off_t *offset, int *length, 
+        int *id, int *gen)
+{
+    int x = 0, status = ZENTRY_FAILED;
+
+    if(zcache && key && nkey > 0)
+    {
+        MUTEX_LOCK(zcache->mutex);
+        if((x = mtrie_get(zcache->index, key, nkey) - 1) >= 0 && x < zcache->nentries)
+        {
+            if((status = zcache->entries[x].status) == ZENTRY_READY)
+            {
+                if(fd && (*fd = dup(zcache->fd)) <= 0) status = ZENTRY_FAILED;
+                *offset = zcache->entries[x].offset;
+                *length = zcache->entries[x].length;
+            }
+        }
+        else
+        {
+            if(zcache->nentries == ZCACHE_ENTRY_MAX) xhttpd_zcache_reset();
+            if(zcache->fd > 0 && zcache->index)
+            {
+                x = zcache->nentries++;
+                zcache->entries[x].offset = 0;
+                zcache->entries[x].length = 0;
+                zcache->entries[x].status = ZENTRY_PENDING;
+                mtrie_add(zcache->index, key, nkey, x + 1);
+                *id = x;
+                *gen = zcache->gen;
+                status = 0;
+            }
+        }
+        MUTEX_UNLOCK(zcache->mutex);
+    }
+    return status;
+}
+
+/* compressed content key of file range */
+int xhttpd_zcache_key(char *key, char *file, off_t from, off_t to, char *encoding, time_t mtime)
+{
+    return sprintf(key, "%s-%lld-%lld.%s.%lu", file, LL(from), LL(to), encoding, UL(mtime));
+}
+
+/* compress task on daemons */
+void xhttpd_zcache_task(void *arg)
+{
+    unsigned char *zstream = NULL;
+    ZCTASK *task = (ZCTASK *)arg;
+    ZENTRY *entry = NULL;
+    int zlen = -1;
+
+    if(zcache && task)
+    {
+        zlen = xhttpd_compress(&zstream, task->encid, task->file, task->from, task->to);
+        MUTEX_LOCK(zcache->mutex);
+        if(task->gen == zcache->gen && task->id < zcache->nentries)
+        {
+            entry = &(zcache->entries[task->id]);
+            entry->status = ZENTRY_FAILED;
+            if(zlen > 0 && (zcache->size + zlen) > zcache->limit) 
+            {
+                xhttpd_zcache_reset();
+            }
+            else if(zlen > 0 && pwrite(zcache->fd, zstream, zlen, zcache->size) == zlen)
+            {
+                entry->offset = zcache->size;
+                entry->length = zlen;
+                entry->status = ZENTRY_READY;
+                zcache->size += zlen;
+            }
+        }
+        MUTEX_UNLOCK(zcache->mutex);
+        if(zstream) free(zstream);
+        free(task);
+    }
+    return ;
+}
+
+/* clean compressed content cache */
+void xhttpd_zcache_clean()
+{
+    if(zcache)
+    {
+        if(zcache->fd > 0) close(zcache->fd);
+        if(zcache->index) mtrie_clean(zcache->index);
+        MUTEX_DESTROY(zcache->mutex);
+        free(zcache);
+        zcache = NULL;
+    }
+    return ;
+}
+
+#ifdef HAVE_PTHREAD
+/* push directory to warm-up walk */
+int xhttpd_warmup_push(char *dir)
+{
+    char **dirs = NULL;
+    int ret = -1, n = 0;
+
+    if(xwarmup && dir)
+    {
+        MUTEX_LOCK(xwarmup->mutex);
+        if(xwarmup->ndirs == xwarmup->mdirs)
+        {
+            n = xwarmup->mdirs + 1024;
+            if((dirs = (char **)realloc(xwarmup->dirs, sizeof(char *) * n)))
+            {
+                xwarmup->dirs = dirs;
+                xwarmup->mdirs = n;
+            }
+        }
+        if(xwarmup->ndirs < xwarmup->mdirs && (xwarmup->dirs[xwarmup->ndirs] = strdup(dir)))
+        {
+            xwarmup->ndirs++;
+            ret = 0;
+        }
+        MUTEX_UNLOCK(xwarmup->mutex);
+    }
+    return ret;
+}
+
+/* warm up hot-object cache and compressed content cache with file */
+int xhttpd_warmup_file(char *file, struct stat *st)
+{
+    char key[ZCACHE_KEY_MAX], head[HTTP_BUF_SIZE], mime[HTTP_PATH_MAX], *name = NULL, *p = NULL;
+    int mimeid = -1, nmime = 0, nkey = 0, n = 0, zid = 0, zgen = 0, zlen = 0, i = 0;
+    off_t offset = 0;
+    ZCTASK *task = NULL;
+
+    if(file && st && st->st_size > 0)
+    {
+        if((p = strrchr(file, '/'))) name = p + 1;
+        else name = file;
+        if((p = strrchr(name, '.')))
+        {
+            while(*++p != '\0')
+            {
+                if(*p >= 'A' && *p <= 'Z') mime[nmime++] = *p + ('a' - 'A');
+                else mime[nmime++] = *p;
+            }
+            mime[nmime] = '\0';
+        }
+        if(nmime > 0 && (mimeid = mtrie_get(namemap, mime, nmime) - 1) >= 0
+                && mimeid < HTTP_MIME_NUM)
+            name = NULL;
+        else mimeid = -1;
+        if(xcache && st->st_size <= xcache->file_max)
+        {
+            nkey = sprintf(key, "0:%s", file);
+            n = xhttpd_xcache_head(head, mimeid, nmime, NULL, name, st->st_mtime, st->st_size);
+            if(xhttpd_xcache_add(key, nkey, head, n, NULL, st->st_size, file, -1, 0, st) == 0)
+            {
+                MUTEX_LOCK(xwarmup->mutex);
+                xwarmup->ncached++;
+                MUTEX_UNLOCK(xwarmup->mutex);
+            }
+        }
+#ifdef HAVE_ZLIB
+        if(zcache && mimeid >= 0 && strstr(http_mime_types[mimeid].s, "text")
+                && st->st_size <= ZCACHE_FILE_MAX)
+        {
+            for(i = 0; i < 2; i++)
+            {
+                nkey = xhttpd_zcache_key(key, file, 0, st->st_size, 
+                        (char *)http_encodings[i], st->st_mtime);
+                if(xhttpd_zcache_get(key, nkey, NULL, &offset, &zlen, &zid, &zgen) == 0
+                        && (task = (ZCTASK *)calloc(1, sizeof(ZCTASK))))
+                {
+                    task->id = zid;
+                    task->gen = zgen;
+                    task->encid = (1 << i);
+                    task->from = 0;
+                    task->to = st->st_size;
+                    strcpy(task->file, file);
+                    xhttpd_zcache_task(task);
+                    MUTEX_LOCK(xwarmup->mutex);
+                    xwarmup->ncompressed++;
+                    MUTEX_UNLOCK(xwarmup->mutex);
+                }
+            }
+        }
+#endif
+        MUTEX_LOCK(xwarmup->mutex);
+        if((++(xwarmup->nfiles) % XWARMUP_REPORT) == 0)
+        {
+            REALLOG(httpd->logger, "warm-up files:%lld cached:%lld compressed:%lld bytes:%lld",
+                    xwarmup->nfiles, xwarmup->ncached, xwarmup->ncompressed, xwarmup->nbytes);
+        }
+        xwarmup->nbytes += (long long)st->st_size;
+        MUTEX_UNLOCK(xwarmup->mutex);
+        return 0;
+    }
+    return -1;
+}
+
+/* warm-up worker, walk directories until all workers idle */
+void *xhttpd_warmup_run(void *arg)
+{
+    char path[HTTP_PATH_MAX], *dir = NULL;
+    struct dirent *ent = NULL;
+    struct stat st = {0};
+    DIR *dirp = NULL;
+    int n = 0;
+
+    while(xwarmup && XWARMUP_RUNNING(xwarmup))
+    {
+        dir = NULL;
+        MUTEX_LOCK(xwarmup->mutex);
+        if(xwarmup->ndirs > 0)
+        {
+            dir = xwarmup->dirs[--(xwarmup->ndirs)];
+            xwarmup->nbusy++;
+        }
+        else if(xwarmup->nbusy == 0)
+        {
+            MUTEX_UNLOCK(xwarmup->mutex);
+            break;
+        }
+        MUTEX_UNLOCK(xwarmup->mutex);
+        if(dir == NULL)
+        {
+            usleep(1000);
+            continue;
+        }
+        if((dirp = opendir(dir)))
+        {
+            while(XWARMUP_RUNNING(xwarmup) && (ent = readdir(dirp)))
+            {
+                if(ent->d_name[0] == '.') continue;
+                n = snprintf(path, HTTP_PATH_MAX, "%s/%s", dir, ent->d_name);
+                if(n <= 0 || n >= HTTP_PATH_MAX || lstat(path, &st) != 0) continue;
+                if(S_ISDIR(st.st_mode)) xhttpd_warmup_push(path);
+                else if(stat(path, &st) == 0 && S_ISREG(st.st_mode))
+                    xhttpd_warmup_file(path, &st);
+            }
+            closedir(dirp);
+        }
+        free(dir);
+        MUTEX_LOCK(xwarmup->mutex);
+        xwarmup->nbusy--;
+        MUTEX_UNLOCK(xwarmup->mutex);
+    }
+    if(xwarmup)
+    {
+        MUTEX_LOCK(xwarmup->mutex);
+        if(--(xwarmup->nthreads) == 0 && xwarmup->running)
+        {
+            REALLOG(httpd->logger, "warm-up over files:%lld cached:%lld compressed:%lld bytes:%lld time:%lds",
+                    xwarmup->nfiles, xwarmup->ncached, xwarmup->ncompressed, xwarmup->nbytes,
+                    (long)(time(NULL) - xwarmup->start));
+        }
+        MUTEX_UNLOCK(xwarmup->mutex);
+    }
+    return NULL;
+}
+
+/* start warm-up workers, serving never wait for them */
+int xhttpd_warmup_init(int nthreads)
+{
+    int i = 0;
+
+    if(nthreads > 0 && (xwarmup = (XWARMUP *)calloc(1, sizeof(XWARMUP))))
+    {
+        if(nthreads > XWARMUP_THREADS_MAX) nthreads = XWARMUP_THREADS_MAX;
+        MUTEX_INIT(xwarmup->mutex);
+        xwarmup->running = 1;
+        xwarmup->start = time(NULL);
+        if(httpd_home) xhttpd_warmup_push(httpd_home);
+        for(i = 0; i < nvhosts; i++)
+        {
+            if(httpd_vhosts[i].home) xhttpd_warmup_push(httpd_vhosts[i].home);
+        }
+        for(i = 0; i < route_map.num; i++)
+        {
+            if((route_map.routes[i].type & (ROUTE_ROOT|ROUTE_ALIAS)) && route_map.routes[i].arg)
+                xhttpd_warmup_push(route_map.routes[i].arg);
+        }
+        MUTEX_LOCK(xwarmup->mutex);
+        for(i = 0; i < nthreads; i++)
+        {
+            if(pthread_create(&(xwarmup->threads[i]), NULL, &xhttpd_warmup_run, NULL) != 0)
+            {
+                FATAL_LOGGER(default_logger, "create warm-up thread[%d] failed, %s", 
+                        i, strerror(errno));
+                break;
+            }
+            xwarmup->nthreads++;
+            xwarmup->nworkers++;
+        }
+        MUTEX_UNLOCK(xwarmup->mutex);
+        return 0;
+    }
+    return -1;
+}
+
+/* stop and clean warm-up workers */
+void xhttpd_warmup_clean()
+{
+    int i = 0, n = 0;
+
+    if(xwarmup)
+    {
+        MUTEX_LOCK(xwarmup->mutex);
+        n = xwarmup->nthreads;
+        __sync_lock_release(&(xwarmup->running));
+        MUTEX_UNLOCK(xwarmup->mutex);
+        for(i = 0; i < xwarmup->nworkers; i++)
+        {
+            pthread_join(xwarmup->threads[i], NULL);
+        }
+        if(n > 0) 
+        {
+            REALLOG(httpd->logger, "warm-up stopped files:%lld cached:%lld compressed:%lld",
+                    xwarmup->nfiles, xwarmup->ncached, xwarmup->ncompressed);
+        }
+        for(i = 0; i < xwarmup->ndirs; i++) free(xwarmup->dirs[i]);
+        if(xwarmup->dirs) free(xwarmup->dirs);
+        MUTEX_DESTROY(xwarmup->mutex);
+        free(xwarmup);
+        xwarmup = NULL;
+    }
+    return ;
+}
+#endif
+
 int xhttpd_resp_handler(CONN *conn, CB_DATA *packet)
 {
     char *p = NULL,  buf[4096], *s = "sdklhafkllllllllllllllllllllllllllllllllllllllllllllllllllllllllllllhflkdfklasdjfkldsakfldsalkfkasdfjksdjfkdasjfklasdjfklsdjfklsjdkfljdssssssssssssssssssssssssssssssssssssssssldkfjsakldjflkajsdfkljadkfjkldajfkljd";
@@ -368,134 +1265,90 @@ int xhttpd_resp_handler(CONN *conn, CB_DATA *packet)
         x = strlen(s);
         if(keepalive)
         {
-            n = sprintf(buf, "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->push_chunk(conn, buf, n); 
+            n = sprintf(buf, "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->ops->push_chunk(conn, buf, n); 
         }
         else
         {
-            n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->push_chunk(conn, buf, n); 
+            n = sprintf(buf, "HTTP/1.0 200 OK\r\nContent-Length:%d\r\n\r\n%s", x, s);conn->ops->push_chunk(conn, buf, n); 
 
         }
-        if(keepalive == 0) conn->over(conn); 
+        if(keepalive == 0) conn->ops->over(conn); 
     }
     return 0;
 }
 /* httpd file compress */
-int xhttpd_compress_handler(CONN *conn, HTTP_REQ *http_req, char *host, int is_need_compress, int mimeid,
+int xhttpd_compress_handler(CONN *conn, HTTP_XREQ *http_req, char *host, int is_need_compress, int mimeid,
         char *file, char *root, off_t from, off_t to, struct stat *st)
 {
-    char zfile[HTTP_PATH_MAX], zoldfile[HTTP_PATH_MAX], linkfile[HTTP_PATH_MAX], 
-         buf[HTTP_BUF_SIZE], *encoding = NULL, *outfile = NULL, *p = NULL;
-    int fd = 0, inlen = 0, zlen = 0, i = 0, id = 0, keepalive = 0, n = 0;
-    unsigned char *block = NULL, *in = NULL, *zstream = NULL;
-    off_t offset = 0, len = 0;
-    struct stat zst = {0};
+    char buf[HTTP_BUF_SIZE], *encoding = NULL, *p = NULL;
+    int zlen = 0, i = 0, id = 0, keepalive = 0, n = 0, nkey = 0, is_full = 0, zid = 0, zgen = 0, zfd = -1;
+    char key[ZCACHE_KEY_MAX], head[HTTP_BUF_SIZE];
+    unsigned char *zstream = NULL;
+    off_t outoff = 0, len = 0;
+    ZCTASK *task = NULL;
+#ifdef HAVE_ZLIB
+    XZSTREAM *zs = NULL;
+#endif
 
     if(is_need_compress)
     {
-        if(httpd_compress)
+        is_full = (from == 0 && to == st->st_size);
+        for(i = 0; i < HTTP_ENCODING_NUM; i++)
         {
-            for(i = 0; i < HTTP_ENCODING_NUM; i++)
+            if(is_need_compress & ((id = (1 << i))))
             {
-                if(is_need_compress & ((id = (1 << i))))
-                {
-                    encoding = (char *)http_encodings[i];
-                    if(from == 0 && to == st->st_size)
-                    {
-                        sprintf(linkfile, "%s/%s%s.%s",  httpd_compress_cachedir,
-                                host, root, encoding);
-                    }
-                    else
-                    {
-                        sprintf(linkfile, "%s/%s%s-%lld-%lld.%s", httpd_compress_cachedir, 
-                                host, root, LL(from), LL(to), encoding);
-                    }
-                    sprintf(zfile, "%s.%lu", linkfile, UL(st->st_mtime));
-                    if(access(zfile, F_OK) == 0)
-                    {
-                        stat(zfile, &zst);
-                        outfile = zfile;
-                        from = 0;
-                        len = zst.st_size;
-                        goto OVER;
-                    }
-                    else
-                    {
-                        if(access(linkfile, F_OK))
-                        {
-                            xhttpd_mkdir(linkfile, 0755);
-                        }
-                        else 
-                        {
-                            if(readlink(linkfile, zoldfile, (HTTP_PATH_MAX - 1)))
-                                unlink(zoldfile);
-                            unlink(linkfile);
-                        }
-                        goto COMPRESS;
-                    }
-                    break;
-                }
+                encoding = (char *)http_encodings[i];
+                break;
             }
         }
-COMPRESS:
-        offset = (from/(off_t)HTTP_MMAP_MAX) * HTTP_MMAP_MAX;
-        len = to - offset;
-        if(len < HTTP_MMAP_MAX && (fd = open(file, O_RDONLY)) > 0)
+#ifndef HAVE_ZLIB
+        if(id == HTTP_ENCODING_DEFLATE || id == HTTP_ENCODING_GZIP) goto err;
+#endif
+#ifndef HAVE_BZ2LIB
+        if(id == HTTP_ENCODING_BZIP2) goto err;
+#endif
+        if(encoding == NULL || id == HTTP_ENCODING_COMPRESS) goto err;
+        /* compressed content cache, compressing on daemons */
+        if(zcache && (to - from) <= ZCACHE_FILE_MAX)
         {
-            if((block = (unsigned char *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)))
+            nkey = xhttpd_zcache_key(key, file, from, to, encoding, st->st_mtime);
+            n = xhttpd_zcache_get(key, nkey, &zfd, &outoff, &zlen, &zid, &zgen);
+            if(n == 0 && (task = (ZCTASK *)calloc(1, sizeof(ZCTASK))))
             {
-                in = block + (from%(off_t)HTTP_MMAP_MAX);
-                inlen = to - from;
-
-#ifdef HAVE_ZLIB
-                if(is_need_compress & HTTP_ENCODING_DEFLATE)
-                {
-                    if((zlen = xhttpd_deflate(&zstream, in, inlen)) <= 0)
-                        goto err;
-                    encoding = "deflate";
-                    //compressed |= HTTP_ENCODING_DEFLATE;
-                }
-                else if(is_need_compress & HTTP_ENCODING_GZIP)
-                {
-                    if((zlen = xhttpd_gzip(&zstream, in, inlen, 
-                                    st->st_mtime)) <= 0) goto err;
-                    encoding = "gzip";
-                    //compressed |= HTTP_ENCODING_GZIP;
-
-                }
-                /*
-                   else if(is_need_compress & HTTP_ENCODING_COMPRESS)
-                   {
-                   compressed |= HTTP_ENCODING_COMPRESS;
-                   }
-                   */
-#endif		
-#ifdef HAVE_BZ2LIB
-                if(encoding == NULL && is_need_compress & HTTP_ENCODING_BZIP2)
-                {
-                    if((zlen = xhttpd_bzip2(&zstream, in, inlen)) <= 0) goto err;
-                    encoding = "bzip2";
-                    //compressed |= HTTP_ENCODING_BZIP2;
-                }
-#endif
-                munmap(block, len);
-                block = NULL;
+                task->id = zid;
+                task->gen = zgen;
+                task->encid = id;
+                task->from = from;
+                task->to = to;
+                strcpy(task->file, file);
+                if(((SERVICE *)conn->service)->newtask((SERVICE *)conn->service, 
+                            &xhttpd_zcache_task, task) == 0)
+                    goto err;
+                /* no daemons, compress inline */
+                xhttpd_zcache_task(task);
+                n = xhttpd_zcache_get(key, nkey, &zfd, &outoff, &zlen, &zid, &zgen);
             }
-            close(fd);
-            if(encoding == NULL) goto err;
-            //write to cache file
-            if(httpd_compress && zstream && zlen > 0)
+            if(n != ZENTRY_READY) goto err;
+            len = zlen;
+            zlen = 0;
+            goto OVER;
+        }
+#ifdef HAVE_ZLIB
+        /* stream large range chunk by chunk */
+        if((id == HTTP_ENCODING_DEFLATE || id == HTTP_ENCODING_GZIP) && (to - from) > XZSTREAM_BLOCK)
+        {
+            if((zs = xhttpd_zstream_pop(id)) == NULL) goto err;
+            if((zs->fd = open(file, O_RDONLY)) <= 0)
             {
-                if((fd = open(zfile, O_CREAT|O_WRONLY, 0644)) > 0)
-                {
-                    if(symlink(zfile, linkfile) != 0 || write(fd, zstream, zlen) <= 0 )
-                    {
-                        FATAL_LOGGER(default_logger, "symlink/write to %s failed, %s", 
-                                linkfile, strerror(errno));
-                    }
-                    close(fd); 
-                }
+                xhttpd_zstream_push(zs);
+                goto err;
             }
+            zs->offset = from;
+            zs->to = to;
+            goto OVER;
         }
+#endif
+        if((zlen = xhttpd_compress(&zstream, id, file, from, to)) <= 0) goto err;
 OVER:
         p = buf;
         if(from > 0)
@@ -512,10 +1365,10 @@ OVER:
         {
             p += sprintf(p, "Content-Type: application/octet-stream; charset=%s\r\n",  http_default_charset);
         }
-        if((n = http_req->headers[HEAD_GEN_CONNECTION]) > 0)
+        if((n = http_req->headers[HEAD_GEN_CONNECTION].off) > 0)
         {
-            p += sprintf(p, "Connection: %s\r\n", http_req->hlines + n);
-            if(strcasestr(http_req->hlines + n, "close") == NULL)
+            p += sprintf(p, "Connection: %s\r\n", http_req->data + n);
+            if(strcasestr(http_req->data + n, "close") == NULL)
                 keepalive = 1;
         }
         else
@@ -527,21 +1380,42 @@ OVER:
         p += sprintf(p, "%s", "\r\n");//date end
         if(zstream && zlen > 0) len = zlen;
         if(encoding) p += sprintf(p, "Content-Encoding: %s\r\n", encoding);
+#ifdef HAVE_ZLIB
+        if(zs)
+        {
+            p += sprintf(p, "Transfer-Encoding: chunked\r\n");
+            p += sprintf(p, "Date: ");p += stime_date(p);p += sprintf(p, "\r\n");
+            p += sprintf(p, "Server: xhttpd/%s\r\n\r\n", XHTTPD_VERSION);
+            conn->ops->push_chunk(conn, buf, (p - buf));
+            zs->keepalive = keepalive;
+            zs->conn = conn;
+            conn->xids[XHTTPD_XID_ZSTREAM] = zs->index + 1;
+            conn->ops->set_watermark(conn, XZSTREAM_SENDQ_HIGH, XZSTREAM_SENDQ_LOW, 0, 0);
+            xhttpd_zstream_fill(conn, zs);
+            return 0;
+        }
+#endif
         p += sprintf(p, "Content-Length: %lld\r\n", LL(len));
-        p += sprintf(p, "Date: ");p += GMTstrdate(time(NULL), p);p += sprintf(p, "\r\n");
+        p += sprintf(p, "Date: ");p += stime_date(p);p += sprintf(p, "\r\n");
         p += sprintf(p, "Server: xhttpd/%s\r\n\r\n", XHTTPD_VERSION);
-        conn->push_chunk(conn, buf, (p - buf));
+        if(xcache && is_full && len <= xcache->file_max)
+        {
+            nkey = sprintf(key, "%d:%s", xhttpd_xcache_encid(is_need_compress), file);
+            n = xhttpd_xcache_head(head, mimeid, 1, encoding, NULL, st->st_mtime, len);
+            xhttpd_xcache_add(key, nkey, head, n, zstream, len, NULL, zfd, outoff, st);
+        }
+        conn->ops->push_chunk(conn, buf, (p - buf));
         if(zstream && zlen > 0)
         {
-            conn->push_chunk(conn, zstream, zlen);
+            conn->ops->push_chunk(conn, zstream, zlen);
         }
         else
         {
-            conn->push_file(conn, outfile, from, len);
+            if(conn->ops->push_fd(conn, zfd, outoff, len) != 0) close(zfd);
         }
         if(zstream) free(zstream);
-        if(!keepalive)conn->over(conn);
-        else conn->set_timeout(conn, HTTPD_TIMEOUT);
+        if(!keepalive)conn->ops->over(conn);
+        else conn->ops->set_timeout(conn, HTTPD_TIMEOUT);
         return 0;
     }
 err:
@@ -553,7 +1427,7 @@ int xhttpd_bind_proxy(CONN *conn, char *host, int port)
 {
     CONN *new_conn = NULL;
     SESSION session = {0};
-    char *ip = NULL;
+    char *ip = host;
     SERVICE *service = NULL;
 
     if(conn && host && port > 0 && (service = (SERVICE *)conn->service))
@@ -565,7 +1439,9 @@ int xhttpd_bind_proxy(CONN *conn, char *host, int port)
             session.timeout = httpd_proxy_timeout;
             if((new_conn = service->newproxy(service, conn, -1, -1, ip, port, &session)))
             {
-                new_conn->start_cstate(new_conn);
+                /* tunnel the rest of connection(request body and pipelined) as is */
+                conn->xsession.packet_type = PACKET_PROXY;
+                new_conn->ops->start_cstate(new_conn);
                 return 0;
             }
         }
@@ -573,6 +1449,18 @@ int xhttpd_bind_proxy(CONN *conn, char *host, int port)
     return -1;
 }
 
+/* route of raw request path, before request parsed in place */
+ROUTE *xhttpd_route(char *p, char *end)
+{
+    char *s = NULL;
+
+    while(p < end && *p != 0x20) ++p;
+    while(p < end && *p == 0x20) ++p;
+    s = p;
+    while(p < end && *p != 0x20 && *p != '?' && *p != '\r' && *p != '\n') ++p;
+    return route_find(&route_map, s, p - s);
+}
+
 int xhttpd_xpacket_handler(CONN *conn, CB_DATA *packet)
 {
     if(conn && packet)
@@ -586,35 +1474,79 @@ int xhttpd_timeout_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DATA
 {
     if(conn)
     {
-        conn->over(conn);
+#ifdef HAVE_ZLIB
+        xhttpd_zstream_push(xhttpd_zstream_get(conn));
+#endif
+        conn->ops->over(conn);
     }
     return 0;
 }
-#define HTTPD_ACCESS_LOG(logger, conn, respid, host, http_req, agent, referer) REALLOG(logger, "%s host[%s] %s[%s] remote[%s:%d] agent[%s] referer[%s]", response_status[respid].e, host, http_methods[http_req.reqid].e, http_req.path, conn->remote_ip, conn->remote_port, agent, referer)
+
+/* error handler */
+int xhttpd_error_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DATA *chunk)
+{
+    if(conn)
+    {
+#ifdef HAVE_ZLIB
+        xhttpd_zstream_push(xhttpd_zstream_get(conn));
+#endif
+        return 0;
+    }
+    return -1;
+}
+
+/* writable handler, send queue fell to low watermark */
+int xhttpd_writable_handler(CONN *conn)
+{
+#ifdef HAVE_ZLIB
+    XZSTREAM *zs = NULL;
+
+    if(conn && (zs = xhttpd_zstream_get(conn)))
+    {
+        return xhttpd_zstream_fill(conn, zs);
+    }
+#endif
+    return -1;
+}
+#define HTTPD_ACCESS_LOG(logger, alog, conn, respid, host, http_req, agent, referer)                \
+do                                                                                              \
+{                                                                                               \
+    if(alog) alog_access((ALOG *)alog, respid, http_req.reqid, host, (http_req.data + http_req.path.off), \
+            inet_addr(conn->remote_ip), conn->remote_port, agent, referer);                     \
+    else REALLOG(logger, "%s host[%s] %s[%s] remote[%s:%d] agent[%s] referer[%s]", response_status[respid].e, host, http_methods[http_req.reqid].e, (http_req.data + http_req.path.off), conn->remote_ip, conn->remote_port, agent, referer);\
+}while(0)
 
 /* packet handler */
 int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
 {
-    int i = 0, n = 0, found = 0, nmime = 0, mimeid = -1, is_need_compress = 0, keepalive = 0;
-    char buf[HTTP_BUF_SIZE], file[HTTP_PATH_MAX], line[HTTP_PATH_MAX], *host = "",
+    int i = 0, n = 0, found = 0, nmime = 0, mimeid = -1, is_need_compress = 0, keepalive = 0, nkey = 0;
+    char buf[HTTP_BUF_SIZE], file[HTTP_PATH_MAX], line[HTTP_PATH_MAX], key[XCACHE_KEY_MAX], *host = "",
          *mime = NULL, *home = NULL, *pp = NULL, *p = NULL, *end = NULL, *root = NULL, 
-         *s = NULL, *outfile = NULL, *name = NULL, *encoding = NULL, *agent = "", *referer = "";
+         *s = NULL, *outfile = NULL, *name = NULL, *encoding = NULL, *agent = "", *referer = "", *path = NULL;
     off_t from = 0, to = 0, len = 0;
-    HTTP_REQ http_req = {0} ;
+    HTTP_XREQ http_req = {0};
     struct stat st = {0};
     DIR *newdir = NULL;
-    void *logger = default_logger;
+    void *logger = default_logger, *alog = default_alog;
+    ROUTE *route = NULL;
 
     if(conn && packet)
     {
         p = packet->data;end = packet->data + packet->ndata;
         //fprintf(stdout, "header:%s\r\n", p);
         //return xhttpd_index_view(conn, &http_req, httpd_home, "/");
-        if(http_request_parse(p, end, &http_req, http_headers_map) == -1) goto err;
+        if(route_map.num > 0 && (route = xhttpd_route(p, end)) && route->type == ROUTE_PROXY)
+        {
+            if(xhttpd_bind_proxy(conn, route->arg, route->port) == 0)
+                return conn->ops->push_exchange(conn, packet->data, packet->ndata);
+            conn->ops->push_chunk(conn, HTTP_BAD_GATEWAY, strlen(HTTP_BAD_GATEWAY));
+            return conn->ops->over(conn);
+        }
+        if(http_xrequest_parse(p, end, &http_req, HTTP_XREQ_TERMINATE) == -1) goto err;
         //get vhost
-        if((n = http_req.headers[HEAD_REQ_HOST]) > 0)
+        if((n = http_req.headers[HEAD_REQ_HOST].off) > 0)
         {
-            p = http_req.hlines + n;
+            p = http_req.data + n;
             if(strncasecmp(p, "www.", 4) == 0) p += 4;
             host = p;
             while(*p != ':' && *p != '\0')
@@ -627,28 +1559,47 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
             if((i = mtrie_get(namemap, host, n) - 1) >= 0) 
             {
                 logger = httpd_vhosts[i].logger;
+                alog = httpd_vhosts[i].alog;
                 home = httpd_vhosts[i].home;
             }
         }
-        if((n = http_req.headers[HEAD_REQ_USER_AGENT]) > 0)
+        if((n = http_req.headers[HEAD_REQ_USER_AGENT].off) > 0)
         {
-            agent = http_req.hlines + n;
+            agent = http_req.data + n;
         }
-        if((n = http_req.headers[HEAD_REQ_REFERER]) > 0)
+        if((n = http_req.headers[HEAD_REQ_REFERER].off) > 0)
         {
-            referer = http_req.hlines + n;
+            referer = http_req.data + n;
+        }
+        if(route && route->type == ROUTE_STATUS)
+        {
+            p = buf;
+            p += sprintf(p, "HTTP/1.1 %s %s\r\n", response_status[route->data].e, 
+                    response_status[route->data].s);
+            if(route->arg) p += sprintf(p, "Location: %s\r\n", route->arg);
+            p += sprintf(p, "Content-Length: 0\r\n\r\n");
+            HTTPD_ACCESS_LOG(logger, alog, conn, route->data, host, http_req, agent, referer);
+            return conn->ops->push_chunk(conn, buf, p - buf);
         }
         if(http_req.reqid == HTTP_GET)
         {
+            path = http_req.data + http_req.path.off;
+            if(route && route->type == ROUTE_ALIAS)
+            {
+                /* prefix matched on raw path may differ from decoded */
+                if(strncmp(path, route->prefix, route->nprefix) == 0) path += route->nprefix;
+                else route = NULL;
+            }
+            if(route && (route->type & (ROUTE_ROOT|ROUTE_ALIAS))) home = route->arg;
             if(home == NULL) home = httpd_home;
             if(home == NULL) goto err;
             p = file;
             p += sprintf(p, "%s", home);
             root = p;
-            if(http_req.path[0] != '/')
-                p += sprintf(p, "/%s", http_req.path);
+            if(path[0] != '/')
+                p += sprintf(p, "/%s", path);
             else
-                p += sprintf(p, "%s", http_req.path);
+                p += sprintf(p, "%s", path);
             if((n = (p - file)) > 0 && stat(file, &st) == 0)
             {
                 newdir = NULL;
@@ -678,10 +1629,17 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                     if(found == 0 && http_indexes_view && (*p = '\0') >= 0)
                     {
                         end = --p;
-
+                        /* links of aliased dir under location prefix */
+                        if(route && route->type == ROUTE_ALIAS)
+                        {
+                            n = route->nprefix;
+                            if(route->prefix[n-1] == '/') --n;
+                            sprintf(line, "%.*s%s", n, route->prefix, root);
+                            root = line;
+                        }
                         if(xhttpd_index_view(conn, &http_req, file, root) == 0) 
                         {
-                            HTTPD_ACCESS_LOG(logger, conn, RESP_OK, host, http_req, agent, referer);
+                            HTTPD_ACCESS_LOG(logger, alog, conn, RESP_OK, host, http_req, agent, referer);
                             return 0; 
                         }
                         else 
@@ -705,24 +1663,24 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                 //no content
                 if(st.st_size == 0)
                 {
-                    HTTPD_ACCESS_LOG(logger, conn, RESP_NOCONTENT, host, http_req, agent, referer);
-                    return conn->push_chunk(conn, HTTP_NO_CONTENT, 
+                    HTTPD_ACCESS_LOG(logger, alog, conn, RESP_NOCONTENT, host, http_req, agent, referer);
+                    return conn->ops->push_chunk(conn, HTTP_NO_CONTENT, 
                             strlen(HTTP_NO_CONTENT));
                 }
                 //if not change
-                else if((n = http_req.headers[HEAD_REQ_IF_MODIFIED_SINCE]) > 0
-                        && str2time(http_req.hlines + n) == st.st_mtime)
+                else if((n = http_req.headers[HEAD_REQ_IF_MODIFIED_SINCE].off) > 0
+                        && str2time(http_req.data + n) == st.st_mtime)
                 {
-                    HTTPD_ACCESS_LOG(logger, conn, RESP_NOTMODIFIED, host, http_req, agent, referer);
-                    return conn->push_chunk(conn, HTTP_NOT_MODIFIED, 
+                    HTTPD_ACCESS_LOG(logger, alog, conn, RESP_NOTMODIFIED, host, http_req, agent, referer);
+                    return conn->ops->push_chunk(conn, HTTP_NOT_MODIFIED, 
                             strlen(HTTP_NOT_MODIFIED));
                 }
                 else
                 {
                     //range 
-                    if((n = http_req.headers[HEAD_REQ_RANGE]) > 0)
+                    if((n = http_req.headers[HEAD_REQ_RANGE].off) > 0)
                     {
-                        p = http_req.hlines + n;
+                        p = http_req.data + n;
                         while(*p == 0x20 || *p == '\t')++p;
                         if(strncasecmp(p, "bytes=", 6) == 0) p += 6;
                         while(*p == 0x20)++p;
@@ -747,10 +1705,10 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                     if(mime && nmime > 0)
                     {
                         if((mimeid = mtrie_get(namemap, mime, nmime) - 1) >= 0
-                                && (n = http_req.headers[HEAD_REQ_ACCEPT_ENCODING]) > 0 
+                                && (n = http_req.headers[HEAD_REQ_ACCEPT_ENCODING].off) > 0 
                                 && strstr(http_mime_types[mimeid].s, "text"))
                         {
-                            p = http_req.hlines + n;
+                            p = http_req.data + n;
 #ifdef HAVE_ZLIB
                             if(strstr(p, "deflate")) 
                                 is_need_compress |= HTTP_ENCODING_DEFLATE;
@@ -773,27 +1731,48 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                             }
                         }
                     }
+                    //hot-object cache
+                    if(xcache && from == 0 && to == st.st_size)
+                    {
+                        nkey = sprintf(key, "%d:%s", xhttpd_xcache_encid(is_need_compress), file);
+                        if(xhttpd_xcache_serve(conn, &http_req, key, nkey, &st) == 0)
+                        {
+                            HTTPD_ACCESS_LOG(logger, alog, conn, RESP_OK, host, http_req, agent, referer);
+                            return 0;
+                        }
+                    }
                     if(is_need_compress > 0  && xhttpd_compress_handler(conn, 
                                 &http_req, host, is_need_compress, mimeid, file, 
                                 root, from, to, &st) == 0)
                     {
-                        HTTPD_ACCESS_LOG(logger, conn, RESP_OK, host, http_req, agent, referer);
+                        HTTPD_ACCESS_LOG(logger, alog, conn, RESP_OK, host, http_req, agent, referer);
                         return 0;
                     }
                     else 
                         outfile = file;
+                    if(xcache && from == 0 && to == st.st_size && len <= xcache->file_max)
+                    {
+                        nkey = sprintf(key, "0:%s", file);
+                        n = xhttpd_xcache_head(buf, mimeid, nmime, encoding, name, st.st_mtime, len);
+                        if(xhttpd_xcache_add(key, nkey, buf, n, NULL, len, file, -1, 0, &st) == 0
+                                && xhttpd_xcache_serve(conn, &http_req, key, nkey, &st) == 0)
+                        {
+                            HTTPD_ACCESS_LOG(logger, alog, conn, RESP_OK, host, http_req, agent, referer);
+                            return 0;
+                        }
+                    }
 
                     p = buf;
                     if(from > 0)
                     {
-                        HTTPD_ACCESS_LOG(logger, conn, RESP_PARTIALCONTENT, host, http_req, agent, referer);
+                        HTTPD_ACCESS_LOG(logger, alog, conn, RESP_PARTIALCONTENT, host, http_req, agent, referer);
                         p += sprintf(p, "HTTP/1.1 206 Partial Content\r\nAccept-Ranges: bytes\r\n"
                                 "Content-Range: bytes %lld-%lld/%lld\r\n", 
                                 LL(from), LL(to - 1), LL(st.st_size));
                     }
                     else
                     {
-                        HTTPD_ACCESS_LOG(logger, conn, RESP_OK, host, http_req, agent, referer);
+                        HTTPD_ACCESS_LOG(logger, alog, conn, RESP_OK, host, http_req, agent, referer);
                         p += sprintf(p, "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\n");
                     }
                     if(mimeid >= 0)
@@ -808,10 +1787,10 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                     {
                         p += sprintf(p, "Content-Type: text/plain; charset=%s\r\n",  http_default_charset);
                     }
-                    if((n = http_req.headers[HEAD_GEN_CONNECTION]) > 0)
+                    if((n = http_req.headers[HEAD_GEN_CONNECTION].off) > 0)
                     {
-                        p += sprintf(p, "Connection: %s\r\n", http_req.hlines + n);
-                        if(strcasestr(http_req.hlines + n, "close") == NULL)
+                        p += sprintf(p, "Connection: %s\r\n", http_req.data + n);
+                        if(strcasestr(http_req.data + n, "close") == NULL)
                             keepalive = 1;
                     }
                     else
@@ -824,29 +1803,29 @@ int xhttpd_packet_handler(CONN *conn, CB_DATA *packet)
                     if(encoding) p += sprintf(p, "Content-Encoding: %s\r\n", encoding);
                     if(name) 
                         p += sprintf(p, "Content-Disposition: attachment; filename=\"%s\"\r\n",name);
-                    p += sprintf(p, "Date: ");p += GMTstrdate(time(NULL),p);p += sprintf(p,"\r\n");
+                    p += sprintf(p, "Date: ");p += stime_date(p);p += sprintf(p,"\r\n");
                     p += sprintf(p, "Content-Length: %lld\r\n", LL(len));
                     p += sprintf(p, "Server: xhttpd/%s\r\n\r\n", XHTTPD_VERSION);
-                    conn->push_chunk(conn, buf, p - buf);
-                    conn->push_file(conn, outfile, from, len);
-                    if(!keepalive) conn->over(conn);
-                    else conn->set_timeout(conn, HTTPD_TIMEOUT);
+                    conn->ops->push_chunk(conn, buf, p - buf);
+                    conn->ops->push_file(conn, outfile, from, len);
+                    if(!keepalive) conn->ops->over(conn);
+                    else conn->ops->set_timeout(conn, HTTPD_TIMEOUT);
                     return 0;
                 }
             }
         }
         else if(http_req.reqid == HTTP_POST)
         {
-            if((n = http_req.headers[HEAD_ENT_CONTENT_LENGTH]) > 0 
-                    && (p = (http_req.hlines + n)) && (n = atoi(p)) > 0)
+            if((n = http_req.headers[HEAD_ENT_CONTENT_LENGTH].off) > 0 
+                    && (p = (http_req.data + n)) && (n = atoi(p)) > 0)
             {
-                conn->save_cache(conn, &http_req, sizeof(HTTP_REQ));
-                return conn->recv_chunk(conn, n);
+                conn->ops->save_cache(conn, &http_req, sizeof(HTTP_XREQ));
+                return conn->ops->recv_chunk(conn, n);
             }
-            return conn->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
+            return conn->ops->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
         }
 err:
-        return conn->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
+        return conn->ops->push_chunk(conn, HTTP_NOT_FOUND, strlen(HTTP_NOT_FOUND));
     }
     return -1;
 }
@@ -856,7 +1835,7 @@ int xhttpd_data_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DATA *ch
 {
     if(conn)
     {
-        return conn->push_chunk(conn, HTTP_NO_CONTENT, strlen(HTTP_NO_CONTENT));
+        return conn->ops->push_chunk(conn, HTTP_NO_CONTENT, strlen(HTTP_NO_CONTENT));
     }
     return -1;
 }
@@ -864,14 +1843,60 @@ int xhttpd_data_handler(CONN *conn, CB_DATA *packet, CB_DATA *cache, CB_DATA *ch
 /* OOB handler */
 int xhttpd_oob_handler(CONN *conn, CB_DATA *oob)
 {
-    if(conn && conn->push_chunk)
+    if(conn && conn->ops->push_chunk)
     {
-        conn->push_chunk((CONN *)conn, ((CB_DATA *)oob)->data, oob->ndata);
+        conn->ops->push_chunk((CONN *)conn, ((CB_DATA *)oob)->data, oob->ndata);
         return oob->ndata;
     }
     return -1;
 }
 
+/* (re)load access rules file if changed */
+int xhttpd_access_rules()
+{
+    struct stat st = {0};
+    char *rules = NULL;
+    int fd = -1, ret = -1;
+
+    if(httpd_access_rules == NULL) return ret;
+    /* missing file failed once, then current rules kept until it comes back */
+    if(stat(httpd_access_rules, &st) != 0)
+    {
+        if(httpd_access_mtime == (time_t)-1) return 0;
+        httpd_access_mtime = (time_t)-1;
+        return ret;
+    }
+    else
+    {
+        if(st.st_mtime == httpd_access_mtime) return 0;
+        httpd_access_mtime = st.st_mtime;
+        if((fd = open(httpd_access_rules, O_RDONLY)) > 0)
+        {
+            if((rules = (char *)calloc(1, st.st_size + 1))
+                    && read(fd, rules, st.st_size) == st.st_size
+                    && httpd->set_acl(httpd, rules, st.st_size) == 0
+                    && (httpsd == NULL || httpsd->set_acl(httpsd, rules, st.st_size) == 0))
+            {
+                ret = 0;
+            }
+            if(rules) free(rules);
+            close(fd);
+        }
+    }
+    return ret;
+}
+
+/* heartbeat */
+void xhttpd_heartbeat_handler(void *arg)
+{
+    /* failed once per change of file, running rules kept until file fixed */
+    if(xhttpd_access_rules() != 0)
+    {
+        WARN_LOGGER(httpd->logger, "reload access rules %s failed, current rules kept", httpd_access_rules);
+    }
+    return ;
+}
+
 /* signal */
 static void xhttpd_stop(int sig)
 {
@@ -901,6 +1926,8 @@ static void xhttpd_sigpipe(int sig)
 int sbase_initialize(SBASE *sbase, char *conf)
 {
     char *s = NULL, *p = NULL, *cacert_file = NULL, *privkey_file = NULL, path[HTTP_PATH_MAX];
+    struct hostent *hp = NULL;
+    ROUTE *route = NULL;
     int n = 0, i = 0;
 
     if((dict = iniparser_new(conf)) == NULL)
@@ -912,6 +1939,13 @@ int sbase_initialize(SBASE *sbase, char *conf)
     sbase->nchilds = iniparser_getint(dict, "SBASE:nchilds", 0);
     sbase->connections_limit = iniparser_getint(dict, "SBASE:connections_limit", SB_CONN_MAX);
     sbase->usec_sleep = iniparser_getint(dict, "SBASE:usec_sleep", SB_USEC_SLEEP);
+    if((n = iniparser_getint(dict, "SBASE:evopid", -1)) >= 0) evbase_prefer_evops(n);
+    if((n = iniparser_getint(dict, "SBASE:log_ring_size", 0)) > 0
+            && logger_async_init(n, iniparser_getint(dict, "SBASE:log_ring_block", 0)) != 0)
+    {
+        fprintf(stderr, "Initialize log flusher failed, %s\n", strerror(errno));
+        _exit(-1);
+    }
     sbase->set_log(sbase, iniparser_getstr(dict, "SBASE:logfile"));
     sbase->set_log_level(sbase, iniparser_getint(dict, "SBASE:log_level", 0));
     sbase->set_evlog(sbase, iniparser_getstr(dict, "SBASE:evlogfile"));
@@ -997,6 +2031,8 @@ int sbase_initialize(SBASE *sbase, char *conf)
     httpd->session.timeout_handler = &xhttpd_timeout_handler;
     httpd->session.data_handler = &xhttpd_data_handler;
     httpd->session.oob_handler = &xhttpd_oob_handler;
+    httpd->session.error_handler = &xhttpd_error_handler;
+    httpd->session.writable_handler = &xhttpd_writable_handler;
     httpd->session.timeout = HTTPD_TIMEOUT;
     if(httpsd)
     {
@@ -1017,11 +2053,6 @@ int sbase_initialize(SBASE *sbase, char *conf)
         memcpy(&(httpsd->session), &(httpd->session), sizeof(SESSION));
     }
     //httpd home
-    if((http_headers_map = http_headers_map_init()) == NULL)
-    {
-        fprintf(stderr, "Initialize http_headers_map failed,%s", strerror(errno));
-        _exit(-1);
-    }
     if((p = iniparser_getstr(dict, "XHTTPD:httpd_home")))
         httpd_home = p;
     http_indexes_view = iniparser_getint(dict, "XHTTPD:http_indexes_view", 1);
@@ -1043,6 +2074,9 @@ int sbase_initialize(SBASE *sbase, char *conf)
             }else break;
         }
     }
+#ifdef HAVE_ZLIB
+    MUTEX_INIT(xzmutex);
+#endif
     if((httpd_compress = iniparser_getint(dict, "XHTTPD:httpd_compress", 0)))
     {
         if((p =  iniparser_getstr(dict, "XHTTPD:httpd_compress_cachedir")))
@@ -1053,12 +2087,46 @@ int sbase_initialize(SBASE *sbase, char *conf)
                     httpd_compress_cachedir, strerror(errno));
             return -1;
         }
+        if(xhttpd_zcache_init(httpd_compress_cachedir, (off_t)iniparser_getint(dict, 
+                        "XHTTPD:httpd_compress_cachesize", ZCACHE_SIZE_MAX)) != 0)
+        {
+            fprintf(stderr, "Initialize compress cache failed, %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    if((n = iniparser_getint(dict, "XHTTPD:httpd_cache_size", 0)) > 0)
+    {
+        if(xhttpd_xcache_init((off_t)n, iniparser_getint(dict, 
+                        "XHTTPD:httpd_cache_file_max", XCACHE_FILE_MAX)) != 0)
+        {
+            fprintf(stderr, "Initialize hot-object cache failed, %s\n", strerror(errno));
+            return -1;
+        }
     }
+    httpd_access_log_binary = iniparser_getint(dict, "XHTTPD:access_log_binary", 0);
     if((p = iniparser_getstr(dict, "XHTTPD:access_log_dir")))
     {
 	httpd_access_log_dir = p;
-	sprintf(path, "%s/httpd_access.log", p);
-        LOGGER_INIT(default_logger, path);
+        if(httpd_access_log_binary)
+        {
+            sprintf(path, "%s/httpd_access.alog", p);
+            if(LOGGER_INIT(default_logger, path)) default_alog = alog_init(default_logger);
+        }
+        else
+        {
+	    sprintf(path, "%s/httpd_access.log", p);
+            LOGGER_INIT(default_logger, path);
+        }
+    }
+    if((p = iniparser_getstr(dict, "XHTTPD:access_rules_file")))
+    {
+        httpd_access_rules = p;
+        if(xhttpd_access_rules() != 0)
+        {
+            fprintf(stderr, "Initialize access rules %s failed, %s\n", p, strerror(errno));
+            return -1;
+        }
+        httpd->set_heartbeat(httpd, SB_HEARTBEAT_INTERVAL, &xhttpd_heartbeat_handler, NULL);
     }
     //name map
     if((namemap = mtrie_init()))
@@ -1090,12 +2158,55 @@ int sbase_initialize(SBASE *sbase, char *conf)
                 httpd_vhosts[nvhosts].home = p;
                 while(*p != ']' && *p != 0x20 && *p != '\t') ++p;
                 *p++ = '\0';
-		sprintf(path, "%s/%s.access.log", httpd_access_log_dir, httpd_vhosts[nvhosts].name );
-		LOGGER_INIT(httpd_vhosts[nvhosts].logger, path);
+                if(httpd_access_log_binary)
+                {
+                    sprintf(path, "%s/%s.access.alog", httpd_access_log_dir, httpd_vhosts[nvhosts].name);
+                    if(LOGGER_INIT(httpd_vhosts[nvhosts].logger, path))
+                        httpd_vhosts[nvhosts].alog = alog_init(httpd_vhosts[nvhosts].logger);
+                }
+                else
+                {
+		    sprintf(path, "%s/%s.access.log", httpd_access_log_dir, httpd_vhosts[nvhosts].name );
+		    LOGGER_INIT(httpd_vhosts[nvhosts].logger, path);
+                }
                 ++nvhosts;
             }
         }
     }
+    //routes of path prefix
+    if((p = iniparser_getstr(dict, "XHTTPD:httpd_routes")) && route_map_init(&route_map) == 0)
+    {
+        if(route_add_line(&route_map, p, p + strlen(p)) != 0)
+            fprintf(stderr, "Invalid routes in \"%s\"\n", p);
+        for(i = 0; i < route_map.num; i++)
+        {
+            route = &(route_map.routes[i]);
+            if(route->type == ROUTE_PROXY && inet_addr(route->arg) == INADDR_NONE)
+            {
+                if((hp = gethostbyname(route->arg)) == NULL)
+                {
+                    fprintf(stderr, "Resolving proxy host %s of route %s failed\n", 
+                            route->arg, route->prefix);
+                    return -1;
+                }
+                free(route->arg);
+                route->arg = strdup(inet_ntoa(*((struct in_addr *)(hp->h_addr))));
+            }
+            else if(route->type == ROUTE_STATUS)
+            {
+                route->data = -1;
+                for(n = 0; n < HTTP_RESPONSE_NUM; n++)
+                {
+                    if(atoi(response_status[n].e) == route->code){route->data = n;break;}
+                }
+                if(route->data < 0)
+                {
+                    fprintf(stderr, "Unknown status %d of route %s\n", route->code, route->prefix);
+                    return -1;
+                }
+            }
+        }
+    }
     //host map
     hostmap = mtrie_init();
     urlmap = mtrie_init();
@@ -1116,7 +2227,7 @@ int sbase_initialize(SBASE *sbase, char *conf)
 int main(int argc, char **argv)
 {
     struct passwd *user = NULL;
-    char *conf = NULL,ch = 0;
+    char *conf = NULL,ch = 0, stats[HTTP_BUF_SIZE];
     int is_daemon = 0, i = 0;
     pid_t pid;
 
@@ -1178,6 +2289,14 @@ int main(int argc, char **argv)
         fprintf(stderr, "setuid() for xhttpd failed, %s\r\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+#ifdef HAVE_PTHREAD
+    /* warm-up caches in background, files read as xhttpd like requests */
+    if((i = iniparser_getint(dict, "XHTTPD:httpd_warmup_threads", 0)) > 0
+            && xhttpd_warmup_init(i) != 0)
+    {
+        fprintf(stderr, "Initialize warm-up failed, %s\n", strerror(errno));
+    }
+#endif
     fprintf(stdout, "Initialized successed\n");
     /*
     if(httpd->sock_type == SOCK_DGRAM 
@@ -1204,17 +2323,37 @@ int main(int argc, char **argv)
     //fprintf(stdout, "sizeof(SERVICE):%d sizeof(CHUNK):%d sizeof(MESSAGE):%d sizeof(MUTEX):%d sizeof(CONN):%d sizeof(HTTP_REQ):%d sizeof(LOGGER):%d sizeof(struct timeval):%d sizeof(struct stat):%d sizeof(pthread_t):%d\n", sizeof(SERVICE), sizeof(CHUNK), sizeof(QMESSAGE), sizeof(MUTEX), sizeof(CONN), sizeof(HTTP_REQ), sizeof(LOGGER), sizeof(struct timeval), sizeof(struct stat), sizeof(pthread_mutex_t));
     sbase->running(sbase, 0);
     //sbase->running(sbase, 300000000);sbase->stop(sbase);
+#ifdef HAVE_PTHREAD
+    /* workers log to httpd->logger freed by sbase->clean() */
+    xhttpd_warmup_clean();
+#endif
+    /* slots dropped with httpd->freeshared() before sbase->clean() frees httpd */
+    if(xcache)
+    {
+        fprintf(stdout, "xcache hits:%lld misses:%lld evicts:%lld total:%lld\n", 
+                xcache->hits, xcache->misses, xcache->evicts, LL(xcache->total));
+        xhttpd_xcache_clean();
+    }
     sbase->clean(sbase);
     if(namemap) mtrie_clean(namemap);
     if(hostmap) mtrie_clean(hostmap);
     if(urlmap) mtrie_clean(urlmap);
-    if(http_headers_map) http_headers_map_clean(http_headers_map);
+    route_map_clean(&route_map);
+    xhttpd_zcache_clean();
+#ifdef HAVE_ZLIB
+    xhttpd_zstream_clean();
+#endif
     for(i = 0; i < nvhosts; i++)
     {
+        alog_clean((ALOG *)httpd_vhosts[i].alog);
+        httpd_vhosts[i].alog = NULL;
 	LOGGER_CLEAN(httpd_vhosts[i].logger);
 	httpd_vhosts[i].logger = NULL;
     }
+    alog_clean((ALOG *)default_alog);
     LOGGER_CLEAN(default_logger);
+    logger_async_clean();
+    if(xmm_stats_print(stats, sizeof(stats)) > 0) fputs(stats, stdout);
     if(dict)iniparser_free(dict);
     return 0;
 }